@@ -91,7 +91,7 @@ int         userLevel;                   /* user level
 PolyTree    *userTree[MAX_NUM_USERTREES];/* array of user trees                           */
 char        workingDir[100];             /* working directory                             */
 
-#if defined (MPI_ENABLED)
+#if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
 int         proc_id;                     /* process ID (0, 1, ..., num_procs-1)                        */
 int         num_procs;                   /* number of active processors                                */
 MrBFlt      myStateInfo[7];              /* likelihood/prior/heat/ran/moveInfo vals of me              */
@@ -102,7 +102,7 @@ int main (int argc, char *argv[])
 {
     int i;
 
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     int     ierror;
 #   endif
 
@@ -157,7 +157,7 @@ int main (int argc, char *argv[])
     SIOUXSettings.columns          = 90;
 #   endif
     
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     ierror = MPI_Init(&argc, &argv);
     if (ierror != MPI_SUCCESS)
         {
@@ -197,7 +197,7 @@ int main (int argc, char *argv[])
        and then wait for input. */
     i = CommandLine (argc, argv);
     
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     MPI_Finalize();
 #   endif
     
@@ -213,11 +213,11 @@ int CommandLine (int argc, char **argv)
     int     i, message, nProcessedArgs;
     char    cmdStr[CMD_STRING_LENGTH];
 #   ifdef HAVE_LIBREADLINE
-#       ifndef MPI_ENABLED
+#       if !defined (MPI_ENABLED) && !defined (BEST_MPI_ENABLED)
     char    *cmdStrP;
 #       endif
 #   endif
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     int     ierror;
 #   endif
 
@@ -264,7 +264,7 @@ int CommandLine (int argc, char **argv)
                 }
             /* normally, we simply wait at the prompt for a
                user action */
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
             if (proc_id == 0)
                 {
                 /* do not use readline because OpenMPI does not handle it */
@@ -338,7 +338,7 @@ int CommandLine (int argc, char **argv)
                     return (ERROR);
                     }
 
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
                 ierror = MPI_Barrier (MPI_COMM_WORLD);
                 if (ierror != MPI_SUCCESS)
                     {
@@ -374,7 +374,7 @@ void GetTimeSeed (void)
 {
     time_t      curTime;
 
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     int         ierror;
     
     if (proc_id == 0)
@@ -480,6 +480,7 @@ int InitializeMrBayes (void)
     numOpenExeFiles = 0;                             /* no execute files open yet                     */
     scientific = YES;                                /* print to file using scientific format?        */
     precision = 6;                                   /* set default precision                         */
+    nPThreads = 1;                                   /* set default number of pthreads                */
     showmovesParams.allavailable = NO;               /* do not show all available moves               */
     strcpy(workingDir,"");                           /* working directory                             */
 #   if defined (BEAGLE_ENABLED)
@@ -823,7 +824,7 @@ void PrintHeader (void)
     MrBayesPrint ("\n\n");
     MrBayesPrint ("                            MrBayes %s %s\n\n", VERSION_NUMBER, HOST_CPU);
     MrBayesPrint ("                      (Bayesian Analysis of Phylogeny)\n\n");
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     MrBayesPrint ("                             (Parallel version)\n");
     MrBayesPrint ("                         (%d processors available)\n\n", num_procs);
 #   endif
@@ -862,6 +863,8 @@ int ReinitializeMrBayes (void)
     chainParams.burninSS = -1;
     chainParams.alphaSS = 0.4;
     chainParams.backupCheckSS = 0;
+    chainParams.numBlocksSS = 1;
+    chainParams.blockSS = 1;
     chainParams.mcmcDiagn = YES;                     /* write MCMC diagnostics to file ?              */
     chainParams.diagnFreq = 5000;                    /* diagnostics frequency                         */
     chainParams.minPartFreq = 0.10;                  /* min partition frequency for diagnostics       */
@@ -895,14 +898,20 @@ int ReinitializeMrBayes (void)
     chainParams.swapAdjacentOnly = NO;               /* swap only adjacent temperatures               */
     chainParams.printMax = 8;                        /* maximum number of chains to print to screen   */
     chainParams.printAll = YES;                      /* whether to print heated chains                */
-    chainParams.treeList = NULL;                     /* vector of tree lists for saving trees         */
+    chainParams.splitPool = NULL;                    /* vector of split pools for saving trees        */
+    chainParams.topoList = NULL;                     /* vector of packed lists for saving trees       */
     chainParams.saveTrees = NO;                      /* save tree samples for later removal?          */
-    chainParams.tFilePos = NULL;                     /* position for reading trees for removal        */
+    chainParams.splitRing = NULL;                    /* vector of split rings for removing trees      */
     chainParams.runWithData = YES;                   /* whether to run with data                      */
     chainParams.orderTaxa = NO;                      /* should taxa be ordered in output trees?       */
     chainParams.append = NO;                         /* append to previous analysis?                  */
     chainParams.autotune = YES;                      /* autotune?                                     */
     chainParams.tuneFreq = 100;                      /* autotuning frequency                          */
+    chainParams.profile = NO;                        /* profile the moves?                            */
+    chainParams.autoweight = NO;                     /* adapt proposal probabilities?                 */
+    chainParams.checkBrlenDerivs = NO;               /* check brlen derivatives?                      */
+    chainParams.checkParsTrees = NO;                 /* check threaded parsimony trees?               */
+    chainParams.checkAutoweight = NO;                /* check adapted proposal probabilities?         */
     chainParams.checkPoint = YES;                    /* should we checkpoint the run?                 */
     chainParams.checkFreq = 2000;                    /* check-pointing frequency                      */
     chainParams.diagnStat = AVGSTDDEV;               /* mcmc diagnostic to use                        */
@@ -940,6 +949,7 @@ int ReinitializeMrBayes (void)
     sumssParams.discardFraction = 0.8;               /* Proportion of samples discarded when ploting step plot.*/
     sumssParams.smoothing = 0;                       /* An integer indicating number of neighbors to average over
                                                         when dooing smoothing of curvs on plots */
+    sumssParams.numBlocks = 1;                       /* number of blocks of steps to merge            */
     /* comparetree parameters */
     strcpy(comptreeParams.comptFileName1, "temp.t"); /* input name for comparetree command            */
     strcpy(comptreeParams.comptFileName2, "temp.t"); /* input name for comparetree command            */
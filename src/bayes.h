@@ -50,14 +50,22 @@
 #define COMPLETIONMATCHES
 #endif
 
-#if defined (MPI_ENABLED)
+#if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
 #include "mpi.h"
 #endif
 
+#if defined (MPI_ENABLED) && defined (BEST_MPI_ENABLED)
+#error "MPI_ENABLED and BEST_MPI_ENABLED cannot be combined"
+#endif
+
 #if defined (BEAGLE_ENABLED)
 #include "libhmsbeagle/beagle.h"
 #endif
 
+#if defined (THREADS_ENABLED)
+#include <pthread.h>
+#endif
+
 #if !defined (UNIX_VERSION) && !defined (WIN_VERSION) && !defined (MAC_VERSION)
 #  ifdef __MWERKS__
 #    define MAC_VERSION
@@ -266,6 +274,18 @@ typedef float CLFlt;        /* single-precision float used for cond likes (CLFlt
 #define NUCMODEL_CODON          2
 #define NUCMODEL_AA             3
 
+#define CLOCKPR_UNIFORM         0
+#define CLOCKPR_BIRTHDEATH      1
+#define CLOCKPR_COALESCENCE     2
+#define CLOCKPR_FOSSILIZATION   3
+#define CLOCKPR_SPCOAL          4
+#define CLOCKPR_FIXED           5
+
+#define SAMPLESTRAT_RANDOM      0
+#define SAMPLESTRAT_DIVERSITY   1
+#define SAMPLESTRAT_CLUSTER     2
+#define SAMPLESTRAT_FOSSILTIP   3
+
 #define NST_MIXED              -1  /* anything other than 1, 2, or 6 */
 
 #define MISSING                 10000000
@@ -419,11 +439,13 @@ typedef float CLFlt;        /* single-precision float used for cond likes (CLFlt
 #define ALLOC_MODEL              83
 #define ALLOC_STDSTATEFREQS      84
 #define ALLOC_PRINTPARAM         85
-#define ALLOC_TREELIST           86
-#define ALLOC_TFILEPOS           87
+#define ALLOC_TOPOLIST           86
+#define ALLOC_SPLITRING          87
 #define ALLOC_BEST               88
 #define ALLOC_SPECIESPARTITIONS  89
 #define ALLOC_SS                 90
+#define ALLOC_SWAPBUFFERS        91
+#define ALLOC_BESTMPI            92
 
 #define LINKED                  0
 #define UNLINKED                1
@@ -540,19 +562,42 @@ typedef struct calibration
     }
     Calibration;
 
-/* typedef for tree (topology) list element */
-typedef struct element
+/* typedef for pool of unique splits shared by packed topologies */
+typedef struct
     {
-    struct element *next;
-    int             *order;
-    } TreeListElement;
-
-/* typedef for list of trees (topologies) */
+    BitsLong    *bits;              /* split bitsets, nLongs per split              */
+    BitsLong    *hash;              /* hash value of each split                     */
+    int         *refCount;          /* number of packed topologies using each split */
+    int         *freeIds;           /* stack of unused split ids                    */
+    int         *table;             /* hash table of split ids (-1 if empty)        */
+    int         nLongs;             /* number of longs per split bitset             */
+    int         numSplits;          /* number of split ids in use or free           */
+    int         numFree;            /* number of unused split ids                   */
+    int         capacity;           /* number of splits that fit in pool            */
+    int         tableSize;          /* size of hash table (a power of 2)            */
+    } SplitPool;
+
+/* typedef for list of tree samples packed as split ids sorted by split hash */
 typedef struct
     {
-    TreeListElement *first;
-    TreeListElement *last;
-    } TreeList;
+    int         *splitIds;          /* split ids, nSplits per stored topology       */
+    int         *repeats;           /* number of consecutive samples of topology    */
+    SplitPool   *pool;              /* pool holding the split bitsets               */
+    int         nSplits;            /* number of splits per topology                */
+    int         capacity;           /* number of topologies that fit in buffer      */
+    int         first;              /* slot of oldest topology                      */
+    int         numStored;          /* number of topologies in buffer               */
+    } PackedTopologyList;
+
+/* typedef for ring buffer holding the splits of tree samples */
+typedef struct
+    {
+    BitsLong    *splits;            /* split bitsets, nSplits per tree sample       */
+    int         nSplits;            /* number of splits per tree sample             */
+    int         capacity;           /* number of tree samples that fit in buffer    */
+    int         first;              /* slot of oldest tree sample                   */
+    int         numSamples;         /* number of tree samples in buffer             */
+    } SplitRing;
 
 /* typedef for packed tree */
 typedef struct
@@ -584,6 +629,21 @@ typedef struct node
     }
     TreeNode;
 
+/* typedef for compact record of an interior node in a likelihood traversal */
+typedef struct
+    {
+    TreeNode        *node;              /*!< the interior node                            */
+    TreeNode        *left, *right;      /*!< its descendants                              */
+    int             index;              /*!< index of the node                            */
+    int             leftIndex;          /*!< index of left descendant                     */
+    int             rightIndex;         /*!< index of right descendant                    */
+    int             upDateLeftTi;       /*!< left ti probs need update?                   */
+    int             upDateRightTi;      /*!< right ti probs need update?                  */
+    int             upDateCl;           /*!< cond likes need update?                      */
+    int             isRoot;             /*!< is the ancestor the (lower) root?            */
+    }
+    TraversalNode;
+
 /* typedef for binary tree */
 typedef struct 
     {
@@ -607,6 +667,8 @@ typedef struct
     BitsLong        *bitsets;           /*!< pointer to bitsets describing splits         */
     BitsLong        *flags;             /*!< pointer to cond like flags                   */
     int             fromUserTree;       /*!< YES is set for the trees whoes branch lengthes are set from user tree(as start tree or fix branch length prior), NO otherwise */       
+    TraversalNode   *traversal;         /*!< interior nodes needing work, in down pass order (see GetTraversal) */
+    int             nTraversal;         /*!< number of nodes in traversal, -1 if not up to date */
     }
     Tree;
 
@@ -933,8 +995,8 @@ typedef int (*LikeUpFxn)(TreeNode *, int, int);
 typedef int (*PrintAncStFxn)(TreeNode *, int, int);
 typedef int (*StateCodeFxn) (int);
 typedef int (*PrintSiteRateFxn) (TreeNode *, int, int);
-typedef int (*PosSelProbsFxn) (TreeNode *, int, int);
-typedef int (*SiteOmegasFxn) (TreeNode *, int, int);
+typedef int (*SiteOmegaProbsFxn) (TreeNode *, int, int);
+typedef int (*BrlenDerivFxn) (TreeNode *, int, int, MrBFlt *, MrBFlt *, MrBFlt *);
 
 typedef struct cmdtyp           
     {
@@ -943,7 +1005,7 @@ typedef struct cmdtyp
     int         specialCmd;
     CmdFxn      cmdFxnPtr;
     short       numParms;
-    short       parmList[50];
+    short       parmList[60];
     int         expect;
     char        *cmdDescription;
     int         cmdUse;
@@ -1157,6 +1219,8 @@ typedef struct chain
     int         burninSS;              /* Fixed burnin for SS                           */
     MrBFlt      alphaSS;               /* Beta values are distributed according to quantiles of Beta(alphaSS,1.0) distribution */
     int         backupCheckSS;         /* Frequency of checkpoints backup               */
+    int         numBlocksSS;           /* Number of blocks the steps of SS are split in */
+    int         blockSS;               /* Block of steps to sample in SS                */
     MrBFlt      chainTemp;             /* chain temperature                             */
     int         userDefinedTemps;      /* should we use the users temperatures?         */
     MrBFlt      userTemps[MAX_CHAINS]; /* user-defined chain temperatures               */
@@ -1187,10 +1251,11 @@ typedef struct chain
     int         stopRule;              /* use stop rule?                                */
     STATS       *stat;                 /* ptr to structs with mcmc diagnostics info     */
     Tree        *dtree;                /* pointing to tree used for conv diagnostics    */
-    TreeList    *treeList;             /* vector of tree lists for saving trees         */
+    SplitPool   *splitPool;            /* vector of split pools for saving trees        */
+    PackedTopologyList *topoList;      /* vector of packed lists for saving trees       */
     int         saveTrees;             /* save tree samples for later removal?          */
     int         stopTreeGen;           /* generation after which no trees need be saved */
-    fpos_t      *tFilePos;             /* position for reading trees for removal        */
+    SplitRing   *splitRing;            /* vector of split rings for removing trees      */
     int         printMax;              /* maximum number of chains to print             */
     int         printAll;              /* whether to print all or only cold chains      */
     int         checkPoint;            /* should we use check-pointing?                 */
@@ -1200,6 +1265,11 @@ typedef struct chain
     int         append;                /* order taxa before printing tree to file?      */
     int         autotune;              /* autotune tuning parameters of proposals ?     */
     int         tuneFreq;              /* autotuning frequency                          */
+    int         profile;               /* should the time spent in moves be profiled?   */
+    int         autoweight;            /* adapt proposal probabilities during burnin?   */
+    int         checkBrlenDerivs;      /* check brlen derivatives in ML start trees?    */
+    int         checkParsTrees;        /* check threaded parsimony start trees?         */
+    int         checkAutoweight;       /* check adapted proposal probabilities?         */
     } Chain;
 
 typedef struct modelinfo
@@ -1210,6 +1280,11 @@ typedef struct modelinfo
     int         nst;                        /* # substitution types                     */
     int         aaModelId;                  /* amino acid model type                    */
     int         parsModelId;                /* is parsimony model used YES/NO           */
+    int         clockPrId;                  /* prior on clock tree (CLOCKPR_*)          */
+    int         sampleStratId;              /* taxon sampling strategy (SAMPLESTRAT_*)  */
+    int         isPopSizeVar;               /* does pop. size vary across tree YES/NO   */
+    int         isGrowthFixed;              /* is coalescence growth rate fixed YES/NO  */
+    MrBFlt      ploidyFactor;               /* factor converting pop. size to theta     */
 
     /* Specific model information */
     int         numRateCats;                /* number of rate cats (1 if inapplic.)    */
@@ -1264,6 +1339,8 @@ typedef struct modelinfo
     int         nParsIntsPerSite;           /* # parsimony ints per character           */  
     int         nCharsPerSite;              /* number chars per site (eg 3 for codon)   */
     int         rateProbStart;              /* start of rate probs (for adgamma)        */
+    int         hmmSiteStart;               /* start of sites in adgamma HMM            */
+    int         numHmmSites;                /* number of sites in adgamma HMM           */
                 
      /* Variables for eigen decompositions */
     int         cijkLength;                 /* stores length of cijk vector                 */
@@ -1335,6 +1412,10 @@ typedef struct modelinfo
     int         tiProbLength;               /* length of ti prob array                      */
     MrBFlt      lnLike[MAX_CHAINS];         /* log like for chain                           */
     CLFlt       *ancStateCondLikes;         /* ancestral state cond like array              */
+    MrBFlt      *siteLnL;                   /* if set, the likelihood fxn stores the lnL of */
+                                            /*   each site pattern here                     */
+    MrBFlt      *siteLnLs;                  /* two site lnL arrays for each chain           */
+    int         *siteLnLIndex;              /* which array holds the values of chain state  */
 
     /* Likelihood function pointers */
     LikeDownFxn         CondLikeDown;       /* function for calculating partials            */
@@ -1346,8 +1427,8 @@ typedef struct modelinfo
     PrintAncStFxn       PrintAncStates;     /* function for sampling ancestral states       */
     StateCodeFxn        StateCode;          /* function for getting states from codes       */
     PrintSiteRateFxn    PrintSiteRates;     /* function for samling site rates              */
-    PosSelProbsFxn      PosSelProbs;        /* function for sampling pos. selection probs   */
-    SiteOmegasFxn       SiteOmegas;         /* function for sampling site omega values      */
+    SiteOmegaProbsFxn   SiteOmegaProbs;     /* function for sampling pos. sel. and omegas   */
+    BrlenDerivFxn       BrlenDerivs;        /* lnL and brlen derivatives for one branch     */
 
     /* Report variables */
     int         printAncStates;             /* should ancestral states be printed (YES/NO)  */
@@ -1466,6 +1547,7 @@ typedef struct sumss
     int         askForMorePlots;       /* Should user be asked to plot for different discardfraction (y/n)?  */
     int         smoothing;             /* An integer indicating number of neighbors to average over when dooing smoothing of curvs on plots */
     MrBFlt      discardFraction;       /* Proportion of samples discarded when ploting step plot.*/
+    int         numBlocks;             /* number of blocks of steps to merge            */
     } Sumss;
 
 typedef struct plot
@@ -1533,6 +1615,7 @@ typedef struct
     MrBFlt      totalScore;
     MrBFlt      stopScore;
     MrBFlt      warp;
+    MrBFlt      branchScore[3];
     TreeNode    **leaf;
     TreeNode    **vertex;
     }
@@ -1750,11 +1833,15 @@ extern MrBFlt           lgPi[20];                    /* stationary frequencies f
 FILE                    *dumpFile;                   /* for debugging logs */
 #endif
 
-#if defined (MPI_ENABLED)
+#if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
 extern int              proc_id;                                /* process ID (0, 1, ..., num_procs-1)                        */
 extern int              num_procs;                              /* number of active processors                                */
 extern MrBFlt           myStateInfo[7];                         /* likelihood/prior/heat/ran/moveInfo vals of me              */
 extern MrBFlt           partnerStateInfo[7];                    /* likelihood/prior/heat/ran/moveInfo vals of partner         */
 #endif
 
+#if defined (BEST_MPI_ENABLED)
+extern int              *isDivisionActive;                      /* is the division (locus) calculated on this processor?      */
+#endif
+
 #endif  /* __BAYES_H__ */
@@ -33,14 +33,31 @@ int         GetDepthMatrix(Tree * speciesTree, double *depthMatrix);
 int         GetMeanDist (Tree *speciesTree, double *depthMatrix, double *mean);
 int         GetMinDepthMatrix (Tree **geneTrees, int numGeneTrees, double *depthMatrix);
 void        LineagesIn (TreeNode* geneTreeNode, TreeNode* speciesTreeNode);
+double      LnCachedJointGeneTreeSpeciesTreePr (Tree **geneTrees, int numGeneTrees, Tree *speciesTree, int chain);
 double      LnPriorProbGeneTree (Tree *geneTree, double mu, Tree *speciesTree, double *popSizePtr);
 double      LnProposalProbSpeciesTree (Tree *speciesTree, double *depthMatrix, double expRate);
+double      LnSpeciesTreePriorPr (Tree *speciesTree, int chain);
 void        MapGeneTreeToSpeciesTree (Tree *geneTree, Tree *speciesTree);
 int         ModifyDepthMatrix (double expRate, double *depthMatrix, RandLong *seed);
+void        RestoreTreePartitions (Tree *t);
+void        SetBestTreePartitions (Tree *t, BitsLong *bitsets);
+void        StoreGeneTreeLnPr (int chain, int whichState);
 
 /* Global BEST variables */
 BitsLong    **speciesPairSets;
 double      *depthMatrix;
+Tree        **geneTreeList;             /* gene trees of a chain, filled in by callers      */
+double      *geneTreeLnPr;              /* gene tree terms of the last joint probability    */
+double      *geneTreeLnPrCache;         /* gene tree terms for each chain and state         */
+int         *isGeneTreeLnPrCached;      /* are the cached terms of the chain state valid?   */
+PolyTree    *minDepthPolyTree;          /* work tree of GetSpeciesTreeFromMinDepths         */
+BitsLong    *speciesTreeBitsets;        /* partitions of species tree nodes, see SetBestTreePartitions */
+BitsLong    *geneTreeBitsets;           /* partitions of gene tree nodes                    */
+
+/* global variables used here but declared elsewhere */
+extern int  numLocalChains;
+extern MrBFlt *moveTime;
+extern MrBFlt priorTime;
 
 /* Allocate variables used by best code during mcmc */
 void AllocateBestChainVariables (void)
@@ -72,6 +89,24 @@ void AllocateBestChainVariables (void)
     /* allocate species for depthMatrix */
     depthMatrix = SafeCalloc (numUpperTriang, sizeof(double));
 
+    /* allocate space for gene tree pointers and gene tree probabilities; the probabilities
+       are cached for both states of each chain so that the current state need not be recomputed
+       (there are no chains yet if we are only checking a species tree given by the user) */
+    geneTreeList = (Tree **) SafeCalloc (numTopologies, sizeof(Tree *));
+    geneTreeLnPr = (double *) SafeCalloc (numTopologies, sizeof(double));
+    if (numLocalChains > 0)
+        {
+        geneTreeLnPrCache    = (double *) SafeCalloc (2*numLocalChains*numTopologies, sizeof(double));
+        isGeneTreeLnPrCached = (int *) SafeCalloc (2*numLocalChains, sizeof(int));
+        }
+
+    /* allocate the work tree and the partitions used by the moves and the gene tree
+       prior once, so that they do not have to be allocated in every generation */
+    minDepthPolyTree = AllocatePolyTree (numSpecies);
+    AllocatePolyTreePartitions (minDepthPolyTree);
+    speciesTreeBitsets = (BitsLong *) SafeCalloc (2*numSpecies*nLongsNeeded, sizeof(BitsLong));
+    geneTreeBitsets    = (BitsLong *) SafeCalloc (2*numLocalTaxa*((numLocalTaxa - 1) / nBitsInALong + 1), sizeof(BitsLong));
+
     memAllocs[ALLOC_BEST] = YES;
 }
 
@@ -219,6 +254,21 @@ void FreeBestChainVariables(void)
     free (depthMatrix);
     depthMatrix = NULL;
 
+    free (geneTreeList);
+    geneTreeList = NULL;
+    free (geneTreeLnPr);
+    geneTreeLnPr = NULL;
+    free (geneTreeLnPrCache);
+    geneTreeLnPrCache = NULL;
+    free (isGeneTreeLnPrCached);
+    isGeneTreeLnPrCached = NULL;
+    FreePolyTree (minDepthPolyTree);
+    minDepthPolyTree = NULL;
+    free (speciesTreeBitsets);
+    speciesTreeBitsets = NULL;
+    free (geneTreeBitsets);
+    geneTreeBitsets = NULL;
+
     memAllocs[ALLOC_BEST] = NO;
 }
 
@@ -236,21 +286,12 @@ void FreeBestChainVariables(void)
 ----------------------------------------------------------------------*/
 int GetDepthMatrix (Tree *speciesTree, double *depthMatrix) {
 
-    int         i, left, right, numUpperTriang, index, nLongsNeeded, freeBitsets;
+    int         i, left, right, numUpperTriang, index, nLongsNeeded;
     double      maxDepth;
     TreeNode    *p;
 
-    // Make sure we have bitfields allocated and set
-    if (speciesTree->bitsets == NULL)
-        {
-        AllocateTreePartitions(speciesTree);
-        freeBitsets = YES;
-        }
-    else
-        {
-        ResetTreePartitions(speciesTree);   // just in case
-        freeBitsets = NO;
-        }
+    // Set the partitions of the species tree
+    SetBestTreePartitions(speciesTree, speciesTreeBitsets);
 
     // Calculate number of values in the upper triangular matrix
     numUpperTriang = numSpecies * (numSpecies - 1) / 2;
@@ -277,9 +318,7 @@ int GetDepthMatrix (Tree *speciesTree, double *depthMatrix) {
             }
         }
 
-    // Free partitions if appropriate
-    if (freeBitsets == YES)
-        FreeTreePartitions(speciesTree);
+    RestoreTreePartitions(speciesTree);
 
     return (NO_ERROR);
 }
@@ -299,21 +338,12 @@ int GetDepthMatrix (Tree *speciesTree, double *depthMatrix) {
 ----------------------------------------------------------------------*/
 int GetMeanDist (Tree *speciesTree, double *minDepthMatrix, double *mean) {
 
-    int         i, left, right, index, nLongsNeeded, freeBitsets;
+    int         i, left, right, index, nLongsNeeded;
     double      dist, minDist=0.0, distSum;
     TreeNode    *p;
 
-    // Make sure we have bitfields allocated and set
-    if (speciesTree->bitsets == NULL)
-        {
-        AllocateTreePartitions(speciesTree);
-        freeBitsets = YES;
-        }
-    else
-        {
-        ResetTreePartitions(speciesTree);   // just in case
-        freeBitsets = NO;
-        }
+    // Set the partitions of the species tree
+    SetBestTreePartitions(speciesTree, speciesTreeBitsets);
 
     // Number of longs needed in a bitfield representing a species set
     nLongsNeeded   = ((numSpecies -1) / nBitsInALong) + 1;
@@ -344,11 +374,8 @@ int GetMeanDist (Tree *speciesTree, double *minDepthMatrix, double *mean) {
 
     (*mean) = distSum / speciesTree->nIntNodes;
 
-    // Reset partitions that were destroyed above or free partitions, as appropriate
-    if (freeBitsets == YES)
-        FreeTreePartitions(speciesTree);
-    else
-        ResetTreePartitions(speciesTree);
+    // The partitions were destroyed above
+    RestoreTreePartitions(speciesTree);
 
     return (NO_ERROR);
     MrBayesPrint ("%lf", *minDepthMatrix); /* just because I am tired of seeing the unused parameter error msg */
@@ -381,8 +408,8 @@ int GetMinDepthMatrix (Tree **geneTrees, int numGeneTrees, double *depthMatrix)
 
     // Allocate space for species partitions
     nLongsNeeded   = ((numSpecies -1) / nBitsInALong) + 1;   // number of longs needed in a bitfield representing a species set
-    speciesSets    = (BitsLong **) SafeCalloc ((2*(size_t)numLocalTaxa-1), sizeof(BitsLong *));
-    speciesSets[0] = (BitsLong *)  SafeCalloc ((2*(size_t)numLocalTaxa-1)*nLongsNeeded, sizeof(BitsLong));
+    speciesSets    = (BitsLong **) ScratchCalloc ((2*(size_t)numLocalTaxa-1), sizeof(BitsLong *));
+    speciesSets[0] = (BitsLong *)  ScratchCalloc ((2*(size_t)numLocalTaxa-1)*nLongsNeeded, sizeof(BitsLong));
     for (i=1; i<2*numLocalTaxa-1; i++)
         speciesSets[i] = speciesSets[0] + i*nLongsNeeded;
 
@@ -455,9 +482,6 @@ int GetMinDepthMatrix (Tree **geneTrees, int numGeneTrees, double *depthMatrix)
         printf ("\n");
         }
 
-    free (speciesSets[0]);
-    free (speciesSets);
-
     return (NO_ERROR);
 }
 
@@ -484,7 +508,7 @@ int GetSpeciesTreeFromMinDepths (Tree* speciesTree, double *depthMatrix) {
 
     nLongsNeeded    = ((numSpecies - 1) / nBitsInALong) + 1;
     numUpperTriang  = numSpecies*(numSpecies - 1) / 2;
-    minDepth        = (Depth *) SafeCalloc (numUpperTriang, sizeof(Depth));
+    minDepth        = (Depth *) ScratchCalloc (numUpperTriang, sizeof(Depth));
 
     // Convert depthMatrix to an array of Depth structs
     index = 0;
@@ -503,9 +527,8 @@ int GetSpeciesTreeFromMinDepths (Tree* speciesTree, double *depthMatrix) {
     // array in O(n^2log(n)) time. We build the tree at the same time, since we can
     // find included pairs in the tree in log(n) time. We use a polytomous tree for this.
     
-    // Allocate space for polytomous tree and set up partitions
-    polyTree = AllocatePolyTree(numSpecies);
-    AllocatePolyTreePartitions(polyTree);
+    // Use the polytomous tree allocated with the other best chain variables
+    polyTree = minDepthPolyTree;
 
     // Build initial tree (a bush)
     polyTree->isRooted = YES;
@@ -615,24 +638,30 @@ int GetSpeciesTreeFromMinDepths (Tree* speciesTree, double *depthMatrix) {
             p->length = 0.0;
         else
             p->length = p->anc->depth - p->depth;
-        if (p->length < 0.0) {
-            FreePolyTree(polyTree);
-            free (minDepth);
+        if (p->length < 0.0)
             return (ERROR); 
-            }           
         }
 
     // Copy to species tree from polytomous tree
     CopyToSpeciesTreeFromPolyTree (speciesTree, polyTree);
 
-    // Free locally allocated variables
-    FreePolyTree(polyTree);
-    free (minDepth);
-
     return(NO_ERROR);
 }
 
 
+/**-----------------------------------------------------------------
+|
+|   InvalidateGeneTreeLnPr: Mark the gene tree probabilities cached
+|       for the current state of a chain as stale. Called before a
+|       move changes the current state.
+|
+------------------------------------------------------------------*/
+void InvalidateGeneTreeLnPr (int chain)
+{
+    isGeneTreeLnPrCached[2*chain+state[chain]] = NO;
+}
+
+
 /**---------------------------------------------------------------------------------------
 |
 |   IsSpeciesTreeConsistent: Called when user tries to set a species tree or when
@@ -743,7 +772,7 @@ double LnSpeciesTreeProb(int chain)
 {
     int         i, numGeneTrees;
     double      lnProb;
-    Tree        **geneTrees, *speciesTree;
+    Tree        *speciesTree;
     ModelInfo   *m;
 
     m = &modelSettings[0];
@@ -751,19 +780,57 @@ double LnSpeciesTreeProb(int chain)
     speciesTree = GetTree(m->speciesTree, chain, state[chain]);
 
     numGeneTrees = m->speciesTree->nSubParams;
-    geneTrees = (Tree **) SafeCalloc (numGeneTrees, sizeof(Tree *));
-
     for (i=0; i<m->speciesTree->nSubParams; i++)
-        geneTrees[i] = GetTree(m->speciesTree->subParams[i], chain, state[chain]);
+        geneTreeList[i] = GetTree(m->speciesTree->subParams[i], chain, state[chain]);
 
-    lnProb = LnJointGeneTreeSpeciesTreePr(geneTrees, numGeneTrees, speciesTree, chain);
+    lnProb = LnJointGeneTreeSpeciesTreePr(geneTreeList, numGeneTrees, speciesTree, chain);
 
-    free (geneTrees);
+    // The gene trees and the species tree are those of the current state
+    StoreGeneTreeLnPr (chain, state[chain]);
 
     return lnProb;
 }
 
 
+/**-----------------------------------------------------------------
+|
+|   LnCachedJointGeneTreeSpeciesTreePr: Calculate the joint probability
+|       of the gene trees and the species tree of the previous state
+|       of a chain, before the move. The gene tree probabilities are
+|       taken from the cache if they are still valid for that state,
+|       otherwise they are calculated and cached.
+|
+------------------------------------------------------------------*/
+double LnCachedJointGeneTreeSpeciesTreePr(Tree **geneTrees, int numGeneTrees, Tree *speciesTree, int chain)
+{
+    double      lnLike, *cachedLnPr;
+    int         i, oldState;
+
+    oldState = state[chain] ^ 1;
+
+    if (isGeneTreeLnPrCached[2*chain+oldState] == NO) {
+        lnLike = LnJointGeneTreeSpeciesTreePr(geneTrees, numGeneTrees, speciesTree, chain);
+        StoreGeneTreeLnPr (chain, oldState);
+        return lnLike;
+        }
+
+    // Leave the trees as LnJointGeneTreeSpeciesTreePr would have; the moves
+    // draw nodes from the downpass sequences
+    for (i=0; i<numGeneTrees; i++)
+        GetDownPass(geneTrees[i]);
+    if (numGeneTrees > 0)
+        GetDownPass(speciesTree);
+
+    // Add up the terms in the same order as LnJointGeneTreeSpeciesTreePr
+    cachedLnPr = geneTreeLnPrCache + (2*chain+oldState)*numTopologies;
+    lnLike = 0.0;
+    for (i=0; i<numGeneTrees; i++)
+        lnLike += cachedLnPr[i];
+
+    return lnLike + LnSpeciesTreePriorPr(speciesTree, chain);
+}
+
+
 /**-----------------------------------------------------------------
 |
 |   LnJointGeneTreeSpeciesTreePr: Converted from LnJointGenetreePr,
@@ -771,22 +838,19 @@ double LnSpeciesTreeProb(int chain)
 |
 |   In this function we calculate the entire probability of the species
 |   tree, including its probability given its priors, and the probability
-|   of the gene trees given the species tree.
+|   of the gene trees given the species tree. The probability of each
+|   gene tree is left in geneTreeLnPr.
 |
 ------------------------------------------------------------------*/
 double LnJointGeneTreeSpeciesTreePr(Tree **geneTrees, int numGeneTrees, Tree *speciesTree, int chain)
 {
-    double      lnPrior, lnLike, clockRate, mu, *popSizePtr, sR, eR, sF;
+    double      lnLike, clockRate, mu, *popSizePtr;
     int         i;
     ModelInfo   *m;
-    ModelParams *mp;
 
     // Get model info for species tree
     m = &modelSettings[speciesTree->relParts[0]];
 
-    // Get model params for species tree
-    mp = &modelParams[speciesTree->relParts[0]];
-
     // Get popSize ptr
     popSizePtr = GetParamVals(m->popSize, chain, state[chain]);
 
@@ -800,24 +864,34 @@ double LnJointGeneTreeSpeciesTreePr(Tree **geneTrees, int numGeneTrees, Tree *sp
     // ShowNodes(speciesTree->root, 0, YES);
     lnLike = 0.0;
     mu = clockRate;
+#   if defined (BEST_MPI_ENABLED)
+    // Each processor only calculates the probability of the gene trees of its own divisions;
+    // the terms are then added up in gene tree order so that the result does not depend on
+    // the number of processors
     for (i=0; i<numGeneTrees; i++) {
-        lnLike += LnPriorProbGeneTree(geneTrees[i], mu, speciesTree, popSizePtr);
-        }
-
-    // Calculate probability of species tree given its priors
-    if (strcmp(mp->speciesTreeBrlensPr, "Birthdeath") == 0) {
-        sR = *GetParamVals(m->speciationRates, chain, state[chain]);
-        eR = *GetParamVals(m->extinctionRates, chain, state[chain]);
-        sF = mp->sampleProb;
-        lnPrior = 0.0;
-        LnBirthDeathPriorPr(speciesTree, clockRate, &lnPrior, sR, eR, mp->sampleStrat, sF);
+        if (isDivisionActive[geneTrees[i]->relParts[0]] == YES)
+            geneTreeLnPr[i] = LnPriorProbGeneTree(geneTrees[i], mu, speciesTree, popSizePtr);
+        else {
+            // Leave the tree as LnPriorProbGeneTree would have; the moves draw
+            // nodes from the downpass sequence, so it must match across processors
+            GetDownPass(geneTrees[i]);
+            geneTreeLnPr[i] = 0.0;
+            }
         }
-    else
-        lnPrior = 0.0;
+    if (numGeneTrees > 0)
+        GetDownPass(speciesTree);
+    if (MPI_Allreduce (MPI_IN_PLACE, geneTreeLnPr, numGeneTrees, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD) != MPI_SUCCESS)
+        MrBayesPrint ("%s   Problem assembling gene tree probabilities\n", spacer);
+#   else
+    for (i=0; i<numGeneTrees; i++)
+        geneTreeLnPr[i] = LnPriorProbGeneTree(geneTrees[i], mu, speciesTree, popSizePtr);
+#   endif
+    for (i=0; i<numGeneTrees; i++)
+        lnLike += geneTreeLnPr[i];
 
     // The population size is taken care of elsewhere
 
-    return lnLike + lnPrior;
+    return lnLike + LnSpeciesTreePriorPr(speciesTree, chain);
 }
 
 
@@ -830,29 +904,25 @@ double LnJointGeneTreeSpeciesTreePr(Tree **geneTrees, int numGeneTrees, Tree *sp
 double LnPriorProbGeneTree (Tree *geneTree, double mu, Tree *speciesTree, double *popSizePtr)
 { 
     int         i, k, index, nEvents, trace=0;
-    double      N, lnProb, ploidyFactor, theta, timeInterval;
+    double      N, lnProb, theta, timeInterval, t=0.0;
     TreeNode    *p, *q=NULL, *r;
-    ModelParams *mp;
+    ModelInfo   *m;
 
-    // Get model params
-    mp = &modelParams[speciesTree->relParts[0]];
+    // Time spent here is charged to the prior in the move profile
+    if (moveTime != NULL)
+        t = ProfileTime ();
 
-    // Find ploidy setting
-    if (strcmp(mp->ploidy, "Diploid") == 0)
-        ploidyFactor = 4.0;
-    else if (strcmp(mp->ploidy, "Haploid") == 0)
-        ploidyFactor = 2.0;
-    else /* if (strcmp(mp->ploidy, "Zlinked") == 0) */
-        ploidyFactor = 3.0;
+    // Get model settings, where ploidy and pop size variation are resolved by SetModelInfo
+    m = &modelSettings[speciesTree->relParts[0]];
 
     // Initialize species tree with theta in d
     for (i=0; i<speciesTree->nNodes-1; i++) {
         p = speciesTree->allDownPass[i];
-        if (strcmp(mp->popVarPr, "Equal") != 0)
+        if (m->isPopSizeVar == YES)
             N = popSizePtr[p->index];
         else
             N = popSizePtr[0];
-        p->d = ploidyFactor * N * mu;
+        p->d = m->ploidyFactor * N * mu;
         }
     
     // Map gene tree to species tree
@@ -929,9 +999,8 @@ double LnPriorProbGeneTree (Tree *geneTree, double mu, Tree *speciesTree, double
     GetDownPass(speciesTree);
     GetDownPass(geneTree);
 
-    // Free space
-    FreeTreePartitions(speciesTree);
-    FreeTreePartitions(geneTree);
+    if (moveTime != NULL)
+        priorTime += ProfileTime () - t;
 
     return lnProb;
 }
@@ -952,17 +1021,13 @@ double LnPriorProbGeneTree (Tree *geneTree, double mu, Tree *speciesTree, double
 ----------------------------------------------------------------------*/
 double LnProposalProbSpeciesTree (Tree *speciesTree, double *depthMatrix, double expRate)
 {
-    int         i, left, right, index, nLongsNeeded, freeBitsets;
+    int         i, left, right, index, nLongsNeeded;
     double      dist, normConst=1.0, negLambdaX=0.0, eNegLambdaX, density, prob,
                 sumDensRatio, prodProb, lnProb;
     TreeNode    *p;
 
-    // Make sure we have bitfields allocated and set
-    if (speciesTree->bitsets == NULL)
-        freeBitsets = YES;
-    else
-        freeBitsets = NO;
-    AllocateTreePartitions(speciesTree);
+    // Set the partitions of the species tree
+    SetBestTreePartitions(speciesTree, speciesTreeBitsets);
 
     // Number of longs needed in a bitfield representing a species set
     nLongsNeeded   = ((numSpecies -1) / nBitsInALong) + 1;
@@ -1000,14 +1065,48 @@ double LnProposalProbSpeciesTree (Tree *speciesTree, double *depthMatrix, double
     // to avoid lnProposalProb is NaN at initial steps
     if (lnProb != lnProb)  lnProb = 0.0;
     
-    // Free partitions if appropriate
-    if (freeBitsets == YES)
-        FreeTreePartitions(speciesTree);
+    RestoreTreePartitions(speciesTree);
 
     return (lnProb);
 }
 
 
+/**-----------------------------------------------------------------
+|
+|   LnSpeciesTreePriorPr: Calculate the probability of the species
+|   tree given its priors.
+|
+------------------------------------------------------------------*/
+double LnSpeciesTreePriorPr (Tree *speciesTree, int chain)
+{
+    double      lnPrior, clockRate, sR, eR, sF;
+    ModelInfo   *m;
+    ModelParams *mp;
+
+    // Get model info and model params for species tree
+    m = &modelSettings[speciesTree->relParts[0]];
+    mp = &modelParams[speciesTree->relParts[0]];
+
+    // Get clock rate
+    if (speciesTree->isCalibrated == YES)
+        clockRate = *GetParamVals(m->clockRate, chain, state[chain]);
+    else
+        clockRate = 1.0;
+
+    if (strcmp(mp->speciesTreeBrlensPr, "Birthdeath") == 0) {
+        sR = *GetParamVals(m->speciationRates, chain, state[chain]);
+        eR = *GetParamVals(m->extinctionRates, chain, state[chain]);
+        sF = mp->sampleProb;
+        lnPrior = 0.0;
+        LnBirthDeathPriorPr(speciesTree, clockRate, &lnPrior, sR, eR, m->sampleStratId, sF);
+        }
+    else
+        lnPrior = 0.0;
+
+    return lnPrior;
+}
+
+
 /**-----------------------------------------------------------------
 |
 |   MapGeneTreeToSpeciesTree: Fold gene tree into species tree. We
@@ -1028,8 +1127,8 @@ void MapGeneTreeToSpeciesTree (Tree *geneTree, Tree *speciesTree)
     // which is OK for the species tree, but we want the gene tree partitions to
     // reflect the species partitions and not the gene partitions, so we need to
     // set them here
-    AllocateTreePartitions(geneTree);
-    AllocateTreePartitions(speciesTree);
+    SetBestTreePartitions(geneTree, geneTreeBitsets);
+    SetBestTreePartitions(speciesTree, speciesTreeBitsets);
     nLongsNeeded = (numSpecies - 1) / nBitsInALong + 1;
     for (i=0; i<geneTree->nNodes-1; i++) {
         p = geneTree->allDownPass[i];
@@ -1041,7 +1140,7 @@ void MapGeneTreeToSpeciesTree (Tree *geneTree, Tree *speciesTree)
                 p->partition[j] = p->left->partition[j] | p->right->partition[j];
             }
         }
-    // Species tree partitions already set by call to AllocateTreePartitions
+    // Species tree partitions already set by call to SetBestTreePartitions
 
     // Reset ->x and ->y of species tree (->x of gene tree does not need to be initialized)
     for (i=0; i<speciesTree->nNodes; i++)
@@ -1066,9 +1165,8 @@ void MapGeneTreeToSpeciesTree (Tree *geneTree, Tree *speciesTree)
             printf ("%-2d -- %d -- %e\n", geneTree->intDownPass[i]->index, geneTree->intDownPass[i]->x, geneTree->intDownPass[i]->nodeDepth);
         }
 
-    // Free space
-    FreeTreePartitions(speciesTree);
-    FreeTreePartitions(geneTree);
+    RestoreTreePartitions(speciesTree);
+    RestoreTreePartitions(geneTree);
 }
 
 
@@ -1133,14 +1231,14 @@ int Move_GeneTree1 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRati
     oldSpeciesTree = GetTree (m->speciesTree, chain, state[chain] ^ 1);
 
     // Get gene trees
-    geneTrees = (Tree **) SafeCalloc (2*numGeneTrees, sizeof(Tree *));
+    geneTrees = geneTreeList;
     for (i=0; i<m->speciesTree->nSubParams; i++) {
         geneTrees[i] = GetTree(m->speciesTree->subParams[i], chain, state[chain]);
         }
 
     // Allocate space for depth matrix copy
     numUpperTriang = numSpecies * (numSpecies - 1) / 2;
-    oldMinDepths   = (double *) SafeCalloc (2*numUpperTriang, sizeof(double));
+    oldMinDepths   = (double *) ScratchCalloc (2*numUpperTriang, sizeof(double));
     modMinDepths   = oldMinDepths + numUpperTriang;
 
     // Get min depth matrix for old gene trees
@@ -1155,8 +1253,9 @@ int Move_GeneTree1 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRati
     // if (mean < 1E-6) mean = 1E-6;
     forwardLambda = 1.0 / mean;
 
-    // Calculate joint probability of old gene trees and old species tree
-    oldLnProb = LnJointGeneTreeSpeciesTreePr(geneTrees, numGeneTrees, oldSpeciesTree, chain);
+    // Calculate joint probability of old gene trees and old species tree, using
+    // the cached gene tree probabilities of the previous state if possible
+    oldLnProb = LnCachedJointGeneTreeSpeciesTreePr(geneTrees, numGeneTrees, oldSpeciesTree, chain);
 
     // Modify the picked gene tree using code from a regular MrBayes move
     Move_ExtSPRClock(param, chain, seed, lnPriorRatio, lnProposalRatio, mvp);
@@ -1174,13 +1273,12 @@ int Move_GeneTree1 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRati
     // Get a new species tree
     if (GetSpeciesTreeFromMinDepths (newSpeciesTree, modMinDepths) == ERROR) {
         abortMove = YES;
-        free (geneTrees);
-        free (oldMinDepths);
         return (NO_ERROR);
         }
     
     // Calculate joint probability of new gene trees and new species tree
     newLnProb = LnJointGeneTreeSpeciesTreePr(geneTrees, numGeneTrees, newSpeciesTree, chain);
+    StoreGeneTreeLnPr (chain, state[chain]);
 
     // Get backward lambda
     GetMeanDist(newSpeciesTree, depthMatrix, &mean);
@@ -1199,10 +1297,6 @@ int Move_GeneTree1 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRati
     // Update proposal ratio based on this move
     (*lnProposalRatio) += (backwardLnProposalProb - forwardLnProposalProb);
 
-    // Free allocated memory
-    free (geneTrees);
-    free (oldMinDepths);
-
     return (NO_ERROR);
 }
 
@@ -1237,14 +1331,14 @@ int Move_GeneTree2 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRati
     oldSpeciesTree = GetTree (m->speciesTree, chain, state[chain] ^ 1);
 
     // Get gene trees
-    geneTrees = (Tree **) SafeCalloc (2*numGeneTrees, sizeof(Tree *));
+    geneTrees = geneTreeList;
     for (i=0; i<m->speciesTree->nSubParams; i++) {
         geneTrees[i] = GetTree(m->speciesTree->subParams[i], chain, state[chain]);
         }
 
     // Allocate space for depth matrix copy
     numUpperTriang = numSpecies * (numSpecies - 1) / 2;
-    oldMinDepths   = (double *) SafeCalloc (2*numUpperTriang, sizeof(double));
+    oldMinDepths   = (double *) ScratchCalloc (2*numUpperTriang, sizeof(double));
     modMinDepths   = oldMinDepths + numUpperTriang;
 
     // Get min depth matrix for old gene trees
@@ -1259,8 +1353,9 @@ int Move_GeneTree2 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRati
     // if (mean < 1E-6) mean = 1E-6;
     forwardLambda = 1.0 / mean;
 
-    // Calculate joint probability of old gene trees and old species tree
-    oldLnProb = LnJointGeneTreeSpeciesTreePr(geneTrees, numGeneTrees, oldSpeciesTree, chain);
+    // Calculate joint probability of old gene trees and old species tree, using
+    // the cached gene tree probabilities of the previous state if possible
+    oldLnProb = LnCachedJointGeneTreeSpeciesTreePr(geneTrees, numGeneTrees, oldSpeciesTree, chain);
 
     // Modify the picked gene tree using code from a regular MrBayes move (no tuning parameter, so passing on mvp is OK)
     Move_NNIClock(param, chain, seed, lnPriorRatio, lnProposalRatio, mvp);
@@ -1278,13 +1373,12 @@ int Move_GeneTree2 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRati
     // Get a new species tree
     if (GetSpeciesTreeFromMinDepths (newSpeciesTree, modMinDepths) == ERROR) {
         abortMove = YES;
-        free (geneTrees);
-        free (oldMinDepths);
         return (NO_ERROR);
         }
     
     // Calculate joint probability of new gene trees and new species tree
     newLnProb = LnJointGeneTreeSpeciesTreePr(geneTrees, numGeneTrees, newSpeciesTree, chain);
+    StoreGeneTreeLnPr (chain, state[chain]);
 
     // Get backward lambda
     GetMeanDist(newSpeciesTree, depthMatrix, &mean);
@@ -1303,10 +1397,6 @@ int Move_GeneTree2 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRati
     // Update proposal ratio based on this move
     (*lnProposalRatio) += (backwardLnProposalProb - forwardLnProposalProb);
 
-    // Free allocated memory
-    free (geneTrees);
-    free (oldMinDepths);
-
     return (NO_ERROR);
 }
 
@@ -1341,14 +1431,14 @@ int Move_GeneTree3 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRati
     oldSpeciesTree = GetTree (m->speciesTree, chain, state[chain] ^ 1);
 
     // Get gene trees
-    geneTrees = (Tree **) SafeCalloc (2*numGeneTrees, sizeof(Tree *));
+    geneTrees = geneTreeList;
     for (i=0; i<m->speciesTree->nSubParams; i++) {
         geneTrees[i] = GetTree(m->speciesTree->subParams[i], chain, state[chain]);
         }
 
     // Allocate space for depth matrix copy
     numUpperTriang = numSpecies * (numSpecies - 1) / 2;
-    oldMinDepths   = (double *) SafeCalloc (2*numUpperTriang, sizeof(double));
+    oldMinDepths   = (double *) ScratchCalloc (2*numUpperTriang, sizeof(double));
     modMinDepths   = oldMinDepths + numUpperTriang;
 
     // Get min depth matrix for old gene trees
@@ -1363,8 +1453,9 @@ int Move_GeneTree3 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRati
     // if (mean < 1E-6) mean = 1E-6;
     forwardLambda = 1.0 / mean;
 
-    // Calculate joint probability of old gene trees and old species tree
-    oldLnProb = LnJointGeneTreeSpeciesTreePr(geneTrees, numGeneTrees, oldSpeciesTree, chain);
+    // Calculate joint probability of old gene trees and old species tree, using
+    // the cached gene tree probabilities of the previous state if possible
+    oldLnProb = LnCachedJointGeneTreeSpeciesTreePr(geneTrees, numGeneTrees, oldSpeciesTree, chain);
 
     // Modify the picked gene tree using code from a regular MrBayes move
     Move_ParsSPRClock(param, chain, seed, lnPriorRatio, lnProposalRatio, mvp);
@@ -1382,13 +1473,12 @@ int Move_GeneTree3 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRati
     // Get a new species tree
     if (GetSpeciesTreeFromMinDepths (newSpeciesTree, modMinDepths) == ERROR) {
         abortMove = YES;
-        free (geneTrees);
-        free (oldMinDepths);
         return (NO_ERROR);
         }
    
     // Calculate joint probability of new gene trees and new species tree
     newLnProb = LnJointGeneTreeSpeciesTreePr(geneTrees, numGeneTrees, newSpeciesTree, chain);
+    StoreGeneTreeLnPr (chain, state[chain]);
 
     // Get backward lambda
     GetMeanDist(newSpeciesTree, depthMatrix, &mean);
@@ -1407,10 +1497,6 @@ int Move_GeneTree3 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRati
     // Update proposal ratio based on this move
     (*lnProposalRatio) += (backwardLnProposalProb - forwardLnProposalProb);
 
-    // Free allocated memory
-    free (geneTrees);
-    free (oldMinDepths);
-
     return (NO_ERROR);
 }
 
@@ -1423,9 +1509,9 @@ int Move_GeneTree3 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRati
 -------------------------------------------------------------------------------------*/
 int Move_NodeSliderGeneTree (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio, MrBFlt *lnProposalRatio, MrBFlt *mvp)
 {
-    int         i, *nEvents;
+    int         i, *nEvents, geneTreeIndex, isCached;
     MrBFlt      window, minDepth, maxDepth, oldDepth, newDepth,
-                oldLeftLength=0.0, oldRightLength=0.0, clockRate,
+                oldLeftLength=0.0, oldRightLength=0.0, clockRate, geneTreeLnPrNew, *oldLnPr, *newLnPr,
                 oldPLength=0.0, lambda=0.0, nu=0.0, igrvar=0.0,
                 *brlens=NULL, *tk02Rate=NULL, *igrRate=NULL, *popSizePtr;
     TreeNode    *p, *q;
@@ -1462,8 +1548,22 @@ int Move_NodeSliderGeneTree (Param *param, int chain, RandLong *seed, MrBFlt *ln
     getchar();
 #   endif
 
-    /* get gene tree prior prob before move */
-    (*lnPriorRatio) -= LnPriorProbGeneTree(geneTree, clockRate, speciesTree, popSizePtr);
+    /* find the gene tree among the gene trees of the species tree */
+    for (geneTreeIndex=0; geneTreeIndex<m->speciesTree->nSubParams; geneTreeIndex++)
+        if (GetTree (m->speciesTree->subParams[geneTreeIndex], chain, state[chain]) == geneTree)
+            break;
+
+    /* get gene tree prior prob before move, from the cache of the previous state if possible */
+    oldLnPr = geneTreeLnPrCache + (2*chain+(state[chain]^1))*numTopologies;
+    newLnPr = geneTreeLnPrCache + (2*chain+state[chain])*numTopologies;
+    isCached = NO;
+    if (isGeneTreeLnPrCached[2*chain+(state[chain]^1)] == YES && geneTreeIndex < m->speciesTree->nSubParams
+        && (speciesTree->isCalibrated == YES || clockRate == 1.0))   /* cached terms use the same rate */
+        isCached = YES;
+    if (isCached == YES)
+        (*lnPriorRatio) -= oldLnPr[geneTreeIndex];
+    else
+        (*lnPriorRatio) -= LnPriorProbGeneTree(geneTree, clockRate, speciesTree, popSizePtr);
 
     /* store values needed later for prior calculation (relaxed clocks) */
     oldPLength = p->length;
@@ -1553,7 +1653,17 @@ int Move_NodeSliderGeneTree (Param *param, int chain, RandLong *seed, MrBFlt *ln
     (*lnProposalRatio) = 0.0;
 
     /* calculate prior ratio */
-    (*lnPriorRatio) += LnPriorProbGeneTree (geneTree, clockRate, speciesTree, popSizePtr);
+    geneTreeLnPrNew = LnPriorProbGeneTree (geneTree, clockRate, speciesTree, popSizePtr);
+    (*lnPriorRatio) += geneTreeLnPrNew;
+
+    /* the probabilities of the other gene trees did not change, so the cache is valid for the new state */
+    if (isCached == YES)
+        {
+        for (i=0; i<m->speciesTree->nSubParams; i++)
+            newLnPr[i] = oldLnPr[i];
+        newLnPr[geneTreeIndex] = geneTreeLnPrNew;
+        isGeneTreeLnPrCached[2*chain+state[chain]] = YES;
+        }
 
     /* adjust proposal and prior ratio for relaxed clock models */
     for (i=0; i<param->nSubParams; i++)
@@ -1700,7 +1810,7 @@ int Move_SpeciesTree (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRa
     oldSpeciesTree = GetTree (m->speciesTree, chain, state[chain] ^ 1);
 
     /* get gene trees */
-    geneTrees = (Tree **) SafeCalloc (numGeneTrees, sizeof(Tree*));
+    geneTrees = geneTreeList;
     for (i=0; i<param->nSubParams; i++)
         geneTrees[i] = GetTree(param->subParams[i], chain, state[chain]);
 
@@ -1713,7 +1823,7 @@ int Move_SpeciesTree (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRa
 
     /* make a copy for modification */
     numUpperTriang = numSpecies * (numSpecies - 1) / 2;
-    modMinDepths = (double *) SafeCalloc (numUpperTriang, sizeof(double));
+    modMinDepths = (double *) ScratchCalloc (numUpperTriang, sizeof(double));
     for (i=0; i<numUpperTriang; i++)
         modMinDepths[i] = depthMatrix[i];
 
@@ -1723,8 +1833,6 @@ int Move_SpeciesTree (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRa
     /* construct a new species tree from the modified constraints */
     if (GetSpeciesTreeFromMinDepths(newSpeciesTree, modMinDepths) == ERROR) {
         abortMove = YES;
-        free (modMinDepths);
-        free (geneTrees);
         return (NO_ERROR);
         }
 
@@ -1737,33 +1845,65 @@ int Move_SpeciesTree (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRa
     forwardLnProposalProb  = LnProposalProbSpeciesTree (newSpeciesTree, depthMatrix, forwardLambda);
     (*lnProposalRatio) = backwardLnProposalProb - forwardLnProposalProb;
 
-#   if defined (BEST_MPI_ENABLED)
-    // Broadcast the proposed species tree to all processors if MPI version
-#   endif
-
-#   if defined (BEST_MPI_ENABLED)
-    // Let each processor calculate the ln probability ratio of its current gene tree(s)
-    //    given the new and old species tree in the MPI version
-
-    // Assemble the ln probability ratios across the processors and to lnPriorRatio
-#   else
     /* calculate the ln probability ratio of the current gene trees
-       given the new and old species trees */
+       given the new and old species trees; in the BEST_MPI version all
+       processors propose the same species tree, and the gene tree terms
+       are assembled across processors in LnJointGeneTreeSpeciesTreePr;
+       the gene tree probabilities given the old species tree are those
+       of the previous state, so they are taken from the cache if possible */
     newLnProb = LnJointGeneTreeSpeciesTreePr(geneTrees, numGeneTrees, newSpeciesTree, chain);
-    oldLnProb = LnJointGeneTreeSpeciesTreePr(geneTrees, numGeneTrees, oldSpeciesTree, chain);
-#   endif
+    StoreGeneTreeLnPr (chain, state[chain]);
+    oldLnProb = LnCachedJointGeneTreeSpeciesTreePr(geneTrees, numGeneTrees, oldSpeciesTree, chain);
 
     /* set (*lnPriorRatio) to ln probability ratio */
     (*lnPriorRatio) = (newLnProb - oldLnProb);
-    
-    /* free allocated space */
-    free (modMinDepths);
-    free (geneTrees);
 
     return (NO_ERROR);
 }
 
 
+/**-----------------------------------------------------------------
+|
+|   RestoreTreePartitions: Point the node partitions of a tree back
+|       at its own bitsets after SetBestTreePartitions, and set them,
+|       or clear the pointers if the tree has no bitsets.
+|
+------------------------------------------------------------------*/
+void RestoreTreePartitions (Tree *t)
+{
+    int         i;
+
+    if (t->bitsets != NULL)
+        SetBestTreePartitions (t, t->bitsets);
+    else
+        {
+        for (i=0; i<t->memNodes; i++)
+            t->nodes[i].partition = NULL;
+        }
+}
+
+
+/**-----------------------------------------------------------------
+|
+|   SetBestTreePartitions: Point the node partitions of a tree at
+|       bitsets, which must have room for all nodes, and set them.
+|       The best code uses this with its own bitsets instead of
+|       allocating partitions for the tree on every call; the tree
+|       is left with RestoreTreePartitions.
+|
+------------------------------------------------------------------*/
+void SetBestTreePartitions (Tree *t, BitsLong *bitsets)
+{
+    int         i, numTaxa, nLongsNeeded;
+
+    numTaxa = t->nNodes - t->nIntNodes - (t->isRooted == YES ? 1 : 0);
+    nLongsNeeded = (numTaxa - 1) / nBitsInALong + 1;
+    for (i=0; i<t->nNodes; i++)
+        t->allDownPass[i]->partition = bitsets + i*nLongsNeeded;
+    ResetTreePartitions (t);
+}
+
+
 /** Show upper triangular matrix */
 void ShowUpperTriangMatrix (double *values, int squareSize)
 {
@@ -1783,3 +1923,22 @@ void ShowUpperTriangMatrix (double *values, int squareSize)
     printf ("\n");
 }
 
+
+/**-----------------------------------------------------------------
+|
+|   StoreGeneTreeLnPr: Cache the gene tree probabilities calculated
+|       by the last call to LnJointGeneTreeSpeciesTreePr for a state
+|       of a chain.
+|
+------------------------------------------------------------------*/
+void StoreGeneTreeLnPr (int chain, int whichState)
+{
+    int         i;
+    double      *cachedLnPr;
+
+    cachedLnPr = geneTreeLnPrCache + (2*chain+whichState)*numTopologies;
+    for (i=0; i<numTopologies; i++)
+        cachedLnPr[i] = geneTreeLnPr[i];
+    isGeneTreeLnPrCached[2*chain+whichState] = YES;
+}
+
@@ -14,6 +14,7 @@ typedef struct {
 void    AllocateBestChainVariables (void);
 int     FillSpeciesTreeParams (RandLong* seed, int from, int to);
 void    FreeBestChainVariables (void);
+void    InvalidateGeneTreeLnPr (int chain);
 int     IsSpeciesTreeConsistent (Tree *speciesTree, int chain);
 double  LnSpeciesTreeProb (int chain);
 double  LnJointGeneTreeSpeciesTreePr (Tree **geneTrees, int numGeneTrees, Tree *speciesTree, int chain);
@@ -47,7 +47,7 @@
 #endif
 
 #define NUMCOMMANDS                     62    /* The total number of commands in the program  */
-#define NUMPARAMS                       278   /* The total number of parameters  */
+#define NUMPARAMS                       286   /* The total number of parameters  */
 #define PARAM(i, s, f, l)               p->string = s;    \
                                         p->fp = f;        \
                                         p->valueList = l; \
@@ -312,10 +312,10 @@ CmdType     commands[] =
             { 24,            "Lset",  NO,            DoLset, 18,                                     {28,29,30,31,32,33,34,40,51,52,53,90,91,131,188,189,276,277},        4,                "Sets the parameters of the likelihood model",  IN_CMD, SHOW },
             { 25,          "Manual",  NO,          DoManual,  1,                                                                                            {126},       36,                  "Prints a command reference to a text file",  IN_CMD, SHOW },
             { 26,          "Matrix", YES,          DoMatrix,  1,                                                                                             {11},649252640,                 "Defines matrix of characters in data block", IN_FILE, SHOW },
-            { 27,            "Mcmc",  NO,            DoMcmc, 46,  {17,18,19,20,21,22,23,24,25,26,27,84,98,112,113,114,115,116,132,142,143,144,148,149,150,151,152,
-                                                                                     153,154,155,156,157,158,159,160,166,169,190,191,198,199,200,202,213,214,215},       36,                   "Starts Markov chain Monte Carlo analysis",  IN_CMD, SHOW },
-            { 28,           "Mcmcp",  NO,           DoMcmcp, 46,  {17,18,19,20,21,22,23,24,25,26,27,84,98,112,113,114,115,116,132,142,143,144,148,149,150,151,152,
-                                                                                     153,154,155,156,157,158,159,160,166,169,190,191,198,199,200,202,213,214,215},        4,     "Sets parameters of a chain (without starting analysis)",  IN_CMD, SHOW },
+            { 27,            "Mcmc",  NO,            DoMcmc, 51,  {17,18,19,20,21,22,23,24,25,26,27,84,98,112,113,114,115,116,132,142,143,144,148,149,150,151,152,
+                                                                                     153,154,155,156,157,158,159,160,166,169,190,191,198,199,200,202,213,214,215,278,279,283,284,285},   36,                   "Starts Markov chain Monte Carlo analysis",  IN_CMD, SHOW },
+            { 28,           "Mcmcp",  NO,           DoMcmcp, 51,  {17,18,19,20,21,22,23,24,25,26,27,84,98,112,113,114,115,116,132,142,143,144,148,149,150,151,152,
+                                                                                     153,154,155,156,157,158,159,160,166,169,190,191,198,199,200,202,213,214,215,278,279,283,284,285},    4,     "Sets parameters of a chain (without starting analysis)",  IN_CMD, SHOW },
             { 29,        "Outgroup", YES,        DoOutgroup,  1,                                                                                             {78},    49152,                                     "Changes outgroup taxon",  IN_CMD, SHOW },
             { 30,           "Pairs", YES,           DoPairs,  1,                                                                                             {92},    32768,        "Defines nucleotide pairs (doublets) for stem models",  IN_CMD, SHOW },
             { 31,       "Partition",  NO,       DoPartition,  1,                                                                                             {16},        4,                              "Assigns a character partition",  IN_CMD, SHOW },
@@ -335,13 +335,13 @@ CmdType     commands[] =
             { 44,      "Showparams",  NO,      DoShowParams,  0,                                                                                             {-1},       32,                          "Shows parameters in current model",  IN_CMD, SHOW },
             { 45,   "Showusertrees",  NO,   DoShowUserTrees,  0,                                                                                             {-1},       32,                                   "Shows user-defined trees",  IN_CMD, SHOW },
             { 46,"Speciespartition",  NO,DoSpeciespartition,  1,                                                                                            {244},        4,                   "Defines a partition of tips into species",  IN_CMD, SHOW },
-            { 47,              "Ss",  NO,              DoSs, 50,  {17,18,19,20,21,22,23,24,25,26,27,84,98,112,113,114,115,116,132,142,143,144,148,149,150,151,152,
-                                                                     153,154,155,156,157,158,159,160,166,169,190,191,198,199,200,202,213,214,215,248,249,250,257},       36,                             "Starts stepping-stone sampling",  IN_CMD, SHOW },
-            { 48,             "Ssp",  NO,             DoSsp, 50,  {17,18,19,20,21,22,23,24,25,26,27,84,98,112,113,114,115,116,132,142,143,144,148,149,150,151,152,
-                                                                     153,154,155,156,157,158,159,160,166,169,190,191,198,199,200,202,213,214,215,248,249,250,257},       36,"Sets parameters of stepping-stone analysis (without starting)",IN_CMD, SHOW },
+            { 47,              "Ss",  NO,              DoSs, 52,  {17,18,19,20,21,22,23,24,25,26,27,84,98,112,113,114,115,116,132,142,143,144,148,149,150,151,152,
+                                                                     153,154,155,156,157,158,159,160,166,169,190,191,198,199,200,202,213,214,215,248,249,250,257,280,281},       36,                             "Starts stepping-stone sampling",  IN_CMD, SHOW },
+            { 48,             "Ssp",  NO,             DoSsp, 52,  {17,18,19,20,21,22,23,24,25,26,27,84,98,112,113,114,115,116,132,142,143,144,148,149,150,151,152,
+                                                                     153,154,155,156,157,158,159,160,166,169,190,191,198,199,200,202,213,214,215,248,249,250,257,280,281},       36,"Sets parameters of stepping-stone analysis (without starting)",IN_CMD, SHOW },
             { 49,       "Startvals",  NO,       DoStartvals,  1,                                                                                            {187},        4,                         "Sets starting values of parameters",  IN_CMD, SHOW },
             { 50,            "Sump",  NO,            DoSump, 13,                                              {96,97,137,138,139,140,141,161,162,178,211,212,231},       36,                   "Summarizes parameters from MCMC analysis",  IN_CMD, SHOW },
-            { 51,           "Sumss",  NO,           DoSumSs, 10,                                                        {258,259,260,261,262,263,264,265,266,267},       36,         "Summarizes parameters from stepping-stone analysis",  IN_CMD, SHOW },
+            { 51,           "Sumss",  NO,           DoSumSs, 11,                                                    {258,259,260,261,262,263,264,265,266,267,282},       36,         "Summarizes parameters from stepping-stone analysis",  IN_CMD, SHOW },
             { 52,            "Sumt",  NO,            DoSumt, 21,                {80,81,82,95,146,147,163,164,165,167,175,177,204,205,206,207,208,209,210,230,232},       36,                        "Summarizes trees from MCMC analysis",  IN_CMD, SHOW },
             { 53,        "Taxastat",  NO,        DoTaxaStat,  0,                                                                                             {-1},       32,                                       "Shows status of taxa",  IN_CMD, SHOW },
             { 54,          "Taxset",  NO,         DoTaxaset,  1,                                                                                             {49},        4,                           "Assigns a group of taxa to a set",  IN_CMD, SHOW },
@@ -3543,7 +3543,7 @@ int DoExecute (void)
     FILE        *fp;
     CmdType     *oldCommandPtr;
     char        *oldTokenP, oldToken[CMD_STRING_LENGTH];
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     int         sumErrors;
 #   endif
         
@@ -3570,7 +3570,7 @@ int DoExecute (void)
     /* set indentation to 0 */
     strcpy (spacer, "");
     
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
     if (sumErrors > 0)
         {
@@ -3595,7 +3595,7 @@ int DoExecute (void)
         MrBayesPrint ("%s   Unknown line termination\n", spacer);
         nErrors++;
         }
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
     if (sumErrors > 0)
         {
@@ -3619,7 +3619,7 @@ int DoExecute (void)
         MrBayesPrint ("%s   Problem allocating string for reading file\n", spacer);
         nErrors++;
         }
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
     if (sumErrors > 0)
         {
@@ -3639,7 +3639,7 @@ int DoExecute (void)
         {
         nErrors++;
         }
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
     if (sumErrors > 0)
         {
@@ -3673,7 +3673,7 @@ int DoExecute (void)
                 {
                 nErrors++;
                 }
-#           if defined (MPI_ENABLED)
+#           if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
             MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
             if (sumErrors > 0)
                 {
@@ -3689,7 +3689,7 @@ int DoExecute (void)
             rc = ParseCommand (s);
             if (rc == ERROR)
                 nErrors++;
-#           if defined (MPI_ENABLED)
+#           if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
             MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
             if (sumErrors > 0)
                 {
@@ -3702,7 +3702,7 @@ int DoExecute (void)
 #           endif
             if (rc == NO_ERROR_QUIT)
                 nErrors++;
-#           if defined (MPI_ENABLED)
+#           if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
             MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
             if (sumErrors > 0)
                 goto quitExit;
@@ -3718,7 +3718,7 @@ int DoExecute (void)
     if (inComment == YES)
         nErrors++;
 
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
     if (sumErrors > 0)
         {
@@ -6398,6 +6398,11 @@ int DoSetParm (char *parmName, char *tkn)
             else if (expecting == Expecting(NUMBER))
                 {
                 sscanf (tkn, "%d", &tempI);
+                if (tempI < 1)
+                    {
+                    MrBayesPrint ("%s   Npthreads must be at least 1\n", spacer);
+                    return (ERROR);
+                    }
                 nPThreads = tempI;
                 MrBayesPrint ("%s   Setting Npthreads to %d\n", spacer, nPThreads);
                 expecting = Expecting(PARAMETER) | Expecting(SEMICOLON);
@@ -8911,7 +8916,7 @@ int DoVersion (void)
 #ifdef BEAGLE_ENABLED
     MrBayesPrint(" Beagle");
 #endif
-#ifdef MPI_ENABLED
+#if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     MrBayesPrint(" MPI");
 #endif
 #ifdef HAVE_LIBREADLINE
@@ -11877,11 +11882,14 @@ int GetUserHelp (char *helpTkn)
         MrBayesPrint ("   Savetrees    -- If you are using a relative burnin for run-time convergence   \n");
         MrBayesPrint ("                   diagnostics, tree samples need to be deleted from split       \n");
         MrBayesPrint ("                   frequency counters as the cut-off point for the burnin moves  \n");
-        MrBayesPrint ("                   during the run. If 'Savetrees' is set to 'No', tree samples   \n");
-        MrBayesPrint ("                   to be discarded are read back in from file. If 'Savetrees' is \n");
-        MrBayesPrint ("                   set to 'Yes', the tree samples to be removed will be stored   \n");
-        MrBayesPrint ("                   in the internal memory instead. This can use up a lot of      \n");
-        MrBayesPrint ("                   memory in large analyses.                                     \n");
+        MrBayesPrint ("                   during the run. If 'Savetrees' is set to 'No', the splits of  \n");
+        MrBayesPrint ("                   tree samples to be discarded are kept in a compact buffer in  \n");
+        MrBayesPrint ("                   memory, so no trees need to be read back in from file. If     \n");
+        MrBayesPrint ("                   'Savetrees' is set to 'Yes', the tree samples to be removed   \n");
+        MrBayesPrint ("                   are instead stored as lists of split ids that refer to a      \n");
+        MrBayesPrint ("                   shared pool of unique splits, and repeated samples of the     \n");
+        MrBayesPrint ("                   same topology are stored only once. This uses less memory     \n");
+        MrBayesPrint ("                   for large trees but needs some extra work per sample.         \n");
         MrBayesPrint ("   Minpartfreq  -- The minimum frequency required for a partition to be included \n");
         MrBayesPrint ("                   in the calculation of the topology convergence diagnostic. The\n");
         MrBayesPrint ("                   partition is included if the minimum frequency is reached in  \n");
@@ -11954,6 +11962,16 @@ int GetUserHelp (char *helpTkn)
         MrBayesPrint ("                   with random trees. Setting 'Starttree' to 'random' causes     \n");
         MrBayesPrint ("                   new starting trees to be drawn randomly at the start of the   \n");
         MrBayesPrint ("                   run, overwriting any previous user-defined starting trees.    \n");
+        MrBayesPrint ("                   'Starttree=parsimony' builds the starting trees by stepwise   \n");
+        MrBayesPrint ("                   addition of the taxa in random order under parsimony, and     \n");
+        MrBayesPrint ("                   'Starttree=ml' continues from these trees with a likelihood   \n");
+        MrBayesPrint ("                   hill-climb over NNI rearrangements and branch lengths, which  \n");
+        MrBayesPrint ("                   can shorten the burnin for large data sets. The search is     \n");
+        MrBayesPrint ("                   done for unconstrained, unrooted trees without a clock.       \n");
+        MrBayesPrint ("                   Only the topology and branch lengths are optimized; the       \n");
+        MrBayesPrint ("                   substitution model parameters keep their starting values, so  \n");
+        MrBayesPrint ("                   the starting likelihood can still be well below the values    \n");
+        MrBayesPrint ("                   reached after burnin.                                         \n");
         MrBayesPrint ("   Nperts       -- This is the number of random perturbations to apply to the    \n");
         MrBayesPrint ("                   user starting tree. This allows you to have something         \n");
         MrBayesPrint ("                   between completely random and user-defined trees start        \n");
@@ -11966,6 +11984,19 @@ int GetUserHelp (char *helpTkn)
         MrBayesPrint ("                   trees will be reordered to match the order of the taxa in the \n");
         MrBayesPrint ("                   data matrix as closely as possible. By default, trees will be \n");
         MrBayesPrint ("                   printed without reordering of taxa.                           \n");
+        MrBayesPrint ("   Pbf          -- Set this to 'Yes' to sample the log likelihood of each site  \n");
+        MrBayesPrint ("                   every 'Samplefreq' generations of the cold chain. The values \n");
+        MrBayesPrint ("                   are written to a file with the ending '.sitelnl', one column \n");
+        MrBayesPrint ("                   per site, and at the end of the run they are summarized into \n");
+        MrBayesPrint ("                   the log pseudo-marginal likelihood (LPML) and WAIC. The      \n");
+        MrBayesPrint ("                   difference in LPML between two models is the log pseudo-Bayes\n");
+        MrBayesPrint ("                   factor. The per-site values are collected in the same pass as\n");
+        MrBayesPrint ("                   the total likelihood, so the cost is mainly the file output. \n");
+        MrBayesPrint ("                   Not available for parsimony and adgamma models, with Gibbs   \n");
+        MrBayesPrint ("                   sampling of rate categories or with Beagle. The sampling is  \n");
+        MrBayesPrint ("                   controlled by 'Samplefreq' and the burnin settings only; the \n");
+        MrBayesPrint ("                   old 'Pbfinitburnin', 'Pbfsamplefreq', 'Pbfsampletime' and    \n");
+        MrBayesPrint ("                   'Pbfsampleburnin' options are not used and are rejected.     \n");
         MrBayesPrint ("   Append       -- Set this to 'Yes' to append the results of the current run to \n");
         MrBayesPrint ("                   a previous run. MrBayes will first read in the results of the \n");
         MrBayesPrint ("                   previous run (number of generations and sampled splits) and   \n");
@@ -11981,6 +12012,46 @@ int GetUserHelp (char *helpTkn)
         MrBayesPrint ("   Tunefreq     -- When a proposal has been tried 'Tunefreq' times, its tuning   \n");
         MrBayesPrint ("                   parameter is adjusted to reach the target acceptance rate     \n");
         MrBayesPrint ("                   if 'Autotune' is set to 'Yes'.                                \n");
+        MrBayesPrint ("   Profile      -- Set this to 'Yes' to record the time spent in each move,      \n");
+        MrBayesPrint ("                   split into proposal, prior, likelihood and copying of the     \n");
+        MrBayesPrint ("                   chain state, and the likelihood time of each partition. The   \n");
+        MrBayesPrint ("                   times are printed with the acceptance rates at the end of the \n");
+        MrBayesPrint ("                   run and written to the file '<Filename>.profile', together    \n");
+        MrBayesPrint ("                   with the time per accepted proposal, which is useful when     \n");
+        MrBayesPrint ("                   setting the relative proposal probabilities with 'Propset'.   \n");
+        MrBayesPrint ("   Autoweight   -- Set this to 'Yes' to adapt the relative proposal              \n");
+        MrBayesPrint ("                   probabilities to the cost and mixing of the moves. During the \n");
+        MrBayesPrint ("                   second half of the burnin, the squared jumps in the log       \n");
+        MrBayesPrint ("                   posterior of the accepted proposals and the time spent in     \n");
+        MrBayesPrint ("                   each move are recorded. At the end of the burnin, the         \n");
+        MrBayesPrint ("                   probability of each move is scaled by its squared jump per    \n");
+        MrBayesPrint ("                   second relative to the other moves changing the same          \n");
+        MrBayesPrint ("                   parameter, by at most a factor of four, and then kept fixed.  \n");
+        MrBayesPrint ("                   The total probability of the moves of each parameter is not   \n");
+        MrBayesPrint ("                   changed. The burnin is the one used for the convergence       \n");
+        MrBayesPrint ("                   diagnostics, or the initial burnin in stepping-stone          \n");
+        MrBayesPrint ("                   sampling. Since the new probabilities depend on timing, runs  \n");
+        MrBayesPrint ("                   are not exactly repeatable with this option. Moves tried fewer\n");
+        MrBayesPrint ("                   than 100 times in a chain keep their probability, so the      \n");
+        MrBayesPrint ("                   burnin needs to be long enough for the moves to adapt.        \n");
+        MrBayesPrint ("   Checkbrlenderivs -- Set this to 'Yes' to check the analytic derivatives of    \n");
+        MrBayesPrint ("                   the likelihood used for the branch lengths of 'Starttree=ML'  \n");
+        MrBayesPrint ("                   against the lnL of the tree and finite differences. The check \n");
+        MrBayesPrint ("                   is done for every branch before it is optimized, and the run  \n");
+        MrBayesPrint ("                   stops with an error if the lnL is off by more than 0.001 or a \n");
+        MrBayesPrint ("                   derivative by more than 1 percent of its scale. This is mainly\n");
+        MrBayesPrint ("                   useful for testing the likelihood code.                       \n");
+        MrBayesPrint ("   Checkparstrees -- Set this to 'Yes' to check that the parsimony starting trees\n");
+        MrBayesPrint ("                   of 'Starttree=Parsimony', which may be built by several       \n");
+        MrBayesPrint ("                   threads (see 'Npthreads' in the 'Set' command), are the same  \n");
+        MrBayesPrint ("                   as the trees built by a single thread. The run stops with an  \n");
+        MrBayesPrint ("                   error if any tree differs. This is mainly useful for testing. \n");
+        MrBayesPrint ("   Checkautoweight -- Set this to 'Yes' to check the proposal probabilities      \n");
+        MrBayesPrint ("                   adapted by 'Autoweight'. The run stops with an error if no    \n");
+        MrBayesPrint ("                   probability was changed, or if the changes of the moves of a  \n");
+        MrBayesPrint ("                   parameter that were not limited to a factor of four are not   \n");
+        MrBayesPrint ("                   proportional to their squared jumps per second. This is mainly\n");
+        MrBayesPrint ("                   useful for testing.                                           \n");
         MrBayesPrint ("                                                                                 \n");
         PrintSettings ("Mcmc");
         MrBayesPrint ("   ---------------------------------------------------------------------------   \n");
@@ -12050,6 +12121,25 @@ int GetUserHelp (char *helpTkn)
         MrBayesPrint ("   into 50 bins, one of which represents the burnin and is discarded. Each step  \n");
         MrBayesPrint ("   in the algorithm will thus be represented by 20 samples.                      \n");
         MrBayesPrint ("                                                                                 \n");
+        MrBayesPrint ("   The steps can also be split into blocks that are sampled in separate analy-  \n");
+        MrBayesPrint ("   ses, which may run at the same time on different processors or computers.    \n");
+        MrBayesPrint ("   Each analysis is started with 'Nblocks' set to the number of blocks and      \n");
+        MrBayesPrint ("   'Block' set to the block it should sample, and with the same settings other- \n");
+        MrBayesPrint ("   wise. The analysis runs the initial burnin ('Burninss') at the power of the  \n");
+        MrBayesPrint ("   first step in its block, and then samples the steps of the block only, using \n");
+        MrBayesPrint ("   the same number of generations for each step as an analysis of all steps. The\n");
+        MrBayesPrint ("   output file names get '.block<i>' appended to 'Filename'. When all blocks    \n");
+        MrBayesPrint ("   are finished, 'sumss nblocks=<n>' merges the step contributions in their .ss \n");
+        MrBayesPrint ("   files into the marginal likelihood estimate. For instance, the steps could be\n");
+        MrBayesPrint ("   sampled in four blocks by four instances of MrBayes started with the commands\n");
+        MrBayesPrint ("                                                                                \n");
+        MrBayesPrint ("      ss nblocks=4 block=1;                                                     \n");
+        MrBayesPrint ("      ss nblocks=4 block=2;                                                     \n");
+        MrBayesPrint ("      ss nblocks=4 block=3;                                                     \n");
+        MrBayesPrint ("      ss nblocks=4 block=4;                                                     \n");
+        MrBayesPrint ("                                                                                \n");
+        MrBayesPrint ("   and the estimate would then be obtained with 'sumss nblocks=4'.              \n");
+        MrBayesPrint ("                                                                                \n");
         MrBayesPrint ("   More information on 'Mcmc' parameters is available in the help for the 'Mcmc' \n");
         MrBayesPrint ("   and 'Mcmcp' commands. Only the exclusive 'Ss' parameters are listed below.    \n");
         MrBayesPrint ("   These can only be set up using the 'Ss' command, while the parameters shared  \n");
@@ -12103,6 +12193,12 @@ int GetUserHelp (char *helpTkn)
         MrBayesPrint ("                   of power posterior change, i.e. in the first step we sample   \n");
         MrBayesPrint ("                   close to the posterior, and with each consequtive step we     \n");
         MrBayesPrint ("                   sample closer to the prior.                                   \n");
+        MrBayesPrint ("   Nblocks      -- Number of blocks the steps are split into, for sampling the  \n");
+        MrBayesPrint ("                   steps in separate analyses (see above). The default value of \n");
+        MrBayesPrint ("                   '1' samples all steps in one analysis.                       \n");
+        MrBayesPrint ("   Block        -- Block of steps to sample when 'Nblocks' is larger than 1. The\n");
+        MrBayesPrint ("                   blocks are numbered from 1 to 'Nblocks' in the order in which\n");
+        MrBayesPrint ("                   the steps would be sampled in a single analysis.             \n");
         MrBayesPrint ("                                                                                 \n");
         MrBayesPrint ("   Current settings:                                                             \n");
         MrBayesPrint ("                                                                                 \n");
@@ -12112,6 +12208,8 @@ int GetUserHelp (char *helpTkn)
         MrBayesPrint ("   BurninSS           <number>              %d\n", chainParams.burninSS);
         MrBayesPrint ("   Nsteps             <number>              %d\n", chainParams.numStepsSS);
         MrBayesPrint ("   FromPrior           Yes/No               %s                                   \n", chainParams.startFromPriorSS == YES ? "Yes" : "No");
+        MrBayesPrint ("   Nblocks            <number>              %d\n", chainParams.numBlocksSS);
+        MrBayesPrint ("   Block              <number>              %d\n", chainParams.blockSS);
         MrBayesPrint ("                                                                                 \n");
         MrBayesPrint ("   ---------------------------------------------------------------------------   \n");
         }
@@ -12135,6 +12233,8 @@ else if (!strcmp(helpTkn, "Ssp"))
         MrBayesPrint ("   BurninSS           <number>              %d\n", chainParams.burninSS);
         MrBayesPrint ("   Nsteps             <number>              %d\n", chainParams.numStepsSS);
         MrBayesPrint ("   FromPrior           Yes/No               %s                                   \n", chainParams.startFromPriorSS == YES ? "Yes" : "No");
+        MrBayesPrint ("   Nblocks            <number>              %d\n", chainParams.numBlocksSS);
+        MrBayesPrint ("   Block              <number>              %d\n", chainParams.blockSS);
         MrBayesPrint ("                                                                                 \n");
         MrBayesPrint ("   ---------------------------------------------------------------------------   \n");
         }
@@ -12210,6 +12310,12 @@ else if (!strcmp(helpTkn, "Set"))
         MrBayesPrint ("   Precision    -- Precision allows you to set the number of decimals to be prin-\n");
         MrBayesPrint ("                   ted when sampled values are written to file. Precision must be\n");
         MrBayesPrint ("                   in the range 3 to 15.                                         \n");
+#   if defined (THREADS_ENABLED)
+        MrBayesPrint ("   Npthreads    -- The number of threads used to build parsimony starting trees \n");
+        MrBayesPrint ("                   for the chains and to run the exhaustive parsimony searches   \n");
+        MrBayesPrint ("                   of parsimony-biased moves. The trees do not depend on the     \n");
+        MrBayesPrint ("                   number of threads.                                            \n");
+#   endif
 #   if defined (BEAGLE_ENABLED)
         MrBayesPrint ("   Usebeagle    -- Set this option to 'Yes' to attempt to use the BEAGLE library \n");
         MrBayesPrint ("                   to compute the phylogenetic likelihood on a variety of high-  \n");
@@ -12247,6 +12353,9 @@ else if (!strcmp(helpTkn, "Set"))
         MrBayesPrint ("   Quitonerror        Yes/No                %s                                   \n", quitOnError == YES ? "Yes" : "No");
         MrBayesPrint ("   Scientific         Yes/No                %s                                   \n", scientific == YES ? "Yes" : "No");
         MrBayesPrint ("   Precision          <number>              %d                                   \n", precision);
+#   if defined (THREADS_ENABLED)
+        MrBayesPrint ("   Npthreads          <number>              %d                                   \n", nPThreads);
+#   endif
 #   if defined (BEAGLE_ENABLED)
         MrBayesPrint ("   Usebeagle          Yes/No                %s                                   \n", tryToUseBEAGLE == YES ? "Yes" : "No");
         MrBayesPrint ("   Beagleresource     <number>              %d                                   \n", beagleResourceNumber);
@@ -12903,6 +13012,14 @@ else if (!strcmp(helpTkn, "Set"))
         MrBayesPrint ("                   '.p' is added to the file name. Otherwise, the endings will   \n");
         MrBayesPrint ("                   be '.run1.p', '.run2.p', etc. Note that the 'Filename' setting\n");
         MrBayesPrint ("                   is shared with 'sump' command.                                \n");
+        MrBayesPrint ("   Nblocks      -- If the steps were sampled in blocks by separate analyses (see\n");
+        MrBayesPrint ("                   'help ss'), setting 'Nblocks' to the number of blocks merges \n");
+        MrBayesPrint ("                   the step contributions in the files '.block1.ss',            \n");
+        MrBayesPrint ("                   '.block2.ss', etc, derived from 'Filename', instead of       \n");
+        MrBayesPrint ("                   summarizing the '.p' files. The contributions are used as    \n");
+        MrBayesPrint ("                   computed by the analyses, so the burnin settings of 'sumss'  \n");
+        MrBayesPrint ("                   do not apply, and no plots are printed. All 'Nsteps' steps   \n");
+        MrBayesPrint ("                   (see 'help ss') have to be present in the files.             \n");
         MrBayesPrint ("   Nruns        -- Determines how many '.p' files from independent analyses that \n");
         MrBayesPrint ("                   will be summarized. If Nruns > 1 then the names of the files  \n");
         MrBayesPrint ("                   are derived from 'Filename' by adding '.run1.p', '.run2.p',   \n");
@@ -12928,6 +13045,7 @@ else if (!strcmp(helpTkn, "Set"))
             MrBayesPrint ("   Filename        <name>                   %s<.p>\n", sumpParams.sumpFileName);
         else
             MrBayesPrint ("   Filename        <name>                   %s<.run<i>.p>\n", sumpParams.sumpFileName);        
+        MrBayesPrint ("   Nblocks         <number>                 %d                                   \n", sumssParams.numBlocks);
         MrBayesPrint ("   Nruns           <number>                 %d                                   \n", sumpParams.numRuns);
         MrBayesPrint ("   Steptoplot      <number>                 %d                                   \n", sumssParams.stepToPlot);
         MrBayesPrint ("   Smoothing       <number>                 %d                                   \n", sumssParams.smoothing);
@@ -13940,14 +14058,20 @@ void PrintSettings (char *command)
         MrBayesPrint ("   Filename        <name>                %s.<p/t>\n", chainParams.chainFileName);
         MrBayesPrint ("   Startparams     Current/Reset         %s                                     \n", chainParams.startParams);
         MrBayesPrint ("   Starttree       Current/Random/       %s                                     \n", chainParams.startTree);
-        MrBayesPrint ("                   Parsimony                                                    \n");
+        MrBayesPrint ("                   Parsimony/ML                                                 \n");
         MrBayesPrint ("   Nperts          <number>              %d                                     \n", chainParams.numStartPerts);
         PrintYesNo (chainParams.runWithData, yesNoStr);
         MrBayesPrint ("   Data            Yes/No                %s                                     \n", yesNoStr);
         MrBayesPrint ("   Ordertaxa       Yes/No                %s                                     \n", chainParams.orderTaxa == YES? "Yes" : "No");
+        MrBayesPrint ("   Pbf             Yes/No                %s                                     \n", chainParams.calcPbf == YES? "Yes" : "No");
         MrBayesPrint ("   Append          Yes/No                %s                                     \n", chainParams.append == YES? "Yes" : "No");
         MrBayesPrint ("   Autotune        Yes/No                %s                                     \n", chainParams.autotune == YES? "Yes" : "No");
         MrBayesPrint ("   Tunefreq        <number>              %d                                     \n", chainParams.tuneFreq);
+        MrBayesPrint ("   Profile         Yes/No                %s                                     \n", chainParams.profile == YES? "Yes" : "No");
+        MrBayesPrint ("   Autoweight      Yes/No                %s                                     \n", chainParams.autoweight == YES? "Yes" : "No");
+        MrBayesPrint ("   Checkbrlenderivs Yes/No               %s                                     \n", chainParams.checkBrlenDerivs == YES? "Yes" : "No");
+        MrBayesPrint ("   Checkparstrees  Yes/No                %s                                     \n", chainParams.checkParsTrees == YES? "Yes" : "No");
+        MrBayesPrint ("   Checkautoweight Yes/No                %s                                     \n", chainParams.checkAutoweight == YES? "Yes" : "No");
         MrBayesPrint ("                                                                                \n");
         }
 }
@@ -14308,7 +14432,7 @@ void SetUpParms (void)
     PARAM  (22, "Temp",           DoMcmcParm,        "\0");
     PARAM  (23, "Filename",       DoMcmcParm,        "\0");
     PARAM  (24, "Burnin",         DoMcmcParm,        "\0");
-    PARAM  (25, "Starttree",      DoMcmcParm,        "Random|Current|User|Parsimony|NJ|\0");
+    PARAM  (25, "Starttree",      DoMcmcParm,        "Random|Current|User|Parsimony|NJ|ML|\0");
     PARAM  (26, "Nperts",         DoMcmcParm,        "\0");
     PARAM  (27, "Savebrlens",     DoMcmcParm,        "Yes|No|\0");
     PARAM  (28, "Nucmodel",       DoLsetParm,        "4by4|Doublet|Codon|Protein|\0");
@@ -14561,9 +14685,17 @@ void SetUpParms (void)
     PARAM (275, "Beagleresource", DoSetParm,         "\0");
     PARAM (276, "Nlnormcat",      DoLsetParm,        "\0");
     PARAM (277, "Nmixtcat",       DoLsetParm,        "\0");
+    PARAM (278, "Profile",        DoMcmcParm,        "Yes|No|\0");
+    PARAM (279, "Autoweight",     DoMcmcParm,        "Yes|No|\0");
+    PARAM (280, "Nblocks",        DoSsParm,          "\0");
+    PARAM (281, "Block",          DoSsParm,          "\0");
+    PARAM (282, "Nblocks",        DoSumSsParm,       "\0");
+    PARAM (283, "Checkbrlenderivs", DoMcmcParm,      "Yes|No|\0");
+    PARAM (284, "Checkparstrees", DoMcmcParm,        "Yes|No|\0");
+    PARAM (285, "Checkautoweight", DoMcmcParm,       "Yes|No|\0");
 
     /* NOTE: If a change is made to the parameter table, make certain you change
-            NUMPARAMS (now 278; one more than last index) at the top of this file. */
+            NUMPARAMS (now 286; one more than last index) at the top of this file. */
     /* CmdType commands[] */
 }
 
@@ -55,7 +55,10 @@ extern int      rateProbRowSize;            /* size of rate probs for one chain
 extern MrBFlt   **rateProbs;                /* pointers to rate probs used by adgamma model */
 
 /* local prototypes */
+int       BrlenDerivsSum (ModelInfo *m, int chain, MrBFlt *bs, MrBFlt *like, MrBFlt *lnL, MrBFlt *d1, MrBFlt *d2);
 void      CopySiteScalers (ModelInfo *m, int chain);
+void      CovarionBlockExp (MrBFlt lambda, MrBFlt s10, MrBFlt s01, MrBFlt t, MrBFlt *e);
+void      CovarionTiProbs (int nObs, MrBFlt *cijk, MrBFlt *e, MrBFlt *tiP);
 void      FlipCondLikeSpace (ModelInfo *m, int chain, int nodeIndex);
 void      FlipCijkSpace (ModelInfo *m, int chain);
 void      FlipNodeScalerSpace (ModelInfo *m, int chain, int nodeIndex);
@@ -74,212 +77,923 @@ int       SetBinaryQMatrix (MrBFlt **a, int whichChain, int division);
 int       SetNucQMatrix (MrBFlt **a, int n, int whichChain, int division, MrBFlt rateMult, MrBFlt *rA, MrBFlt *rS);
 int       SetStdQMatrix (MrBFlt **a, int nStates, MrBFlt *bs, int cType);
 int       SetProteinQMatrix (MrBFlt **a, int n, int whichChain, int division, MrBFlt rateMult);
+int       TiProbsDerivs (TreeNode *p, int division, int chain, MrBFlt *tiP, MrBFlt *tiP1, MrBFlt *tiP2);
+void      TiProbsDerivsQP (MrBFlt **q, int n, MrBFlt f, MrBFlt t, MrBFlt *tiP, MrBFlt *tiP1, MrBFlt *tiP2);
+#if defined (SSE_ENABLED)
+void      TiProbsTimesCondLikes_SSE (__m128 *like, CLFlt *tiP, __m128 *cl, int nStates, int nVecs);
+void      TransformCondLikes_SSE (CLFlt *like, CLFlt *tiPT, CLFlt *cl, int nStates);
+void      TransposeTiProbs_SSE (CLFlt *tiPT, CLFlt *tiP, int nStates, int nRateCats);
+#endif
 int       UpDateCijk (int whichPart, int whichChain);
 
 
-#if !defined (SSE_ENABLED) || 1
 /*----------------------------------------------------------------
 |
-|   CondLikeDown_Bin: binary model with or without rate
-|       variation
+|   BrlenDerivs_Gen: log likelihood and its first and second
+|       derivatives with respect to the length of the branch below
+|       p, general n-state model with or without rate variation,
+|       omega categories (NY98) or covarion. The derivatives are
+|       taken at p->length; the cond likes, the ti probs of the
+|       branch and the final (up pass) cond likes of p->anc must be
+|       current for the branch length used in the last down pass.
 |
 -----------------------------------------------------------------*/
-int CondLikeDown_Bin (TreeNode *p, int division, int chain)
+int BrlenDerivs_Gen (TreeNode *p, int division, int chain, MrBFlt *lnL, MrBFlt *d1, MrBFlt *d2)
 {
-    int             c, k;
-    CLFlt           *clL, *clR, *clP, *pL, *pR, *tiPL, *tiPR;
+    int             b, c, i, k, n, nStatesSquared;
+    MrBFlt          *tiP, *tiP1, *tiP2, *like, *like1, *like2, *bs, covBF[40], s01, s10, probOn, *swr,
+                    *omegaCatFreq=NULL, freq, r, sum, sum1, sum2, x, x1, x2;
+    CLFlt           *clF, *clD, *tiP0;
     ModelInfo       *m;
-    
-    /* find model settings for this division */
+
     m = &modelSettings[division];
+    n = m->numModelStates;
+    nStatesSquared = n * n;
 
-    /* Flip conditional likelihood space */
-    FlipCondLikeSpace (m, chain, p->index);
-    
-    /* find conditional likelihood pointers */
-    clL = m->condLikes[m->condLikeIndex[chain][p->left->index ]];
-    clR = m->condLikes[m->condLikeIndex[chain][p->right->index]];
-    clP = m->condLikes[m->condLikeIndex[chain][p->index       ]];
-    
-    /* find transition probabilities */
-    pL = m->tiProbs[m->tiProbsIndex[chain][p->left->index ]];
-    pR = m->tiProbs[m->tiProbsIndex[chain][p->right->index]];
+    /* find the partials on either side of the branch; p->anc is
+       a tip if the branch leads to the root of an unrooted tree */
+    if (p->anc->anc == NULL)
+        {
+        clF = m->condLikes[m->condLikeIndex[chain][p->index     ]];
+        clD = m->condLikes[m->condLikeIndex[chain][p->anc->index]];
+        }
+    else
+        {
+        clF = m->condLikes[m->condLikeScratchIndex[p->anc->index]];
+        clD = m->condLikes[m->condLikeIndex[chain][p->index     ]];
+        }
+    tiP0 = m->tiProbs[m->tiProbsIndex[chain][p->index]];
 
-    tiPL = pL;
-    tiPR = pR;
-    for (k=0; k<m->numRateCats; k++)
+    /* get scratch space for the ti probs and their derivatives at p->length, and for the site likelihoods */
+    tiP = (MrBFlt *) ScratchCalloc (3*m->tiProbLength + 3*m->numChars, sizeof (MrBFlt));
+    if (!tiP)
+        return (ERROR);
+    tiP1  = tiP + m->tiProbLength;
+    tiP2  = tiP1 + m->tiProbLength;
+    like  = tiP2 + m->tiProbLength;
+    like1 = like + m->numChars;
+    like2 = like1 + m->numChars;
+    if (TiProbsDerivs (p, division, chain, tiP, tiP1, tiP2) == ERROR)
+        return (ERROR);
+
+    /* find base frequencies, adjusted for the covarion model */
+    bs = GetParamSubVals (m->stateFreq, chain, state[chain]);
+    if (m->switchRates != NULL)
         {
-        for (c=0; c<m->numChars; c++)
+        swr = GetParamVals (m->switchRates, chain, state[chain]);
+        s01 = swr[0];
+        s10 = swr[1];
+        probOn = s01 / (s01 + s10);
+        for (b=0; b<n/2; b++)
             {
-            *(clP++) = (tiPL[0]*clL[0] + tiPL[1]*clL[1])
-                      *(tiPR[0]*clR[0] + tiPR[1]*clR[1]);
-            *(clP++) = (tiPL[2]*clL[0] + tiPL[3]*clL[1])
-                      *(tiPR[2]*clR[0] + tiPR[3]*clR[1]);
+            covBF[b] = bs[b] * probOn;
+            covBF[b+n/2] = bs[b] * (1.0 - probOn);
+            }
+        bs = covBF;
+        }
 
-            clL += 2;
-            clR += 2;
+    /* find category frequencies */
+    if (m->numOmegaCats > 1)
+        omegaCatFreq = GetParamSubVals (m->omega, chain, state[chain]);
+    if (m->pInvar == NULL)
+        freq = 1.0 / m->numRateCats;
+    else
+        freq = (1.0 - *GetParamVals (m->pInvar, chain, state[chain])) / m->numRateCats;
+
+    /* the rest of the tree is clF divided by the contribution of the branch
+       under the old ti probs; combine it with the new ones */
+    for (k=0; k<m->numTiCats; k++)
+        {
+        if (omegaCatFreq != NULL)
+            freq = omegaCatFreq[k];
+        for (c=0; c<m->numChars; c++)
+            {
+            x = x1 = x2 = 0.0;
+            for (b=0; b<n; b++)
+                {
+                sum = 0.0;
+                for (i=0; i<n; i++)
+                    sum += tiP0[b*n+i] * clD[i];
+                if (sum == 0.0)
+                    continue;
+                r = bs[b] * clF[b] / sum;
+                sum = sum1 = sum2 = 0.0;
+                for (i=0; i<n; i++)
+                    {
+                    sum  += tiP [b*n+i] * clD[i];
+                    sum1 += tiP1[b*n+i] * clD[i];
+                    sum2 += tiP2[b*n+i] * clD[i];
+                    }
+                x  += r * sum;
+                x1 += r * sum1;
+                x2 += r * sum2;
+                }
+            like [c] += freq * x;
+            like1[c] += freq * x1;
+            like2[c] += freq * x2;
+            clF += n;
+            clD += n;
             }
-        tiPL += 4;
-        tiPR += 4;
+        tiP0 += nStatesSquared;
+        tiP  += nStatesSquared;
+        tiP1 += nStatesSquared;
+        tiP2 += nStatesSquared;
         }
 
-    return NO_ERROR;
-    
+    return BrlenDerivsSum (m, chain, bs, like, lnL, d1, d2);
 }
-#endif
 
 
-#if defined (SSE_ENABLED)
 /*----------------------------------------------------------------
 |
-|   CondLikeDown_Bin_SSE: binary model with or without rate
-|       variation
+|   BrlenDerivs_NUC4: log likelihood and its first and second
+|       derivatives with respect to the length of the branch below
+|       p, 4by4 nucleotide model with or without rate variation
 |
 -----------------------------------------------------------------*/
-int CondLikeDown_Bin_SSE (TreeNode *p, int division, int chain)
+int BrlenDerivs_NUC4 (TreeNode *p, int division, int chain, MrBFlt *lnL, MrBFlt *d1, MrBFlt *d2)
 {
-    int             c, k;
-    CLFlt           *pL, *pR, *tiPL, *tiPR;
-    __m128          *clL, *clR, *clP;
-    __m128          m1, m2, m3, m4, m5, m6;
+    int             b, c, k;
+    MrBFlt          *tiP, *tiP1, *tiP2, *like, *like1, *like2, *bs, freq, r[4], x, x1, x2;
+    CLFlt           *clF, *clD, *tiP0, sum;
     ModelInfo       *m;
-    
+
     m = &modelSettings[division];
 
-    /* flip state of node so that we are not overwriting old cond likes */
-    FlipCondLikeSpace (m, chain, p->index);
-    
-    /* find conditional likelihood pointers */
-    clL = (__m128 *) m->condLikes[m->condLikeIndex[chain][p->left->index ]];
-    clR = (__m128 *) m->condLikes[m->condLikeIndex[chain][p->right->index]];
-    clP = (__m128 *) m->condLikes[m->condLikeIndex[chain][p->index       ]];
-    
-    /* find transition probabilities */
-    pL = m->tiProbs[m->tiProbsIndex[chain][p->left->index ]];
-    pR = m->tiProbs[m->tiProbsIndex[chain][p->right->index]];
+    /* find the partials on either side of the branch */
+    if (p->anc->anc == NULL)
+        {
+        clF = m->condLikes[m->condLikeIndex[chain][p->index     ]];
+        clD = m->condLikes[m->condLikeIndex[chain][p->anc->index]];
+        }
+    else
+        {
+        clF = m->condLikes[m->condLikeScratchIndex[p->anc->index]];
+        clD = m->condLikes[m->condLikeIndex[chain][p->index     ]];
+        }
+    tiP0 = m->tiProbs[m->tiProbsIndex[chain][p->index]];
+
+    /* get scratch space and the ti probs and their derivatives at p->length */
+    tiP = (MrBFlt *) ScratchCalloc (3*m->tiProbLength + 3*m->numChars, sizeof (MrBFlt));
+    if (!tiP)
+        return (ERROR);
+    tiP1  = tiP + m->tiProbLength;
+    tiP2  = tiP1 + m->tiProbLength;
+    like  = tiP2 + m->tiProbLength;
+    like1 = like + m->numChars;
+    like2 = like1 + m->numChars;
+    if (TiProbsDerivs (p, division, chain, tiP, tiP1, tiP2) == ERROR)
+        return (ERROR);
+
+    bs = GetParamSubVals (m->stateFreq, chain, state[chain]);
+    if (m->pInvar == NULL)
+        freq = 1.0 / m->numRateCats;
+    else
+        freq = (1.0 - *GetParamVals (m->pInvar, chain, state[chain])) / m->numRateCats;
 
-    tiPL = pL;
-    tiPR = pR;
     for (k=0; k<m->numRateCats; k++)
         {
-        for (c=0; c<m->numVecChars; c++)
+        for (c=0; c<m->numChars; c++)
             {
-            m1 = _mm_load1_ps (&tiPL[0]);
-            m2 = _mm_load1_ps (&tiPR[0]);
-            m5 = _mm_mul_ps (m1, clL[0]);
-            m6 = _mm_mul_ps (m2, clR[0]);
+            for (b=0; b<4; b++)
+                {
+                sum = tiP0[4*b+A]*clD[A] + tiP0[4*b+C]*clD[C] + tiP0[4*b+G]*clD[G] + tiP0[4*b+T]*clD[T];
+                if (sum == 0.0)
+                    r[b] = 0.0;
+                else
+                    r[b] = bs[b] * clF[b] / sum;
+                }
+            x  = r[A] * (tiP [AA]*clD[A] + tiP [AC]*clD[C] + tiP [AG]*clD[G] + tiP [AT]*clD[T])
+               + r[C] * (tiP [CA]*clD[A] + tiP [CC]*clD[C] + tiP [CG]*clD[G] + tiP [CT]*clD[T])
+               + r[G] * (tiP [GA]*clD[A] + tiP [GC]*clD[C] + tiP [GG]*clD[G] + tiP [GT]*clD[T])
+               + r[T] * (tiP [TA]*clD[A] + tiP [TC]*clD[C] + tiP [TG]*clD[G] + tiP [TT]*clD[T]);
+            x1 = r[A] * (tiP1[AA]*clD[A] + tiP1[AC]*clD[C] + tiP1[AG]*clD[G] + tiP1[AT]*clD[T])
+               + r[C] * (tiP1[CA]*clD[A] + tiP1[CC]*clD[C] + tiP1[CG]*clD[G] + tiP1[CT]*clD[T])
+               + r[G] * (tiP1[GA]*clD[A] + tiP1[GC]*clD[C] + tiP1[GG]*clD[G] + tiP1[GT]*clD[T])
+               + r[T] * (tiP1[TA]*clD[A] + tiP1[TC]*clD[C] + tiP1[TG]*clD[G] + tiP1[TT]*clD[T]);
+            x2 = r[A] * (tiP2[AA]*clD[A] + tiP2[AC]*clD[C] + tiP2[AG]*clD[G] + tiP2[AT]*clD[T])
+               + r[C] * (tiP2[CA]*clD[A] + tiP2[CC]*clD[C] + tiP2[CG]*clD[G] + tiP2[CT]*clD[T])
+               + r[G] * (tiP2[GA]*clD[A] + tiP2[GC]*clD[C] + tiP2[GG]*clD[G] + tiP2[GT]*clD[T])
+               + r[T] * (tiP2[TA]*clD[A] + tiP2[TC]*clD[C] + tiP2[TG]*clD[G] + tiP2[TT]*clD[T]);
+            like [c] += freq * x;
+            like1[c] += freq * x1;
+            like2[c] += freq * x2;
+            clF += 4;
+            clD += 4;
+            }
+        tiP0 += 16;
+        tiP  += 16;
+        tiP1 += 16;
+        tiP2 += 16;
+        }
+
+    return BrlenDerivsSum (m, chain, bs, like, lnL, d1, d2);
+}
 
-            m1 = _mm_load1_ps (&tiPL[1]);
-            m2 = _mm_load1_ps (&tiPR[1]);
-            m3 = _mm_mul_ps (m1, clL[1]);
-            m4 = _mm_mul_ps (m2, clR[1]);
 
-            m5 = _mm_add_ps (m3, m5);
-            m6 = _mm_add_ps (m4, m6);
+/*----------------------------------------------------------------
+|
+|   BrlenDerivs_Std: log likelihood and its first and second
+|       derivatives with respect to the length of the branch below
+|       p, standard model with equal or unequal state frequencies
+|
+-----------------------------------------------------------------*/
+int BrlenDerivs_Std (TreeNode *p, int division, int chain, MrBFlt *lnL, MrBFlt *d1, MrBFlt *d2)
+{
+    int             b, c, i, j, k, nStates, nCats, offset;
+    MrBFlt          *tiP, *tiP1, *tiP2, *like, *like1, *like2, *bs, *bsBase, freq, catFreq, r, sum, sum1, sum2, x, x1, x2;
+    CLFlt           *clF, *clD, *tiP0, *tiPBase;
+    ModelInfo       *m;
 
-            *clP++ = _mm_mul_ps (m5, m6);
+    m = &modelSettings[division];
 
-            m1 = _mm_load1_ps (&tiPL[2]);
-            m2 = _mm_load1_ps (&tiPR[2]);
-            m5 = _mm_mul_ps (m1, clL[0]);
-            m6 = _mm_mul_ps (m2, clR[0]);
+    /* find the partials on either side of the branch */
+    if (p->anc->anc == NULL)
+        {
+        clF = m->condLikes[m->condLikeIndex[chain][p->index     ]];
+        clD = m->condLikes[m->condLikeIndex[chain][p->anc->index]];
+        }
+    else
+        {
+        clF = m->condLikes[m->condLikeScratchIndex[p->anc->index]];
+        clD = m->condLikes[m->condLikeIndex[chain][p->index     ]];
+        }
+    tiPBase = m->tiProbs[m->tiProbsIndex[chain][p->index]];
 
-            m1 = _mm_load1_ps (&tiPL[3]);
-            m2 = _mm_load1_ps (&tiPR[3]);
-            m3 = _mm_mul_ps (m1, clL[1]);
-            m4 = _mm_mul_ps (m2, clR[1]);
+    /* get scratch space and the ti probs and their derivatives at p->length */
+    tiP = (MrBFlt *) ScratchCalloc (3*m->tiProbLength + 3*m->numChars, sizeof (MrBFlt));
+    if (!tiP)
+        return (ERROR);
+    tiP1  = tiP + m->tiProbLength;
+    tiP2  = tiP1 + m->tiProbLength;
+    like  = tiP2 + m->tiProbLength;
+    like1 = like + m->numChars;
+    like2 = like1 + m->numChars;
+    if (TiProbsDerivs (p, division, chain, tiP, tiP1, tiP2) == ERROR)
+        return (ERROR);
 
-            m5 = _mm_add_ps (m3, m5);
-            m6 = _mm_add_ps (m4, m6);
-           
-            *clP++ = _mm_mul_ps (m5, m6);
-            clL += 2;
-            clR += 2;
+    bsBase = GetParamStdStateFreqs (m->stateFreq, chain, state[chain]);
+    freq = 1.0 / m->numRateCats;
+
+    /* cond likes are in numRateCats blocks, with the beta categories of a
+       binary character next to each other; the ti probs of a character are
+       found at tiIndex, with one matrix for each rate category and, for
+       binary characters, the rate categories of each beta category in turn */
+    for (k=0; k<m->numRateCats; k++)
+        {
+        for (c=0; c<m->numChars; c++)
+            {
+            nStates = m->nStates[c];
+            if (nStates == 2)
+                nCats = m->numBetaCats;
+            else
+                nCats = 1;
+            catFreq = freq / nCats;
+            bs = bsBase + m->bsIndex[c];
+            for (j=0; j<nCats; j++)
+                {
+                offset = m->tiIndex[c] + (j*m->numRateCats + k)*nStates*nStates;
+                tiP0 = tiPBase + offset;
+                x = x1 = x2 = 0.0;
+                for (b=0; b<nStates; b++)
+                    {
+                    sum = 0.0;
+                    for (i=0; i<nStates; i++)
+                        sum += tiP0[b*nStates+i] * clD[i];
+                    if (sum == 0.0)
+                        continue;
+                    r = bs[b] * clF[b] / sum;
+                    sum = sum1 = sum2 = 0.0;
+                    for (i=0; i<nStates; i++)
+                        {
+                        sum  += tiP [offset+b*nStates+i] * clD[i];
+                        sum1 += tiP1[offset+b*nStates+i] * clD[i];
+                        sum2 += tiP2[offset+b*nStates+i] * clD[i];
+                        }
+                    x  += r * sum;
+                    x1 += r * sum1;
+                    x2 += r * sum2;
+                    }
+                like [c] += catFreq * x;
+                like1[c] += catFreq * x1;
+                like2[c] += catFreq * x2;
+                bs  += nStates;
+                clF += nStates;
+                clD += nStates;
+                }
             }
-        tiPL += 4;
-        tiPR += 4;
         }
 
-    return NO_ERROR;
+    return BrlenDerivsSum (m, chain, NULL, like, lnL, d1, d2);
 }
-#endif
 
 
+#if defined (AVX_ENABLED)
 /*----------------------------------------------------------------
 |
-|   CondLikeDown_Gen: general n-state model with or without rate
-|       variation
+|   BrlenDerivs_Vec_AVX: log likelihood and its first and second
+|       derivatives with respect to the length of the branch below
+|       p, any model using the AVX cond like layout, in which each
+|       vector holds one state of eight characters. As in
+|       BrlenDerivs_Vec_SSE, the sums with the double precision ti
+|       probs are done four characters at a time.
 |
 -----------------------------------------------------------------*/
-int CondLikeDown_Gen (TreeNode *p, int division, int chain)
+int BrlenDerivs_Vec_AVX (TreeNode *p, int division, int chain, MrBFlt *lnL, MrBFlt *d1, MrBFlt *d2)
 {
-    int             a, b, c, h, i, k, j, shortCut, *lState=NULL, *rState=NULL,
-                    nObsStates, nStates, nStatesSquared, preLikeJump;
-    CLFlt           likeL, likeR, *pL, *pR, *tiPL, *tiPR, *clL, *clR, *clP;
+    int             b, c, i, k, l, n, nStatesSquared;
+    MrBFlt          *tiP, *tiP1, *tiP2, *like, *like1, *like2, *bs, covBF[40], s01, s10, probOn, *swr,
+                    *omegaCatFreq=NULL, freq, x[8], x1[8], x2[8];
+    CLFlt           *tiP0;
+    __m256          *clF, *clD, mSum;
+    __m256d         mClDLo[64], mClDHi[64], mTi, mTi1, mTi2, mZero, mRLo, mRHi, mSumLo, mSumHi, mSum1Lo, mSum1Hi,
+                    mSum2Lo, mSum2Hi, mXLo, mXHi, mX1Lo, mX1Hi, mX2Lo, mX2Hi;
     ModelInfo       *m;
-#   if !defined (DEBUG_NOSHORTCUTS)
-    int catStart;
-#   endif
-    
-    /* find model settings for this division and nStates, nStatesSquared */
+
     m = &modelSettings[division];
-    nObsStates = m->numStates;
-    nStates = m->numModelStates;
-    nStatesSquared = nStates * nStates;
-    preLikeJump = nObsStates * nStates;
+    n = m->numModelStates;
+    nStatesSquared = n * n;
 
-    /* flip conditional likelihood space */
-    FlipCondLikeSpace (m, chain, p->index);
-    
-    /* find conditional likelihood pointers */
-    clL = m->condLikes[m->condLikeIndex[chain][p->left->index ]];
-    clR = m->condLikes[m->condLikeIndex[chain][p->right->index]];
-    clP = m->condLikes[m->condLikeIndex[chain][p->index       ]];
-    
-    /* find transition probabilities */
-    pL = m->tiProbs[m->tiProbsIndex[chain][p->left->index ]];
-    pR = m->tiProbs[m->tiProbsIndex[chain][p->right->index]];
+    /* find the partials on either side of the branch */
+    if (p->anc->anc == NULL)
+        {
+        clF = (__m256 *) m->condLikes[m->condLikeIndex[chain][p->index     ]];
+        clD = (__m256 *) m->condLikes[m->condLikeIndex[chain][p->anc->index]];
+        }
+    else
+        {
+        clF = (__m256 *) m->condLikes[m->condLikeScratchIndex[p->anc->index]];
+        clD = (__m256 *) m->condLikes[m->condLikeIndex[chain][p->index     ]];
+        }
+    tiP0 = m->tiProbs[m->tiProbsIndex[chain][p->index]];
 
-    /* find likelihoods of site patterns for left branch if terminal */
-    shortCut = 0;
-#   if !defined (DEBUG_NOSHORTCUTS)
-    if (p->left->left == NULL && m->isPartAmbig[p->left->index] == NO)
+    /* get scratch space and the ti probs and their derivatives at p->length */
+    tiP = (MrBFlt *) ScratchCalloc (3*m->tiProbLength + 3*m->numChars, sizeof (MrBFlt));
+    if (!tiP)
+        return (ERROR);
+    tiP1  = tiP + m->tiProbLength;
+    tiP2  = tiP1 + m->tiProbLength;
+    like  = tiP2 + m->tiProbLength;
+    like1 = like + m->numChars;
+    like2 = like1 + m->numChars;
+    if (TiProbsDerivs (p, division, chain, tiP, tiP1, tiP2) == ERROR)
+        return (ERROR);
+
+    /* find base frequencies, adjusted for the covarion model */
+    bs = GetParamSubVals (m->stateFreq, chain, state[chain]);
+    if (m->switchRates != NULL)
         {
-        shortCut |= 1;
-        lState = m->termState[p->left->index];
-        tiPL = pL;
-        for (k=a=0; k<m->numRateCats; k++)
+        swr = GetParamVals (m->switchRates, chain, state[chain]);
+        s01 = swr[0];
+        s10 = swr[1];
+        probOn = s01 / (s01 + s10);
+        for (b=0; b<n/2; b++)
             {
-            catStart = a;
-            for (i=0; i<nObsStates; i++)
-                for (j=i; j<nStatesSquared; j+=nStates)
-                    preLikeL[a++] = tiPL[j];
-            for (b=1; b<nStates/nObsStates; b++)
-                {
-                a = catStart;
-                for (i=0; i<nObsStates; i++)
-                    {
-                    for (j=i+b*nObsStates; j<nStatesSquared; j+=nStates)
-                        preLikeL[a++] += tiPL[j];
-                    }
-                }
-            /* for ambiguous */
-            for (i=0; i<nStates; i++)
-                preLikeL[a++] = 1.0;
-            tiPL += nStatesSquared;
+            covBF[b] = bs[b] * probOn;
+            covBF[b+n/2] = bs[b] * (1.0 - probOn);
             }
+        bs = covBF;
         }
 
-    /* find likelihoods of site patterns for right branch if terminal */
-    if (p->right->left == NULL && m->isPartAmbig[p->right->index] == NO)
+    /* find category frequencies */
+    if (m->numOmegaCats > 1)
+        omegaCatFreq = GetParamSubVals (m->omega, chain, state[chain]);
+    if (m->pInvar == NULL)
+        freq = 1.0 / m->numRateCats;
+    else
+        freq = (1.0 - *GetParamVals (m->pInvar, chain, state[chain])) / m->numRateCats;
+
+    mZero = _mm256_setzero_pd ();
+    for (k=0; k<m->numTiCats; k++)
         {
-        shortCut |= 2;
-        rState = m->termState[p->right->index];
-        tiPR = pR;
-        for (k=a=0; k<m->numRateCats; k++)
+        if (omegaCatFreq != NULL)
+            freq = omegaCatFreq[k];
+        for (c=0; c<m->numVecChars; c++)
             {
-            catStart = a;
-            for (i=0; i<nObsStates; i++)
+            for (i=0; i<n; i++)
+                {
+                mClDLo[i] = _mm256_cvtps_pd (_mm256_castps256_ps128 (clD[i]));
+                mClDHi[i] = _mm256_cvtps_pd (_mm256_extractf128_ps (clD[i], 1));
+                }
+            mXLo = mXHi = mX1Lo = mX1Hi = mX2Lo = mX2Hi = mZero;
+            for (b=0; b<n; b++)
+                {
+                /* r = bs[b] * clF[b] / sum, or 0.0 if the old ti probs give a sum of 0.0 */
+                mSum = _mm256_setzero_ps ();
+                for (i=0; i<n; i++)
+                    mSum = _mm256_add_ps (mSum, _mm256_mul_ps (_mm256_set1_ps (tiP0[b*n+i]), clD[i]));
+                mSumLo = _mm256_cvtps_pd (_mm256_castps256_ps128 (mSum));
+                mSumHi = _mm256_cvtps_pd (_mm256_extractf128_ps (mSum, 1));
+                mRLo = _mm256_mul_pd (_mm256_set1_pd (bs[b]), _mm256_cvtps_pd (_mm256_castps256_ps128 (clF[b])));
+                mRHi = _mm256_mul_pd (_mm256_set1_pd (bs[b]), _mm256_cvtps_pd (_mm256_extractf128_ps (clF[b], 1)));
+                mRLo = _mm256_and_pd (_mm256_div_pd (mRLo, mSumLo), _mm256_cmp_pd (mSumLo, mZero, _CMP_NEQ_OQ));
+                mRHi = _mm256_and_pd (_mm256_div_pd (mRHi, mSumHi), _mm256_cmp_pd (mSumHi, mZero, _CMP_NEQ_OQ));
+
+                /* the same sum and its derivatives under the ti probs at p->length */
+                mSumLo = mSumHi = mSum1Lo = mSum1Hi = mSum2Lo = mSum2Hi = mZero;
+                for (i=0; i<n; i++)
+                    {
+                    mTi  = _mm256_set1_pd (tiP [b*n+i]);
+                    mTi1 = _mm256_set1_pd (tiP1[b*n+i]);
+                    mTi2 = _mm256_set1_pd (tiP2[b*n+i]);
+                    mSumLo  = _mm256_add_pd (mSumLo,  _mm256_mul_pd (mTi,  mClDLo[i]));
+                    mSumHi  = _mm256_add_pd (mSumHi,  _mm256_mul_pd (mTi,  mClDHi[i]));
+                    mSum1Lo = _mm256_add_pd (mSum1Lo, _mm256_mul_pd (mTi1, mClDLo[i]));
+                    mSum1Hi = _mm256_add_pd (mSum1Hi, _mm256_mul_pd (mTi1, mClDHi[i]));
+                    mSum2Lo = _mm256_add_pd (mSum2Lo, _mm256_mul_pd (mTi2, mClDLo[i]));
+                    mSum2Hi = _mm256_add_pd (mSum2Hi, _mm256_mul_pd (mTi2, mClDHi[i]));
+                    }
+                mXLo  = _mm256_add_pd (mXLo,  _mm256_mul_pd (mRLo, mSumLo));
+                mXHi  = _mm256_add_pd (mXHi,  _mm256_mul_pd (mRHi, mSumHi));
+                mX1Lo = _mm256_add_pd (mX1Lo, _mm256_mul_pd (mRLo, mSum1Lo));
+                mX1Hi = _mm256_add_pd (mX1Hi, _mm256_mul_pd (mRHi, mSum1Hi));
+                mX2Lo = _mm256_add_pd (mX2Lo, _mm256_mul_pd (mRLo, mSum2Lo));
+                mX2Hi = _mm256_add_pd (mX2Hi, _mm256_mul_pd (mRHi, mSum2Hi));
+                }
+            _mm256_storeu_pd (x,    mXLo);
+            _mm256_storeu_pd (x+4,  mXHi);
+            _mm256_storeu_pd (x1,   mX1Lo);
+            _mm256_storeu_pd (x1+4, mX1Hi);
+            _mm256_storeu_pd (x2,   mX2Lo);
+            _mm256_storeu_pd (x2+4, mX2Hi);
+
+            /* the last vector may be padded beyond the real characters */
+            for (l=0; l<8 && 8*c+l<m->numChars; l++)
+                {
+                like [8*c+l] += freq * x [l];
+                like1[8*c+l] += freq * x1[l];
+                like2[8*c+l] += freq * x2[l];
+                }
+            clF += n;
+            clD += n;
+            }
+        tiP0 += nStatesSquared;
+        tiP  += nStatesSquared;
+        tiP1 += nStatesSquared;
+        tiP2 += nStatesSquared;
+        }
+
+    return BrlenDerivsSum (m, chain, bs, like, lnL, d1, d2);
+}
+#endif
+
+
+#if defined (SSE_ENABLED)
+/*----------------------------------------------------------------
+|
+|   BrlenDerivs_Vec_SSE: log likelihood and its first and second
+|       derivatives with respect to the length of the branch below
+|       p, any model using the SSE cond like layout, in which each
+|       vector holds one state of four characters (NUC4, general
+|       n-state, covarion and NY98 models). The ti probs and their
+|       derivatives are in double precision, so the sums with them
+|       are done two characters at a time in double vectors.
+|
+-----------------------------------------------------------------*/
+int BrlenDerivs_Vec_SSE (TreeNode *p, int division, int chain, MrBFlt *lnL, MrBFlt *d1, MrBFlt *d2)
+{
+    int             b, c, i, k, l, n, nStatesSquared;
+    MrBFlt          *tiP, *tiP1, *tiP2, *like, *like1, *like2, *bs, covBF[40], s01, s10, probOn, *swr,
+                    *omegaCatFreq=NULL, freq, x[4], x1[4], x2[4];
+    CLFlt           *tiP0;
+    __m128          *clF, *clD, mSum;
+    __m128d         mClDLo[64], mClDHi[64], mTi, mTi1, mTi2, mZero, mRLo, mRHi, mSumLo, mSumHi, mSum1Lo, mSum1Hi,
+                    mSum2Lo, mSum2Hi, mXLo, mXHi, mX1Lo, mX1Hi, mX2Lo, mX2Hi;
+    ModelInfo       *m;
+
+    m = &modelSettings[division];
+    n = m->numModelStates;
+    nStatesSquared = n * n;
+
+    /* find the partials on either side of the branch */
+    if (p->anc->anc == NULL)
+        {
+        clF = (__m128 *) m->condLikes[m->condLikeIndex[chain][p->index     ]];
+        clD = (__m128 *) m->condLikes[m->condLikeIndex[chain][p->anc->index]];
+        }
+    else
+        {
+        clF = (__m128 *) m->condLikes[m->condLikeScratchIndex[p->anc->index]];
+        clD = (__m128 *) m->condLikes[m->condLikeIndex[chain][p->index     ]];
+        }
+    tiP0 = m->tiProbs[m->tiProbsIndex[chain][p->index]];
+
+    /* get scratch space and the ti probs and their derivatives at p->length */
+    tiP = (MrBFlt *) ScratchCalloc (3*m->tiProbLength + 3*m->numChars, sizeof (MrBFlt));
+    if (!tiP)
+        return (ERROR);
+    tiP1  = tiP + m->tiProbLength;
+    tiP2  = tiP1 + m->tiProbLength;
+    like  = tiP2 + m->tiProbLength;
+    like1 = like + m->numChars;
+    like2 = like1 + m->numChars;
+    if (TiProbsDerivs (p, division, chain, tiP, tiP1, tiP2) == ERROR)
+        return (ERROR);
+
+    /* find base frequencies, adjusted for the covarion model */
+    bs = GetParamSubVals (m->stateFreq, chain, state[chain]);
+    if (m->switchRates != NULL)
+        {
+        swr = GetParamVals (m->switchRates, chain, state[chain]);
+        s01 = swr[0];
+        s10 = swr[1];
+        probOn = s01 / (s01 + s10);
+        for (b=0; b<n/2; b++)
+            {
+            covBF[b] = bs[b] * probOn;
+            covBF[b+n/2] = bs[b] * (1.0 - probOn);
+            }
+        bs = covBF;
+        }
+
+    /* find category frequencies */
+    if (m->numOmegaCats > 1)
+        omegaCatFreq = GetParamSubVals (m->omega, chain, state[chain]);
+    if (m->pInvar == NULL)
+        freq = 1.0 / m->numRateCats;
+    else
+        freq = (1.0 - *GetParamVals (m->pInvar, chain, state[chain])) / m->numRateCats;
+
+    mZero = _mm_setzero_pd ();
+    for (k=0; k<m->numTiCats; k++)
+        {
+        if (omegaCatFreq != NULL)
+            freq = omegaCatFreq[k];
+        for (c=0; c<m->numVecChars; c++)
+            {
+            for (i=0; i<n; i++)
+                {
+                mClDLo[i] = _mm_cvtps_pd (clD[i]);
+                mClDHi[i] = _mm_cvtps_pd (_mm_movehl_ps (clD[i], clD[i]));
+                }
+            mXLo = mXHi = mX1Lo = mX1Hi = mX2Lo = mX2Hi = mZero;
+            for (b=0; b<n; b++)
+                {
+                /* r = bs[b] * clF[b] / sum, or 0.0 if the old ti probs give a sum of 0.0 */
+                mSum = _mm_setzero_ps ();
+                for (i=0; i<n; i++)
+                    mSum = _mm_add_ps (mSum, _mm_mul_ps (_mm_set1_ps (tiP0[b*n+i]), clD[i]));
+                mSumLo = _mm_cvtps_pd (mSum);
+                mSumHi = _mm_cvtps_pd (_mm_movehl_ps (mSum, mSum));
+                mRLo = _mm_mul_pd (_mm_set1_pd (bs[b]), _mm_cvtps_pd (clF[b]));
+                mRHi = _mm_mul_pd (_mm_set1_pd (bs[b]), _mm_cvtps_pd (_mm_movehl_ps (clF[b], clF[b])));
+                mRLo = _mm_and_pd (_mm_div_pd (mRLo, mSumLo), _mm_cmpneq_pd (mSumLo, mZero));
+                mRHi = _mm_and_pd (_mm_div_pd (mRHi, mSumHi), _mm_cmpneq_pd (mSumHi, mZero));
+
+                /* the same sum and its derivatives under the ti probs at p->length */
+                mSumLo = mSumHi = mSum1Lo = mSum1Hi = mSum2Lo = mSum2Hi = mZero;
+                for (i=0; i<n; i++)
+                    {
+                    mTi  = _mm_set1_pd (tiP [b*n+i]);
+                    mTi1 = _mm_set1_pd (tiP1[b*n+i]);
+                    mTi2 = _mm_set1_pd (tiP2[b*n+i]);
+                    mSumLo  = _mm_add_pd (mSumLo,  _mm_mul_pd (mTi,  mClDLo[i]));
+                    mSumHi  = _mm_add_pd (mSumHi,  _mm_mul_pd (mTi,  mClDHi[i]));
+                    mSum1Lo = _mm_add_pd (mSum1Lo, _mm_mul_pd (mTi1, mClDLo[i]));
+                    mSum1Hi = _mm_add_pd (mSum1Hi, _mm_mul_pd (mTi1, mClDHi[i]));
+                    mSum2Lo = _mm_add_pd (mSum2Lo, _mm_mul_pd (mTi2, mClDLo[i]));
+                    mSum2Hi = _mm_add_pd (mSum2Hi, _mm_mul_pd (mTi2, mClDHi[i]));
+                    }
+                mXLo  = _mm_add_pd (mXLo,  _mm_mul_pd (mRLo, mSumLo));
+                mXHi  = _mm_add_pd (mXHi,  _mm_mul_pd (mRHi, mSumHi));
+                mX1Lo = _mm_add_pd (mX1Lo, _mm_mul_pd (mRLo, mSum1Lo));
+                mX1Hi = _mm_add_pd (mX1Hi, _mm_mul_pd (mRHi, mSum1Hi));
+                mX2Lo = _mm_add_pd (mX2Lo, _mm_mul_pd (mRLo, mSum2Lo));
+                mX2Hi = _mm_add_pd (mX2Hi, _mm_mul_pd (mRHi, mSum2Hi));
+                }
+            _mm_storeu_pd (x,    mXLo);
+            _mm_storeu_pd (x+2,  mXHi);
+            _mm_storeu_pd (x1,   mX1Lo);
+            _mm_storeu_pd (x1+2, mX1Hi);
+            _mm_storeu_pd (x2,   mX2Lo);
+            _mm_storeu_pd (x2+2, mX2Hi);
+
+            /* the last vector may be padded beyond the real characters */
+            for (l=0; l<4 && 4*c+l<m->numChars; l++)
+                {
+                like [4*c+l] += freq * x [l];
+                like1[4*c+l] += freq * x1[l];
+                like2[4*c+l] += freq * x2[l];
+                }
+            clF += n;
+            clD += n;
+            }
+        tiP0 += nStatesSquared;
+        tiP  += nStatesSquared;
+        tiP1 += nStatesSquared;
+        tiP2 += nStatesSquared;
+        }
+
+    return BrlenDerivsSum (m, chain, bs, like, lnL, d1, d2);
+}
+#endif
+
+
+/*----------------------------------------------------------------
+|
+|   BrlenDerivsSum: sum the site likelihoods and their derivatives
+|       (the numChars values in like are followed by the first and
+|       the second derivatives) into the log likelihood and its
+|       derivatives, taking the invariable sites and the correction
+|       for unobserved characters into account. bs is only needed
+|       for the invariable sites model, whose cond likes are in the
+|       SIMD layout of the partition, if any.
+|
+-----------------------------------------------------------------*/
+int BrlenDerivsSum (ModelInfo *m, int chain, MrBFlt *bs, MrBFlt *like, MrBFlt *lnL, MrBFlt *d1, MrBFlt *d2)
+{
+    int             c, f, j, n;
+    MrBFlt          *like1, *like2, pInvar=0.0, likeI, x, x1, x2, pUnobserved, pUnobserved1, pUnobserved2, pObserved, scaler;
+    CLFlt           *lnScaler, *nSitesOfPat, *clInvar=NULL;
+
+    n = m->numModelStates;
+    like1 = like + m->numChars;
+    like2 = like1 + m->numChars;
+
+    /* number of characters sharing each vector of invariable cond likes */
+    f = 1;
+#   if defined (SSE_ENABLED)
+    if (m->useVec != VEC_NONE)
+        f = m->numFloatsPerVec;
+#   endif
+
+    lnScaler = m->scalers[m->siteScalerIndex[chain]];
+    nSitesOfPat = numSitesOfPat + ((chainId[chain] % chainParams.numChains)*numCompressedChars) + m->compCharStart;
+    if (m->pInvar != NULL)
+        {
+        pInvar = *GetParamVals (m->pInvar, chain, state[chain]);
+        clInvar = m->invCondLikes;
+        }
+
+    *lnL = *d1 = *d2 = 0.0;
+
+    /* probability of unobserved characters and its derivatives */
+    pUnobserved = pUnobserved1 = pUnobserved2 = 0.0;
+    for (c=0; c<m->numDummyChars; c++)
+        {
+        scaler = exp (lnScaler[c]);
+        pUnobserved  += like [c] * scaler;
+        pUnobserved1 += like1[c] * scaler;
+        pUnobserved2 += like2[c] * scaler;
+        }
+
+    for (c=m->numDummyChars; c<m->numChars; c++)
+        {
+        x  = like [c];
+        x1 = like1[c];
+        x2 = like2[c];
+        if (m->pInvar != NULL)
+            {
+            /* add the invariable category as in Likelihood_Gen */
+            likeI = 0.0;
+            for (j=0; j<n; j++)
+                likeI += clInvar[(c/f)*n*f + j*f + c%f] * bs[j] * pInvar;
+            if (lnScaler[c] < -200.0)
+                {
+                if (likeI > 1E-70)
+                    {
+                    /* the branch does not matter for this site */
+                    *lnL += log (likeI) * nSitesOfPat[c];
+                    continue;
+                    }
+                }
+            else
+                x += likeI / exp (lnScaler[c]);
+            }
+        if (x < LIKE_EPSILON)
+            {
+            /* this branch length is not possible; let the caller back off */
+            *lnL = MRBFLT_NEG_MAX;
+            *d1 = *d2 = 0.0;
+            return (NO_ERROR);
+            }
+        x1 /= x;
+        x2 /= x;
+        *lnL += (lnScaler[c] + log (x)) * nSitesOfPat[c];
+        *d1  += x1 * nSitesOfPat[c];
+        *d2  += (x2 - x1 * x1) * nSitesOfPat[c];
+        }
+
+    /* correct for unobserved characters */
+    if (m->numDummyChars > 0)
+        {
+        pObserved = 1.0 - pUnobserved;
+        if (pObserved < LIKE_EPSILON)
+            {
+            pObserved = LIKE_EPSILON;
+            pUnobserved1 = pUnobserved2 = 0.0;
+            }
+        *lnL -= log (pObserved) * m->numUncompressedChars;
+        *d1  += pUnobserved1 / pObserved * m->numUncompressedChars;
+        *d2  += (pUnobserved2 / pObserved + (pUnobserved1 / pObserved) * (pUnobserved1 / pObserved)) * m->numUncompressedChars;
+        }
+
+    return (NO_ERROR);
+}
+
+#if !defined (SSE_ENABLED) || 1
+/*----------------------------------------------------------------
+|
+|   CondLikeDown_Bin: binary model with or without rate
+|       variation
+|
+-----------------------------------------------------------------*/
+int CondLikeDown_Bin (TreeNode *p, int division, int chain)
+{
+    int             c, k;
+    CLFlt           *clL, *clR, *clP, *pL, *pR, *tiPL, *tiPR;
+    ModelInfo       *m;
+    
+    /* find model settings for this division */
+    m = &modelSettings[division];
+
+    /* Flip conditional likelihood space */
+    FlipCondLikeSpace (m, chain, p->index);
+    
+    /* find conditional likelihood pointers */
+    clL = m->condLikes[m->condLikeIndex[chain][p->left->index ]];
+    clR = m->condLikes[m->condLikeIndex[chain][p->right->index]];
+    clP = m->condLikes[m->condLikeIndex[chain][p->index       ]];
+    
+    /* find transition probabilities */
+    pL = m->tiProbs[m->tiProbsIndex[chain][p->left->index ]];
+    pR = m->tiProbs[m->tiProbsIndex[chain][p->right->index]];
+
+    tiPL = pL;
+    tiPR = pR;
+    for (k=0; k<m->numRateCats; k++)
+        {
+        for (c=0; c<m->numChars; c++)
+            {
+            *(clP++) = (tiPL[0]*clL[0] + tiPL[1]*clL[1])
+                      *(tiPR[0]*clR[0] + tiPR[1]*clR[1]);
+            *(clP++) = (tiPL[2]*clL[0] + tiPL[3]*clL[1])
+                      *(tiPR[2]*clR[0] + tiPR[3]*clR[1]);
+
+            clL += 2;
+            clR += 2;
+            }
+        tiPL += 4;
+        tiPR += 4;
+        }
+
+    return NO_ERROR;
+    
+}
+#endif
+
+
+#if defined (SSE_ENABLED)
+/*----------------------------------------------------------------
+|
+|   CondLikeDown_Bin_SSE: binary model with or without rate
+|       variation
+|
+-----------------------------------------------------------------*/
+int CondLikeDown_Bin_SSE (TreeNode *p, int division, int chain)
+{
+    int             c, k;
+    CLFlt           *pL, *pR, *tiPL, *tiPR;
+    __m128          *clL, *clR, *clP;
+    __m128          m1, m2, m3, m4, m5, m6;
+    ModelInfo       *m;
+    
+    m = &modelSettings[division];
+
+    /* flip state of node so that we are not overwriting old cond likes */
+    FlipCondLikeSpace (m, chain, p->index);
+    
+    /* find conditional likelihood pointers */
+    clL = (__m128 *) m->condLikes[m->condLikeIndex[chain][p->left->index ]];
+    clR = (__m128 *) m->condLikes[m->condLikeIndex[chain][p->right->index]];
+    clP = (__m128 *) m->condLikes[m->condLikeIndex[chain][p->index       ]];
+    
+    /* find transition probabilities */
+    pL = m->tiProbs[m->tiProbsIndex[chain][p->left->index ]];
+    pR = m->tiProbs[m->tiProbsIndex[chain][p->right->index]];
+
+    tiPL = pL;
+    tiPR = pR;
+    for (k=0; k<m->numRateCats; k++)
+        {
+        for (c=0; c<m->numVecChars; c++)
+            {
+            m1 = _mm_load1_ps (&tiPL[0]);
+            m2 = _mm_load1_ps (&tiPR[0]);
+            m5 = _mm_mul_ps (m1, clL[0]);
+            m6 = _mm_mul_ps (m2, clR[0]);
+
+            m1 = _mm_load1_ps (&tiPL[1]);
+            m2 = _mm_load1_ps (&tiPR[1]);
+            m3 = _mm_mul_ps (m1, clL[1]);
+            m4 = _mm_mul_ps (m2, clR[1]);
+
+            m5 = _mm_add_ps (m3, m5);
+            m6 = _mm_add_ps (m4, m6);
+
+            *clP++ = _mm_mul_ps (m5, m6);
+
+            m1 = _mm_load1_ps (&tiPL[2]);
+            m2 = _mm_load1_ps (&tiPR[2]);
+            m5 = _mm_mul_ps (m1, clL[0]);
+            m6 = _mm_mul_ps (m2, clR[0]);
+
+            m1 = _mm_load1_ps (&tiPL[3]);
+            m2 = _mm_load1_ps (&tiPR[3]);
+            m3 = _mm_mul_ps (m1, clL[1]);
+            m4 = _mm_mul_ps (m2, clR[1]);
+
+            m5 = _mm_add_ps (m3, m5);
+            m6 = _mm_add_ps (m4, m6);
+           
+            *clP++ = _mm_mul_ps (m5, m6);
+            clL += 2;
+            clR += 2;
+            }
+        tiPL += 4;
+        tiPR += 4;
+        }
+
+    return NO_ERROR;
+}
+#endif
+
+
+/*----------------------------------------------------------------
+|
+|   CondLikeDown_Gen: general n-state model with or without rate
+|       variation
+|
+-----------------------------------------------------------------*/
+int CondLikeDown_Gen (TreeNode *p, int division, int chain)
+{
+    int             a, b, c, h, i, k, j, shortCut, *lState=NULL, *rState=NULL,
+                    nObsStates, nStates, nStatesSquared, preLikeJump;
+    CLFlt           likeL, likeR, *pL, *pR, *tiPL, *tiPR, *clL, *clR, *clP;
+    ModelInfo       *m;
+#   if !defined (DEBUG_NOSHORTCUTS)
+    int catStart;
+#   endif
+    
+    /* find model settings for this division and nStates, nStatesSquared */
+    m = &modelSettings[division];
+    nObsStates = m->numStates;
+    nStates = m->numModelStates;
+    nStatesSquared = nStates * nStates;
+    preLikeJump = nObsStates * nStates;
+
+    /* flip conditional likelihood space */
+    FlipCondLikeSpace (m, chain, p->index);
+    
+    /* find conditional likelihood pointers */
+    clL = m->condLikes[m->condLikeIndex[chain][p->left->index ]];
+    clR = m->condLikes[m->condLikeIndex[chain][p->right->index]];
+    clP = m->condLikes[m->condLikeIndex[chain][p->index       ]];
+    
+    /* find transition probabilities */
+    pL = m->tiProbs[m->tiProbsIndex[chain][p->left->index ]];
+    pR = m->tiProbs[m->tiProbsIndex[chain][p->right->index]];
+
+    /* find likelihoods of site patterns for left branch if terminal */
+    shortCut = 0;
+#   if !defined (DEBUG_NOSHORTCUTS)
+    if (p->left->left == NULL && m->isPartAmbig[p->left->index] == NO)
+        {
+        shortCut |= 1;
+        lState = m->termState[p->left->index];
+        tiPL = pL;
+        for (k=a=0; k<m->numRateCats; k++)
+            {
+            catStart = a;
+            for (i=0; i<nObsStates; i++)
+                for (j=i; j<nStatesSquared; j+=nStates)
+                    preLikeL[a++] = tiPL[j];
+            for (b=1; b<nStates/nObsStates; b++)
+                {
+                a = catStart;
+                for (i=0; i<nObsStates; i++)
+                    {
+                    for (j=i+b*nObsStates; j<nStatesSquared; j+=nStates)
+                        preLikeL[a++] += tiPL[j];
+                    }
+                }
+            /* for ambiguous */
+            for (i=0; i<nStates; i++)
+                preLikeL[a++] = 1.0;
+            tiPL += nStatesSquared;
+            }
+        }
+
+    /* find likelihoods of site patterns for right branch if terminal */
+    if (p->right->left == NULL && m->isPartAmbig[p->right->index] == NO)
+        {
+        shortCut |= 2;
+        rState = m->termState[p->right->index];
+        tiPR = pR;
+        for (k=a=0; k<m->numRateCats; k++)
+            {
+            catStart = a;
+            for (i=0; i<nObsStates; i++)
                 for (j=i; j<nStatesSquared; j+=nStates)
                     preLikeR[a++] = tiPR[j];
             for (b=1; b<nStates/nObsStates; b++)
@@ -512,104 +1226,299 @@ int CondLikeDown_Gen_SSE (TreeNode *p, int division, int chain)
                     clL += nStates;
                     clR += nStates;
                     }
-                tiPL += nStatesSquared;
-                tiPR += nStatesSquared;
+                tiPL += nStatesSquared;
+                tiPR += nStatesSquared;
+                }
+            break;
+        case 1:
+            tiPR = pR;
+            for (k=0; k<m->numRateCats; k++)
+                {
+                for (c=t=0; c<m->numVecChars; c++)
+                    {
+                    for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
+                        {
+                        preLikeLV[c1] = &preLikeL[lState[t] + k*(preLikeJump+nStates)];
+                        }
+                    for (i=h=0; i<nStates; i++)
+                        {
+                        mAcumL = _mm_set_ps (*(preLikeLV[3]++), *(preLikeLV[2]++), *(preLikeLV[1]++), *(preLikeLV[0]++));
+                        mAcumR = _mm_setzero_ps();
+                        for (j=0; j<nStates; j++)
+                            {
+                            mTiPR  = _mm_load1_ps (&tiPR[h++]);
+                            mR     = _mm_mul_ps (mTiPR, clR[j]);
+                            mAcumR = _mm_add_ps (mR, mAcumR);
+                            }
+                        *(clP++) = _mm_mul_ps (mAcumL,mAcumR);
+                        }
+                    clR += nStates;
+                    }
+                tiPR += nStatesSquared;
+                }
+            break;
+        case 2:
+            tiPL = pL;
+            for (k=0; k<m->numRateCats; k++)
+                {
+                for (c=t=0; c<m->numVecChars; c++)
+                    {
+                    for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
+                        {
+                        preLikeRV[c1] = &preLikeR[rState[t] + k*(preLikeJump+nStates)];
+                        }
+                    for (i=h=0; i<nStates; i++)
+                        {
+                        mAcumR = _mm_set_ps (*(preLikeRV[3]++), *(preLikeRV[2]++), *(preLikeRV[1]++), *(preLikeRV[0]++));
+                        mAcumL = _mm_setzero_ps();
+                        for (j=0; j<nStates; j++)
+                            {
+                            mTiPL  = _mm_load1_ps (&tiPL[h++]);
+                            mL     = _mm_mul_ps (mTiPL, clL[j]);
+                            mAcumL = _mm_add_ps (mL, mAcumL);
+                            }
+                        *(clP++) = _mm_mul_ps (mAcumL,mAcumR);
+                        }
+                    clL += nStates;
+                    }
+                tiPL += nStatesSquared;
+                }
+            break;
+        case 3:
+            for (k=0; k<m->numRateCats; k++)
+                {
+                for (c=t=0; c<m->numVecChars; c++)
+                    {
+                    for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
+                        {
+                        preLikeRV[c1] = &preLikeR[rState[t] + k*(preLikeJump+nStates)];
+                        preLikeLV[c1] = &preLikeL[lState[t] + k*(preLikeJump+nStates)];
+                        }
+                    for (i=0; i<nStates; i++)
+                        {
+                        assert (m->numFloatsPerVec == 4); /* In the following 2 statments we assume that SSE register can hold exactly 4 ClFlts. */
+                        mL = _mm_set_ps (*(preLikeLV[3]++), *(preLikeLV[2]++), *(preLikeLV[1]++), *(preLikeLV[0]++));
+                        mR = _mm_set_ps (*(preLikeRV[3]++), *(preLikeRV[2]++), *(preLikeRV[1]++), *(preLikeRV[0]++));
+                        *(clP++) = _mm_mul_ps (mL,mR);
+                        }
+                    }
+                }
+            break;
+        }
+    return NO_ERROR;
+}
+#endif
+
+
+/*----------------------------------------------------------------
+|
+|   CondLikeDown_Gen_GibbsGamma: general n-state model with rate
+|       variation modeled using discrete gamma with Gibbs resampling
+|
+-----------------------------------------------------------------*/
+int CondLikeDown_Gen_GibbsGamma (TreeNode *p, int division, int chain)
+{
+    int             a, b, c, i, j, r, *rateCat, shortCut, *lState=NULL, *rState=NULL,
+                    nObsStates, nStates, nStatesSquared, nGammaCats, preLikeJump;
+    CLFlt           likeL, likeR, *pL, *pR, *tiPL, *tiPR, *clL, *clR, *clP;
+    ModelInfo       *m;
+#   if !defined (DEBUG_NOSHORTCUTS)
+    int k, catStart;
+#   endif
+    
+    /* find model settings for this division and nStates, nStatesSquared */
+    m = &modelSettings[division];
+    nObsStates = m->numStates;
+    nStates = m->numModelStates;
+    nStatesSquared = nStates * nStates;
+    preLikeJump = nObsStates * nStates;
+
+    /* flip conditional likelihood space */
+    FlipCondLikeSpace (m, chain, p->index);
+    
+    /* find conditional likelihood pointers */
+    clL = m->condLikes[m->condLikeIndex[chain][p->left->index ]];
+    clR = m->condLikes[m->condLikeIndex[chain][p->right->index]];
+    clP = m->condLikes[m->condLikeIndex[chain][p->index       ]];
+    
+    /* find transition probabilities */
+    pL = m->tiProbs[m->tiProbsIndex[chain][p->left->index ]];
+    pR = m->tiProbs[m->tiProbsIndex[chain][p->right->index]];
+
+    /* find rate category index and number of gamma categories */
+    rateCat = m->tiIndex + chain * m->numChars;
+    nGammaCats = m->numRateCats;
+
+    /* find likelihoods of site patterns for left branch if terminal */
+    shortCut = 0;
+#   if !defined (DEBUG_NOSHORTCUTS)
+    if (p->left->left == NULL && m->isPartAmbig[p->left->index] == NO)
+        {
+        shortCut |= 1;
+        lState = m->termState[p->left->index];
+        tiPL = pL;
+        for (k=a=0; k<nGammaCats; k++)
+            {
+            catStart = a;
+            for (i=0; i<nObsStates; i++)
+                for (j=i; j<nStatesSquared; j+=nStates)
+                    preLikeL[a++] = tiPL[j];
+            for (b=1; b<nStates/nObsStates; b++)
+                {
+                a = catStart;
+                for (i=0; i<nObsStates; i++)
+                    {
+                    for (j=i+b*nObsStates; j<nStatesSquared; j+=nStates)
+                        preLikeL[a++] += tiPL[j];
+                    }
+                }
+            /* for ambiguous */
+            for (i=0; i<nStates; i++)
+                preLikeL[a++] = 1.0;
+            tiPL += nStatesSquared;
+            }
+        }
+
+    /* find likelihoods of site patterns for right branch if terminal */
+    if (p->right->left == NULL && m->isPartAmbig[p->right->index] == NO)
+        {
+        shortCut |= 2;
+        rState = m->termState[p->right->index];
+        tiPR = pR;
+        for (k=a=0; k<nGammaCats; k++)
+            {
+            catStart = a;
+            for (i=0; i<nObsStates; i++)
+                for (j=i; j<nStatesSquared; j+=nStates)
+                    preLikeR[a++] = tiPR[j];
+            for (b=1; b<nStates/nObsStates; b++)
+                {
+                a = catStart;
+                for (i=0; i<nObsStates; i++)
+                    {
+                    for (j=i+b*nObsStates; j<nStatesSquared; j+=nStates)
+                        preLikeR[a++] += tiPR[j];
+                    }
+                }
+            /* for ambiguous */
+            for (i=0; i<nStates; i++)
+                preLikeR[a++] = 1.0;
+            tiPR += nStatesSquared;
+            }
+        }
+#   endif
+
+    switch (shortCut)
+        {
+        case 0:
+            for (c=0; c<m->numChars; c++)
+                {
+                r = (*rateCat++);
+                if (r < nGammaCats)
+                    {
+                    tiPL = pL + r*nStatesSquared;
+                    tiPR = pR + r*nStatesSquared;
+                    for (i=0; i<nStates; i++)
+                        {
+                        likeL = likeR = 0.0;
+                        for (j=0; j<nStates; j++)
+                            {
+                            likeL += (*tiPL++) * clL[j];
+                            likeR += (*tiPR++) * clR[j];
+                            }
+                        *(clP++) = likeL * likeR;
+                        }
+                    }
+                else
+                    clP += nStates;
+                clL += nStates;
+                clR += nStates;
                 }
             break;
         case 1:
-            tiPR = pR;
-            for (k=0; k<m->numRateCats; k++)
+            for (c=0; c<m->numChars; c++)
                 {
-                for (c=t=0; c<m->numVecChars; c++)
+                r = (*rateCat++);
+                if (r < nGammaCats)
                     {
-                    for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
-                        {
-                        preLikeLV[c1] = &preLikeL[lState[t] + k*(preLikeJump+nStates)];
-                        }
-                    for (i=h=0; i<nStates; i++)
+                    tiPR = pR + r*nStatesSquared;
+                    a = lState[c] + r*(preLikeJump+nStates);
+                    for (i=0; i<nStates; i++)
                         {
-                        mAcumL = _mm_set_ps (*(preLikeLV[3]++), *(preLikeLV[2]++), *(preLikeLV[1]++), *(preLikeLV[0]++));
-                        mAcumR = _mm_setzero_ps();
+                        likeR = 0.0;
                         for (j=0; j<nStates; j++)
                             {
-                            mTiPR  = _mm_load1_ps (&tiPR[h++]);
-                            mR     = _mm_mul_ps (mTiPR, clR[j]);
-                            mAcumR = _mm_add_ps (mR, mAcumR);
+                            likeR += (*tiPR++)*clR[j];
                             }
-                        *(clP++) = _mm_mul_ps (mAcumL,mAcumR);
+                        *(clP++) = preLikeL[a++] * likeR;
                         }
-                    clR += nStates;
                     }
-                tiPR += nStatesSquared;
+                else
+                    clP += nStates;
+                clR += nStates;
                 }
             break;
         case 2:
-            tiPL = pL;
-            for (k=0; k<m->numRateCats; k++)
+            for (c=0; c<m->numChars; c++)
                 {
-                for (c=t=0; c<m->numVecChars; c++)
+                r = (*rateCat++);
+                if (r < nGammaCats)
                     {
-                    for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
-                        {
-                        preLikeRV[c1] = &preLikeR[rState[t] + k*(preLikeJump+nStates)];
-                        }
-                    for (i=h=0; i<nStates; i++)
+                    tiPL = pL + r*nStatesSquared;
+                    a = rState[c] + r*(preLikeJump+nStates);
+                    for (i=0; i<nStates; i++)
                         {
-                        mAcumR = _mm_set_ps (*(preLikeRV[3]++), *(preLikeRV[2]++), *(preLikeRV[1]++), *(preLikeRV[0]++));
-                        mAcumL = _mm_setzero_ps();
+                        likeL = 0.0;
                         for (j=0; j<nStates; j++)
                             {
-                            mTiPL  = _mm_load1_ps (&tiPL[h++]);
-                            mL     = _mm_mul_ps (mTiPL, clL[j]);
-                            mAcumL = _mm_add_ps (mL, mAcumL);
+                            likeL += (*tiPL++)*clL[j];
                             }
-                        *(clP++) = _mm_mul_ps (mAcumL,mAcumR);
+                        *(clP++) = preLikeR[a++] * likeL;
                         }
-                    clL += nStates;
                     }
-                tiPL += nStatesSquared;
+                else
+                    clP += nStates;
+                clL += nStates;
                 }
             break;
         case 3:
-            for (k=0; k<m->numRateCats; k++)
+            for (c=0; c<m->numChars; c++)
                 {
-                for (c=t=0; c<m->numVecChars; c++)
+                r = (*rateCat++);
+                if (r < nGammaCats)
                     {
-                    for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
-                        {
-                        preLikeRV[c1] = &preLikeR[rState[t] + k*(preLikeJump+nStates)];
-                        preLikeLV[c1] = &preLikeL[lState[t] + k*(preLikeJump+nStates)];
-                        }
+                    a = lState[c] + r*(preLikeJump+nStates);
+                    b = rState[c] + r*(preLikeJump+nStates);
                     for (i=0; i<nStates; i++)
-                        {
-                        assert (m->numFloatsPerVec == 4); /* In the following 2 statments we assume that SSE register can hold exactly 4 ClFlts. */
-                        mL = _mm_set_ps (*(preLikeLV[3]++), *(preLikeLV[2]++), *(preLikeLV[1]++), *(preLikeLV[0]++));
-                        mR = _mm_set_ps (*(preLikeRV[3]++), *(preLikeRV[2]++), *(preLikeRV[1]++), *(preLikeRV[0]++));
-                        *(clP++) = _mm_mul_ps (mL,mR);
-                        }
+                        *(clP++) = preLikeL[a++]*preLikeR[b++];
                     }
+                else
+                    clP += nStates;
                 }
             break;
         }
+
     return NO_ERROR;
 }
-#endif
 
 
+#if defined (SSE_ENABLED)
 /*----------------------------------------------------------------
 |
-|   CondLikeDown_Gen_GibbsGamma: general n-state model with rate
-|       variation modeled using discrete gamma with Gibbs resampling
+|   CondLikeDown_Gen_GibbsGamma_SSE: general n-state model with rate
+|       variation modeled using discrete gamma with Gibbs resampling,
+|       using SSE instructions over the states of each character
 |
 -----------------------------------------------------------------*/
-int CondLikeDown_Gen_GibbsGamma (TreeNode *p, int division, int chain)
+int CondLikeDown_Gen_GibbsGamma_SSE (TreeNode *p, int division, int chain)
 {
-    int             a, b, c, i, j, r, *rateCat, shortCut, *lState=NULL, *rState=NULL,
-                    nObsStates, nStates, nStatesSquared, nGammaCats;
-    CLFlt           likeL, likeR, *pL, *pR, *tiPL, *tiPR, *clL, *clR, *clP;
+    int             a, b, c, i, r, *rateCat, shortCut, *lState=NULL, *rState=NULL,
+                    nObsStates, nStates, nStatesSquared, nGammaCats, catSize, preLikeJump;
+    CLFlt           likeL[64], likeR[64], *pL, *pR, *clL, *clR, *clP;
     ModelInfo       *m;
 #   if !defined (DEBUG_NOSHORTCUTS)
-    int k, catStart;
+    int j, k, catStart;
+    CLFlt *tiPL, *tiPR;
 #   endif
     
     /* find model settings for this division and nStates, nStatesSquared */
@@ -617,6 +1526,10 @@ int CondLikeDown_Gen_GibbsGamma (TreeNode *p, int division, int chain)
     nObsStates = m->numStates;
     nStates = m->numModelStates;
     nStatesSquared = nStates * nStates;
+    preLikeJump = nObsStates * nStates;
+
+    /* size of one rate category of transposed transition probabilities */
+    catSize = nStates * 4 * ((nStates + 3) / 4);
 
     /* flip conditional likelihood space */
     FlipCondLikeSpace (m, chain, p->index);
@@ -693,6 +1606,12 @@ int CondLikeDown_Gen_GibbsGamma (TreeNode *p, int division, int chain)
         }
 #   endif
 
+    /* the precalculated space of interior branches holds their transposed transition probabilities */
+    if ((shortCut & 1) == 0)
+        TransposeTiProbs_SSE (preLikeL, pL, nStates, nGammaCats);
+    if ((shortCut & 2) == 0)
+        TransposeTiProbs_SSE (preLikeR, pR, nStates, nGammaCats);
+
     switch (shortCut)
         {
         case 0:
@@ -701,18 +1620,10 @@ int CondLikeDown_Gen_GibbsGamma (TreeNode *p, int division, int chain)
                 r = (*rateCat++);
                 if (r < nGammaCats)
                     {
-                    tiPL = pL + r*nStatesSquared;
-                    tiPR = pR + r*nStatesSquared;
+                    TransformCondLikes_SSE (likeL, preLikeL + r*catSize, clL, nStates);
+                    TransformCondLikes_SSE (likeR, preLikeR + r*catSize, clR, nStates);
                     for (i=0; i<nStates; i++)
-                        {
-                        likeL = likeR = 0.0;
-                        for (j=0; j<nStates; j++)
-                            {
-                            likeL += (*tiPL++) * clL[j];
-                            likeR += (*tiPR++) * clR[j];
-                            }
-                        *(clP++) = likeL * likeR;
-                        }
+                        *(clP++) = likeL[i] * likeR[i];
                     }
                 else
                     clP += nStates;
@@ -726,17 +1637,10 @@ int CondLikeDown_Gen_GibbsGamma (TreeNode *p, int division, int chain)
                 r = (*rateCat++);
                 if (r < nGammaCats)
                     {
-                    tiPR = pR + r*nStatesSquared;
-                    a = lState[c] + r*(nStatesSquared+nStates);
+                    TransformCondLikes_SSE (likeR, preLikeR + r*catSize, clR, nStates);
+                    a = lState[c] + r*(preLikeJump+nStates);
                     for (i=0; i<nStates; i++)
-                        {
-                        likeR = 0.0;
-                        for (j=0; j<nStates; j++)
-                            {
-                            likeR += (*tiPR++)*clR[j];
-                            }
-                        *(clP++) = preLikeL[a++] * likeR;
-                        }
+                        *(clP++) = preLikeL[a++] * likeR[i];
                     }
                 else
                     clP += nStates;
@@ -749,17 +1653,10 @@ int CondLikeDown_Gen_GibbsGamma (TreeNode *p, int division, int chain)
                 r = (*rateCat++);
                 if (r < nGammaCats)
                     {
-                    tiPL = pL + r*nStatesSquared;
-                    a = rState[c] + r*(nStatesSquared+nStates);
+                    TransformCondLikes_SSE (likeL, preLikeL + r*catSize, clL, nStates);
+                    a = rState[c] + r*(preLikeJump+nStates);
                     for (i=0; i<nStates; i++)
-                        {
-                        likeL = 0.0;
-                        for (j=0; j<nStates; j++)
-                            {
-                            likeL += (*tiPL++)*clL[j];
-                            }
-                        *(clP++) = preLikeR[a++] * likeL;
-                        }
+                        *(clP++) = preLikeR[a++] * likeL[i];
                     }
                 else
                     clP += nStates;
@@ -772,8 +1669,8 @@ int CondLikeDown_Gen_GibbsGamma (TreeNode *p, int division, int chain)
                 r = (*rateCat++);
                 if (r < nGammaCats)
                     {
-                    a = lState[c] + r*(nStatesSquared+nStates);
-                    b = rState[c] + r*(nStatesSquared+nStates);
+                    a = lState[c] + r*(preLikeJump+nStates);
+                    b = rState[c] + r*(preLikeJump+nStates);
                     for (i=0; i<nStates; i++)
                         *(clP++) = preLikeL[a++]*preLikeR[b++];
                     }
@@ -785,6 +1682,7 @@ int CondLikeDown_Gen_GibbsGamma (TreeNode *p, int division, int chain)
 
     return NO_ERROR;
 }
+#endif
 
 
 /*----------------------------------------------------------------
@@ -1121,6 +2019,152 @@ int CondLikeDown_NUC4_GibbsGamma (TreeNode *p, int division, int chain)
 }
 
 
+#if defined (SSE_ENABLED)
+/*----------------------------------------------------------------
+|
+|   CondLikeDown_NUC4_GibbsGamma_SSE: 4by4 nucleotide model with rate
+|       variation approximated using Gibbs sampling of gamma, using
+|       SSE instructions over the four states of each character
+|
+-----------------------------------------------------------------*/
+int CondLikeDown_NUC4_GibbsGamma_SSE (TreeNode *p, int division, int chain)
+{
+    int             c, k, r, *rateCat, shortCut, *lState=NULL, *rState=NULL,
+                    nGammaCats;
+    CLFlt           *clL, *clR, *clP, *pL, *pR;
+    __m128          mTiL[5*MAX_RATE_CATS], mTiR[5*MAX_RATE_CATS], *mL, *mR, mLikeL, mLikeR;
+    ModelInfo       *m;
+    
+    m = &modelSettings[division];
+
+    /* flip conditional likelihood space */
+    FlipCondLikeSpace (m, chain, p->index);
+    
+    /* find conditional likelihood pointers */
+    clL = m->condLikes[m->condLikeIndex[chain][p->left->index ]];
+    clR = m->condLikes[m->condLikeIndex[chain][p->right->index]];
+    clP = m->condLikes[m->condLikeIndex[chain][p->index       ]];
+    
+    /* find transition probabilities */
+    pL = m->tiProbs[m->tiProbsIndex[chain][p->left->index ]];
+    pR = m->tiProbs[m->tiProbsIndex[chain][p->right->index]];
+
+    /* find rate category index  and number of gamma categories */
+    rateCat = m->tiIndex + chain * m->numChars;
+    nGammaCats = m->numRateCats;
+
+    /* store the columns of the transition probability matrices; the fifth vector
+       of each category (all ones) is used for ambiguous terminal states */
+    for (k=0; k<nGammaCats; k++)
+        {
+        mL = mTiL + 5*k;
+        mR = mTiR + 5*k;
+        mL[A] = _mm_loadu_ps (&pL[16*k + AA]);
+        mL[C] = _mm_loadu_ps (&pL[16*k + CA]);
+        mL[G] = _mm_loadu_ps (&pL[16*k + GA]);
+        mL[T] = _mm_loadu_ps (&pL[16*k + TA]);
+        _MM_TRANSPOSE4_PS (mL[A], mL[C], mL[G], mL[T]);
+        mL[4] = _mm_set1_ps (1.0);
+        mR[A] = _mm_loadu_ps (&pR[16*k + AA]);
+        mR[C] = _mm_loadu_ps (&pR[16*k + CA]);
+        mR[G] = _mm_loadu_ps (&pR[16*k + GA]);
+        mR[T] = _mm_loadu_ps (&pR[16*k + TA]);
+        _MM_TRANSPOSE4_PS (mR[A], mR[C], mR[G], mR[T]);
+        mR[4] = _mm_set1_ps (1.0);
+        }
+
+    /* use the columns directly for terminal branches without partial ambiguities */
+    shortCut = 0;
+#   if !defined (DEBUG_NOSHORTCUTS)
+    if (p->left->left == NULL && m->isPartAmbig[p->left->index] == NO)
+        {
+        shortCut |= 1;
+        lState = m->termState[p->left->index];
+        }
+    if (p->right->left == NULL && m->isPartAmbig[p->right->index] == NO)
+        {
+        shortCut |= 2;
+        rState = m->termState[p->right->index];
+        }
+#   endif
+
+    switch (shortCut)
+        {
+        case 0:
+            for (c=0; c<m->numChars; c++)
+                {
+                r = rateCat[c];
+                if (r < nGammaCats)
+                    {
+                    mL = mTiL + 5*r;
+                    mR = mTiR + 5*r;
+                    mLikeL = _mm_mul_ps (mL[A], _mm_set1_ps (clL[A]));
+                    mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[C], _mm_set1_ps (clL[C])));
+                    mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[G], _mm_set1_ps (clL[G])));
+                    mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[T], _mm_set1_ps (clL[T])));
+                    mLikeR = _mm_mul_ps (mR[A], _mm_set1_ps (clR[A]));
+                    mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[C], _mm_set1_ps (clR[C])));
+                    mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[G], _mm_set1_ps (clR[G])));
+                    mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[T], _mm_set1_ps (clR[T])));
+                    _mm_storeu_ps (clP, _mm_mul_ps (mLikeL, mLikeR));
+                    }
+                clP += 4;
+                clL += 4;
+                clR += 4;
+                }
+            break;
+        case 1:
+            for (c=0; c<m->numChars; c++)
+                {
+                r = rateCat[c];
+                if (r < nGammaCats)
+                    {
+                    mR = mTiR + 5*r;
+                    mLikeL = mTiL[5*r + lState[c]/4];
+                    mLikeR = _mm_mul_ps (mR[A], _mm_set1_ps (clR[A]));
+                    mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[C], _mm_set1_ps (clR[C])));
+                    mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[G], _mm_set1_ps (clR[G])));
+                    mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[T], _mm_set1_ps (clR[T])));
+                    _mm_storeu_ps (clP, _mm_mul_ps (mLikeL, mLikeR));
+                    }
+                clP += 4;
+                clR += 4;
+                }
+            break;
+        case 2:
+            for (c=0; c<m->numChars; c++)
+                {
+                r = rateCat[c];
+                if (r < nGammaCats)
+                    {
+                    mL = mTiL + 5*r;
+                    mLikeL = _mm_mul_ps (mL[A], _mm_set1_ps (clL[A]));
+                    mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[C], _mm_set1_ps (clL[C])));
+                    mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[G], _mm_set1_ps (clL[G])));
+                    mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[T], _mm_set1_ps (clL[T])));
+                    mLikeR = mTiR[5*r + rState[c]/4];
+                    _mm_storeu_ps (clP, _mm_mul_ps (mLikeL, mLikeR));
+                    }
+                clP += 4;
+                clL += 4;
+                }
+            break;
+        case 3:
+            for (c=0; c<m->numChars; c++)
+                {
+                r = rateCat[c];
+                if (r < nGammaCats)
+                    _mm_storeu_ps (clP, _mm_mul_ps (mTiL[5*r + lState[c]/4], mTiR[5*r + rState[c]/4]));
+                clP += 4;
+                }
+            break;
+        }
+
+    return NO_ERROR;
+}
+#endif
+
+
 #if defined (FMA_ENABLED)
 /*----------------------------------------------------------------
  |
@@ -1742,10 +2786,10 @@ int CondLikeDown_NY98 (TreeNode *p, int division, int chain)
 -----------------------------------------------------------------*/
 int CondLikeDown_NY98_SSE (TreeNode *p, int division, int chain)
 {
-    int             c, c1, h, i, j, k, t, shortCut, *lState=NULL, *rState=NULL, nStates, nStatesSquared;
+    int             b, c, c1, i, j, k, t, v, shortCut, *lState=NULL, *rState=NULL, nStates, nStatesSquared;
     CLFlt           *pL, *pR, *tiPL, *tiPR;
     __m128          *clL, *clR, *clP;
-    __m128          mTiPL, mTiPR, mL, mR, mAcumL, mAcumR;
+    __m128          mL, mR, likeL[128], likeR[128];
     ModelInfo       *m;
     CLFlt           *preLikeRV[4];
     CLFlt           *preLikeLV[4];
@@ -1816,25 +2860,16 @@ int CondLikeDown_NY98_SSE (TreeNode *p, int division, int chain)
             tiPR = pR;
             for (k=0; k<m->numOmegaCats; k++)
                 {
-                for (c=0; c<m->numVecChars; c++)
+                /* two SSE vectors of characters at a time, see TiProbsTimesCondLikes_SSE */
+                for (c=0; c<m->numVecChars; c+=b)
                     {
-                    for (i=h=0; i<nStates; i++)
-                        {
-                        mAcumL = _mm_setzero_ps();
-                        mAcumR = _mm_setzero_ps();
-                        for (j=0; j<nStates; j++)
-                            {
-                            mTiPL  = _mm_load1_ps (&tiPL[h]);
-                            mTiPR  = _mm_load1_ps (&tiPR[h++]);
-                            mL     = _mm_mul_ps (mTiPL, clL[j]);
-                            mR     = _mm_mul_ps (mTiPR, clR[j]);
-                            mAcumL = _mm_add_ps (mL, mAcumL);
-                            mAcumR = _mm_add_ps (mR, mAcumR);
-                            }
-                        *(clP++) = _mm_mul_ps (mAcumL, mAcumR);
-                        }
-                    clL += nStates;
-                    clR += nStates;
+                    b = (c+1 < m->numVecChars) ? 2 : 1;
+                    TiProbsTimesCondLikes_SSE (likeL, tiPL, clL, nStates, b);
+                    TiProbsTimesCondLikes_SSE (likeR, tiPR, clR, nStates, b);
+                    for (i=0; i<b*nStates; i++)
+                        *(clP++) = _mm_mul_ps (likeL[i], likeR[i]);
+                    clL += b*nStates;
+                    clR += b*nStates;
                     }
                 tiPL += nStatesSquared;
                 tiPR += nStatesSquared;
@@ -1844,54 +2879,50 @@ int CondLikeDown_NY98_SSE (TreeNode *p, int division, int chain)
             tiPR = pR;
             for (k=0; k<m->numOmegaCats; k++)
                 {
-                for (c=t=0; c<m->numVecChars; c++)
+                for (c=t=0; c<m->numVecChars; c+=b)
                     {
-                    for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
-                        {
-                        preLikeLV[c1] = &preLikeL[lState[t] + k*(nStatesSquared+nStates)];
-                        }
-                    for (i=h=0; i<nStates; i++)
+                    b = (c+1 < m->numVecChars) ? 2 : 1;
+                    TiProbsTimesCondLikes_SSE (likeR, tiPR, clR, nStates, b);
+                    for (v=0; v<b; v++)
                         {
-                        assert (m->numFloatsPerVec == 4); /* In the following statment we assume that SSE register can hold exactly 4 ClFlts. */
-                        mAcumL = _mm_set_ps (*(preLikeLV[3]++), *(preLikeLV[2]++), *(preLikeLV[1]++), *(preLikeLV[0]++));
-                        mAcumR = _mm_setzero_ps();
-                        for (j=0; j<nStates; j++)
+                        for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
                             {
-                            mTiPR  = _mm_load1_ps (&tiPR[h++]);
-                            mR     = _mm_mul_ps (mTiPR, clR[j]);
-                            mAcumR = _mm_add_ps (mR, mAcumR);
+                            preLikeLV[c1] = &preLikeL[lState[t] + k*(nStatesSquared+nStates)];
+                            }
+                        for (i=0; i<nStates; i++)
+                            {
+                            assert (m->numFloatsPerVec == 4); /* In the following statment we assume that SSE register can hold exactly 4 ClFlts. */
+                            mL = _mm_set_ps (*(preLikeLV[3]++), *(preLikeLV[2]++), *(preLikeLV[1]++), *(preLikeLV[0]++));
+                            *(clP++) = _mm_mul_ps (mL, likeR[v*nStates+i]);
                             }
-                        *(clP++) = _mm_mul_ps (mAcumL,mAcumR);
                         }
-                    clR += nStates;
+                    clR += b*nStates;
                     }
                 tiPR += nStatesSquared;
                 }
             break;
         case 2:
-            tiPL = pL;
-            for (k=0; k<m->numOmegaCats; k++)
-                {
-                for (c=t=0; c<m->numVecChars; c++)
-                    {
-                    for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
-                        {
-                        preLikeRV[c1] = &preLikeR[rState[t] + k*(nStatesSquared+nStates)];
-                        }
-                    for (i=h=0; i<nStates; i++)
+            tiPL = pL;
+            for (k=0; k<m->numOmegaCats; k++)
+                {
+                for (c=t=0; c<m->numVecChars; c+=b)
+                    {
+                    b = (c+1 < m->numVecChars) ? 2 : 1;
+                    TiProbsTimesCondLikes_SSE (likeL, tiPL, clL, nStates, b);
+                    for (v=0; v<b; v++)
                         {
-                        assert (m->numFloatsPerVec == 4); /* In the following statment we assume that SSE register can hold exactly 4 ClFlts. */
-                        mAcumR = _mm_set_ps (*(preLikeRV[3]++), *(preLikeRV[2]++), *(preLikeRV[1]++), *(preLikeRV[0]++));
-                        mAcumL = _mm_setzero_ps();
-                        for (j=0; j<nStates; j++)
+                        for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
                             {
-                            mTiPL  = _mm_load1_ps (&tiPL[h++]);
-                            mL     = _mm_mul_ps (mTiPL, clL[j]);
-                            mAcumL = _mm_add_ps (mL, mAcumL);
+                            preLikeRV[c1] = &preLikeR[rState[t] + k*(nStatesSquared+nStates)];
+                            }
+                        for (i=0; i<nStates; i++)
+                            {
+                            assert (m->numFloatsPerVec == 4); /* In the following statment we assume that SSE register can hold exactly 4 ClFlts. */
+                            mR = _mm_set_ps (*(preLikeRV[3]++), *(preLikeRV[2]++), *(preLikeRV[1]++), *(preLikeRV[0]++));
+                            *(clP++) = _mm_mul_ps (likeL[v*nStates+i], mR);
                             }
-                        *(clP++) = _mm_mul_ps (mAcumL,mAcumR);
                         }
-                    clL += nStates;
+                    clL += b*nStates;
                     }
                 tiPL += nStatesSquared;
                 }
@@ -2685,57 +3716,310 @@ int CondLikeRoot_Gen_SSE (TreeNode *p, int division, int chain)
         case 3:
             for (k=0; k<m->numRateCats; k++)
                 {
-                for (c=t=0; c<m->numVecChars; c++)
+                for (c=t=0; c<m->numVecChars; c++)
+                    {
+                    for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
+                        {
+                        preLikeRV[c1] = &preLikeR[rState[t] + k*(preLikeJump+nStates)];
+                        preLikeLV[c1] = &preLikeL[lState[t] + k*(preLikeJump+nStates)];
+                        preLikeAV[c1] = &preLikeA[aState[t] + k*(preLikeJump+nStates)];
+                        }
+                    for (i=0; i<nStates; i++)
+                        {
+                        assert (m->numFloatsPerVec == 4); /* In the following 2 statments we assume that SSE register can hold exactly 4 ClFlts. */
+                        mL = _mm_set_ps (*(preLikeLV[3]++), *(preLikeLV[2]++), *(preLikeLV[1]++), *(preLikeLV[0]++));
+                        mR = _mm_set_ps (*(preLikeRV[3]++), *(preLikeRV[2]++), *(preLikeRV[1]++), *(preLikeRV[0]++));
+                        mA = _mm_set_ps (*(preLikeAV[3]++), *(preLikeAV[2]++), *(preLikeAV[1]++), *(preLikeAV[0]++));
+                        mL = _mm_mul_ps (mL,mR);
+                        *(clP++) = _mm_mul_ps (mL,mA);
+                        }
+                    }
+                }
+            break;
+        }
+
+    return NO_ERROR;
+}
+#endif
+
+
+/*----------------------------------------------------------------
+|
+|   CondLikeRoot_Gen_GibbsGamma: general n-state model with rate
+|       variation modeled using a discrete gamma distribution with
+|       Gibbs resampling of rate categories
+|
+-----------------------------------------------------------------*/
+int CondLikeRoot_Gen_GibbsGamma (TreeNode *p, int division, int chain)
+{
+    int             a, b, c, i, j, r, *rateCat, shortCut, *lState=NULL,
+                    *rState=NULL, *aState=NULL, nObsStates, nStates,
+                    nStatesSquared, nRateCats, preLikeJump;
+    CLFlt           likeL, likeR, likeA, *clL, *clR, *clP, *clA, *pL, *pR, *pA,
+                    *tiPL, *tiPR, *tiPA;
+    ModelInfo       *m;
+#   if !defined (DEBUG_NOSHORTCUTS)
+    int k, catStart;
+#endif
+    
+    /* find model settings for this division and nStates, nStatesSquared */
+    m = &modelSettings[division];
+    nObsStates = m->numStates;
+    nStates = m->numModelStates;
+    nStatesSquared = nStates * nStates;
+    preLikeJump = nObsStates * nStates;
+
+    /* flip conditional likelihood space */
+    FlipCondLikeSpace (m, chain, p->index);
+
+    /* find conditional likelihood pointers */
+    clL = m->condLikes[m->condLikeIndex[chain][p->left->index ]];
+    clR = m->condLikes[m->condLikeIndex[chain][p->right->index]];
+    clP = m->condLikes[m->condLikeIndex[chain][p->index       ]];
+    clA = m->condLikes[m->condLikeIndex[chain][p->anc->index  ]];
+
+    /* find transition probabilities (or calculate instead) */
+    pL = m->tiProbs[m->tiProbsIndex[chain][p->left->index ]];
+    pR = m->tiProbs[m->tiProbsIndex[chain][p->right->index]];
+    pA = m->tiProbs[m->tiProbsIndex[chain][p->index       ]];
+
+    /* find rate category index and number of rate categories */
+    rateCat = m->tiIndex + chain * m->numChars;
+    nRateCats = m->numRateCats;
+
+    /* find likelihoods of site patterns for left branch if terminal */
+    shortCut = 0;
+#   if !defined (DEBUG_NOSHORTCUTS)
+    if (p->left->left == NULL && m->isPartAmbig[p->left->index] == NO)
+        {
+        shortCut |= 1;
+        lState = m->termState[p->left->index];
+        tiPL = pL;
+        for (k=a=0; k<nRateCats; k++)
+            {
+            catStart = a;
+            for (i=0; i<nObsStates; i++)
+                for (j=i; j<nStatesSquared; j+=nStates)
+                    preLikeL[a++] = tiPL[j];
+            for (b=1; b<nStates/nObsStates; b++)
+                {
+                a = catStart;
+                for (i=0; i<nObsStates; i++)
+                    {
+                    for (j=i+b*nObsStates; j<nStatesSquared; j+=nStates)
+                        preLikeL[a++] += tiPL[j];
+                    }
+                }
+            /* for ambiguous */
+            for (i=0; i<nStates; i++)
+                preLikeL[a++] = 1.0;
+            tiPL += nStatesSquared;
+            }
+        }
+
+    /* find likelihoods of site patterns for right branch if terminal */
+    if (p->right->left == NULL && m->isPartAmbig[p->right->index] == NO)
+        {
+        shortCut |= 2;
+        rState = m->termState[p->right->index];
+        tiPR = pR;
+        for (k=a=0; k<nRateCats; k++)
+            {
+            catStart = a;
+            for (i=0; i<nObsStates; i++)
+                for (j=i; j<nStatesSquared; j+=nStates)
+                    preLikeR[a++] = tiPR[j];
+            for (b=1; b<nStates/nObsStates; b++)
+                {
+                a = catStart;
+                for (i=0; i<nObsStates; i++)
+                    {
+                    for (j=i+b*nObsStates; j<nStatesSquared; j+=nStates)
+                        preLikeR[a++] += tiPR[j];
+                    }
+                }
+            /* for ambiguous */
+            for (i=0; i<nStates; i++)
+                preLikeR[a++] = 1.0;
+            tiPR += nStatesSquared;
+            }
+        }
+
+    /* find likelihoods of site patterns for anc branch, always terminal */
+    if (m->isPartAmbig[p->anc->index] == YES)
+        {
+        shortCut = 4;
+        }
+    else 
+        {
+        aState = m->termState[p->anc->index];
+        tiPA = pA;
+        for (k=a=0; k<nRateCats; k++)
+            {
+            catStart = a;
+            for (i=0; i<nObsStates; i++)
+                for (j=i; j<nStatesSquared; j+=nStates)
+                    preLikeA[a++] = tiPA[j];
+            for (b=1; b<nStates/nObsStates; b++)
+                {
+                a = catStart;
+                for (i=0; i<nObsStates; i++)
+                    {
+                    for (j=i+b*nObsStates; j<nStatesSquared; j+=nStates)
+                        preLikeA[a++] += tiPA[j];
+                    }
+                }
+            /* for ambiguous */
+            for (i=0; i<nStates; i++)
+                preLikeA[a++] = 1.0;
+            tiPA += nStatesSquared;
+            }
+        }
+#   else
+    shortCut = 4;
+#   endif
+
+    switch (shortCut)
+        {
+    case 4:
+        for (c=0; c<m->numChars; c++)
+            {
+            r = (*rateCat++);
+            if (r < nRateCats)
+                {
+                tiPL = pL + r*nStatesSquared;
+                tiPR = pR + r*nStatesSquared;
+                tiPA = pA + r*nStatesSquared;
+                for (i=0; i<nStates; i++)
+                    {
+                    likeL = likeR = likeA = 0.0;
+                    for (j=0; j<nStates; j++)
+                        {
+                        likeL += (*tiPL++) * clL[j];
+                        likeR += (*tiPR++) * clR[j];
+                        likeA += (*tiPA++) * clA[j];
+                        }
+                    *(clP++) = likeL * likeR * likeA;
+                    }
+                }
+            else
+                clP += nStates;
+            clL += nStates;
+            clR += nStates;
+            clA += nStates;
+            }
+        break;
+    case 0:
+    case 3:
+        for (c=0; c<m->numChars; c++)
+            {
+            r = (*rateCat++);
+            if (r < nRateCats)
+                {
+                tiPL = pL + r*nStatesSquared;
+                tiPR = pR + r*nStatesSquared;
+                a = aState[c] + r*(preLikeJump+nStates);
+                for (i=0; i<nStates; i++)
+                    {
+                    likeL = likeR = 0.0;
+                    for (j=0; j<nStates; j++)
+                        {
+                        likeL += (*tiPL++) * clL[j];
+                        likeR += (*tiPR++) * clR[j];
+                        }
+                    *(clP++) = likeL * likeR * preLikeA[a++];
+                    }
+                }
+            else
+                clP += nStates;
+            clL += nStates;
+            clR += nStates;
+            }
+        break;
+    case 1:
+        for (c=0; c<m->numChars; c++)
+            {
+            r = (*rateCat++);
+            if (r < nRateCats)
+                {
+                tiPR = pR + r*nStatesSquared;
+                a = lState[c] + r*(preLikeJump+nStates);
+                b = aState[c] + r*(preLikeJump+nStates);
+                for (i=0; i<nStates; i++)
+                    {
+                    likeR = 0.0;
+                    for (j=0; j<nStates; j++)
+                        {
+                        likeR += (*tiPR++) * clR[j];
+                        }
+                    *(clP++) = preLikeL[a++] * likeR * preLikeA[b++];
+                    }
+                }
+            else
+                clP += nStates;
+            clR += nStates;
+            }
+        break;
+    case 2:
+        for (c=0; c<m->numChars; c++)
+            {
+            r = (*rateCat++);
+            if (r < nRateCats)
+                {
+                tiPL = pL + r*nStatesSquared;
+                a = rState[c] + r*(preLikeJump+nStates);
+                b = aState[c] + r*(preLikeJump+nStates);
+                for (i=0; i<nStates; i++)
                     {
-                    for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
-                        {
-                        preLikeRV[c1] = &preLikeR[rState[t] + k*(preLikeJump+nStates)];
-                        preLikeLV[c1] = &preLikeL[lState[t] + k*(preLikeJump+nStates)];
-                        preLikeAV[c1] = &preLikeA[aState[t] + k*(preLikeJump+nStates)];
-                        }
-                    for (i=0; i<nStates; i++)
+                    likeL = 0.0;
+                    for (j=0; j<nStates; j++)
                         {
-                        assert (m->numFloatsPerVec == 4); /* In the following 2 statments we assume that SSE register can hold exactly 4 ClFlts. */
-                        mL = _mm_set_ps (*(preLikeLV[3]++), *(preLikeLV[2]++), *(preLikeLV[1]++), *(preLikeLV[0]++));
-                        mR = _mm_set_ps (*(preLikeRV[3]++), *(preLikeRV[2]++), *(preLikeRV[1]++), *(preLikeRV[0]++));
-                        mA = _mm_set_ps (*(preLikeAV[3]++), *(preLikeAV[2]++), *(preLikeAV[1]++), *(preLikeAV[0]++));
-                        mL = _mm_mul_ps (mL,mR);
-                        *(clP++) = _mm_mul_ps (mL,mA);
+                        likeL += (*tiPL++) * clL[j];
                         }
+                    *(clP++) = likeL * preLikeR[a++] * preLikeA[b++];
                     }
                 }
-            break;
+            else
+                clP += nStates;
+            clL += nStates;
+            }
+        break;
         }
 
     return NO_ERROR;
 }
-#endif
 
 
+#if defined (SSE_ENABLED)
 /*----------------------------------------------------------------
 |
-|   CondLikeRoot_Gen_GibbsGamma: general n-state model with rate
-|       variation modeled using a discrete gamma distribution with
-|       Gibbs resampling of rate categories
+|   CondLikeRoot_Gen_GibbsGamma_SSE: general n-state model with rate
+|       variation modeled using discrete gamma with Gibbs resampling,
+|       using SSE instructions over the states of each character
 |
 -----------------------------------------------------------------*/
-int CondLikeRoot_Gen_GibbsGamma (TreeNode *p, int division, int chain)
+int CondLikeRoot_Gen_GibbsGamma_SSE (TreeNode *p, int division, int chain)
 {
-    int             a, b, c, i, j, r, *rateCat, shortCut, *lState=NULL,
+    int             a, b, c, i, r, *rateCat, shortCut, *lState=NULL,
                     *rState=NULL, *aState=NULL, nObsStates, nStates,
-                    nStatesSquared, nRateCats;
-    CLFlt           likeL, likeR, likeA, *clL, *clR, *clP, *clA, *pL, *pR, *pA,
-                    *tiPL, *tiPR, *tiPA;
+                    nStatesSquared, nRateCats, catSize, preLikeJump;
+    CLFlt           likeL[64], likeR[64], likeA[64], *clL, *clR, *clP, *clA,
+                    *pL, *pR, *pA;
     ModelInfo       *m;
 #   if !defined (DEBUG_NOSHORTCUTS)
-    int k, catStart;
-#endif
+    int j, k, catStart;
+    CLFlt *tiPL, *tiPR, *tiPA;
+#   endif
     
     /* find model settings for this division and nStates, nStatesSquared */
     m = &modelSettings[division];
     nObsStates = m->numStates;
     nStates = m->numModelStates;
     nStatesSquared = nStates * nStates;
+    preLikeJump = nObsStates * nStates;
+
+    /* size of one rate category of transposed transition probabilities */
+    catSize = nStates * 4 * ((nStates + 3) / 4);
 
     /* flip conditional likelihood space */
     FlipCondLikeSpace (m, chain, p->index);
@@ -2847,6 +4131,14 @@ int CondLikeRoot_Gen_GibbsGamma (TreeNode *p, int division, int chain)
     shortCut = 4;
 #   endif
 
+    /* the precalculated space of branches not using a shortcut holds their transposed transition probabilities */
+    if (shortCut != 1)
+        TransposeTiProbs_SSE (preLikeL, pL, nStates, nRateCats);
+    if (shortCut != 2)
+        TransposeTiProbs_SSE (preLikeR, pR, nStates, nRateCats);
+    if (shortCut == 4)
+        TransposeTiProbs_SSE (preLikeA, pA, nStates, nRateCats);
+
     switch (shortCut)
         {
     case 4:
@@ -2855,20 +4147,11 @@ int CondLikeRoot_Gen_GibbsGamma (TreeNode *p, int division, int chain)
             r = (*rateCat++);
             if (r < nRateCats)
                 {
-                tiPL = pL + r*nStatesSquared;
-                tiPR = pR + r*nStatesSquared;
-                tiPA = pA + r*nStatesSquared;
+                TransformCondLikes_SSE (likeL, preLikeL + r*catSize, clL, nStates);
+                TransformCondLikes_SSE (likeR, preLikeR + r*catSize, clR, nStates);
+                TransformCondLikes_SSE (likeA, preLikeA + r*catSize, clA, nStates);
                 for (i=0; i<nStates; i++)
-                    {
-                    likeL = likeR = likeA = 0.0;
-                    for (j=0; j<nStates; j++)
-                        {
-                        likeL += (*tiPL++) * clL[j];
-                        likeR += (*tiPR++) * clR[j];
-                        likeA += (*tiPA++) * clA[j];
-                        }
-                    *(clP++) = likeL * likeR * likeA;
-                    }
+                    *(clP++) = likeL[i] * likeR[i] * likeA[i];
                 }
             else
                 clP += nStates;
@@ -2884,19 +4167,11 @@ int CondLikeRoot_Gen_GibbsGamma (TreeNode *p, int division, int chain)
             r = (*rateCat++);
             if (r < nRateCats)
                 {
-                tiPL = pL + r*nStatesSquared;
-                tiPR = pR + r*nStatesSquared;
-                a = aState[c] + r*(nStatesSquared+nStates);
+                TransformCondLikes_SSE (likeL, preLikeL + r*catSize, clL, nStates);
+                TransformCondLikes_SSE (likeR, preLikeR + r*catSize, clR, nStates);
+                a = aState[c] + r*(preLikeJump+nStates);
                 for (i=0; i<nStates; i++)
-                    {
-                    likeL = likeR = 0.0;
-                    for (j=0; j<nStates; j++)
-                        {
-                        likeL += (*tiPL++) * clL[j];
-                        likeR += (*tiPR++) * clR[j];
-                        }
-                    *(clP++) = likeL * likeR * preLikeA[a++];
-                    }
+                    *(clP++) = likeL[i] * likeR[i] * preLikeA[a++];
                 }
             else
                 clP += nStates;
@@ -2910,18 +4185,11 @@ int CondLikeRoot_Gen_GibbsGamma (TreeNode *p, int division, int chain)
             r = (*rateCat++);
             if (r < nRateCats)
                 {
-                tiPR = pR + r*nStatesSquared;
-                a = lState[c] + r*(nStatesSquared+nStates);
-                b = aState[c] + r*(nStatesSquared+nStates);
+                TransformCondLikes_SSE (likeR, preLikeR + r*catSize, clR, nStates);
+                a = lState[c] + r*(preLikeJump+nStates);
+                b = aState[c] + r*(preLikeJump+nStates);
                 for (i=0; i<nStates; i++)
-                    {
-                    likeR = 0.0;
-                    for (j=0; j<nStates; j++)
-                        {
-                        likeR += (*tiPR++) * clR[j];
-                        }
-                    *(clP++) = preLikeL[a++] * likeR * preLikeA[b++];
-                    }
+                    *(clP++) = preLikeL[a++] * likeR[i] * preLikeA[b++];
                 }
             else
                 clP += nStates;
@@ -2934,18 +4202,11 @@ int CondLikeRoot_Gen_GibbsGamma (TreeNode *p, int division, int chain)
             r = (*rateCat++);
             if (r < nRateCats)
                 {
-                tiPL = pL + r*nStatesSquared;
-                a = rState[c] + r*(nStatesSquared+nStates);
-                b = aState[c] + r*(nStatesSquared+nStates);
+                TransformCondLikes_SSE (likeL, preLikeL + r*catSize, clL, nStates);
+                a = rState[c] + r*(preLikeJump+nStates);
+                b = aState[c] + r*(preLikeJump+nStates);
                 for (i=0; i<nStates; i++)
-                    {
-                    likeL = 0.0;
-                    for (j=0; j<nStates; j++)
-                        {
-                        likeL += (*tiPL++) * clL[j];
-                        }
-                    *(clP++) = likeL * preLikeR[a++] * preLikeA[b++];
-                    }
+                    *(clP++) = likeL[i] * preLikeR[a++] * preLikeA[b++];
                 }
             else
                 clP += nStates;
@@ -2956,6 +4217,7 @@ int CondLikeRoot_Gen_GibbsGamma (TreeNode *p, int division, int chain)
 
     return NO_ERROR;
 }
+#endif
 
 
 /*----------------------------------------------------------------
@@ -3416,6 +4678,195 @@ int CondLikeRoot_NUC4_GibbsGamma (TreeNode *p, int division, int chain)
 }
 
 
+#if defined (SSE_ENABLED)
+/*----------------------------------------------------------------
+|
+|   CondLikeRoot_NUC4_GibbsGamma_SSE: 4by4 nucleotide model with rate
+|       variation approximated by Gibbs sampling from gamma, using
+|       SSE instructions over the four states of each character
+|
+-----------------------------------------------------------------*/
+int CondLikeRoot_NUC4_GibbsGamma_SSE (TreeNode *p, int division, int chain)
+{
+    int             c, k, r, *rateCat, shortCut, *lState=NULL, *rState=NULL, *aState=NULL,
+                    nRateCats;
+    CLFlt           *clL, *clR, *clP, *clA, *pL, *pR, *pA;
+    __m128          mTiL[5*MAX_RATE_CATS], mTiR[5*MAX_RATE_CATS], mTiA[5*MAX_RATE_CATS],
+                    *mL, *mR, *mA, mLikeL, mLikeR, mLikeA;
+    ModelInfo       *m;
+    
+    m = &modelSettings[division];
+
+    /* flip conditional likelihood space */
+    FlipCondLikeSpace (m, chain, p->index);
+
+    /* find conditional likelihood pointers */
+    clL = m->condLikes[m->condLikeIndex[chain][p->left->index ]];
+    clR = m->condLikes[m->condLikeIndex[chain][p->right->index]];
+    clP = m->condLikes[m->condLikeIndex[chain][p->index       ]];
+    clA = m->condLikes[m->condLikeIndex[chain][p->anc->index  ]];
+
+    /* find transition probabilities (or calculate instead) */
+    pL = m->tiProbs[m->tiProbsIndex[chain][p->left->index ]];
+    pR = m->tiProbs[m->tiProbsIndex[chain][p->right->index]];
+    pA = m->tiProbs[m->tiProbsIndex[chain][p->index       ]];
+
+    /* find rate category index and number of gamma categories */
+    rateCat = m->tiIndex + chain * m->numChars;
+    nRateCats = m->numRateCats;
+
+    /* store the columns of the transition probability matrices; the fifth vector
+       of each category (all ones) is used for ambiguous terminal states */
+    for (k=0; k<nRateCats; k++)
+        {
+        mL = mTiL + 5*k;
+        mR = mTiR + 5*k;
+        mA = mTiA + 5*k;
+        mL[A] = _mm_loadu_ps (&pL[16*k + AA]);
+        mL[C] = _mm_loadu_ps (&pL[16*k + CA]);
+        mL[G] = _mm_loadu_ps (&pL[16*k + GA]);
+        mL[T] = _mm_loadu_ps (&pL[16*k + TA]);
+        _MM_TRANSPOSE4_PS (mL[A], mL[C], mL[G], mL[T]);
+        mL[4] = _mm_set1_ps (1.0);
+        mR[A] = _mm_loadu_ps (&pR[16*k + AA]);
+        mR[C] = _mm_loadu_ps (&pR[16*k + CA]);
+        mR[G] = _mm_loadu_ps (&pR[16*k + GA]);
+        mR[T] = _mm_loadu_ps (&pR[16*k + TA]);
+        _MM_TRANSPOSE4_PS (mR[A], mR[C], mR[G], mR[T]);
+        mR[4] = _mm_set1_ps (1.0);
+        mA[A] = _mm_loadu_ps (&pA[16*k + AA]);
+        mA[C] = _mm_loadu_ps (&pA[16*k + CA]);
+        mA[G] = _mm_loadu_ps (&pA[16*k + GA]);
+        mA[T] = _mm_loadu_ps (&pA[16*k + TA]);
+        _MM_TRANSPOSE4_PS (mA[A], mA[C], mA[G], mA[T]);
+        mA[4] = _mm_set1_ps (1.0);
+        }
+
+    /* use the columns directly for terminal branches without partial ambiguities */
+    shortCut = 0;
+#   if !defined (DEBUG_NOSHORTCUTS)
+    if (p->left->left == NULL && m->isPartAmbig[p->left->index] == NO)
+        {
+        shortCut |= 1;
+        lState = m->termState[p->left->index];
+        }
+    if (p->right->left == NULL && m->isPartAmbig[p->right->index] == NO)
+        {
+        shortCut |= 2;
+        rState = m->termState[p->right->index];
+        }
+    if (m->isPartAmbig[p->anc->index] == YES)
+        shortCut = 4;
+    else
+        aState = m->termState[p->anc->index];
+#   else
+    shortCut = 4;
+#   endif
+
+    switch (shortCut)
+        {
+    case 4:
+        for (c=0; c<m->numChars; c++)
+            {
+            r = rateCat[c];
+            if (r < nRateCats)
+                {
+                mL = mTiL + 5*r;
+                mR = mTiR + 5*r;
+                mA = mTiA + 5*r;
+                mLikeL = _mm_mul_ps (mL[A], _mm_set1_ps (clL[A]));
+                mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[C], _mm_set1_ps (clL[C])));
+                mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[G], _mm_set1_ps (clL[G])));
+                mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[T], _mm_set1_ps (clL[T])));
+                mLikeR = _mm_mul_ps (mR[A], _mm_set1_ps (clR[A]));
+                mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[C], _mm_set1_ps (clR[C])));
+                mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[G], _mm_set1_ps (clR[G])));
+                mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[T], _mm_set1_ps (clR[T])));
+                mLikeA = _mm_mul_ps (mA[A], _mm_set1_ps (clA[A]));
+                mLikeA = _mm_add_ps (mLikeA, _mm_mul_ps (mA[C], _mm_set1_ps (clA[C])));
+                mLikeA = _mm_add_ps (mLikeA, _mm_mul_ps (mA[G], _mm_set1_ps (clA[G])));
+                mLikeA = _mm_add_ps (mLikeA, _mm_mul_ps (mA[T], _mm_set1_ps (clA[T])));
+                _mm_storeu_ps (clP, _mm_mul_ps (_mm_mul_ps (mLikeL, mLikeR), mLikeA));
+                }
+            clP += 4;
+            clL += 4;
+            clR += 4;
+            clA += 4;
+            }
+        break;
+
+    case 0:
+    case 3:
+        for (c=0; c<m->numChars; c++)
+            {
+            r = rateCat[c];
+            if (r < nRateCats)
+                {
+                mL = mTiL + 5*r;
+                mR = mTiR + 5*r;
+                mLikeL = _mm_mul_ps (mL[A], _mm_set1_ps (clL[A]));
+                mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[C], _mm_set1_ps (clL[C])));
+                mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[G], _mm_set1_ps (clL[G])));
+                mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[T], _mm_set1_ps (clL[T])));
+                mLikeR = _mm_mul_ps (mR[A], _mm_set1_ps (clR[A]));
+                mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[C], _mm_set1_ps (clR[C])));
+                mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[G], _mm_set1_ps (clR[G])));
+                mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[T], _mm_set1_ps (clR[T])));
+                mLikeA = mTiA[5*r + aState[c]/4];
+                _mm_storeu_ps (clP, _mm_mul_ps (_mm_mul_ps (mLikeL, mLikeR), mLikeA));
+                }
+            clP += 4;
+            clL += 4;
+            clR += 4;
+            }
+        break;
+
+    case 1:
+        for (c=0; c<m->numChars; c++)
+            {
+            r = rateCat[c];
+            if (r < nRateCats)
+                {
+                mR = mTiR + 5*r;
+                mLikeR = _mm_mul_ps (mR[A], _mm_set1_ps (clR[A]));
+                mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[C], _mm_set1_ps (clR[C])));
+                mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[G], _mm_set1_ps (clR[G])));
+                mLikeR = _mm_add_ps (mLikeR, _mm_mul_ps (mR[T], _mm_set1_ps (clR[T])));
+                mLikeL = mTiL[5*r + lState[c]/4];
+                mLikeA = mTiA[5*r + aState[c]/4];
+                _mm_storeu_ps (clP, _mm_mul_ps (_mm_mul_ps (mLikeR, mLikeL), mLikeA));
+                }
+            clP += 4;
+            clR += 4;
+            }
+        break;
+
+    case 2:
+        for (c=0; c<m->numChars; c++)
+            {
+            r = rateCat[c];
+            if (r < nRateCats)
+                {
+                mL = mTiL + 5*r;
+                mLikeL = _mm_mul_ps (mL[A], _mm_set1_ps (clL[A]));
+                mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[C], _mm_set1_ps (clL[C])));
+                mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[G], _mm_set1_ps (clL[G])));
+                mLikeL = _mm_add_ps (mLikeL, _mm_mul_ps (mL[T], _mm_set1_ps (clL[T])));
+                mLikeR = mTiR[5*r + rState[c]/4];
+                mLikeA = mTiA[5*r + aState[c]/4];
+                _mm_storeu_ps (clP, _mm_mul_ps (_mm_mul_ps (mLikeL, mLikeR), mLikeA));
+                }
+            clP += 4;
+            clL += 4;
+            }
+        break;
+        }
+
+    return NO_ERROR;
+}
+#endif
+
+
 #if defined (FMA_ENABLED)
 /*----------------------------------------------------------------
  |
@@ -4240,12 +5691,12 @@ int CondLikeRoot_NY98 (TreeNode *p, int division, int chain)
 -----------------------------------------------------------------*/
 int CondLikeRoot_NY98_SSE (TreeNode *p, int division, int chain)
 {
-    int             c, c1, t, h, i, j, k, shortCut, *lState=NULL, *rState=NULL, *aState=NULL,
+    int             b, c, c1, t, i, j, k, v, shortCut, *lState=NULL, *rState=NULL, *aState=NULL,
                     nStates, nStatesSquared;
     CLFlt           *pL, *pR, *pA,
                     *tiPL, *tiPR, *tiPA;
     __m128          *clL, *clR, *clP, *clA;
-    __m128          mTiPL, mTiPR, mTiPA, mL, mR, mA, mAcumL, mAcumR, mAcumA;
+    __m128          mL, mR, mA, likeL[128], likeR[128], likeA[128];
     ModelInfo       *m;
     CLFlt           *preLikeRV[4];
     CLFlt           *preLikeLV[4];
@@ -4344,31 +5795,21 @@ int CondLikeRoot_NY98_SSE (TreeNode *p, int division, int chain)
             tiPA = pA;
             for (k=0; k<m->numOmegaCats; k++)
                 {
-                for (c=0; c<m->numVecChars; c++)
+                /* two SSE vectors of characters at a time, see TiProbsTimesCondLikes_SSE */
+                for (c=0; c<m->numVecChars; c+=b)
                     {
-                    for (i=h=0; i<nStates; i++)
+                    b = (c+1 < m->numVecChars) ? 2 : 1;
+                    TiProbsTimesCondLikes_SSE (likeL, tiPL, clL, nStates, b);
+                    TiProbsTimesCondLikes_SSE (likeR, tiPR, clR, nStates, b);
+                    TiProbsTimesCondLikes_SSE (likeA, tiPA, clA, nStates, b);
+                    for (i=0; i<b*nStates; i++)
                         {
-                        mAcumL = _mm_setzero_ps();
-                        mAcumR = _mm_setzero_ps();
-                        mAcumA = _mm_setzero_ps();
-                        for (j=0; j<nStates; j++)
-                            {
-                            mTiPL  = _mm_load1_ps (&tiPL[h]);
-                            mTiPR  = _mm_load1_ps (&tiPR[h]);
-                            mTiPA  = _mm_load1_ps (&tiPA[h++]);
-                            mL     = _mm_mul_ps (mTiPL, clL[j]);
-                            mR     = _mm_mul_ps (mTiPR, clR[j]);
-                            mA     = _mm_mul_ps (mTiPA, clA[j]);
-                            mAcumL = _mm_add_ps (mL, mAcumL);
-                            mAcumR = _mm_add_ps (mR, mAcumR);
-                            mAcumA = _mm_add_ps (mA, mAcumA);
-                            }
-                        mAcumL = _mm_mul_ps (mAcumL, mAcumR);
-                        *(clP++) = _mm_mul_ps (mAcumL, mAcumA);
+                        mL = _mm_mul_ps (likeL[i], likeR[i]);
+                        *(clP++) = _mm_mul_ps (mL, likeA[i]);
                         }
-                    clL += nStates;
-                    clR += nStates;
-                    clA += nStates;
+                    clL += b*nStates;
+                    clR += b*nStates;
+                    clA += b*nStates;
                     }
                 tiPL += nStatesSquared;
                 tiPR += nStatesSquared;
@@ -4380,32 +5821,27 @@ int CondLikeRoot_NY98_SSE (TreeNode *p, int division, int chain)
             tiPR =pR;
             for (k=0; k<m->numOmegaCats; k++)
                 {
-                for (c=t=0; c<m->numVecChars; c++)
+                for (c=t=0; c<m->numVecChars; c+=b)
                     {
-                    for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
+                    b = (c+1 < m->numVecChars) ? 2 : 1;
+                    TiProbsTimesCondLikes_SSE (likeL, tiPL, clL, nStates, b);
+                    TiProbsTimesCondLikes_SSE (likeR, tiPR, clR, nStates, b);
+                    for (v=0; v<b; v++)
                         {
-                        preLikeAV[c1] = &preLikeA[aState[t] + k*(nStatesSquared+nStates)];
-                        }
-                    for (i=h=0; i<nStates; i++)
-                        {
-                        assert (m->numFloatsPerVec == 4); /* In the following statment we assume that SSE register can hold exactly 4 ClFlts. */
-                        mAcumA = _mm_set_ps (*(preLikeAV[3]++), *(preLikeAV[2]++), *(preLikeAV[1]++), *(preLikeAV[0]++));
-                        mAcumL = _mm_setzero_ps();
-                        mAcumR = _mm_setzero_ps();
-                        for (j=0; j<nStates; j++)
+                        for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
                             {
-                            mTiPL  = _mm_load1_ps (&tiPL[h]);
-                            mL     = _mm_mul_ps (mTiPL, clL[j]);
-                            mAcumL = _mm_add_ps (mL, mAcumL);
-                            mTiPR  = _mm_load1_ps (&tiPR[h++]);
-                            mR     = _mm_mul_ps (mTiPR, clR[j]);
-                            mAcumR = _mm_add_ps (mR, mAcumR);
+                            preLikeAV[c1] = &preLikeA[aState[t] + k*(nStatesSquared+nStates)];
+                            }
+                        for (i=0; i<nStates; i++)
+                            {
+                            assert (m->numFloatsPerVec == 4); /* In the following statment we assume that SSE register can hold exactly 4 ClFlts. */
+                            mA = _mm_set_ps (*(preLikeAV[3]++), *(preLikeAV[2]++), *(preLikeAV[1]++), *(preLikeAV[0]++));
+                            mL = _mm_mul_ps (likeL[v*nStates+i], likeR[v*nStates+i]);
+                            *(clP++) = _mm_mul_ps (mL, mA);
                             }
-                        mAcumL = _mm_mul_ps (mAcumL, mAcumR);
-                        *(clP++) = _mm_mul_ps (mAcumL, mAcumA);
                         }
-                    clR += nStates;
-                    clL += nStates;
+                    clR += b*nStates;
+                    clL += b*nStates;
                     }
                 tiPL += nStatesSquared;
                 tiPR += nStatesSquared;
@@ -4413,31 +5849,29 @@ int CondLikeRoot_NY98_SSE (TreeNode *p, int division, int chain)
             break;
         case 1:
             tiPR = pR;
-            for (k=0; k<m->numOmegaCats; k++)
-                {
-                for (c=t=0; c<m->numVecChars; c++)
-                    {
-                    for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
-                        {
-                        preLikeLV[c1] = &preLikeL[lState[t] + k*(nStatesSquared+nStates)];
-                        preLikeAV[c1] = &preLikeA[aState[t] + k*(nStatesSquared+nStates)];
-                        }
-                    for (i=h=0; i<nStates; i++)
+            for (k=0; k<m->numOmegaCats; k++)
+                {
+                for (c=t=0; c<m->numVecChars; c+=b)
+                    {
+                    b = (c+1 < m->numVecChars) ? 2 : 1;
+                    TiProbsTimesCondLikes_SSE (likeR, tiPR, clR, nStates, b);
+                    for (v=0; v<b; v++)
                         {
-                        assert (m->numFloatsPerVec == 4); /* In the following statment we assume that SSE register can hold exactly 4 ClFlts. */
-                        mAcumL = _mm_set_ps (*(preLikeLV[3]++), *(preLikeLV[2]++), *(preLikeLV[1]++), *(preLikeLV[0]++));
-                        mAcumA = _mm_set_ps (*(preLikeAV[3]++), *(preLikeAV[2]++), *(preLikeAV[1]++), *(preLikeAV[0]++));
-                        mAcumR = _mm_setzero_ps();
-                        for (j=0; j<nStates; j++)
+                        for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
                             {
-                            mTiPR  = _mm_load1_ps (&tiPR[h++]);
-                            mR     = _mm_mul_ps (mTiPR, clR[j]);
-                            mAcumR = _mm_add_ps (mR, mAcumR);
+                            preLikeLV[c1] = &preLikeL[lState[t] + k*(nStatesSquared+nStates)];
+                            preLikeAV[c1] = &preLikeA[aState[t] + k*(nStatesSquared+nStates)];
+                            }
+                        for (i=0; i<nStates; i++)
+                            {
+                            assert (m->numFloatsPerVec == 4); /* In the following statment we assume that SSE register can hold exactly 4 ClFlts. */
+                            mL = _mm_set_ps (*(preLikeLV[3]++), *(preLikeLV[2]++), *(preLikeLV[1]++), *(preLikeLV[0]++));
+                            mA = _mm_set_ps (*(preLikeAV[3]++), *(preLikeAV[2]++), *(preLikeAV[1]++), *(preLikeAV[0]++));
+                            mL = _mm_mul_ps (mL, likeR[v*nStates+i]);
+                            *(clP++) = _mm_mul_ps (mL, mA);
                             }
-                        mAcumL = _mm_mul_ps (mAcumL, mAcumR);
-                        *(clP++) = _mm_mul_ps (mAcumL, mAcumA);
                         }
-                    clR += nStates;
+                    clR += b*nStates;
                     }
                 tiPR += nStatesSquared;
                 }
@@ -4446,29 +5880,27 @@ int CondLikeRoot_NY98_SSE (TreeNode *p, int division, int chain)
             tiPL = pL;
             for (k=0; k<m->numOmegaCats; k++)
                 {
-                for (c=t=0; c<m->numVecChars; c++)
+                for (c=t=0; c<m->numVecChars; c+=b)
                     {
-                    for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
-                        {
-                        preLikeRV[c1] = &preLikeR[rState[t] + k*(nStatesSquared+nStates)];
-                        preLikeAV[c1] = &preLikeA[aState[t] + k*(nStatesSquared+nStates)];
-                        }
-                    for (i=h=0; i<nStates; i++)
+                    b = (c+1 < m->numVecChars) ? 2 : 1;
+                    TiProbsTimesCondLikes_SSE (likeL, tiPL, clL, nStates, b);
+                    for (v=0; v<b; v++)
                         {
-                        assert (m->numFloatsPerVec == 4); /* In the following statment we assume that SSE register can hold exactly 4 ClFlts. */
-                        mAcumR = _mm_set_ps (*(preLikeRV[3]++), *(preLikeRV[2]++), *(preLikeRV[1]++), *(preLikeRV[0]++));
-                        mAcumA = _mm_set_ps (*(preLikeAV[3]++), *(preLikeAV[2]++), *(preLikeAV[1]++), *(preLikeAV[0]++));
-                        mAcumL = _mm_setzero_ps();
-                        for (j=0; j<nStates; j++)
+                        for (c1=0; c1<m->numFloatsPerVec; c1++,t++)
                             {
-                            mTiPL  = _mm_load1_ps (&tiPL[h++]);
-                            mL     = _mm_mul_ps (mTiPL, clL[j]);
-                            mAcumL = _mm_add_ps (mL, mAcumL);
+                            preLikeRV[c1] = &preLikeR[rState[t] + k*(nStatesSquared+nStates)];
+                            preLikeAV[c1] = &preLikeA[aState[t] + k*(nStatesSquared+nStates)];
+                            }
+                        for (i=0; i<nStates; i++)
+                            {
+                            assert (m->numFloatsPerVec == 4); /* In the following statment we assume that SSE register can hold exactly 4 ClFlts. */
+                            mR = _mm_set_ps (*(preLikeRV[3]++), *(preLikeRV[2]++), *(preLikeRV[1]++), *(preLikeRV[0]++));
+                            mA = _mm_set_ps (*(preLikeAV[3]++), *(preLikeAV[2]++), *(preLikeAV[1]++), *(preLikeAV[0]++));
+                            mL = _mm_mul_ps (likeL[v*nStates+i], mR);
+                            *(clP++) = _mm_mul_ps (mL, mA);
                             }
-                        mAcumL = _mm_mul_ps (mAcumL, mAcumR);
-                        *(clP++) = _mm_mul_ps (mAcumL,mAcumA);
                         }
-                    clL += nStates;
+                    clL += b*nStates;
                     }
                 tiPL += nStatesSquared;
                 }
@@ -4659,7 +6091,7 @@ int CondLikeUp_Bin (TreeNode *p, int division, int chain)
 int CondLikeUp_Gen (TreeNode *p, int division, int chain)
 {
     int             a, c, i, j, k, nStates, nStatesSquared, nRateCats;
-    CLFlt           *clFA, *clFP, *clDP, *tiP, *condLikeUp, sum;
+    CLFlt           *clFA, *clFP, *clDP, *tiP, condLikeUp[64], sum;
     ModelInfo       *m;
     
     /* find model settings for this division */
@@ -4669,14 +6101,11 @@ int CondLikeUp_Gen (TreeNode *p, int division, int chain)
     nStates = m->numModelStates;
     nStatesSquared = nStates * nStates;
 
-    /* find number of gamma cats */
-    nRateCats = m->numRateCats;
+    /* find number of gamma (or omega) cats */
+    nRateCats = m->numTiCats;
     if (m->gibbsGamma == YES)
         nRateCats = 1;
 
-    /* use preallocated scratch space */
-    condLikeUp = m->ancStateCondLikes;
-
     /* calculate final states */
     if (p->anc->anc == NULL)
         {
@@ -4714,7 +6143,10 @@ int CondLikeUp_Gen (TreeNode *p, int division, int chain)
                     sum = 0.0;
                     for (i=0; i<nStates; i++)
                         sum += tiP[j++]*clDP[i];
-                    if (sum != 0.0) condLikeUp[a] = clFA[a] / sum;
+                    if (sum == 0.0)
+                        condLikeUp[a] = 0.0;    /* we lost the conditional likelihood in the downpass (can occur in gamma model) */
+                    else
+                        condLikeUp[a] = clFA[a] / sum;
                     }
                     
                 for (a=j=0; a<nStates; a++)
@@ -4738,6 +6170,109 @@ int CondLikeUp_Gen (TreeNode *p, int division, int chain)
 }
 
 
+#if defined (SSE_ENABLED)
+/*----------------------------------------------------------------
+|
+|   CondLikeUp_Gen_SSE: pull likelihoods up and calculate scaled
+|       finals for an interior node, using SSE instructions over
+|       the states of each character
+|
+-----------------------------------------------------------------*/
+int CondLikeUp_Gen_SSE (TreeNode *p, int division, int chain)
+{
+    int             a, b, c, i, k, nStates, nStatesSquared, nVecStates, nRateCats;
+    CLFlt           *clFA, *clFP, *clDP, *tiP, *tiPT, condLikeUp[64], sum[64];
+    __m128          mSum[16], *mTiPT;
+    ModelInfo       *m;
+    
+    /* find model settings for this division */
+    m = &modelSettings[division];
+
+    /* the root node is dealt with by the non-SSE version */
+    if (p->anc->anc == NULL)
+        return CondLikeUp_Gen (p, division, chain);
+
+    /* find number of states in the model and the number of vectors holding them */
+    nStates = m->numModelStates;
+    nStatesSquared = nStates * nStates;
+    nVecStates = (nStates + 3) / 4;
+
+    /* find number of gamma (or omega) cats */
+    nRateCats = m->numTiCats;
+    if (m->gibbsGamma == YES)
+        nRateCats = 1;
+
+    /* allocate space for the transposed transition probabilities, padded to whole vectors */
+    mTiPT = (__m128 *) AlignedMalloc (nStates * nVecStates * sizeof(__m128), 16);
+    if (!mTiPT)
+        {
+        MrBayesPrint ("%s   ERROR: Out of memory in CondLikeUp_Gen_SSE\n", spacer);
+        return (ERROR);
+        }
+    tiPT = (CLFlt *) mTiPT;
+
+    /* find conditional likelihood pointers */
+    /* use conditional likelihood scratch space for final cond likes */
+    clFA = m->condLikes[m->condLikeScratchIndex[p->anc->index]];
+    clFP = m->condLikes[m->condLikeScratchIndex[p->index     ]];
+    clDP = m->condLikes[m->condLikeIndex[chain][p->index     ]];
+    
+    /* find transition probabilities */
+    tiP = m->tiProbs[m->tiProbsIndex[chain][p->index]];
+    
+    for (k=0; k<nRateCats; k++)
+        {
+        /* column i of tiP is stored in vectors i*nVecStates to (i+1)*nVecStates-1 of mTiPT */
+        for (i=0; i<nStates; i++)
+            {
+            for (a=0; a<nStates; a++)
+                tiPT[i*nVecStates*4 + a] = tiP[a*nStates + i];
+            for (; a<nVecStates*4; a++)
+                tiPT[i*nVecStates*4 + a] = 0.0;
+            }
+
+        for (c=0; c<m->numChars; c++)
+            {
+            /* sum[a] = sum over i of tiP[a][i]*clDP[i] */
+            for (b=0; b<nVecStates; b++)
+                mSum[b] = _mm_setzero_ps ();
+            for (i=0; i<nStates; i++)
+                for (b=0; b<nVecStates; b++)
+                    mSum[b] = _mm_add_ps (mSum[b], _mm_mul_ps (mTiPT[i*nVecStates + b], _mm_set1_ps (clDP[i])));
+            for (b=0; b<nVecStates; b++)
+                _mm_storeu_ps (&sum[4*b], mSum[b]);
+            for (a=0; a<nStates; a++)
+                {
+                if (sum[a] == 0.0)
+                    condLikeUp[a] = 0.0;    /* we lost the conditional likelihood in the downpass (can occur in gamma model) */
+                else
+                    condLikeUp[a] = clFA[a] / sum[a];
+                }
+
+            /* clFP[a] = (sum over i of condLikeUp[i]*tiP[a][i]) * clDP[a] */
+            for (b=0; b<nVecStates; b++)
+                mSum[b] = _mm_setzero_ps ();
+            for (i=0; i<nStates; i++)
+                for (b=0; b<nVecStates; b++)
+                    mSum[b] = _mm_add_ps (mSum[b], _mm_mul_ps (mTiPT[i*nVecStates + b], _mm_set1_ps (condLikeUp[i])));
+            for (b=0; b<nVecStates; b++)
+                _mm_storeu_ps (&sum[4*b], mSum[b]);
+            for (a=0; a<nStates; a++)
+                *(clFP++) = sum[a] * clDP[a];
+
+            clFA += nStates;
+            clDP += nStates;
+            }
+        tiP += nStatesSquared;
+        }
+
+    ALIGNEDSAFEFREE (mTiPT);
+
+    return NO_ERROR;
+}
+#endif
+
+
 /*----------------------------------------------------------------
 |
 |   CondLikeUp_NUC4: pull likelihoods up and calculate scaled
@@ -4831,6 +6366,82 @@ int     CondLikeUp_NUC4 (TreeNode *p, int division, int chain)
 }
 
 
+#if defined (SSE_ENABLED)
+/*----------------------------------------------------------------
+|
+|   CondLikeUp_NUC4_SSE: pull likelihoods up and calculate scaled
+|       finals for an interior node, using SSE instructions over
+|       the four states of each character
+|
+-----------------------------------------------------------------*/
+int     CondLikeUp_NUC4_SSE (TreeNode *p, int division, int chain)
+{
+    int             c, k, nRateCats;
+    CLFlt           *clFA, *clFP, *clDP, *tiP;
+    __m128          m1, m2, mZero, mTiA, mTiC, mTiG, mTiT;
+    ModelInfo       *m;
+    
+    /* find model settings for this division */
+    m = &modelSettings[division];
+
+    /* find number of rate cats */
+    nRateCats = m->numRateCats;
+    if (m->gibbsGamma == YES)
+        nRateCats = 1;
+
+    /* the root node is dealt with by the non-SSE version */
+    if (p->anc->anc == NULL)
+        return CondLikeUp_NUC4 (p, division, chain);
+
+    /* find conditional likelihood pointers */
+    /* use conditional likelihood scratch space for final cond likes */
+    clFA = m->condLikes[m->condLikeScratchIndex[p->anc->index]];
+    clFP = m->condLikes[m->condLikeScratchIndex[p->index     ]];
+    clDP = m->condLikes[m->condLikeIndex[chain][p->index     ]];
+    
+    /* find transition probabilities */
+    tiP = m->tiProbs[m->tiProbsIndex[chain][p->index]];
+    
+    mZero = _mm_setzero_ps ();
+    for (k=0; k<nRateCats; k++)
+        {
+        /* columns of the transition probability matrix */
+        mTiA = _mm_loadu_ps (&tiP[AA]);
+        mTiC = _mm_loadu_ps (&tiP[CA]);
+        mTiG = _mm_loadu_ps (&tiP[GA]);
+        mTiT = _mm_loadu_ps (&tiP[TA]);
+        _MM_TRANSPOSE4_PS (mTiA, mTiC, mTiG, mTiT);
+        for (c=0; c<m->numChars; c++)
+            {
+            /* sum[X] = tiP[XA]*clDP[A] + tiP[XC]*clDP[C] + tiP[XG]*clDP[G] + tiP[XT]*clDP[T] */
+            m1 = _mm_loadu_ps (clDP);
+            m2 = _mm_mul_ps (mTiA, _mm_shuffle_ps (m1, m1, _MM_SHUFFLE(0,0,0,0)));
+            m2 = _mm_add_ps (m2, _mm_mul_ps (mTiC, _mm_shuffle_ps (m1, m1, _MM_SHUFFLE(1,1,1,1))));
+            m2 = _mm_add_ps (m2, _mm_mul_ps (mTiG, _mm_shuffle_ps (m1, m1, _MM_SHUFFLE(2,2,2,2))));
+            m2 = _mm_add_ps (m2, _mm_mul_ps (mTiT, _mm_shuffle_ps (m1, m1, _MM_SHUFFLE(3,3,3,3))));
+
+            /* condLikeUp[X] = clFA[X] / sum[X], or 0.0 if sum[X] is 0.0 */
+            m2 = _mm_and_ps (_mm_div_ps (_mm_loadu_ps (clFA), m2), _mm_cmpneq_ps (m2, mZero));
+
+            /* clFP[X] = (condLikeUp[A]*tiP[XA] + condLikeUp[C]*tiP[XC] + condLikeUp[G]*tiP[XG] + condLikeUp[T]*tiP[XT])*clDP[X] */
+            m1 = _mm_mul_ps (mTiA, _mm_shuffle_ps (m2, m2, _MM_SHUFFLE(0,0,0,0)));
+            m1 = _mm_add_ps (m1, _mm_mul_ps (mTiC, _mm_shuffle_ps (m2, m2, _MM_SHUFFLE(1,1,1,1))));
+            m1 = _mm_add_ps (m1, _mm_mul_ps (mTiG, _mm_shuffle_ps (m2, m2, _MM_SHUFFLE(2,2,2,2))));
+            m1 = _mm_add_ps (m1, _mm_mul_ps (mTiT, _mm_shuffle_ps (m2, m2, _MM_SHUFFLE(3,3,3,3))));
+            _mm_storeu_ps (clFP, _mm_mul_ps (m1, _mm_loadu_ps (clDP)));
+
+            clFA += 4;
+            clFP += 4;
+            clDP += 4;
+            }
+        tiP += 16;
+        }
+
+    return NO_ERROR;
+}
+#endif
+
+
 /*----------------------------------------------------------------
 |
 |   CondLikeUp_Std: pull likelihoods up and calculate scaled
@@ -4875,75 +6486,225 @@ int     CondLikeUp_Std (TreeNode *p, int division, int chain)
         /* finally multiply with the rate cats */
         coppySize *= m->numRateCats;
 
-        /* copy cond likes */ 
-        for (k=0; k<coppySize; k++)
+        /* copy cond likes */ 
+        for (k=0; k<coppySize; k++)
+            *(clFP++) = *(clDP++);
+        }
+    else
+        {
+        /* find conditional likelihood pointers */
+        /* use conditional likelihood scratch space for final cond likes */
+        clFA = m->condLikes[m->condLikeScratchIndex[p->anc->index]];
+        clFP = m->condLikes[m->condLikeScratchIndex[p->index     ]];
+        clDP = m->condLikes[m->condLikeIndex[chain][p->index     ]];
+
+        /* find transition probabilities */
+        pA = m->tiProbs[m->tiProbsIndex[chain][p->index]];
+        
+        for (k=0; k<m->numRateCats; k++)
+            {
+            for (c=0; c<m->numChars; c++)
+                {
+
+                /* calculate nStates and nCats */
+                nStates = m->nStates[c];
+                
+                /* the following lines ensure that nCats is 1 unless */
+                /* the character is binary and beta categories are used  */
+                if (nStates == 2)
+                    nCats = m->numBetaCats;
+                else
+                    nCats = 1;
+
+                tmp = k*nStates*nStates; /* tmp contains offset to skip rate cats that already processed*/
+                tiP = pA + m->tiIndex[c] + tmp;
+                tmp = (m->numRateCats-1)*2*2; /* tmp contains size of block of tpi matrices across all rate cats (minus one) for single beta category. Further used only if character is binary to jump to next beta category */
+
+                /* now calculate the final cond likes */
+                for (t=0; t<nCats; t++)
+                    {
+                    for (a=j=0; a<nStates; a++)
+                        {
+                        sum = 0.0;
+                        for (i=0; i<nStates; i++)
+                            sum += tiP[j++]*clDP[i];
+                        if (sum == 0.0)
+                            condLikeUp[a] = 0.0;    /* we lost the conditional likelihood in the downpass (can occur in gamma model) */
+                        else
+                            condLikeUp[a] = clFA[a] / sum;
+                        }
+                        
+                    for (a=j=0; a<nStates; a++)
+                        {
+                        sum = 0.0;
+                        for (i=0; i<nStates; i++)
+                            {
+                            sum += condLikeUp[i] * tiP[j++];
+                            }
+                        clFP[a] = sum * clDP[a];
+                        }
+
+                    clFP += nStates;
+                    clFA += nStates;
+                    clDP += nStates;
+                    tiP += nStates*nStates + tmp;   /* the loops above do not move tiP */
+                    }
+                }
+            }
+        }
+
+    return NO_ERROR;
+}
+
+
+#if defined (AVX_ENABLED)
+/*----------------------------------------------------------------
+|
+|   CondLikeUp_Vec_AVX: pull likelihoods up and calculate scaled
+|       finals for an interior node, any model using the AVX cond
+|       like layout, in which each vector holds one state of eight
+|       characters
+|
+-----------------------------------------------------------------*/
+int CondLikeUp_Vec_AVX (TreeNode *p, int division, int chain)
+{
+    int             a, c, i, k, nStates, nStatesSquared;
+    CLFlt           *tiP;
+    __m256          *clFA, *clFP, *clDP, mCondLikeUp[64], mSum, mZero;
+    ModelInfo       *m;
+    
+    /* find model settings for this division */
+    m = &modelSettings[division];
+
+    /* find number of states in the model */
+    nStates = m->numModelStates;
+    nStatesSquared = nStates * nStates;
+
+    /* calculate final states */
+    if (p->anc->anc == NULL)
+        {
+        /* this is the root node */
+        /* final cond likes = downpass cond likes, kept in the cond like scratch space */
+        clDP = (__m256 *) m->condLikes[m->condLikeIndex[chain][p->index]];
+        clFP = (__m256 *) m->condLikes[m->condLikeScratchIndex[p->index]];
+        for (c=0; c<m->numTiCats*m->numVecChars*nStates; c++)
+            *(clFP++) = *(clDP++);
+        return NO_ERROR;
+        }
+
+    /* find conditional likelihood and transition probability pointers */
+    clFA = (__m256 *) m->condLikes[m->condLikeScratchIndex[p->anc->index]];
+    clFP = (__m256 *) m->condLikes[m->condLikeScratchIndex[p->index     ]];
+    clDP = (__m256 *) m->condLikes[m->condLikeIndex[chain][p->index     ]];
+    tiP = m->tiProbs[m->tiProbsIndex[chain][p->index]];
+    
+    mZero = _mm256_setzero_ps ();
+    for (k=0; k<m->numTiCats; k++)
+        {
+        for (c=0; c<m->numVecChars; c++)
+            {
+            /* condLikeUp[a] = clFA[a] / (sum over i of tiP[a][i]*clDP[i]), or 0.0 if the sum is 0.0 */
+            for (a=0; a<nStates; a++)
+                {
+                mSum = _mm256_setzero_ps ();
+                for (i=0; i<nStates; i++)
+                    mSum = _mm256_add_ps (mSum, _mm256_mul_ps (_mm256_set1_ps (tiP[a*nStates+i]), clDP[i]));
+                mCondLikeUp[a] = _mm256_and_ps (_mm256_div_ps (clFA[a], mSum), _mm256_cmp_ps (mSum, mZero, _CMP_NEQ_OQ));
+                }
+
+            /* clFP[a] = (sum over i of condLikeUp[i]*tiP[a][i]) * clDP[a] */
+            for (a=0; a<nStates; a++)
+                {
+                mSum = _mm256_setzero_ps ();
+                for (i=0; i<nStates; i++)
+                    mSum = _mm256_add_ps (mSum, _mm256_mul_ps (_mm256_set1_ps (tiP[a*nStates+i]), mCondLikeUp[i]));
+                *(clFP++) = _mm256_mul_ps (mSum, clDP[a]);
+                }
+
+            clFA += nStates;
+            clDP += nStates;
+            }
+        tiP += nStatesSquared;
+        }
+
+    return NO_ERROR;
+}
+#endif
+
+
+#if defined (SSE_ENABLED)
+/*----------------------------------------------------------------
+|
+|   CondLikeUp_Vec_SSE: pull likelihoods up and calculate scaled
+|       finals for an interior node, any model using the SSE cond
+|       like layout, in which each vector holds one state of four
+|       characters
+|
+-----------------------------------------------------------------*/
+int CondLikeUp_Vec_SSE (TreeNode *p, int division, int chain)
+{
+    int             a, c, i, k, nStates, nStatesSquared;
+    CLFlt           *tiP;
+    __m128          *clFA, *clFP, *clDP, mCondLikeUp[64], mSum, mZero;
+    ModelInfo       *m;
+    
+    /* find model settings for this division */
+    m = &modelSettings[division];
+
+    /* find number of states in the model */
+    nStates = m->numModelStates;
+    nStatesSquared = nStates * nStates;
+
+    /* calculate final states */
+    if (p->anc->anc == NULL)
+        {
+        /* this is the root node */
+        /* final cond likes = downpass cond likes, kept in the cond like scratch space */
+        clDP = (__m128 *) m->condLikes[m->condLikeIndex[chain][p->index]];
+        clFP = (__m128 *) m->condLikes[m->condLikeScratchIndex[p->index]];
+        for (c=0; c<m->numTiCats*m->numVecChars*nStates; c++)
             *(clFP++) = *(clDP++);
+        return NO_ERROR;
         }
-    else
-        {
-        /* find conditional likelihood pointers */
-        /* use conditional likelihood scratch space for final cond likes */
-        clFA = m->condLikes[m->condLikeScratchIndex[p->anc->index]];
-        clFP = m->condLikes[m->condLikeScratchIndex[p->index     ]];
-        clDP = m->condLikes[m->condLikeIndex[chain][p->index     ]];
 
-        /* find transition probabilities */
-        pA = m->tiProbs[m->tiProbsIndex[chain][p->index]];
-        
-        for (k=0; k<m->numRateCats; k++)
+    /* find conditional likelihood and transition probability pointers */
+    clFA = (__m128 *) m->condLikes[m->condLikeScratchIndex[p->anc->index]];
+    clFP = (__m128 *) m->condLikes[m->condLikeScratchIndex[p->index     ]];
+    clDP = (__m128 *) m->condLikes[m->condLikeIndex[chain][p->index     ]];
+    tiP = m->tiProbs[m->tiProbsIndex[chain][p->index]];
+    
+    mZero = _mm_setzero_ps ();
+    for (k=0; k<m->numTiCats; k++)
+        {
+        for (c=0; c<m->numVecChars; c++)
             {
-            for (c=0; c<m->numChars; c++)
+            /* condLikeUp[a] = clFA[a] / (sum over i of tiP[a][i]*clDP[i]), or 0.0 if the sum is 0.0 */
+            for (a=0; a<nStates; a++)
                 {
+                mSum = _mm_setzero_ps ();
+                for (i=0; i<nStates; i++)
+                    mSum = _mm_add_ps (mSum, _mm_mul_ps (_mm_set1_ps (tiP[a*nStates+i]), clDP[i]));
+                mCondLikeUp[a] = _mm_and_ps (_mm_div_ps (clFA[a], mSum), _mm_cmpneq_ps (mSum, mZero));
+                }
 
-                /* calculate nStates and nCats */
-                nStates = m->nStates[c];
-                
-                /* the following lines ensure that nCats is 1 unless */
-                /* the character is binary and beta categories are used  */
-                if (nStates == 2)
-                    nCats = m->numBetaCats;
-                else
-                    nCats = 1;
-
-                tmp = k*nStates*nStates; /* tmp contains offset to skip rate cats that already processed*/
-                tiP = pA + m->tiIndex[c] + tmp;
-                tmp = (m->numRateCats-1)*2*2; /* tmp contains size of block of tpi matrices across all rate cats (minus one) for single beta category. Further used only if character is binary to jump to next beta category */
-
-                /* now calculate the final cond likes */
-                for (t=0; t<nCats; t++)
-                    {
-                    for (a=j=0; a<nStates; a++)
-                        {
-                        sum = 0.0;
-                        for (i=0; i<nStates; i++)
-                            sum += tiP[j++]*clDP[i];
-                        if (sum == 0.0)
-                            condLikeUp[a] = 0.0;    /* we lost the conditional likelihood in the downpass (can occur in gamma model) */
-                        else
-                            condLikeUp[a] = clFA[a] / sum;
-                        }
-                        
-                    for (a=j=0; a<nStates; a++)
-                        {
-                        sum = 0.0;
-                        for (i=0; i<nStates; i++)
-                            {
-                            sum += condLikeUp[i] * tiP[j++];
-                            }
-                        clFP[a] = sum * clDP[a];
-                        }
-
-                    clFP += nStates;
-                    clFA += nStates;
-                    clDP += nStates;
-                    tiP += tmp;
-                    }
+            /* clFP[a] = (sum over i of condLikeUp[i]*tiP[a][i]) * clDP[a] */
+            for (a=0; a<nStates; a++)
+                {
+                mSum = _mm_setzero_ps ();
+                for (i=0; i<nStates; i++)
+                    mSum = _mm_add_ps (mSum, _mm_mul_ps (_mm_set1_ps (tiP[a*nStates+i]), mCondLikeUp[i]));
+                *(clFP++) = _mm_mul_ps (mSum, clDP[a]);
                 }
+
+            clFA += nStates;
+            clDP += nStates;
             }
+        tiP += nStatesSquared;
         }
 
     return NO_ERROR;
 }
+#endif
 
 
 /*----------------------------------------------------------------
@@ -5808,6 +7569,8 @@ int Likelihood_Gen (TreeNode *p, int division, int chain, MrBFlt *lnL, int which
             else    
                 {
                 (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+                if (m->siteLnL != NULL)
+                    m->siteLnL[c] = lnScaler[c] + log(like);
                 }
             }
         }
@@ -5855,6 +7618,8 @@ int Likelihood_Gen (TreeNode *p, int division, int chain, MrBFlt *lnL, int which
             else    
                 {
                 (*lnL) += lnLike * nSitesOfPat[c];
+                if (m->siteLnL != NULL)
+                    m->siteLnL[c] = lnLike;
                 }
             }       
         }
@@ -6026,6 +7791,8 @@ int Likelihood_Gen_SSE (TreeNode *p, int division, int chain, MrBFlt *lnL, int w
             else    
                 {
                 (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+                if (m->siteLnL != NULL)
+                    m->siteLnL[c] = lnScaler[c] + log(like);
                 }
             }
         }
@@ -6079,6 +7846,8 @@ int Likelihood_Gen_SSE (TreeNode *p, int division, int chain, MrBFlt *lnL, int w
             else    
                 {
                 (*lnL) += lnLike * nSitesOfPat[c];
+                if (m->siteLnL != NULL)
+                    m->siteLnL[c] = lnLike;
                 }
             }       
         }
@@ -6297,6 +8066,8 @@ int Likelihood_NUC4 (TreeNode *p, int division, int chain, MrBFlt *lnL, int whic
             else    
                 {
                 (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+                if (m->siteLnL != NULL)
+                    m->siteLnL[c] = lnScaler[c] + log(like);
                 }
             }
         }
@@ -6344,6 +8115,8 @@ int Likelihood_NUC4 (TreeNode *p, int division, int chain, MrBFlt *lnL, int whic
             else    
                 {
                 (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+                if (m->siteLnL != NULL)
+                    m->siteLnL[c] = lnScaler[c] + log(like);
                 }
             }       
         }
@@ -6707,6 +8480,8 @@ int Likelihood_NUC4_FMA (TreeNode *p, int division, int chain, MrBFlt *lnL, int
             else
             {
                 (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+                if (m->siteLnL != NULL)
+                    m->siteLnL[c] = lnScaler[c] + log(like);
             }
         }
     }
@@ -6746,6 +8521,8 @@ int Likelihood_NUC4_FMA (TreeNode *p, int division, int chain, MrBFlt *lnL, int
             else
             {
                 (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+                if (m->siteLnL != NULL)
+                    m->siteLnL[c] = lnScaler[c] + log(like);
             }
         }
     }
@@ -6879,6 +8656,8 @@ int Likelihood_NUC4_AVX (TreeNode *p, int division, int chain, MrBFlt *lnL, int
             else
             {
                 (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+                if (m->siteLnL != NULL)
+                    m->siteLnL[c] = lnScaler[c] + log(like);
             }
         }
     }
@@ -6918,6 +8697,8 @@ int Likelihood_NUC4_AVX (TreeNode *p, int division, int chain, MrBFlt *lnL, int
             else
             {
                 (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+                if (m->siteLnL != NULL)
+                    m->siteLnL[c] = lnScaler[c] + log(like);
             }
         }
     }
@@ -7051,6 +8832,8 @@ int Likelihood_NUC4_SSE (TreeNode *p, int division, int chain, MrBFlt *lnL, int
             else    
                 {
                 (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+                if (m->siteLnL != NULL)
+                    m->siteLnL[c] = lnScaler[c] + log(like);
                 }
             }
         }
@@ -7090,6 +8873,8 @@ int Likelihood_NUC4_SSE (TreeNode *p, int division, int chain, MrBFlt *lnL, int
             else    
                 {
                 (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+                if (m->siteLnL != NULL)
+                    m->siteLnL[c] = lnScaler[c] + log(like);
                 }
             }
         }
@@ -7164,6 +8949,8 @@ int Likelihood_NY98 (TreeNode *p, int division, int chain, MrBFlt *lnL, int whic
         else
             {
             (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+            if (m->siteLnL != NULL)
+                m->siteLnL[c] = lnScaler[c] + log(like);
             }
         }
 
@@ -7250,6 +9037,8 @@ int Likelihood_NY98_SSE (TreeNode *p, int division, int chain, MrBFlt *lnL, int
         else    
             {
             (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+            if (m->siteLnL != NULL)
+                m->siteLnL[c] = lnScaler[c] + log(like);
             }
         }
 
@@ -7341,11 +9130,18 @@ int Likelihood_Res (TreeNode *p, int division, int chain, MrBFlt *lnL, int which
         else    
             {
             (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+            if (m->siteLnL != NULL)
+                m->siteLnL[c] = lnScaler[c] + log(like);
             }
         }
 
     /* correct for absent characters */
     (*lnL) -=  log(pObserved) * (m->numUncompressedChars);
+    if (m->siteLnL != NULL)
+        {
+        for (c=m->numDummyChars; c<m->numChars; c++)
+            m->siteLnL[c] -= log(pObserved);
+        }
 
     return NO_ERROR;
 }
@@ -7448,11 +9244,18 @@ int Likelihood_Res_SSE (TreeNode *p, int division, int chain, MrBFlt *lnL, int w
         else    
             {
             (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+            if (m->siteLnL != NULL)
+                m->siteLnL[c] = lnScaler[c] + log(like);
             }
         }
 
     /* correct for absent characters */
     (*lnL) -=  log(pObserved) * (m->numUncompressedChars);
+    if (m->siteLnL != NULL)
+        {
+        for (c=m->numDummyChars; c<m->numChars; c++)
+            m->siteLnL[c] -= log(pObserved);
+        }
 
     return NO_ERROR;
 }
@@ -7558,6 +9361,8 @@ int Likelihood_Std (TreeNode *p, int division, int chain, MrBFlt *lnL, int which
             else    
                 {
                 (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+                if (m->siteLnL != NULL)
+                    m->siteLnL[c] = lnScaler[c] + log(like);
                 }
             }
         }
@@ -7638,12 +9443,19 @@ int Likelihood_Std (TreeNode *p, int division, int chain, MrBFlt *lnL, int which
             else    
                 {
                 (*lnL) += (lnScaler[c] +  log(like)) * nSitesOfPat[c];
+                if (m->siteLnL != NULL)
+                    m->siteLnL[c] = lnScaler[c] + log(like);
                 }
             }
         }
 
     /* correct for absent characters */
     (*lnL) -=  log(pObserved) * (m->numUncompressedChars);
+    if (m->siteLnL != NULL)
+        {
+        for (c=m->numDummyChars; c<m->numChars; c++)
+            m->siteLnL[c] -= log(pObserved);
+        }
 
     return NO_ERROR;
 }
@@ -7859,8 +9671,8 @@ int Likelihood_ParsStd (TreeNode *p, int division, int chain, MrBFlt *lnL, int w
     /* Get tree */
     t = GetTree(m->brlens,chain,state[chain]);
     
-    /* Allocate space for parsimony tree length */
-    treeLength = (CLFlt *) SafeCalloc (m->numChars, sizeof (CLFlt));
+    /* Get scratch space for parsimony tree length */
+    treeLength = (CLFlt *) ScratchCalloc (m->numChars, sizeof (CLFlt));
     
     /* Get number of states */
     nStates = m->nStates;
@@ -7919,9 +9731,6 @@ int Likelihood_ParsStd (TreeNode *p, int division, int chain, MrBFlt *lnL, int w
         *lnL -= ((treeLength[c] + nSitesOfPat[c]) * log (nStates[c]));
         }
 
-    /* Free space for parsimony character states */
-    free (treeLength);
-
     return (NO_ERROR);
 }
 
@@ -7936,6 +9745,7 @@ void LaunchLogLikeForDivision(int chain, int d, MrBFlt* lnL)
 {
     int i;
     TreeNode        *p;
+    TraversalNode   *q;
     ModelInfo       *m;
     Tree            *tree;
 #   if defined (TIMING_ANALIZ)
@@ -7972,39 +9782,41 @@ void LaunchLogLikeForDivision(int chain, int d, MrBFlt* lnL)
     
     if (m->parsModelId == NO)
         {
-        for (i=0; i<tree->nIntNodes; i++)
+        /* run through the interior nodes that need work, collected by GetTraversal in LogLike */
+        for (i=0; i<tree->nTraversal; i++)
             {
-            p = tree->intDownPass[i];
+            q = &tree->traversal[i];
+            p = q->node;
             
-            if (p->left->upDateTi == YES)
+            if (q->upDateLeftTi == YES)
                 {
                 /* shift state of ti probs for node */
-                FlipTiProbsSpace (m, chain, p->left->index);
-                m->TiProbs (p->left, d, chain);
+                FlipTiProbsSpace (m, chain, q->leftIndex);
+                m->TiProbs (q->left, d, chain);
                 }
             
-            if (p->right->upDateTi == YES)
+            if (q->upDateRightTi == YES)
                 {
                 /* shift state of ti probs for node */
-                FlipTiProbsSpace (m, chain, p->right->index);
-                m->TiProbs (p->right, d, chain);
+                FlipTiProbsSpace (m, chain, q->rightIndex);
+                m->TiProbs (q->right, d, chain);
                 }
             
             if (tree->isRooted == NO)
                 {
-                if (p->anc->anc == NULL /* && p->upDateTi == YES */)
+                if (q->isRoot == YES /* && p->upDateTi == YES */)
                     {
                     /* shift state of ti probs for node */
-                    FlipTiProbsSpace (m, chain, p->index);
+                    FlipTiProbsSpace (m, chain, q->index);
                     m->TiProbs (p, d, chain);
                     }
                 }
             
-            if (p->upDateCl == YES)
+            if (q->upDateCl == YES)
                 {
                 if (tree->isRooted == NO)
                     {
-                    if (p->anc->anc == NULL)
+                    if (q->isRoot == YES)
                         {
                         TIME(m->CondLikeRoot (p, d, chain),CPUCondLikeRoot);
                         }
@@ -8018,7 +9830,7 @@ void LaunchLogLikeForDivision(int chain, int d, MrBFlt* lnL)
                     TIME(m->CondLikeDown (p, d, chain),CPUCondLikeDown);
                     }
 
-                if (m->unscaledNodes[chain][p->index] == 0 && m->upDateAll == NO)
+                if (m->unscaledNodes[chain][q->index] == 0 && m->upDateAll == NO)
                     {
 #if defined (SSE_ENABLED)
                     if (m->useVec == VEC_SSE)
@@ -8039,17 +9851,25 @@ void LaunchLogLikeForDivision(int chain, int d, MrBFlt* lnL)
                     TIME(RemoveNodeScalers (p, d, chain),CPUScalersRemove);
 #   endif
                     }
-                FlipNodeScalerSpace (m, chain, p->index);
-                m->unscaledNodes[chain][p->index] = 1 + m->unscaledNodes[chain][p->left->index] + m->unscaledNodes[chain][p->right->index];
+                FlipNodeScalerSpace (m, chain, q->index);
+                m->unscaledNodes[chain][q->index] = 1 + m->unscaledNodes[chain][q->leftIndex] + m->unscaledNodes[chain][q->rightIndex];
                 
-                if (m->unscaledNodes[chain][p->index] >= m->rescaleFreq[chain] && p->anc->anc != NULL)
+                if (m->unscaledNodes[chain][q->index] >= m->rescaleFreq[chain] && q->isRoot == NO)
                     {
                     TIME(m->CondLikeScaler (p, d, chain),CPUScalers);
                     }
                 }
             }
         }
+    /* the site lnLs go to the array not holding those of the other state, which the chain may return to */
+    if (m->siteLnLs != NULL)
+        {
+        i = 2 * chain + state[chain];
+        m->siteLnLIndex[i] = m->siteLnLIndex[i ^ 1] ^ 1;
+        m->siteLnL = m->siteLnLs + (2 * chain + m->siteLnLIndex[i]) * m->numChars;
+        }
     TIME(m->Likelihood (tree->root->left, d, chain, lnL, (chainId[chain] % chainParams.numChains)),CPULilklihood);
+    m->siteLnL = NULL;
     return;
 }
 
@@ -8882,412 +10702,1014 @@ int SetProteinQMatrix (MrBFlt **a, int n, int whichChain, int division, MrBFlt r
         else if (aaModelID == AAMODEL_MTREV)
             {
             for (i=0; i<20; i++)
-                for (j=0; j<20; j++)
+                for (j=0; j<20; j++)
+                    a[i][j] = aaMtrev24[i][j];
+            }
+        else if (aaModelID == AAMODEL_MTMAM)
+            {
+            for (i=0; i<20; i++)
+                for (j=0; j<20; j++)
+                    a[i][j] = aaMtmam[i][j];
+            }
+        else if (aaModelID == AAMODEL_RTREV)
+            {
+            for (i=0; i<20; i++)
+                for (j=0; j<20; j++)
+                    a[i][j] = aartREV[i][j];
+            }
+        else if (aaModelID == AAMODEL_WAG)
+            {
+            for (i=0; i<20; i++)
+                for (j=0; j<20; j++)
+                    a[i][j] = aaWAG[i][j];
+            }
+        else if (aaModelID == AAMODEL_CPREV)
+            {
+            for (i=0; i<20; i++)
+                for (j=0; j<20; j++)
+                    a[i][j] = aacpREV[i][j];
+            }
+        else if (aaModelID == AAMODEL_VT)
+            {
+            for (i=0; i<20; i++)
+                for (j=0; j<20; j++)
+                    a[i][j] = aaVt[i][j];
+            }
+        else if (aaModelID == AAMODEL_BLOSUM)
+            {
+            for (i=0; i<20; i++)
+                for (j=0; j<20; j++)
+                    a[i][j] = aaBlosum[i][j];
+            }
+        else if (aaModelID == AAMODEL_LG)
+            {
+            for (i=0; i<20; i++)
+                for (j=0; j<20; j++)
+                    a[i][j] = aaLG[i][j];
+            }
+        else
+            {
+            MrBayesPrint ("%s   ERROR: Don't understand which amino acid model is needed\n");
+            return (ERROR);
+            }
+#       if 0
+        for (i=0; i<20; i++)
+            {
+            for (j=0; j<20; j++)
+                printf ("%1.3lf ", a[i][j]);
+            printf ("\n");
+            }
+#       endif
+        }
+    else
+        {
+        /* 40 X 40 covarion model:
+        
+           We have a covarion model, and must set up the other quadrants. Note that if
+           we are at this point in the code, that we have already set up the upper left
+           portion of the 40 X 40 rate matrix. Note that if we have rate
+           variation across sites, that we need to deal with the multiplication
+           in the rate matrix (i.e., we cannot simply deal with rate variation
+           by multiplying the branch length by a rate multiplier as we can
+           with other models). Instead, we multiply the scaled rate matrix
+           by the rate multiplier. */
+
+        /* Get the switching rates. The rate of off->on is s01 and the rate
+           of on->off is s10. The stationary probability of the switch process
+           is prob1 = s01/(s01+s10) and prob0 = s10/(s01+s10). */
+        swr = GetParamVals (m->switchRates, whichChain, state[whichChain]);
+        s01 = swr[0];
+        s10 = swr[1];
+        probOn = s01 / (s01 + s10);
+        
+        /* set matrix a[][] to 0 */
+        for (i=0; i<40; i++)
+            for (j=0; j<40; j++)
+                a[i][j] = 0.0;  
+                
+        /* fill in upper-left sub matrix (where substitutions occur */
+        if (aaModelID == AAMODEL_POISSON)
+            {
+            scaler = 0.0;
+            for (i=0; i<20; i++)
+                {
+                for (j=i+1; j<20; j++)
+                    {
+                    a[i][j] = 0.05;
+                    a[j][i] = 0.05;
+                    scaler += 0.05 * a[i][j] * probOn;
+                    scaler += 0.05 * a[j][i] * probOn;
+                    }
+                }
+            }
+        else if (aaModelID == AAMODEL_EQ)
+            {
+            bs = GetParamSubVals (m->stateFreq, whichChain, state[whichChain]);
+            scaler = 0.0;
+            for (i=0; i<20; i++)
+                {
+                for (j=i+1; j<20; j++)
+                    {
+                    a[i][j] = bs[j];
+                    a[j][i] = bs[i];
+                    scaler += bs[i] * a[i][j] * probOn;
+                    scaler += bs[j] * a[j][i] * probOn;
+                    }
+                }
+            }
+        else if (aaModelID == AAMODEL_GTR)
+            {
+            bs = GetParamSubVals (m->stateFreq, whichChain, state[whichChain]);
+            rt = GetParamVals (m->revMat, whichChain, state[whichChain]);
+            for (i=0; i<20; i++)
+                for (j=0; j<20; j++)
+                    a[i][j] = 0.0;
+            scaler = 0.0;
+            for (i=k=0; i<20; i++)
+                {
+                for (j=i+1; j<20; j++)
+                    {
+                    a[i][i] -= (a[i][j] = bs[j] * rt[k]);
+                    a[j][j] -= (a[j][i] = bs[i] * rt[k]);
+                    k++;
+                    }
+                }
+            for (i=0; i<20; i++)
+                scaler += -(bs[i] * a[i][i]);
+            for (i=0; i<20; i++)
+                for (j=0; j<20; j++)
+                    a[i][j] /= scaler;
+            for (i=0; i<20; i++)
+                {
+                for (j=i+1; j<20; j++)
+                    {
+                    a[i][j] = bs[j];
+                    a[j][i] = bs[i];
+                    scaler += bs[i] * a[i][j] * probOn;
+                    scaler += bs[j] * a[j][i] * probOn;
+                    }
+                }
+            }
+        else if (aaModelID == AAMODEL_JONES)
+            {
+            scaler = 0.0;
+            for (i=0; i<20; i++)
+                {
+                for (j=i+1; j<20; j++)
+                    {
+                    a[i][j] = aaJones[i][j];
+                    a[j][i] = aaJones[j][i];
+                    scaler += jonesPi[i] * a[i][j] * probOn;
+                    scaler += jonesPi[j] * a[j][i] * probOn;
+                    }
+                }
+            }
+        else if (aaModelID == AAMODEL_DAY)
+            {
+            scaler = 0.0;
+            for (i=0; i<20; i++)
+                {
+                for (j=i+1; j<20; j++)
+                    {
+                    a[i][j] = aaDayhoff[i][j];
+                    a[j][i] = aaDayhoff[j][i];
+                    scaler += dayhoffPi[i] * a[i][j] * probOn;
+                    scaler += dayhoffPi[j] * a[j][i] * probOn;
+                    }
+                }
+            }
+        else if (aaModelID == AAMODEL_MTREV)
+            {
+            scaler = 0.0;
+            for (i=0; i<20; i++)
+                {
+                for (j=i+1; j<20; j++)
+                    {
                     a[i][j] = aaMtrev24[i][j];
+                    a[j][i] = aaMtrev24[j][i];
+                    scaler += mtrev24Pi[i] * a[i][j] * probOn;
+                    scaler += mtrev24Pi[j] * a[j][i] * probOn;
+                    }
+                }
             }
         else if (aaModelID == AAMODEL_MTMAM)
             {
+            scaler = 0.0;
             for (i=0; i<20; i++)
-                for (j=0; j<20; j++)
+                {
+                for (j=i+1; j<20; j++)
+                    {
                     a[i][j] = aaMtmam[i][j];
+                    a[j][i] = aaMtmam[j][i];
+                    scaler += mtmamPi[i] * a[i][j] * probOn;
+                    scaler += mtmamPi[j] * a[j][i] * probOn;
+                    }
+                }
             }
         else if (aaModelID == AAMODEL_RTREV)
             {
+            scaler = 0.0;
             for (i=0; i<20; i++)
-                for (j=0; j<20; j++)
+                {
+                for (j=i+1; j<20; j++)
+                    {
                     a[i][j] = aartREV[i][j];
+                    a[j][i] = aartREV[j][i];
+                    scaler += rtrevPi[i] * a[i][j] * probOn;
+                    scaler += rtrevPi[j] * a[j][i] * probOn;
+                    }
+                }
             }
         else if (aaModelID == AAMODEL_WAG)
             {
+            scaler = 0.0;
             for (i=0; i<20; i++)
-                for (j=0; j<20; j++)
+                {
+                for (j=i+1; j<20; j++)
+                    {
                     a[i][j] = aaWAG[i][j];
+                    a[j][i] = aaWAG[j][i];
+                    scaler += wagPi[i] * a[i][j] * probOn;
+                    scaler += wagPi[j] * a[j][i] * probOn;
+                    }
+                }
             }
         else if (aaModelID == AAMODEL_CPREV)
             {
+            scaler = 0.0;
             for (i=0; i<20; i++)
-                for (j=0; j<20; j++)
+                {
+                for (j=i+1; j<20; j++)
+                    {
                     a[i][j] = aacpREV[i][j];
+                    a[j][i] = aacpREV[j][i];
+                    scaler += cprevPi[i] * a[i][j] * probOn;
+                    scaler += cprevPi[j] * a[j][i] * probOn;
+                    }
+                }
             }
         else if (aaModelID == AAMODEL_VT)
             {
+            scaler = 0.0;
             for (i=0; i<20; i++)
-                for (j=0; j<20; j++)
+                {
+                for (j=i+1; j<20; j++)
+                    {
                     a[i][j] = aaVt[i][j];
+                    a[j][i] = aaVt[j][i];
+                    scaler += vtPi[i] * a[i][j] * probOn;
+                    scaler += vtPi[j] * a[j][i] * probOn;
+                    }
+                }
             }
         else if (aaModelID == AAMODEL_BLOSUM)
             {
+            scaler = 0.0;
             for (i=0; i<20; i++)
-                for (j=0; j<20; j++)
+                {
+                for (j=i+1; j<20; j++)
+                    {
                     a[i][j] = aaBlosum[i][j];
+                    a[j][i] = aaBlosum[j][i];
+                    scaler += blosPi[i] * a[i][j] * probOn;
+                    scaler += blosPi[j] * a[j][i] * probOn;
+                    }
+                }
             }
         else if (aaModelID == AAMODEL_LG)
             {
+            scaler = 0.0;
             for (i=0; i<20; i++)
-                for (j=0; j<20; j++)
+                {
+                for (j=i+1; j<20; j++)
+                    {
                     a[i][j] = aaLG[i][j];
+                    a[j][i] = aaLG[j][i];
+                    scaler += lgPi[i] * a[i][j] * probOn;
+                    scaler += lgPi[j] * a[j][i] * probOn;
+                    }
+                }
             }
         else
             {
             MrBayesPrint ("%s   ERROR: Don't understand which amino acid model is needed\n");
             return (ERROR);
             }
-#       if 0
+
+        /* rescale off diagonal elements of Q matrix */
+        scaler = 1.0 / scaler;
         for (i=0; i<20; i++)
             {
             for (j=0; j<20; j++)
-                printf ("%1.3lf ", a[i][j]);
-            printf ("\n");
+                {
+                if (i != j)
+                    a[i][j] *= scaler;
+                }
             }
-#       endif
+            
+        /* now, scale by rate factor */
+        for (i=0; i<20; i++)
+            {
+            for (j=0; j<20; j++)
+                {
+                if (i != j)
+                    a[i][j] *= rateMult;
+                }
+            }
+            
+        /* put in diagonal elements */
+        for (i=0; i<20; i++)
+            {
+            sum = 0.0;
+            for (j=0; j<20; j++)
+                {
+                if (i != j)
+                    sum += a[i][j];
+                a[i][i] = -(sum + s10);
+                }
+            }
+                
+        /* fill in the other three submatrices */
+        for (i=20; i<40; i++)
+            a[i][i] = -s01;
+        for (i=0; i<20; i++)
+            {
+            a[i][20+i] = s10;
+            a[20+i][i] = s01;
+            }
+                       
         }
-    else
-        {
-        /* 40 X 40 covarion model:
-        
-           We have a covarion model, and must set up the other quadrants. Note that if
-           we are at this point in the code, that we have already set up the upper left
-           portion of the 40 X 40 rate matrix. Note that if we have rate
-           variation across sites, that we need to deal with the multiplication
-           in the rate matrix (i.e., we cannot simply deal with rate variation
-           by multiplying the branch length by a rate multiplier as we can
-           with other models). Instead, we multiply the scaled rate matrix
-           by the rate multiplier. */
 
-        /* Get the switching rates. The rate of off->on is s01 and the rate
-           of on->off is s10. The stationary probability of the switch process
-           is prob1 = s01/(s01+s10) and prob0 = s10/(s01+s10). */
-        swr = GetParamVals (m->switchRates, whichChain, state[whichChain]);
-        s01 = swr[0];
-        s10 = swr[1];
-        probOn = s01 / (s01 + s10);
-        
-        /* set matrix a[][] to 0 */
-        for (i=0; i<40; i++)
-            for (j=0; j<40; j++)
-                a[i][j] = 0.0;  
-                
-        /* fill in upper-left sub matrix (where substitutions occur */
-        if (aaModelID == AAMODEL_POISSON)
+    return (NO_ERROR);
+}
+
+
+int SetStdQMatrix (MrBFlt **a, int nStates, MrBFlt *bs, int cType)
+{
+    register int    i, j;
+    MrBFlt          scaler;
+
+    /* This function sets up ordered or unordered models for standard characters
+       with unequal stationary state frequencies. It requires the stationary
+       frequencies of the states (passed when calling the function). It also
+       needs to know the number of states and the type (ordered or unordered) 
+       of the character. */
+
+    /* set Q matrix to 0 */
+    for (i=0; i<nStates; i++)
+        for (j=0; j<nStates; j++)
+            a[i][j] = 0.0;
+
+    /* initialize Q matrix */
+    scaler = 0.0;
+    if (cType == UNORD)
+        {
+        /* unordered characters */
+        for (i=0; i<nStates; i++)
             {
-            scaler = 0.0;
-            for (i=0; i<20; i++)
+            for (j=0; j<nStates; j++)
                 {
-                for (j=i+1; j<20; j++)
+                if (i != j)
                     {
-                    a[i][j] = 0.05;
-                    a[j][i] = 0.05;
-                    scaler += 0.05 * a[i][j] * probOn;
-                    scaler += 0.05 * a[j][i] * probOn;
+                    a[i][i] -= (a[i][j] = bs[j]);
+                    scaler += bs[i] * a[i][j];
                     }
                 }
             }
-        else if (aaModelID == AAMODEL_EQ)
+        }
+    else
+        {
+        /* ordered characters */
+        for (i=0; i<nStates; i++)
             {
-            bs = GetParamSubVals (m->stateFreq, whichChain, state[whichChain]);
-            scaler = 0.0;
-            for (i=0; i<20; i++)
+            for (j=0; j<nStates; j++)
                 {
-                for (j=i+1; j<20; j++)
+                if (abs(i - j) == 1)
                     {
-                    a[i][j] = bs[j];
-                    a[j][i] = bs[i];
-                    scaler += bs[i] * a[i][j] * probOn;
-                    scaler += bs[j] * a[j][i] * probOn;
+                    a[i][i] -= (a[i][j] = bs[j]);
+                    scaler += bs[i] * a[i][j];
                     }
                 }
             }
-        else if (aaModelID == AAMODEL_GTR)
+        }
+        
+    /* rescale Q matrix */
+    for (i=0; i<nStates; i++)
+        for (j=0; j<nStates; j++)
+            a[i][j] /= scaler;
+
+#   if defined DEBUG_SETSTDQMATRIX
+    for (i=0; i<nStates; i++)
+        {
+        for (j=0; j<nStates; j++)
+            printf ("%0.5lf ", a[i][j]);
+        printf ("\n");
+        }
+#   endif
+
+    return (NO_ERROR);
+}
+
+
+/*----------------------------------------------------------------
+|
+|   TiProbsDerivs: Calculates transition probabilities for the
+|       branch below p at p->length, and their first and second
+|       derivatives with respect to the branch length, in double
+|       precision and with the layout of the tiProbs arrays. Models
+|       with eigen systems use them directly, and so does the
+|       standard model with unequal state frequencies, whose binary
+|       characters have a closed form in each beta category. For the
+|       other closed-form models P = exp(fQv) is computed here in
+|       double precision, so that lnL stays smooth in v even at
+|       BRLENS_MIN, and P' = fQP, P'' = fQP' for the rate matrix Q
+|       scaled by the category rate f.
+|
+-----------------------------------------------------------------*/
+int TiProbsDerivs (TreeNode *p, int division, int chain, MrBFlt *tiP, MrBFlt *tiP1, MrBFlt *tiP2)
+{
+    int             i, j, k, l, n, s, nObs, nCats, index, sizeOfSingleCijk, nStates, cType;
+    MrBFlt          t, f, *catRate, baseRate, theRate, *eigenValues, *cijk, *ptr, correctionFactor,
+                    eV0[64], eV1[64], eV2[64], sum, sum1, sum2, *pis, kap, scaler,
+                    qMem[100], *q[10], bs[10], lambda, s10, s01, *e0, *e1, *e2,
+                    eE0[80], eE1[80], eE2[80], x;
+    ModelInfo       *m;
+
+    m = &modelSettings[division];
+    n = m->numModelStates;
+
+    /* get base rate, compensated for invariable sites */
+    baseRate = GetRate (division, chain);
+    if (m->pInvar != NULL)
+        baseRate /= (1.0 - (*GetParamVals(m->pInvar, chain, state[chain])));
+
+    /* get category rates */
+    theRate = 1.0;
+    if (m->shape != NULL)
+        catRate = GetParamSubVals (m->shape, chain, state[chain]);
+    else if (m->mixtureRates != NULL)
+        catRate = GetParamSubVals (m->mixtureRates, chain, state[chain]);
+    else
+        catRate = &theRate;
+
+    if (m->TiProbs == &TiProbs_Cov)
+        {
+        /* each eigen mode evolves under the 2 X 2 matrix M of CovarionBlockExp, so
+           the derivatives of its block exponential E are fME and fM(fME) */
+        nObs = n / 2;
+        eigenValues = m->cijks[m->cijkIndex[chain]];
+        ptr = eigenValues + nObs;
+        s10 = ptr[m->nCijkParts];
+        s01 = ptr[m->nCijkParts + 1];
+        cijk = ptr + m->nCijkParts + 2;
+        f = (m->nCijkParts == 1) ? baseRate * catRate[0] : 1.0;
+        t = p->length * f;
+        for (k=0; k<m->nCijkParts; k++)
             {
-            bs = GetParamSubVals (m->stateFreq, whichChain, state[whichChain]);
-            rt = GetParamVals (m->revMat, whichChain, state[whichChain]);
-            for (i=0; i<20; i++)
-                for (j=0; j<20; j++)
-                    a[i][j] = 0.0;
-            scaler = 0.0;
-            for (i=k=0; i<20; i++)
+            for (s=0; s<nObs; s++)
                 {
-                for (j=i+1; j<20; j++)
-                    {
-                    a[i][i] -= (a[i][j] = bs[j] * rt[k]);
-                    a[j][j] -= (a[j][i] = bs[i] * rt[k]);
-                    k++;
-                    }
+                lambda = ptr[k] * eigenValues[s];
+                e0 = eE0 + 4*s;
+                e1 = eE1 + 4*s;
+                e2 = eE2 + 4*s;
+                CovarionBlockExp (lambda, s10, s01, t, e0);
+                e1[0] = f * ((lambda - s10) * e0[0] + s10 * e0[2]);
+                e1[1] = f * ((lambda - s10) * e0[1] + s10 * e0[3]);
+                e1[2] = f * (s01 * e0[0] - s01 * e0[2]);
+                e1[3] = f * (s01 * e0[1] - s01 * e0[3]);
+                e2[0] = f * ((lambda - s10) * e1[0] + s10 * e1[2]);
+                e2[1] = f * ((lambda - s10) * e1[1] + s10 * e1[3]);
+                e2[2] = f * (s01 * e1[0] - s01 * e1[2]);
+                e2[3] = f * (s01 * e1[1] - s01 * e1[3]);
                 }
-            for (i=0; i<20; i++)
-                scaler += -(bs[i] * a[i][i]);
-            for (i=0; i<20; i++)
-                for (j=0; j<20; j++)
-                    a[i][j] /= scaler;
-            for (i=0; i<20; i++)
+            index = k * n * n;
+            CovarionTiProbs (nObs, cijk, eE0, tiP + index);
+            CovarionTiProbs (nObs, cijk, eE1, tiP1 + index);
+            CovarionTiProbs (nObs, cijk, eE2, tiP2 + index);
+            for (i=0; i<n*n; i++)
                 {
-                for (j=i+1; j<20; j++)
-                    {
-                    a[i][j] = bs[j];
-                    a[j][i] = bs[i];
-                    scaler += bs[i] * a[i][j] * probOn;
-                    scaler += bs[j] * a[j][i] * probOn;
-                    }
+                if (tiP[index+i] < 0.0)
+                    tiP[index+i] = 0.0;
                 }
             }
-        else if (aaModelID == AAMODEL_JONES)
+
+        return (NO_ERROR);
+        }
+
+    if (m->TiProbs == &TiProbs_Gen || m->TiProbs == &TiProbs_GenCov)
+        {
+        correctionFactor = 1.0;
+        if (m->dataType == DNA || m->dataType == RNA)
             {
-            scaler = 0.0;
-            for (i=0; i<20; i++)
-                {
-                for (j=i+1; j<20; j++)
-                    {
-                    a[i][j] = aaJones[i][j];
-                    a[j][i] = aaJones[j][i];
-                    scaler += jonesPi[i] * a[i][j] * probOn;
-                    scaler += jonesPi[j] * a[j][i] * probOn;
-                    }
-                }
+            if (m->nucModelId == NUCMODEL_DOUBLET)
+                correctionFactor = 2.0;
+            else if (m->nucModelId == NUCMODEL_CODON)
+                correctionFactor = 3.0;
             }
-        else if (aaModelID == AAMODEL_DAY)
+
+        /* TiProbs_GenCov has the omega categories in separate eigen systems,
+           stored as V and V^-1 of the unscaled rate matrices (see UpDateCijk) */
+        eigenValues = m->cijks[m->cijkIndex[chain]];
+        if (m->TiProbs == &TiProbs_Gen)
             {
-            scaler = 0.0;
-            for (i=0; i<20; i++)
-                {
-                for (j=i+1; j<20; j++)
-                    {
-                    a[i][j] = aaDayhoff[i][j];
-                    a[j][i] = aaDayhoff[j][i];
-                    scaler += dayhoffPi[i] * a[i][j] * probOn;
-                    scaler += dayhoffPi[j] * a[j][i] * probOn;
-                    }
-                }
+            nCats = m->numRateCats;
+            sizeOfSingleCijk = 0;
             }
-        else if (aaModelID == AAMODEL_MTREV)
+        else
             {
-            scaler = 0.0;
-            for (i=0; i<20; i++)
-                {
-                for (j=i+1; j<20; j++)
-                    {
-                    a[i][j] = aaMtrev24[i][j];
-                    a[j][i] = aaMtrev24[j][i];
-                    scaler += mtrev24Pi[i] * a[i][j] * probOn;
-                    scaler += mtrev24Pi[j] * a[j][i] * probOn;
-                    }
-                }
+            nCats = m->nCijkParts;
+            sizeOfSingleCijk = m->cijkLength / m->nCijkParts;
             }
-        else if (aaModelID == AAMODEL_MTMAM)
+
+        for (k=index=0; k<nCats; k++)
             {
-            scaler = 0.0;
-            for (i=0; i<20; i++)
+            if (m->TiProbs == &TiProbs_Gen)
+                f = baseRate * catRate[k] * correctionFactor;
+            else
+                f = correctionFactor * eigenValues[2*n + 3*n*n];
+            t = p->length * f;
+            for (s=0; s<n; s++)
                 {
-                for (j=i+1; j<20; j++)
-                    {
-                    a[i][j] = aaMtmam[i][j];
-                    a[j][i] = aaMtmam[j][i];
-                    scaler += mtmamPi[i] * a[i][j] * probOn;
-                    scaler += mtmamPi[j] * a[j][i] * probOn;
-                    }
+                eV0[s] = exp (eigenValues[s] * t);
+                eV1[s] = f * eigenValues[s] * eV0[s];
+                eV2[s] = f * eigenValues[s] * eV1[s];
                 }
-            }
-        else if (aaModelID == AAMODEL_RTREV)
-            {
-            scaler = 0.0;
-            for (i=0; i<20; i++)
+            cijk = eigenValues + (2 * n);
+            for (i=0; i<n; i++)
                 {
-                for (j=i+1; j<20; j++)
+                for (j=0; j<n; j++)
                     {
-                    a[i][j] = aartREV[i][j];
-                    a[j][i] = aartREV[j][i];
-                    scaler += rtrevPi[i] * a[i][j] * probOn;
-                    scaler += rtrevPi[j] * a[j][i] * probOn;
+                    sum = sum1 = sum2 = 0.0;
+                    if (m->TiProbs == &TiProbs_Gen)
+                        {
+                        ptr = cijk + (i*n + j)*n;
+                        for (s=0; s<n; s++)
+                            {
+                            sum  += ptr[s] * eV0[s];
+                            sum1 += ptr[s] * eV1[s];
+                            sum2 += ptr[s] * eV2[s];
+                            }
+                        }
+                    else
+                        {
+                        for (s=0; s<n; s++)
+                            {
+                            x = cijk[i*n + s] * cijk[n*n + s*n + j];
+                            sum  += x * eV0[s];
+                            sum1 += x * eV1[s];
+                            sum2 += x * eV2[s];
+                            }
+                        }
+                    tiP [index] = (sum < 0.0) ? 0.0 : sum;
+                    tiP1[index] = sum1;
+                    tiP2[index] = sum2;
+                    index++;
                     }
                 }
+            eigenValues += sizeOfSingleCijk;
             }
-        else if (aaModelID == AAMODEL_WAG)
+
+        return (NO_ERROR);
+        }
+
+    if (m->TiProbs == &TiProbs_Std && m->stateFreq->paramId != SYMPI_EQUAL)
+        {
+        /* same order of matrices as in TiProbs_Std: binary characters in beta
+           categories, then one eigen system for each multistate character */
+        index = 0;
+        if (m->isTiNeeded[0] == YES)
             {
-            scaler = 0.0;
-            for (i=0; i<20; i++)
+            pis = GetParamStdStateFreqs (m->stateFreq, chain, state[chain]);
+            for (l=0; l<m->numBetaCats; l++)
                 {
-                for (j=i+1; j<20; j++)
+                lambda = 1.0 / (2.0 * pis[0] * pis[1]);
+                for (k=0; k<m->numRateCats; k++)
                     {
-                    a[i][j] = aaWAG[i][j];
-                    a[j][i] = aaWAG[j][i];
-                    scaler += wagPi[i] * a[i][j] * probOn;
-                    scaler += wagPi[j] * a[j][i] * probOn;
-                    }
+                    f = - lambda * baseRate * catRate[k];
+                    sum  = exp (f * p->length);
+                    sum1 = f * sum;
+                    sum2 = f * sum1;
+                    tiP [index  ] = pis[0] + pis[1] * sum;
+                    tiP [index+1] = pis[1] - pis[1] * sum;
+                    tiP [index+2] = pis[0] - pis[0] * sum;
+                    tiP [index+3] = pis[1] + pis[0] * sum;
+                    tiP1[index  ] =   pis[1] * sum1;
+                    tiP1[index+1] = - pis[1] * sum1;
+                    tiP1[index+2] = - pis[0] * sum1;
+                    tiP1[index+3] =   pis[0] * sum1;
+                    tiP2[index  ] =   pis[1] * sum2;
+                    tiP2[index+1] = - pis[1] * sum2;
+                    tiP2[index+2] = - pis[0] * sum2;
+                    tiP2[index+3] =   pis[0] * sum2;
+                    index += 4;
+                    }
+                pis += 2;
                 }
             }
-        else if (aaModelID == AAMODEL_CPREV)
+        if (m->cijkLength > 0)
             {
-            scaler = 0.0;
-            for (i=0; i<20; i++)
+            if (m->upDateCijk == YES && UpDateCijk (division, chain) == ERROR)
+                return (ERROR);
+            eigenValues = m->cijks[m->cijkIndex[chain]];
+            for (l=0; l<m->stateFreq->nSympi; l++)
                 {
-                for (j=i+1; j<20; j++)
+                nStates = m->stateFreq->sympinStates[l];
+                for (k=0; k<m->numRateCats; k++)
                     {
-                    a[i][j] = aacpREV[i][j];
-                    a[j][i] = aacpREV[j][i];
-                    scaler += cprevPi[i] * a[i][j] * probOn;
-                    scaler += cprevPi[j] * a[j][i] * probOn;
+                    f = baseRate * catRate[k];
+                    for (s=0; s<nStates; s++)
+                        {
+                        eV0[s] = exp (eigenValues[s] * p->length * f);
+                        eV1[s] = f * eigenValues[s] * eV0[s];
+                        eV2[s] = f * eigenValues[s] * eV1[s];
+                        }
+                    cijk = eigenValues + (2 * nStates);
+                    for (i=0; i<nStates*nStates; i++)
+                        {
+                        sum = sum1 = sum2 = 0.0;
+                        for (s=0; s<nStates; s++)
+                            {
+                            sum  += cijk[s] * eV0[s];
+                            sum1 += cijk[s] * eV1[s];
+                            sum2 += cijk[s] * eV2[s];
+                            }
+                        cijk += nStates;
+                        tiP [index] = (sum < 0.0) ? 0.0 : sum;
+                        tiP1[index] = sum1;
+                        tiP2[index] = sum2;
+                        index++;
+                        }
                     }
+                eigenValues += (nStates * nStates * nStates) + (2 * nStates);
                 }
             }
-        else if (aaModelID == AAMODEL_VT)
+
+        return (NO_ERROR);
+        }
+
+    for (i=0; i<10; i++)
+        q[i] = qMem + i*10;
+
+    if (m->TiProbs == &TiProbs_Fels || m->TiProbs == &TiProbs_Hky)
+        {
+        /* F81 or HKY rate matrix with one expected substitution per unit time */
+        pis = GetParamSubVals (m->stateFreq, chain, state[chain]);
+        if (m->TiProbs == &TiProbs_Hky)
+            kap = *GetParamVals (m->tRatio, chain, state[chain]);
+        else
+            kap = 1.0;
+        scaler = 0.0;
+        for (i=0; i<4; i++)
             {
-            scaler = 0.0;
-            for (i=0; i<20; i++)
+            q[i][i] = 0.0;
+            for (j=0; j<4; j++)
                 {
-                for (j=i+1; j<20; j++)
-                    {
-                    a[i][j] = aaVt[i][j];
-                    a[j][i] = aaVt[j][i];
-                    scaler += vtPi[i] * a[i][j] * probOn;
-                    scaler += vtPi[j] * a[j][i] * probOn;
-                    }
+                if (i == j)
+                    continue;
+                q[i][j] = pis[j] * (abs(i - j) == 2 ? kap : 1.0);
+                q[i][i] -= q[i][j];
+                scaler += pis[i] * q[i][j];
                 }
             }
-        else if (aaModelID == AAMODEL_BLOSUM)
+        for (i=0; i<4; i++)
+            for (j=0; j<4; j++)
+                q[i][j] /= scaler;
+
+        for (k=0; k<m->numRateCats; k++)
             {
-            scaler = 0.0;
-            for (i=0; i<20; i++)
+            f = baseRate * catRate[k];
+            TiProbsDerivsQP (q, 4, f, p->length, tiP + 16*k, tiP1 + 16*k, tiP2 + 16*k);
+            }
+        }
+    else if (m->TiProbs == &TiProbs_Std)
+        {
+        /* same order of matrices as in TiProbs_Std: unordered characters with 2 to 10
+           states, then ordered characters with 3 to 6 states */
+        index = 0;
+        for (l=0; l<13; l++)
+            {
+            if (m->isTiNeeded[l] == NO)
+                continue;
+            if (l < 9)
                 {
-                for (j=i+1; j<20; j++)
-                    {
-                    a[i][j] = aaBlosum[i][j];
-                    a[j][i] = aaBlosum[j][i];
-                    scaler += blosPi[i] * a[i][j] * probOn;
-                    scaler += blosPi[j] * a[j][i] * probOn;
-                    }
+                nStates = l + 2;
+                cType = UNORD;
+                }
+            else
+                {
+                nStates = l - 6;
+                cType = ORD;
+                }
+            for (i=0; i<nStates; i++)
+                bs[i] = 1.0 / nStates;
+            SetStdQMatrix (q, nStates, bs, cType);
+            for (k=0; k<m->numRateCats; k++)
+                {
+                f = baseRate * catRate[k];
+                TiProbsDerivsQP (q, nStates, f, p->length, tiP + index, tiP1 + index, tiP2 + index);
+                index += nStates * nStates;
                 }
             }
-        else if (aaModelID == AAMODEL_LG)
+        }
+    else
+        {
+        MrBayesPrint ("%s   Branch length derivatives are not available for this model\n", spacer);
+        return (ERROR);
+        }
+
+    return (NO_ERROR);
+}
+
+
+/* TiProbsDerivsQP: P = exp(fQt), P' = fQP and P'' = fQP' for one n by n rate matrix Q, n <= 10;
+   the exponential is a Taylor series of fQt scaled to a norm below 0.5, squared back up */
+void TiProbsDerivsQP (MrBFlt **q, int n, MrBFlt f, MrBFlt t, MrBFlt *tiP, MrBFlt *tiP1, MrBFlt *tiP2)
+{
+    int     i, j, l, k, nSquarings;
+    MrBFlt  sum, norm, scaler, a[100], term[100], tmp[100];
+
+    /* a = fQt / 2^nSquarings */
+    norm = 0.0;
+    for (i=0; i<n; i++)
+        {
+        sum = 0.0;
+        for (j=0; j<n; j++)
+            sum += fabs (q[i][j]);
+        if (sum > norm)
+            norm = sum;
+        }
+    norm *= f * t;
+    scaler = f * t;
+    for (nSquarings=0; norm > 0.5; nSquarings++)
+        {
+        norm /= 2.0;
+        scaler /= 2.0;
+        }
+    for (i=0; i<n; i++)
+        for (j=0; j<n; j++)
+            a[i*n+j] = q[i][j] * scaler;
+
+    /* P = I + a + a^2/2! + ..., to double precision for a norm below 0.5 */
+    for (i=0; i<n*n; i++)
+        tiP[i] = term[i] = (i % (n + 1) == 0 ? 1.0 : 0.0);
+    for (k=1; k<=18; k++)
+        {
+        for (i=0; i<n; i++)
             {
-            scaler = 0.0;
-            for (i=0; i<20; i++)
+            for (j=0; j<n; j++)
                 {
-                for (j=i+1; j<20; j++)
-                    {
-                    a[i][j] = aaLG[i][j];
-                    a[j][i] = aaLG[j][i];
-                    scaler += lgPi[i] * a[i][j] * probOn;
-                    scaler += lgPi[j] * a[j][i] * probOn;
-                    }
+                sum = 0.0;
+                for (l=0; l<n; l++)
+                    sum += term[i*n+l] * a[l*n+j];
+                tmp[i*n+j] = sum / k;
                 }
             }
-        else
+        for (i=0; i<n*n; i++)
             {
-            MrBayesPrint ("%s   ERROR: Don't understand which amino acid model is needed\n");
-            return (ERROR);
+            term[i] = tmp[i];
+            tiP[i] += term[i];
             }
-
-        /* rescale off diagonal elements of Q matrix */
-        scaler = 1.0 / scaler;
-        for (i=0; i<20; i++)
+        }
+    for (k=0; k<nSquarings; k++)
+        {
+        for (i=0; i<n; i++)
             {
-            for (j=0; j<20; j++)
+            for (j=0; j<n; j++)
                 {
-                if (i != j)
-                    a[i][j] *= scaler;
+                sum = 0.0;
+                for (l=0; l<n; l++)
+                    sum += tiP[i*n+l] * tiP[l*n+j];
+                tmp[i*n+j] = sum;
                 }
             }
-            
-        /* now, scale by rate factor */
-        for (i=0; i<20; i++)
+        for (i=0; i<n*n; i++)
+            tiP[i] = tmp[i];
+        }
+
+    for (i=0; i<n; i++)
+        {
+        for (j=0; j<n; j++)
             {
-            for (j=0; j<20; j++)
-                {
-                if (i != j)
-                    a[i][j] *= rateMult;
-                }
+            sum = 0.0;
+            for (l=0; l<n; l++)
+                sum += q[i][l] * tiP[l*n+j];
+            tiP1[i*n+j] = f * sum;
             }
-            
-        /* put in diagonal elements */
-        for (i=0; i<20; i++)
+        }
+    for (i=0; i<n; i++)
+        {
+        for (j=0; j<n; j++)
+            {
+            sum = 0.0;
+            for (l=0; l<n; l++)
+                sum += q[i][l] * tiP1[l*n+j];
+            tiP2[i*n+j] = f * sum;
+            }
+        }
+}
+
+
+/*-----------------------------------------------------------------
+|
+|   CovarionBlockExp: transition probabilities over time t of one
+|       eigen mode of a covarion model. With eigen value lambda of
+|       the substitution matrix, the mode evolves under the 2 X 2
+|       matrix M = [lambda - s10, s10; s01, -s01]; e returns exp(Mt)
+|       in the order on-on, on-off, off-on, off-off.
+|
+------------------------------------------------------------------*/
+void CovarionBlockExp (MrBFlt lambda, MrBFlt s10, MrBFlt s01, MrBFlt t, MrBFlt *e)
+{
+    MrBFlt      x, delta, mu, mu2, g;
+
+    /* the eigen values mu > mu2 of M are real; mu2 is found without cancellation
+       and mu from mu * mu2 = det (M) = -lambda * s01 */
+    x = lambda + s01 - s10;
+    delta = sqrt (x * x + 4.0 * s10 * s01);
+    mu2 = 0.5 * (lambda - s10 - s01 - delta);
+    if (mu2 < 0.0)
+        mu = -lambda * s01 / mu2;
+    else
+        mu = 0.5 * (lambda - s10 - s01 + delta);
+
+    /* exp(Mt) = exp(mu t) (I + (M - mu I) (1 - exp(-delta t)) / delta) */
+    if (delta > 0.0)
+        g = -expm1 (-delta * t) / delta;
+    else
+        g = t;
+    x = exp (mu * t);
+    e[0] = x * (1.0 + (lambda - s10 - mu) * g);
+    e[1] = x * s10 * g;
+    e[2] = x * s01 * g;
+    e[3] = x * (1.0 - (s01 + mu) * g);
+}
+
+
+/*-----------------------------------------------------------------
+|
+|   CovarionTiProbs: the 2n X 2n matrix of a covarion model from the
+|       products c_isj = V[i][s] V^-1[s][j] of the eigen vectors of
+|       the n X n substitution matrix, stored in the order i, s, j,
+|       and the 2 X 2 matrices e of the eigen modes (on-on, on-off,
+|       off-on, off-off). The four blocks are found in one pass over
+|       c_isj, with the innermost loop running over j (n is at most 20).
+|
+------------------------------------------------------------------*/
+void CovarionTiProbs (int nObs, MrBFlt *cijk, MrBFlt *e, MrBFlt *tiP)
+{
+    int         i, j, s, n;
+    MrBFlt      *c, e0, e1, e2, e3, onOn[20], onOff[20], offOn[20], offOff[20];
+
+    /* the blocks are summed in local arrays, which the compiler can keep apart
+       from cijk and vectorize over j */
+    n = 2 * nObs;
+    c = cijk;
+    for (i=0; i<nObs; i++)
+        {
+        for (j=0; j<nObs; j++)
+            onOn[j] = onOff[j] = offOn[j] = offOff[j] = 0.0;
+        for (s=0; s<nObs; s++)
             {
-            sum = 0.0;
-            for (j=0; j<20; j++)
+            e0 = e[4*s];
+            e1 = e[4*s+1];
+            e2 = e[4*s+2];
+            e3 = e[4*s+3];
+            for (j=0; j<nObs; j++)
                 {
-                if (i != j)
-                    sum += a[i][j];
-                a[i][i] = -(sum + s10);
+                onOn[j]   += c[j] * e0;
+                onOff[j]  += c[j] * e1;
+                offOn[j]  += c[j] * e2;
+                offOff[j] += c[j] * e3;
                 }
+            c += nObs;
             }
-                
-        /* fill in the other three submatrices */
-        for (i=20; i<40; i++)
-            a[i][i] = -s01;
-        for (i=0; i<20; i++)
+        for (j=0; j<nObs; j++)
             {
-            a[i][20+i] = s10;
-            a[20+i][i] = s01;
+            tiP[i*n + j]               = onOn[j];
+            tiP[i*n + nObs + j]        = onOff[j];
+            tiP[(nObs+i)*n + j]        = offOn[j];
+            tiP[(nObs+i)*n + nObs + j] = offOff[j];
             }
-                       
         }
-
-    return (NO_ERROR);
 }
 
 
-int SetStdQMatrix (MrBFlt **a, int nStates, MrBFlt *bs, int cType)
+/*-----------------------------------------------------------------
+|
+|   TiProbs_Cov: update transition probabilities for covarion
+|       models (8 X 8 nucleotide and 40 X 40 amino acid), with or
+|       without rate variation. The rate matrix has the substitution
+|       matrix S in its upper left block and the switching rates on
+|       the diagonals of the other blocks, so in the eigen system of
+|       S each eigen mode is a two-state switch process (see
+|       CovarionBlockExp). One eigen system of S serves all rate
+|       categories, and each of the four blocks of P costs a fourth
+|       of the work of the full 2n X 2n product.
+|
+------------------------------------------------------------------*/
+int TiProbs_Cov (TreeNode *p, int division, int chain)
 {
-    register int    i, j;
-    MrBFlt          scaler;
+    int         i, j, k, n, s, nObs, index;
+    MrBFlt      t, length, baseRate, theRate, *catRate, *eigenValues, *rates, s10, s01,
+                *cijk, *bs, probOn, e[80], pCov[1600];
+    CLFlt       *tiP;
+    ModelInfo   *m;
+    
+    m = &modelSettings[division];
+    n = m->numModelStates;
+    nObs = n / 2;
 
-    /* This function sets up ordered or unordered models for standard characters
-       with unequal stationary state frequencies. It requires the stationary
-       frequencies of the states (passed when calling the function). It also
-       needs to know the number of states and the type (ordered or unordered) 
-       of the character. */
+    /* find transition probabilities */
+    tiP = m->tiProbs[m->tiProbsIndex[chain][p->index]];
 
-    /* set Q matrix to 0 */
-    for (i=0; i<nStates; i++)
-        for (j=0; j<nStates; j++)
-            a[i][j] = 0.0;
+    /* get the eigen system of S, the rate multipliers of the categories and the
+       switching rates (see UpDateCijk) */
+    eigenValues = m->cijks[m->cijkIndex[chain]];
+    rates = eigenValues + nObs;
+    s10 = rates[m->nCijkParts];
+    s01 = rates[m->nCijkParts + 1];
+    cijk = rates + m->nCijkParts + 2;
 
-    /* initialize Q matrix */
-    scaler = 0.0;
-    if (cType == UNORD)
+    /* find length */
+    if (m->cppEvents != NULL)
         {
-        /* unordered characters */
-        for (i=0; i<nStates; i++)
+        length = GetParamSubVals (m->cppEvents, chain, state[chain])[p->index];
+        }
+    else if (m->tk02BranchRates != NULL)
+        {
+        length = GetParamSubVals (m->tk02BranchRates, chain, state[chain])[p->index];
+        }
+    else if (m->igrBranchRates != NULL)
+        {
+        length = GetParamSubVals (m->igrBranchRates, chain, state[chain])[p->index];
+        }
+    else if (m->mixedBrchRates != NULL)
+        {
+        length = GetParamSubVals (m->mixedBrchRates, chain, state[chain])[p->index];
+        }
+    else
+        length = p->length;
+
+    /* without rate variation the whole rate matrix is scaled by the
+       base rate, as in TiProbs_Gen */
+    if (m->nCijkParts == 1)
+        {
+        baseRate = GetRate (division, chain);
+        if (m->pInvar != NULL)
+            baseRate /= (1.0 - (*GetParamVals(m->pInvar, chain, state[chain])));
+        theRate = 1.0;
+        if (m->shape != NULL)
+            catRate = GetParamSubVals (m->shape, chain, state[chain]);
+        else if (m->mixtureRates != NULL)
+            catRate = GetParamSubVals (m->mixtureRates, chain, state[chain]);
+        else
+            catRate = &theRate;
+        length *= baseRate * catRate[0];
+        }
+
+    /* fill in values */
+    for (k=index=0; k<m->nCijkParts; k++)
+        {
+        t = length;
+
+        if (t < TIME_MIN)
             {
-            for (j=0; j<nStates; j++)
+            /* Fill in identity matrix */
+            for (i=0; i<n; i++)
                 {
-                if (i != j)
+                for (j=0; j<n; j++)
                     {
-                    a[i][i] -= (a[i][j] = bs[j]);
-                    scaler += bs[i] * a[i][j];
+                    if (i == j)
+                        tiP[index++] = 1.0;
+                    else
+                        tiP[index++] = 0.0;
                     }
                 }
             }
-        }
-    else
-        {
-        /* ordered characters */
-        for (i=0; i<nStates; i++)
+        else if (t > TIME_MAX)
             {
-            for (j=0; j<nStates; j++)
+            /* Fill in stationary matrix */
+            bs = GetParamSubVals (m->stateFreq, chain, state[chain]);
+            probOn = s01 / (s01 + s10);
+            for (i=0; i<n; i++)
                 {
-                if (abs(i - j) == 1)
-                    {
-                    a[i][i] -= (a[i][j] = bs[j]);
-                    scaler += bs[i] * a[i][j];
-                    }
+                for (j=0; j<nObs; j++)
+                    tiP[index++] = (CLFlt) (bs[j] * probOn);
+                for (j=0; j<nObs; j++)
+                    tiP[index++] = (CLFlt) (bs[j] * (1.0 - probOn));
                 }
             }
+        else
+            {
+            for (s=0; s<nObs; s++)
+                CovarionBlockExp (rates[k] * eigenValues[s], s10, s01, t, e + 4*s);
+            CovarionTiProbs (nObs, cijk, e, pCov);
+            for (i=0; i<n*n; i++)
+                tiP[index++] = (CLFlt) ((pCov[i] < 0.0) ? 0.0 : pCov[i]);
+            }
         }
-        
-    /* rescale Q matrix */
-    for (i=0; i<nStates; i++)
-        for (j=0; j<nStates; j++)
-            a[i][j] /= scaler;
-
-#   if defined DEBUG_SETSTDQMATRIX
-    for (i=0; i<nStates; i++)
-        {
-        for (j=0; j<nStates; j++)
-            printf ("%0.5lf ", a[i][j]);
-        printf ("\n");
-        }
-#   endif
 
-    return (NO_ERROR);
+    return NO_ERROR;
 }
 
 
@@ -9413,9 +11835,10 @@ int TiProbs_Fels (TreeNode *p, int division, int chain)
 |       not work with:
 |      
 |       1. codon models with omega variation or
-|       2. covarion models with rate variation
+|       2. covarion models
 |
-|   In either of these cases, TiProbs_GenCov is used
+|   TiProbs_GenCov is used in the first case and TiProbs_Cov in
+|   the second
 |
 -----------------------------------------------------------------*/
 int TiProbs_Gen (TreeNode *p, int division, int chain)
@@ -9550,16 +11973,17 @@ int TiProbs_Gen (TreeNode *p, int division, int chain)
 /*----------------------------------------------------------------
 |
 |   TiProbs_GenCov: Calculates transition probabilities for codon
-|       models with omega variation or covarion models with
-|       rate variation.
+|       models with omega variation. Each omega category has the
+|       eigen system of its unscaled rate matrix and the common
+|       scaler, laid out as described in UpDateCijk.
 |
 -----------------------------------------------------------------*/
 int TiProbs_GenCov (TreeNode *p, int division, int chain)
 {
     register int    i, j, k, n, s, index;
     int             sizeOfSingleCijk;
-    MrBFlt          t, *eigenValues, *cijk, EigValexp[64], sum, *ptr, correctionFactor,
-                    length, *bs;
+    MrBFlt          t, *eigenValues, *eigvecs, *inverseEigvecs, EigValexp[64], *ptr, correctionFactor,
+                    length, *bs, a, row[64];
     CLFlt           *tiP;
     ModelInfo       *m;
     
@@ -9580,12 +12004,11 @@ int TiProbs_GenCov (TreeNode *p, int division, int chain)
     /* find transition probabilities */
     tiP = m->tiProbs[m->tiProbsIndex[chain][p->index]];
             
-    /* get eigenvalues and cijk pointers */
+    /* get eigenvalues and eigen vectors of the unscaled rate matrices (see UpDateCijk) */
     eigenValues = m->cijks[m->cijkIndex[chain]];
-    cijk        = eigenValues + (2 * n);
     
     /* get offset size (we need to move the pointers to the appropriate
-       cijk information for these models) */
+       eigen system for these models) */
     sizeOfSingleCijk = m->cijkLength / m->nCijkParts;
 
     /* find length */
@@ -9614,7 +12037,9 @@ int TiProbs_GenCov (TreeNode *p, int division, int chain)
     /* fill in values */
     for (k=index=0; k<m->nCijkParts; k++)
         {
-        t =  length * correctionFactor;
+        eigvecs        = eigenValues + (2 * n);
+        inverseEigvecs = eigvecs + (n * n);
+        t =  length * correctionFactor * eigenValues[2*n + 3*n*n];
             
         if (t < TIME_MIN)
             {
@@ -9641,30 +12066,30 @@ int TiProbs_GenCov (TreeNode *p, int division, int chain)
             }
         else
             {
-            /* We actually need to do some work... */
+            /* P = V diag(exp(lambda t)) V^-1, one row at a time; the innermost loop runs
+               over the columns of V^-1, so it vectorizes and V^-1 stays in cache */
             for (s=0; s<n; s++)
                 EigValexp[s] =  exp(eigenValues[s] * t);
 
-            ptr = cijk;
             for (i=0; i<n; i++)
                 {
                 for (j=0; j<n; j++)
+                    row[j] = 0.0;
+                ptr = inverseEigvecs;
+                for (s=0; s<n; s++)
                     {
-                    sum = 0.0;
-                    for (s=0; s<n; s++)
-                        sum += (*ptr++) * EigValexp[s];
-                    tiP[index++] = (CLFlt) ((sum < 0.0) ? 0.0 : sum);
+                    a = eigvecs[i*n+s] * EigValexp[s];
+                    for (j=0; j<n; j++)
+                        row[j] += a * ptr[j];
+                    ptr += n;
                     }
-                }
-                
-            /* increment pointers by m->cijkLength */
-            if (k+1 < m->nCijkParts)
-                {
-                /* shift pointers */
-                eigenValues += sizeOfSingleCijk;
-                cijk        += sizeOfSingleCijk;
+                for (j=0; j<n; j++)
+                    tiP[index++] = (CLFlt) ((row[j] < 0.0) ? 0.0 : row[j]);
                 }
             }
+
+        /* shift pointer */
+        eigenValues += sizeOfSingleCijk;
         }
         
 #   if 0
@@ -10430,11 +12855,176 @@ int TiProbs_Std (TreeNode *p, int division, int chain)
 }
 
 
+#if defined (SSE_ENABLED)
+/*----------------------------------------------------------------
+|
+|   TiProbsTimesCondLikes_SSE: multiply the conditional likelihoods
+|       of nVecs (one or two) consecutive SSE vectors of characters
+|       with a transition probability matrix stored by row. The
+|       product is blocked by four rows and two vectors, so that
+|       each broadcast probability serves two vectors, each vector
+|       of cond likes serves four rows and the eight sums are
+|       independent; each sum is accumulated in the same order as
+|       in the scalar code. The result for vector v is stored in
+|       like[v*nStates] to like[v*nStates+nStates-1].
+|
+-----------------------------------------------------------------*/
+void TiProbsTimesCondLikes_SSE (__m128 *like, CLFlt *tiP, __m128 *cl, int nStates, int nVecs)
+{
+    int         i, j;
+    CLFlt       *tiP0, *tiP1, *tiP2, *tiP3;
+    __m128      *cl1, *like1, mCl0, mCl1, mTiP,
+                mAcum0, mAcum1, mAcum2, mAcum3, mAcum4, mAcum5, mAcum6, mAcum7;
+
+    if (nVecs == 2)
+        {
+        cl1 = cl + nStates;
+        like1 = like + nStates;
+        for (i=0; i+4<=nStates; i+=4)
+            {
+            tiP0 = tiP + i*nStates;
+            tiP1 = tiP0 + nStates;
+            tiP2 = tiP1 + nStates;
+            tiP3 = tiP2 + nStates;
+            mAcum0 = mAcum1 = mAcum2 = mAcum3 = _mm_setzero_ps ();
+            mAcum4 = mAcum5 = mAcum6 = mAcum7 = _mm_setzero_ps ();
+            for (j=0; j<nStates; j++)
+                {
+                mCl0 = cl[j];
+                mCl1 = cl1[j];
+                mTiP = _mm_load1_ps (&tiP0[j]);
+                mAcum0 = _mm_add_ps (_mm_mul_ps (mTiP, mCl0), mAcum0);
+                mAcum4 = _mm_add_ps (_mm_mul_ps (mTiP, mCl1), mAcum4);
+                mTiP = _mm_load1_ps (&tiP1[j]);
+                mAcum1 = _mm_add_ps (_mm_mul_ps (mTiP, mCl0), mAcum1);
+                mAcum5 = _mm_add_ps (_mm_mul_ps (mTiP, mCl1), mAcum5);
+                mTiP = _mm_load1_ps (&tiP2[j]);
+                mAcum2 = _mm_add_ps (_mm_mul_ps (mTiP, mCl0), mAcum2);
+                mAcum6 = _mm_add_ps (_mm_mul_ps (mTiP, mCl1), mAcum6);
+                mTiP = _mm_load1_ps (&tiP3[j]);
+                mAcum3 = _mm_add_ps (_mm_mul_ps (mTiP, mCl0), mAcum3);
+                mAcum7 = _mm_add_ps (_mm_mul_ps (mTiP, mCl1), mAcum7);
+                }
+            like[i]    = mAcum0;
+            like[i+1]  = mAcum1;
+            like[i+2]  = mAcum2;
+            like[i+3]  = mAcum3;
+            like1[i]   = mAcum4;
+            like1[i+1] = mAcum5;
+            like1[i+2] = mAcum6;
+            like1[i+3] = mAcum7;
+            }
+        for (; i<nStates; i++)
+            {
+            tiP0 = tiP + i*nStates;
+            mAcum0 = mAcum4 = _mm_setzero_ps ();
+            for (j=0; j<nStates; j++)
+                {
+                mTiP = _mm_load1_ps (&tiP0[j]);
+                mAcum0 = _mm_add_ps (_mm_mul_ps (mTiP, cl[j]), mAcum0);
+                mAcum4 = _mm_add_ps (_mm_mul_ps (mTiP, cl1[j]), mAcum4);
+                }
+            like[i]  = mAcum0;
+            like1[i] = mAcum4;
+            }
+        }
+    else
+        {
+        for (i=0; i+4<=nStates; i+=4)
+            {
+            tiP0 = tiP + i*nStates;
+            tiP1 = tiP0 + nStates;
+            tiP2 = tiP1 + nStates;
+            tiP3 = tiP2 + nStates;
+            mAcum0 = mAcum1 = mAcum2 = mAcum3 = _mm_setzero_ps ();
+            for (j=0; j<nStates; j++)
+                {
+                mCl0 = cl[j];
+                mAcum0 = _mm_add_ps (_mm_mul_ps (_mm_load1_ps (&tiP0[j]), mCl0), mAcum0);
+                mAcum1 = _mm_add_ps (_mm_mul_ps (_mm_load1_ps (&tiP1[j]), mCl0), mAcum1);
+                mAcum2 = _mm_add_ps (_mm_mul_ps (_mm_load1_ps (&tiP2[j]), mCl0), mAcum2);
+                mAcum3 = _mm_add_ps (_mm_mul_ps (_mm_load1_ps (&tiP3[j]), mCl0), mAcum3);
+                }
+            like[i]   = mAcum0;
+            like[i+1] = mAcum1;
+            like[i+2] = mAcum2;
+            like[i+3] = mAcum3;
+            }
+        for (; i<nStates; i++)
+            {
+            tiP0 = tiP + i*nStates;
+            mAcum0 = _mm_setzero_ps ();
+            for (j=0; j<nStates; j++)
+                mAcum0 = _mm_add_ps (_mm_mul_ps (_mm_load1_ps (&tiP0[j]), cl[j]), mAcum0);
+            like[i] = mAcum0;
+            }
+        }
+}
+
+
+/*----------------------------------------------------------------
+|
+|   TransformCondLikes_SSE: multiply the conditional likelihoods of
+|       one character with a transition probability matrix stored
+|       by column (see TransposeTiProbs_SSE); the sum over states is
+|       accumulated in the same order as in the scalar code
+|
+-----------------------------------------------------------------*/
+void TransformCondLikes_SSE (CLFlt *like, CLFlt *tiPT, CLFlt *cl, int nStates)
+{
+    int         a, i, nPadded;
+    CLFlt       *tiP;
+    __m128      mLike, mCl;
+
+    nPadded = 4 * ((nStates + 3) / 4);
+    for (a=0; a<nStates; a+=4)
+        {
+        tiP = tiPT + a;
+        mLike = _mm_setzero_ps ();
+        for (i=0; i<nStates; i++)
+            {
+            mCl = _mm_set1_ps (cl[i]);
+            mLike = _mm_add_ps (mLike, _mm_mul_ps (_mm_loadu_ps (tiP), mCl));
+            tiP += nPadded;
+            }
+        _mm_storeu_ps (like + a, mLike);
+        }
+}
+
+
+/*----------------------------------------------------------------
+|
+|   TransposeTiProbs_SSE: store the transition probability matrices
+|       of all rate categories by column, padding each column with
+|       zeros to a multiple of four states
+|
+-----------------------------------------------------------------*/
+void TransposeTiProbs_SSE (CLFlt *tiPT, CLFlt *tiP, int nStates, int nRateCats)
+{
+    int         a, i, k, nPadded;
+
+    nPadded = 4 * ((nStates + 3) / 4);
+    for (k=0; k<nRateCats; k++)
+        {
+        for (i=0; i<nStates; i++)
+            {
+            for (a=0; a<nStates; a++)
+                tiPT[a] = tiP[a*nStates + i];
+            for (; a<nPadded; a++)
+                tiPT[a] = 0.0;
+            tiPT += nPadded;
+            }
+        tiP += nStates * nStates;
+        }
+}
+#endif
+
+
 int UpDateCijk (int whichPart, int whichChain)
 {
-    int         c, i, j, k, n, n3, isComplex, sizeOfSingleCijk, cType, numQAllocated;
+    int         c, i, j, k, n, n3, nObs, isComplex, isSame, sizeOfSingleCijk, cType, numQAllocated;
     MrBFlt      **q[100], **eigvecs, **inverseEigvecs;
-    MrBFlt      *eigenValues, *eigvalsImag, *cijk;
+    MrBFlt      *eigenValues, *eigvalsImag, *cijk, *ptr, s10, s01, *oldEigenValues, *oldPtr;
     MrBFlt      *bs, *bsBase, *rateOmegaValues=NULL, rA=0.0, rS=0.0, posScaler, *omegaCatFreq=NULL;
     MrBComplex     **Ceigvecs, **CinverseEigvecs;
     ModelInfo   *m;
@@ -10555,7 +13145,48 @@ int UpDateCijk (int whichPart, int whichChain)
             Ceigvecs = AllocateSquareComplexMatrix (n);
             CinverseEigvecs = AllocateSquareComplexMatrix (n);
             
-            if (m->nCijkParts == 1)
+            if (m->switchRates != NULL && m->useBeagle == NO)
+                {
+                /* Covarion models (see TiProbs_Cov): we only need the eigen system of the
+                   n/2 X n/2 substitution matrix S, which is shared by all rate categories.
+                   The layout is the nObs eigen values, the rate multipliers of the
+                   m->nCijkParts categories, the switching rates s10 and s01, and then
+                   the products c_isj = V[i][s] V^-1[s][j], in the order i, s, j. */
+                nObs = n / 2;
+                if (m->dataType == PROTEIN)
+                    {
+                    if (SetProteinQMatrix (q[0], n, whichChain, whichPart, 1.0) == ERROR)
+                        goto errorExit;
+                    }
+                else
+                    {
+                    if (SetNucQMatrix (q[0], n, whichChain, whichPart, 1.0, &rA, &rS) == ERROR)
+                        goto errorExit;
+                    }
+                s10 = q[0][0][nObs];
+                s01 = q[0][nObs][0];
+                for (i=0; i<nObs; i++)
+                    q[0][i][i] += s10;
+                isComplex = GetEigens (nObs, q[0], eigenValues, eigvalsImag, eigvecs, inverseEigvecs, Ceigvecs, CinverseEigvecs);
+                if (isComplex != NO)
+                    {
+                    if (isComplex == YES)
+                        MrBayesPrint ("%s   ERROR: Complex eigenvalues found!\n", spacer);
+                    else
+                        MrBayesPrint ("%s   ERROR: Computing eigenvalues problem!\n", spacer);
+                    goto errorExit;
+                    }
+                ptr = eigenValues + nObs;
+                for (k=0; k<m->nCijkParts; k++)
+                    *ptr++ = (m->nCijkParts > 1) ? rateOmegaValues[k] : 1.0;
+                *ptr++ = s10;
+                *ptr++ = s01;
+                for (i=0; i<nObs; i++)
+                    for (c=0; c<nObs; c++)
+                        for (j=0; j<nObs; j++)
+                            *ptr++ = eigvecs[i][c] * inverseEigvecs[c][j];
+                }
+            else if (m->nCijkParts == 1)
                 {
                 if (m->dataType == DNA || m->dataType == RNA)
                     {
@@ -10629,6 +13260,74 @@ int UpDateCijk (int whichPart, int whichChain)
                     }
 #   endif
                 }
+            else if (m->nucModelId == NUCMODEL_CODON && m->useBeagle == NO)
+                {
+                /* Codon models with omega variation (see TiProbs_GenCov). The rate matrices of
+                   the omega categories come out of SetNucQMatrix unscaled and are then scaled
+                   jointly so that the mean substitution rate is one. The scaling does not change
+                   the eigen vectors, so each category stores the eigen system of its unscaled
+                   matrix: the eigen values, V and V^-1 (instead of the n^3 products c_ijk), the
+                   unscaled matrix itself and, last, the common scaler. A category whose unscaled
+                   matrix is the same as in the current state of the chain, such as all of them
+                   when only the category frequencies change, copies that eigen system instead
+                   of decomposing the matrix again. */
+                posScaler = 0.0;
+                for (k=0; k<m->nCijkParts; k++)
+                    {
+                    if (SetNucQMatrix (q[k], n, whichChain, whichPart, rateOmegaValues[k], &rA, &rS) == ERROR)
+                        goto errorExit;
+                    posScaler += omegaCatFreq[k] * (rS + rA);
+                    }
+                posScaler = 1.0 / posScaler;
+
+                /* after the flip, the scratch space holds the current state of the chain */
+                oldEigenValues = m->cijks[m->cijkScratchIndex];
+                for (k=0; k<m->nCijkParts; k++)
+                    {
+                    ptr = eigenValues + 2*n + 2*n*n;
+                    oldPtr = oldEigenValues + 2*n + 2*n*n;
+                    isSame = YES;
+                    for (i=0; i<n; i++)
+                        {
+                        for (j=0; j<n; j++)
+                            {
+                            if (q[k][i][j] != oldPtr[i*n+j])
+                                isSame = NO;
+                            ptr[i*n+j] = q[k][i][j];
+                            }
+                        }
+                    if (isSame == YES)
+                        {
+                        for (i=0; i<2*n+2*n*n; i++)
+                            eigenValues[i] = oldEigenValues[i];
+                        }
+                    else
+                        {
+                        isComplex = GetEigens (n, q[k], eigenValues, eigvalsImag, eigvecs, inverseEigvecs, Ceigvecs, CinverseEigvecs);
+                        if (isComplex != NO)
+                            {
+                            if (isComplex == YES)
+                                MrBayesPrint ("%s   ERROR: Complex eigenvalues found!\n", spacer);
+                            else
+                                MrBayesPrint ("%s   ERROR: Computing eigenvalues problem!\n", spacer);
+                            goto errorExit;
+                            }
+                        ptr = eigenValues + 2*n;
+                        for (i=0; i<n; i++)
+                            for (j=0; j<n; j++)
+                                *ptr++ = eigvecs[i][j];
+                        for (i=0; i<n; i++)
+                            for (j=0; j<n; j++)
+                                *ptr++ = inverseEigvecs[i][j];
+                        }
+                    eigenValues[2*n + 3*n*n] = posScaler;
+
+                    /* shift pointers */
+                    eigenValues    += sizeOfSingleCijk;
+                    eigvalsImag    += sizeOfSingleCijk;
+                    oldEigenValues += sizeOfSingleCijk;
+                    }
+                }
             else
                 {
                 /* Here, we calculate the rate matrices (Q) for various nucleotide and amino acid
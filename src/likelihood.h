@@ -39,6 +39,15 @@
 #define TG                          14
 #define TT                          15
 
+int       BrlenDerivs_Gen (TreeNode *p, int division, int chain, MrBFlt *lnL, MrBFlt *d1, MrBFlt *d2);
+int       BrlenDerivs_NUC4 (TreeNode *p, int division, int chain, MrBFlt *lnL, MrBFlt *d1, MrBFlt *d2);
+int       BrlenDerivs_Std (TreeNode *p, int division, int chain, MrBFlt *lnL, MrBFlt *d1, MrBFlt *d2);
+#if defined (AVX_ENABLED)
+int       BrlenDerivs_Vec_AVX (TreeNode *p, int division, int chain, MrBFlt *lnL, MrBFlt *d1, MrBFlt *d2);
+#endif
+#if defined (SSE_ENABLED)
+int       BrlenDerivs_Vec_SSE (TreeNode *p, int division, int chain, MrBFlt *lnL, MrBFlt *d1, MrBFlt *d2);
+#endif
 int       CondLikeDown_Bin (TreeNode *p, int division, int chain);
 #if defined (SSE_ENABLED)
 int       CondLikeDown_Bin_SSE (TreeNode *p, int division, int chain);
@@ -48,6 +57,9 @@ int       CondLikeDown_Gen (TreeNode *p, int division, int chain);
 int       CondLikeDown_Gen_SSE (TreeNode *p, int division, int chain);
 #endif
 int       CondLikeDown_Gen_GibbsGamma (TreeNode *p, int division, int chain);
+#if defined (SSE_ENABLED)
+int       CondLikeDown_Gen_GibbsGamma_SSE (TreeNode *p, int division, int chain);
+#endif
 int       CondLikeDown_NUC4 (TreeNode *p, int division, int chain);
 #if defined (FMA_ENABLED)
 int       CondLikeDown_NUC4_FMA (TreeNode *p, int division, int chain);
@@ -59,6 +71,9 @@ int       CondLikeDown_NUC4_AVX (TreeNode *p, int division, int chain);
 int       CondLikeDown_NUC4_SSE (TreeNode *p, int division, int chain);
 #endif
 int       CondLikeDown_NUC4_GibbsGamma (TreeNode *p, int division, int chain);
+#if defined (SSE_ENABLED)
+int       CondLikeDown_NUC4_GibbsGamma_SSE (TreeNode *p, int division, int chain);
+#endif
 int       CondLikeDown_NY98 (TreeNode *p, int division, int chain);
 #if defined (SSE_ENABLED)
 int       CondLikeDown_NY98_SSE (TreeNode *p, int division, int chain);
@@ -73,6 +88,9 @@ int       CondLikeRoot_Gen (TreeNode *p, int division, int chain);
 int       CondLikeRoot_Gen_SSE (TreeNode *p, int division, int chain);
 #endif
 int       CondLikeRoot_Gen_GibbsGamma (TreeNode *p, int division, int chain);
+#if defined (SSE_ENABLED)
+int       CondLikeRoot_Gen_GibbsGamma_SSE (TreeNode *p, int division, int chain);
+#endif
 int       CondLikeRoot_NUC4 (TreeNode *p, int division, int chain);
 #if defined (FMA_ENABLED)
 int       CondLikeRoot_NUC4_FMA (TreeNode *p, int division, int chain);
@@ -84,6 +102,9 @@ int       CondLikeRoot_NUC4_AVX (TreeNode *p, int division, int chain);
 int       CondLikeRoot_NUC4_SSE (TreeNode *p, int division, int chain);
 #endif
 int       CondLikeRoot_NUC4_GibbsGamma (TreeNode *p, int division, int chain);
+#if defined (SSE_ENABLED)
+int       CondLikeRoot_NUC4_GibbsGamma_SSE (TreeNode *p, int division, int chain);
+#endif
 int       CondLikeRoot_NY98 (TreeNode *p, int division, int chain);
 #if defined (SSE_ENABLED)
 int       CondLikeRoot_NY98_SSE (TreeNode *p, int division, int chain);
@@ -109,8 +130,20 @@ int       CondLikeScaler_NY98_SSE (TreeNode *p, int division, int chain);
 int       CondLikeScaler_Std (TreeNode *p, int division, int chain);
 int       CondLikeUp_Bin (TreeNode *p, int division, int chain);
 int       CondLikeUp_Gen (TreeNode *p, int division, int chain);
+#if defined (SSE_ENABLED)
+int       CondLikeUp_Gen_SSE (TreeNode *p, int division, int chain);
+#endif
 int       CondLikeUp_NUC4 (TreeNode *p, int division, int chain);
+#if defined (SSE_ENABLED)
+int       CondLikeUp_NUC4_SSE (TreeNode *p, int division, int chain);
+#endif
 int       CondLikeUp_Std (TreeNode *p, int division, int chain);
+#if defined (AVX_ENABLED)
+int       CondLikeUp_Vec_AVX (TreeNode *p, int division, int chain);
+#endif
+#if defined (SSE_ENABLED)
+int       CondLikeUp_Vec_SSE (TreeNode *p, int division, int chain);
+#endif
 void      LaunchLogLikeForDivision (int chain, int d, MrBFlt* lnL);
 int       Likelihood_Adgamma (TreeNode *p, int division, int chain, MrBFlt *lnL, int whichSitePats);
 int       Likelihood_Gen (TreeNode *p, int division, int chain, MrBFlt *lnL, int whichSitePats);
@@ -140,6 +173,7 @@ int       Likelihood_Res (TreeNode *p, int division, int chain, MrBFlt *lnL, int
 int       Likelihood_Res_SSE (TreeNode *p, int division, int chain, MrBFlt *lnL, int whichSitePats);
 #endif
 int       Likelihood_Std (TreeNode *p, int division, int chain, MrBFlt *lnL, int whichSitePats);
+int       TiProbs_Cov (TreeNode *p, int division, int chain);
 int       TiProbs_Fels (TreeNode *p, int division, int chain);
 int       TiProbs_Gen (TreeNode *p, int division, int chain);
 int       TiProbs_GenCov (TreeNode *p, int division, int chain);
@@ -59,6 +59,7 @@ typedef void (*sighandler_t) (int);
 #define GIBBS_SAMPLE_FREQ           100         /* generations between gibbs sampling of gamma cats */
 #define MAX_SMALL_JUMP              10          /* threshold for precalculating trans probs of adgamma model */
 #define BIG_JUMP                    100         /* threshold for using stationary approximation */
+#define MIN_HMM_SCALER              1E-30       /* threshold for rescaling forward probs of adgamma model */
 #define MAX_RUNS                    120         /* maximum number of independent runs */
 #define PFILE                       0
 #define TFILE                       1
@@ -69,6 +70,20 @@ typedef void (*sighandler_t) (int);
 #define BEAGLE_RESCALE_FREQ         160
 #define BEAGLE_RESCALE_FREQ_DOUBLE  10          /* The factor by which BEAGLE_RESCALE_FREQ get multiplied if double presicion is used */
 #define TARGETLENDELTA              100
+#define SWAP_SUMMARY_SIZE           6           /* heat, lnL, lnPr and ss accumulators of a chain in a swap round */
+#define MPI_TIME_SWAP               0           /* timers of MPI communication in the run loop, see PrintMPITimes */
+#define MPI_TIME_SAMPLES            1
+#define MPI_TIME_DIAGN              2
+#define MPI_TIME_CHECKPOINT         3
+#define MPI_TIME_OTHER              4
+#define NUM_MPI_TIMERS              5
+#define PROFILE_PROPOSAL            0           /* timers of each move when profiling, see PrintMoveProfile */
+#define PROFILE_PRIOR               1
+#define PROFILE_LIKE                2
+#define PROFILE_COPY                3
+#define NUM_PROFILE_TIMERS          4
+#define AUTOWEIGHT_MAX_FACTOR       4.0         /* largest change in the probability of a move, see ReweightMoves */
+#define AUTOWEIGHT_MIN_TRIES        100         /* fewer tries than this leave the probability of a move unchanged */
 
 /* debugging compiler statements */
 #undef  DEBUG_SETUPTERMSTATE
@@ -109,12 +124,48 @@ typedef struct pfnode
     BitsLong        *partition;
     } PFNODE;
 
+typedef struct
+    {
+    BitsLong        hash;
+    int             id;
+    } SPLITKEY;
+
+typedef struct
+    {
+    int             thread;                  /* index of thread, selects its parsimony sets  */
+    int             numThreads;              /* number of threads sharing the work           */
+    int             fromChain;               /* first chain to build starting trees for      */
+    int             toChain;                 /* last chain (+1) to build starting trees for  */
+    RandLong        *chainSeed;              /* seed of each chain for its starting trees    */
+    int             *isBuilt;                /* is the starting tree of a topology built?    */
+    int             chain;                   /* chain of the exhaustive search               */
+    Tree            *t;                      /* tree enumerated by the exhaustive search     */
+    Tree            treeCopy;                /* private copy of the tree for other threads   */
+    TreeInfo        tInfo;                   /* scores of the exhaustive search              */
+    MrBFlt          minScore[3];             /* lowest score of each search branch           */
+    int             rc;                      /* return code of the work                      */
+    } PARSWORK;
+
 /* local prototypes */
-int       AddTreeSamples (int from, int to, int saveToList);
+void      AcceptTreeChange (Tree *t, int chain, int accept);
+int       AddTreeSamples (int from, int to, int saveSamples);
+void      AddMoveTime (int whichMove, int whichTimer);
 PFNODE   *AddPartition (PFNODE *r, BitsLong *p, int runId);
+int       AddSplitsToDiagnostics (BitsLong *splits, int nSplits, int treeId, int runId, int curGen);
+int       AddSplitsToPackedTopologyList (BitsLong *splits, int nSplits, PackedTopologyList *list);
+int       AddSplitsToPartitionCounters (BitsLong *splits, int nSplits, int treeId, int runId);
+int       AddSplitsToSplitRing (BitsLong *splits, int nSplits, SplitRing *ring);
+int       AddSplitToPool (SplitPool *pool, BitsLong *p);
 int       AddTreeToPartitionCounters (Tree *tree, int treeId, int runId);
+int       AppendToPrintString (char *tempStr, size_t *len);
 int       AttemptSwap (int swapA, int swapB, RandLong *seed);
+#if defined (MPI_ENABLED)
+int       AttemptSwapRound (RandLong *seed);
+#endif
+void      BuildExhaustiveSearchBranch (Tree *t, int chain, int nTaxInTree, int branch, TreeInfo *tInfo);
 void      BuildExhaustiveSearchTree (Tree *t, int chain, int nTaxInTree, TreeInfo *tInfo);
+int       BuildMLTrees (RandLong *seed, int fromChain, int toChain);
+void     *BuildParsTreesThread (void *arg);
 int       BuildStepwiseTree (Tree *t, int chain, RandLong *seed);
 int       CalcLikeAdgamma (int d, Param *param, int chain, MrBFlt *lnL);
 void      CalcPartFreqStats (PFNODE *p, STATS *stat);
@@ -124,14 +175,21 @@ BOOL      WINAPI CatchInterrupt (DWORD signum);
 #else  
 void      CatchInterrupt (int signum);
 #endif  
+int       CheckBrlenDerivs (Tree *t, TreeNode *p, int chain);
 int       CheckTemperature (void);
 void      CloseMBPrintFiles (void);
 PFNODE   *CompactTree (PFNODE *p);
+int       CompareSplitKeys (const void *x, const void *y);
 int       ConfirmAbortRun(void);
+int       CopyExhaustiveSearchTree (Tree *t, TreeInfo *tInfo, PARSWORK *work);
 void      CopyParams (int chain);
 void      CopyPFNodeDown (PFNODE *p);
 void      CopySiteScalers (ModelInfo *m, int chain);
 void      CopyTrees (int chain);
+#if defined (BEST_MPI_ENABLED)
+int       DistributeDivisions (void);
+#endif
+void     *ExhaustiveSearchThread (void *arg);
 int       ExtendChainQuery (void);
 int       FillNumSitesOfPat (void);
 TreeNode *FindBestNode (Tree *t, TreeNode *p, TreeNode *addNode, CLFlt *minLength, int chain);
@@ -141,22 +199,33 @@ void      FlipNodeScalerSpace (ModelInfo *m, int chain, int nodeIndex);
 void      FlipSiteScalerSpace (ModelInfo *m, int chain);
 void      FlipTiProbsSpace (ModelInfo *m, int chain, int nodeIndex);
 void      FreeChainMemory (void);
+int       FullClockTreePriorRatio (Param *param, int chain, MrBFlt clockRate, MrBFlt *lnPriorRatio);
+void      FreePackedTopologyList (PackedTopologyList *list);
+void      FreeSplitPool (SplitPool *pool);
+void      FreeSplitRing (SplitRing *ring);
+int       GetBrlenDerivs (Tree *t, TreeNode *p, int chain, MrBFlt *lnL, MrBFlt *d1, MrBFlt *d2);
 MrBFlt    GetFitchPartials (ModelInfo *m, int chain, int source1, int source2, int destination);
 void      GetStamp (void);
 void      GetSwappers (int *swapA, int *swapB, int curGen);
 void      GetTempDownPassSeq (TreeNode *p, int *i, TreeNode **dp);
+int       GetTreeSplits (Tree *tree, BitsLong *splits);
 int       GetTotalRateShifts (Model *mp, MrBFlt *shiftTimes);
 MrBFlt    GibbsSampleGamma (int chain, int division, RandLong *seed);
+BitsLong  HashSplit (BitsLong *p, int nLongs);
 int       InitAdGamma(void);
+int       InitAugmentedModels (void);
 int       InitChainCondLikes (void);
 int       InitClockBrlens (Tree *t);
 int       InitEigenSystemInfo (ModelInfo *m);
 int       InitInvCondLikes (void);
 int       InitParsSets (void);
 int       InitPrintParams (void);
+int       InitSiteLnLs (void);
 int       IsPFNodeEmpty (PFNODE *p);
 PFNODE   *LargestNonemptyPFNode (PFNODE *p, int *i, int j);
+int       LocalClockTreePriorRatio (Param *param, int chain, MrBFlt clockRate, MrBFlt *lnPriorRatio);
 MrBFlt    LogLike (int chain);
+MrBFlt    LogLikeTree (Tree *t, int chain);
 MrBFlt    LogPrior (int chain);
 int       LnBirthDeathPriorPrRandom    (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt sR, MrBFlt eR, MrBFlt sF);
 int       LnBirthDeathPriorPrDiversity (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt sR, MrBFlt eR, MrBFlt sF);
@@ -174,12 +243,13 @@ MrBFlt    LnQi_fossil (MrBFlt t, MrBFlt *t_f, int sl, MrBFlt *c1, MrBFlt *c2);
 MrBFlt    LnPi_fossil (MrBFlt t, MrBFlt *t_f, int sl, MrBFlt *c1, MrBFlt *c2, MrBFlt *lambda, MrBFlt *mu, MrBFlt *psi);
 int       NewtonRaphsonBrlen (Tree *t, TreeNode *p, int chain);
 void      NodeToNodeDistances (Tree *t, TreeNode *fromNode);
+int       OptimizeMLBrlens (Tree *t, int chain, MrBFlt minV, MrBFlt maxV, MrBFlt *lnL);
+int       OptimizeMLTree (Tree *t, int chain, MrBFlt *lnL, int *nNNIs);
+#if defined (MPI_ENABLED)
+int       OpenSampleFile (char *name, int fileIndex);
+#endif
 int       PickProposal (RandLong *seed, int chainIndex);
 int       NumCppEvents (Param *p, int chain);
-int       PosSelProbs (TreeNode *p, int division, int chain);
-#if defined (SSE_ENABLED)
-int       PosSelProbs_SSE (TreeNode *p, int division, int chain);
-#endif
 int       PreparePrintFiles (void);
 int       PrintAncStates_Bin (TreeNode *p, int division, int chain);
 int       PrintAncStates_Gen (TreeNode *p, int division, int chain);
@@ -188,11 +258,14 @@ int       PrintAncStates_Std (TreeNode *p, int division, int chain);
 int       PrintCalTree (int curGen, Tree *tree);
 int       PrintCheckPoint (int gen);
 int       PrintMCMCDiagnosticsToFile (int curGen);
+int       PrintMoveProfile (int numStepHeapAllocs, int lastHeapAllocGen);
 #if defined (MPI_ENABLED)
 int       PrintMPISlaves (FILE *fp);
+int       PrintMPITimes (double loopTime);
 #endif
 void      PrintParamValues (Param *p, int chain, char *s);
 int       PrintParsMatrix (void);
+int       PrintSiteLnLs (int curGen, int coldId);
 int       PrintSiteRates_Gen (TreeNode *p, int division, int chain);
 int       PrintSiteRates_Std (TreeNode *p, int division, int chain);
 int       PrintStates (int curGen, int coldId);
@@ -214,16 +287,22 @@ int       RedistributeParamVals (void);
 int       RedistributeTuningParams (void);
 #endif
 int       RemovePartition (PFNODE *r, BitsLong *p, int runId);
-int       RemoveTreeFromPartitionCounters (Tree *tree, int treeId, int runId);
+void      ReleaseSplitFromPool (SplitPool *pool, int id);
+int       RemoveTopologyFromPartitionCounters (PackedTopologyList *list, int treeId, int runId);
+int       RemoveTreeFromSplitRing (SplitRing *ring, int treeId, int runId);
 int       RemoveTreeSamples (int from, int to);
 int       ReopenMBPrintFiles (void);
 void      ResetChainIds (void);
 void      ResetFlips(int chain);
+void      ResetMoveWeights (int reweightGen);
 void      ResetSiteScalers (ModelInfo *m, int chain);
 int       ReusePreviousResults(int *numSamples, int);
+int       ReweightMoves (int *numChanged);
 int       RunChain (RandLong *seed);
+int       RunParsThreads (void *(*threadFxn)(void *), PARSWORK *work, int numThreads);
 int       SafeSprintf (char **target, int *targetLen, char *fmt, ...);
 void      SetChainIds (void);
+void      SetCumProposalProbs (void);
 void      SetFileNames (void);
 int       SetLikeFunctions (void);
 int       SetLocalChainsAndDataSplits (void);
@@ -238,11 +317,12 @@ int       SetUpTermState (void);
 int       SetUsedMoves (void);
 int       ShowMoveSummary (void);
 void      ShowValuesForChain (int chn);
-int       SiteOmegas (TreeNode *p, int division, int chain);
+int       SiteOmegaProbs (TreeNode *p, int division, int chain);
 #if defined (SSE_ENABLED)
-int       SiteOmegas_SSE (TreeNode *p, int division, int chain);
+int       SiteOmegaProbs_SSE (TreeNode *p, int division, int chain);
 #endif
 PFNODE   *SmallestNonemptyPFNode (PFNODE *p, int *i, int j);
+int       SummarizeSiteLnLs (void);
 PFNODE   *Talloc (void);
 void      Tfree (PFNODE *r);
 MrBFlt    Temperature (int x);
@@ -250,6 +330,10 @@ void      TouchAllCijks (int chain);
 void      TouchAllPartitions (void);
 void      TouchAllTrees (int chain);
 void      TouchEverything (int chain);
+#if defined (MPI_ENABLED)
+int       WaitForSwappedMoveInfo (int chn);
+#endif
+int       WriteSampleString (int runId, int whichFile);
 
 /* globals declared here and used elsewhere */
 int             *bsIndex;                    /* compressed std stat freq index               */
@@ -284,11 +368,18 @@ int             *chainId = NULL;             /* information on the id (0 ...) of
 MrBFlt          *curLnL = NULL;              /* stores log likelihood                        */
 MrBFlt          *curLnPr = NULL;             /* stores log prior probability                 */
 int             stepRelativeBurninSS;        /* Should we use relative burn in within each step or not    */
+int             firstStepSS, lastStepSS;     /* first and last step sampled in this (block of) SS         */
 MrBFlt          powerSS;                     /* power (betta) in power posterior destribution used in SS  */
 MrBFlt          *marginalLnLSS = NULL;       /* marginal liklihood obtained using stepppingstone sampling */
 MrBFlt          *stepAcumulatorSS = NULL;    /* accumulates liklihoods for current step in SS             */
 MrBFlt          *stepScalerSS = NULL;        /* scaler of stepAcumulatorSS in log scale in SS             */
 MrBFlt          *splitfreqSS = NULL;         /* array holding split frequencis for each step in SS        */
+MrBFlt          *moveTime = NULL;            /* time spent in each move by timer, when profiling          */
+MrBFlt          *divisionLikeTime = NULL;    /* likelihood time of each division, when profiling          */
+MrBFlt          priorTime;                   /* time spent in the prior functions during the current move */
+MrBFlt          lastMoveTime;                /* time of the last profiling point in the run loop          */
+MrBFlt          *autoweightInfo = NULL;      /* time, squared jumps and tries of moves, see ReweightMoves */
+int             numBrlenDerivChecks;         /* branches with checked derivatives, see CheckBrlenDerivs   */
 int             *sympiIndex;                 /* sympi state freq index for multistate chars  */
 int             stdStateFreqsRowSize;        /* row size for std state frequencies           */
 int             *weight;                     /* weight of each compressed char               */
@@ -317,11 +408,14 @@ int             inferPosSel;                 /* indicates if positive selection
 MrBFlt          *posSelProbs;                /* probs. for positive selection                */
 int             hasMarkovTi[MAX_SMALL_JUMP]; /* vector marking size of observed HMM jumps    */
 int             *siteJump;                   /* vector of sitejumps for adgamma model        */
+int             *hmmSites;                   /* division, char and jump of adgamma HMM sites */
 MrBFlt          **rateProbs;                 /* pointers to rate probs used by adgamma model */
 MrBFlt          *rateProbSpace;              /* space for rate probs used by adgamma model   */
 int             rateProbRowSize;             /* size of rate probs for one chain one state   */
 MrBFlt          **markovTi[MAX_SMALL_JUMP];  /* trans prob matrices used in calc of adgamma  */
 MrBFlt          **markovTiN;                 /* trans prob matrices used in calc of adgamma  */
+MrBFlt          markovTiVals[MAX_RATE_CATS*MAX_RATE_CATS]; /* trans probs held in markovTi */
+int             markovTiRates;               /* no. rates in markovTiVals, 0 if not set      */
 int             whichReweightNum;            /* used for setting reweighting of char pats    */
 int             ***swapInfo;                 /* keeps track of attempts & successes of swaps */
 int             tempIndex;                   /* keeps track of which user temp is specified  */
@@ -329,25 +423,89 @@ int             abortMove;                   /* flag determining whether to abor
 PFNODE          **partFreqTreeRoot;          /* root of tree(s) holding partition freqs      */
 int             nLongsNeeded;                /* number of longs needed for partitions        */
 BitsLong        **partition;                 /* matrix holding partitions                    */
+SPLITKEY        *splitKeys;                  /* space for sorting splits of packed trees     */
+BitsLong        *treeSplits;                 /* splits of last tree added to counters        */
 MrBFlt          *maxLnL0 = NULL;             /* maximum likelihood                           */
 FILE            *fpMcmc = NULL;              /* pointer to .mcmc file                        */
 FILE            **fpParm = NULL;             /* pointer to .p file(s)                        */
 FILE            ***fpTree = NULL;            /* pointer to .t file(s)                        */
 FILE            *fpSS = NULL;                /* pointer to .ss file                          */
+FILE            **fpSiteLnL = NULL;          /* pointer to .sitelnl file(s)                  */
+int             *siteLnLChars = NULL;        /* first character of each site in .sitelnl     */
+int             numSiteLnLChars;             /* number of sites in .sitelnl                  */
 static int      requestAbortRun;             /* flag for aborting mcmc analysis              */
 int             *topologyPrintIndex;         /* print file index of each topology            */
 int             *printTreeTopologyIndex;     /* topology index of each tree print file       */
 int             numPreviousGen;              /* number of generations in run to append to    */
+int             numParsThreads;              /* number of threads sharing the parsimony sets */
 
 #if defined (MPI_ENABLED)
 int             lowestLocalRunId;            /* lowest local run Id                          */
 int             highestLocalRunId;           /* highest local run Id                         */
+MrBFlt          *swapSummary;                /* state summaries of all chains in swap round  */
+MrBFlt          *swapMoveInfo;               /* move info of heats changing processor        */
+MPI_Request     *swapRequest;                /* pending sends and receives of move info      */
+int             *swapHeat;                   /* heats, old and new slots used in swap round  */
+int             *swapRecvHeat;               /* heat being received by each local chain      */
+double          mpiTime[NUM_MPI_TIMERS];     /* time spent communicating in the run loop     */
+MPI_File        *sampleFile = NULL;          /* .p, .sitelnl and .t files, written by MPI-IO */
+MPI_Offset      *sampleFileEnd;              /* end of each sample file, same on all procs   */
+int             *sampleFileBytes;            /* bytes written since the ends were updated    */
+int             numSampleFiles;              /* number of sample files                       */
+#endif
+
+#if defined (BEST_MPI_ENABLED)
+int             *isDivisionActive;           /* is the division calculated on this processor */
+MrBFlt          *divisionLnLike;             /* division lnLs to be summed across processors */
 #endif
 
 #if defined (PRINT_DUMP)
 FILE            **fpDump = NULL;             /* pointer to .dump file(s)                     */
 #endif
 
+/* AcceptTreeChange: Keep or discard the cond likes and division lnLs calculated by LogLikeTree
+   for the touched nodes of t, and reset the update flags of t and its divisions */
+void AcceptTreeChange (Tree *t, int chain, int accept)
+{
+    int         i;
+    ModelInfo   *m;
+
+    if (accept == NO)
+        {
+        ResetFlips (chain);
+        for (i=0; i<t->nRelParts; i++)
+            {
+            m = &modelSettings[t->relParts[i]];
+            m->lnLike[2*chain + state[chain]] = m->lnLike[2*chain + (state[chain] ^ 1)];
+            }
+        }
+
+    for (i=0; i<t->nNodes; i++)
+        t->allDownPass[i]->upDateCl = t->allDownPass[i]->upDateTi = NO;
+    for (i=0; i<t->nRelParts; i++)
+        {
+        modelSettings[t->relParts[i]].upDateCl = NO;
+        modelSettings[t->relParts[i]].upDateCijk = NO;
+        modelSettings[t->relParts[i]].upDateAll = NO;
+        }
+}
+
+
+/* AddMoveTime: Charge the time since the last profiling point to a timer of a move;
+   time spent in the prior functions since then is charged to the prior timer */
+void AddMoveTime (int whichMove, int whichTimer)
+{
+    MrBFlt      t, *x;
+
+    t = ProfileTime ();
+    x = moveTime + whichMove*NUM_PROFILE_TIMERS;
+    x[whichTimer] += t - lastMoveTime - priorTime;
+    x[PROFILE_PRIOR] += priorTime;
+    priorTime = 0.0;
+    lastMoveTime = t;
+}
+
+
 /* AddPartition: Add a partition to the tree keeping track of partition frequencies */
 PFNODE *AddPartition (PFNODE *r, BitsLong *p, int runId)
 {
@@ -406,6 +564,92 @@ PFNODE *AddPartition (PFNODE *r, BitsLong *p, int runId)
 }
 
 
+/* AddSplitToPool: Add a reference to a split in a split pool and return its id (-1 on error) */
+int AddSplitToPool (SplitPool *pool, BitsLong *p)
+{
+    int         i, j, k, id, newCapacity, *newTable, *newRefCount, *newFreeIds;
+    BitsLong    h, *newBits, *newHash;
+
+    h = HashSplit (p, pool->nLongs);
+
+    /* look for the split in the hash table */
+    if (pool->tableSize > 0)
+        {
+        for (k=(int)(h & (pool->tableSize-1)); pool->table[k] != -1; k=(k+1) & (pool->tableSize-1))
+            {
+            id = pool->table[k];
+            if (pool->hash[id] != h)
+                continue;
+            for (j=0; j<pool->nLongs; j++)
+                if (pool->bits[id*pool->nLongs+j] != p[j])
+                    break;
+            if (j == pool->nLongs)
+                {
+                pool->refCount[id]++;
+                return id;
+                }
+            }
+        }
+
+    /* new split; grow pool and hash table if needed, keeping the table at most half full */
+    if (pool->numFree == 0 && pool->numSplits == pool->capacity)
+        {
+        /* grow into temporaries so that a failed allocation leaves the pool usable; a block
+           that was moved successfully is stored right away since its old address is gone,
+           but the capacity only grows once all blocks have been reallocated */
+        newCapacity = (pool->capacity == 0 ? 256 : 2 * pool->capacity);
+        newTable = (int *) SafeMalloc ((size_t)2 * newCapacity * sizeof(int));
+        if (!newTable)
+            return -1;
+        newBits = (BitsLong *) SafeRealloc ((void *)pool->bits, (size_t)newCapacity * pool->nLongs * sizeof(BitsLong));
+        if (newBits)
+            pool->bits = newBits;
+        newHash = (BitsLong *) SafeRealloc ((void *)pool->hash, (size_t)newCapacity * sizeof(BitsLong));
+        if (newHash)
+            pool->hash = newHash;
+        newRefCount = (int *) SafeRealloc ((void *)pool->refCount, (size_t)newCapacity * sizeof(int));
+        if (newRefCount)
+            pool->refCount = newRefCount;
+        newFreeIds = (int *) SafeRealloc ((void *)pool->freeIds, (size_t)newCapacity * sizeof(int));
+        if (newFreeIds)
+            pool->freeIds = newFreeIds;
+        if (!newBits || !newHash || !newRefCount || !newFreeIds)
+            {
+            free (newTable);
+            return -1;
+            }
+        pool->capacity = newCapacity;
+        pool->tableSize = 2 * newCapacity;
+        for (k=0; k<pool->tableSize; k++)
+            newTable[k] = -1;
+        for (i=0; i<pool->numSplits; i++)
+            {
+            if (pool->refCount[i] == 0)
+                continue;
+            for (k=(int)(pool->hash[i] & (pool->tableSize-1)); newTable[k] != -1; k=(k+1) & (pool->tableSize-1))
+                ;
+            newTable[k] = i;
+            }
+        free (pool->table);
+        pool->table = newTable;
+        }
+
+    for (k=(int)(h & (pool->tableSize-1)); pool->table[k] != -1; k=(k+1) & (pool->tableSize-1))
+        ;
+    if (pool->numFree > 0)
+        id = pool->freeIds[--pool->numFree];
+    else
+        id = pool->numSplits++;
+    for (j=0; j<pool->nLongs; j++)
+        pool->bits[id*pool->nLongs+j] = p[j];
+    pool->hash[id] = h;
+    pool->refCount[id] = 1;
+    pool->table[k] = id;
+
+    return id;
+}
+
+
 int AddToPrintString (char *tempStr)
 {
     size_t  len1, len2;
@@ -431,8 +675,33 @@ int AddToPrintString (char *tempStr)
 }
 
 
-/* AddTreeSamples: Add tree samples from .t files to partition counters. if saveToList == YES then also save trees in tree list */
-int AddTreeSamples (int from, int to, int saveToList)
+/* AppendToPrintString: Like AddToPrintString, but len holds the length of printString, so that
+   adding many short strings takes linear time; len is updated */
+int AppendToPrintString (char *tempStr, size_t *len)
+{
+    size_t  len2;
+
+    len2 = strlen(tempStr);
+    if (*len + len2 + 1 > printStringSize)
+        {
+        printStringSize = 2 * (*len + len2 + 1);
+        printString = (char*)SafeRealloc((void*)printString, printStringSize * sizeof(char));
+        if (!printString)
+            {
+            MrBayesPrint ("%s   Problem reallocating printString (%d)\n", spacer, printStringSize * sizeof(char));
+            return (ERROR);
+            }
+        }
+    strcpy(printString + *len, tempStr);
+    *len += len2;
+
+    return (NO_ERROR);
+}
+
+
+/* AddTreeSamples: Add tree samples from .t files to partition counters. if saveSamples == YES then also save
+   the samples for later removal, in the packed topology list if saveTrees == YES and in the split ring otherwise */
+int AddTreeSamples (int from, int to, int saveSamples)
 {
     int     i, j, k, longestLine;
     BitsLong    lastBlock;
@@ -445,7 +714,7 @@ int AddTreeSamples (int from, int to, int saveToList)
     if (from > to)
         return (NO_ERROR);
 
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     if (proc_id != 0)
         return (NO_ERROR);
 #   endif
@@ -537,9 +806,16 @@ int AddTreeSamples (int from, int to, int saveToList)
                         free (tempStr);
                         return ERROR;
                         }
-                    if (saveToList == YES)
-                        if (AddToTreeList(&chainParams.treeList[numTopologies*j+i],t) == ERROR)
+                    if (saveSamples == YES && chainParams.saveTrees == YES)
+                        {
+                        if (AddSplitsToPackedTopologyList (treeSplits, t->nIntNodes-1, &chainParams.topoList[numTopologies*j+i]) == ERROR)
+                            return (ERROR);
+                        }
+                    else if (saveSamples == YES)
+                        {
+                        if (AddSplitsToSplitRing (treeSplits, t->nIntNodes-1, &chainParams.splitRing[numTopologies*j+i]) == ERROR)
                             return (ERROR);
+                        }
                     }
                 }
             SafeFclose (&fp);
@@ -551,35 +827,113 @@ int AddTreeSamples (int from, int to, int saveToList)
 }
 
 
-/* AddTreeToPartitionCounters: Break a tree into partitions and add those to counters */
-int AddTreeToPartitionCounters (Tree *tree, int treeId, int runId)
+/* AddSplitsToDiagnostics: Add the splits of a sampled tree to the partition counters of a run and, if they
+   may have to be removed later because of relative burnin, save them too */
+int AddSplitsToDiagnostics (BitsLong *splits, int nSplits, int treeId, int runId, int curGen)
 {
-    int         i, j, nTaxa;
-    TreeNode    *p;
+    if (AddSplitsToPartitionCounters (splits, nSplits, treeId, runId) == ERROR)
+        return (ERROR);
 
-    if (tree->isRooted == YES)
-        nTaxa = tree->nNodes - tree->nIntNodes - 1;
-    else
-        nTaxa = tree->nNodes - tree->nIntNodes;
+    if (chainParams.relativeBurnin == YES && (noWarn == NO || curGen <= chainParams.stopTreeGen))
+        {
+        if (chainParams.saveTrees == YES)
+            return (AddSplitsToPackedTopologyList (splits, nSplits, &chainParams.topoList[numTopologies*runId+treeId]));
+        else
+            return (AddSplitsToSplitRing (splits, nSplits, &chainParams.splitRing[numTopologies*runId+treeId]));
+        }
 
-    for (i=0; i<nTaxa; i++)
+    return (NO_ERROR);
+}
+
+
+/* AddSplitsToPackedTopologyList: Save the topology given by nSplits consecutive splits at the end of a packed
+   topology list */
+int AddSplitsToPackedTopologyList (BitsLong *splits, int nSplits, PackedTopologyList *list)
+{
+    int         i, slot, newCapacity, *newIds, *newRepeats, *x;
+
+    if (list->splitIds == NULL)
+        list->nSplits = nSplits;
+    else if (list->nSplits != nSplits)
         {
-        ClearBits(partition[i], nLongsNeeded);
-        SetBit(i, partition[i]);
+        MrBayesPrint ("%s   Wrong number of splits in AddSplitsToPackedTopologyList\n", spacer);
+        return (ERROR);
         }
 
-    for (i=0; i<tree->nIntNodes-1; i++)
+    /* get split ids and sort them on hash value so that equal topologies have equal id vectors */
+    for (i=0; i<nSplits; i++)
         {
-        p = tree->intDownPass[i];
-        assert (p->index >= tree->nNodes - tree->nIntNodes - (tree->isRooted == YES ? 1 : 0));
-        for (j=0; j<nLongsNeeded; j++)
+        splitKeys[i].id = AddSplitToPool (list->pool, splits + (size_t)i*nLongsNeeded);
+        if (splitKeys[i].id == -1)
+            return (ERROR);
+        splitKeys[i].hash = list->pool->hash[splitKeys[i].id];
+        }
+    qsort ((void *)splitKeys, (size_t)nSplits, sizeof(SPLITKEY), CompareSplitKeys);
+
+    /* same topology as last sample: just count it */
+    if (list->numStored > 0)
+        {
+        slot = (list->first + list->numStored - 1) % list->capacity;
+        x = list->splitIds + (size_t)slot*nSplits;
+        for (i=0; i<nSplits; i++)
+            if (x[i] != splitKeys[i].id)
+                break;
+        if (i == nSplits)
             {
-            partition[p->index][j] = partition[p->left->index][j] | partition[p->right->index][j];
+            for (i=0; i<nSplits; i++)
+                ReleaseSplitFromPool (list->pool, splitKeys[i].id);
+            list->repeats[slot]++;
+            return (NO_ERROR);
+            }
+        }
+
+    /* grow buffer if full, unwrapping the topologies so that the oldest is first */
+    if (list->numStored == list->capacity)
+        {
+        newCapacity = (list->capacity == 0 ? 64 : 2 * list->capacity);
+        newIds = (int *) SafeMalloc ((size_t)newCapacity * nSplits * sizeof (int));
+        newRepeats = (int *) SafeMalloc ((size_t)newCapacity * sizeof (int));
+        if (!newIds || !newRepeats)
+            {
+            free (newIds);
+            free (newRepeats);
+            return (ERROR);
+            }
+        for (i=0; i<list->numStored; i++)
+            {
+            slot = (list->first + i) % list->capacity;
+            memcpy (newIds + (size_t)i*nSplits, list->splitIds + (size_t)slot*nSplits, nSplits*sizeof (int));
+            newRepeats[i] = list->repeats[slot];
             }
+        free (list->splitIds);
+        free (list->repeats);
+        list->splitIds = newIds;
+        list->repeats = newRepeats;
+        list->capacity = newCapacity;
+        list->first = 0;
+        }
 
-        if ((partFreqTreeRoot[treeId] = AddPartition (partFreqTreeRoot[treeId], partition[p->index], runId)) == NULL)
+    slot = (list->first + list->numStored) % list->capacity;
+    x = list->splitIds + (size_t)slot*nSplits;
+    for (i=0; i<nSplits; i++)
+        x[i] = splitKeys[i].id;
+    list->repeats[slot] = 1;
+    list->numStored++;
+
+    return (NO_ERROR);
+}
+
+
+/* AddSplitsToPartitionCounters: Add nSplits consecutive splits to the partition counters of a run */
+int AddSplitsToPartitionCounters (BitsLong *splits, int nSplits, int treeId, int runId)
+{
+    int         i;
+
+    for (i=0; i<nSplits; i++)
+        {
+        if ((partFreqTreeRoot[treeId] = AddPartition (partFreqTreeRoot[treeId], splits + (size_t)i*nLongsNeeded, runId)) == NULL)
             {
-            MrBayesPrint ("%s   Could not allocate space for new partition in AddTreeToPartitionCounters\n", spacer);
+            MrBayesPrint ("%s   Could not allocate space for new partition in AddSplitsToPartitionCounters\n", spacer);
             return ERROR;
             }
         }
@@ -588,6 +942,58 @@ int AddTreeToPartitionCounters (Tree *tree, int treeId, int runId)
 }
 
 
+/* AddTreeToPartitionCounters: Break a tree into partitions and add those to counters. The splits are left in
+   treeSplits, from where they can be saved with AddSplitsToPackedTopologyList or AddSplitsToSplitRing */
+int AddTreeToPartitionCounters (Tree *tree, int treeId, int runId)
+{
+    int         nSplits;
+
+    nSplits = GetTreeSplits (tree, treeSplits);
+
+    return (AddSplitsToPartitionCounters (treeSplits, nSplits, treeId, runId));
+}
+
+
+/* AddSplitsToSplitRing: Save nSplits consecutive splits of a tree at the end of a split ring */
+int AddSplitsToSplitRing (BitsLong *splits, int nSplits, SplitRing *ring)
+{
+    int         k, slot, newCapacity;
+    BitsLong    *newSplits;
+
+    if (ring->splits == NULL)
+        ring->nSplits = nSplits;
+    else if (ring->nSplits != nSplits)
+        {
+        MrBayesPrint ("%s   Wrong number of splits in AddSplitsToSplitRing\n", spacer);
+        return (ERROR);
+        }
+
+    /* grow buffer if full, unwrapping the samples so that the oldest is first */
+    if (ring->numSamples == ring->capacity)
+        {
+        newCapacity = (ring->capacity == 0 ? 64 : 2 * ring->capacity);
+        newSplits = (BitsLong *) SafeMalloc ((size_t)newCapacity * nSplits * nLongsNeeded * sizeof (BitsLong));
+        if (!newSplits)
+            return (ERROR);
+        for (k=0; k<ring->numSamples; k++)
+            {
+            slot = (ring->first + k) % ring->capacity;
+            memcpy (newSplits + (size_t)k*nSplits*nLongsNeeded, ring->splits + (size_t)slot*nSplits*nLongsNeeded, nSplits*nLongsNeeded*sizeof (BitsLong));
+            }
+        free (ring->splits);
+        ring->splits = newSplits;
+        ring->capacity = newCapacity;
+        ring->first = 0;
+        }
+
+    slot = (ring->first + ring->numSamples) % ring->capacity;
+    memcpy (ring->splits + (size_t)slot*nSplits*nLongsNeeded, splits, nSplits*nLongsNeeded*sizeof (BitsLong));
+    ring->numSamples++;
+
+    return (NO_ERROR);
+}
+
+
 int AttemptSwap (int swapA, int swapB, RandLong *seed)
 {
     int             d, tempX, reweightingChars, isSwapSuccessful, chI, chJ, runId;
@@ -1250,6 +1656,221 @@ int AttemptSwap (int swapA, int swapB, RandLong *seed)
 }
 
 
+#   if defined (MPI_ENABLED)
+/*----------------------------------------------------------------
+|
+|   AttemptSwapRound: Attempt all heat swaps of a swap round. The
+|      heat, lnL and lnPr of every chain are gathered in a single
+|      collective, after which all processors make the same swap
+|      decisions using the shared swapSeed. The move info of heats
+|      that change processor is sent without blocking and is only
+|      waited for when the receiving chain is next updated (see
+|      WaitForSwappedMoveInfo). With character reweighting, swaps
+|      need the likelihood of one state on the other chain's data,
+|      so we fall back to swapping pairs with AttemptSwap.
+|
+----------------------------------------------------------------*/
+int AttemptSwapRound (RandLong *seed)
+{
+    int         i, j, k, run, swapA, swapB, tempX, chI, chJ, isSwapSuccessful, firstSlot, oldHeat, newHeat,
+                fromProc, toProc, nMoveInfo, *heat, *oldSlot, *newSlot, ierror;
+    MrBFlt      tempA, tempB, lnLikeA, lnLikeB, lnPriorA, lnPriorB, lnR, r, *x, *buf;
+    double      t0;
+    MCMCMove    *mv;
+
+    if ((chainParams.weightScheme[0] + chainParams.weightScheme[1]) > 0.00001)
+        {
+        t0 = MPI_Wtime ();
+        for (i=0; i<chainParams.numRuns; i++)
+            {
+            for (j=0; j<chainParams.numSwaps; j++)
+                {
+                GetSwappers (&swapA, &swapB, i);
+                if (AttemptSwap (swapA, swapB, seed) == ERROR)
+                    return (ERROR);
+                }
+            }
+        mpiTime[MPI_TIME_SWAP] += MPI_Wtime () - t0;
+        return (NO_ERROR);
+        }
+
+    /* complete transfers left over from the previous round */
+    if (WaitForSwappedMoveInfo (-1) == ERROR)
+        return (ERROR);
+
+    /* summarize local chains; cold chains also carry the stepping-stone values of their run */
+    x = swapSummary + numGlobalChains * SWAP_SUMMARY_SIZE;
+    for (j=0; j<numLocalChains; j++)
+        {
+        x[0] = chainId[j];
+        x[1] = curLnL[j];
+        x[2] = curLnPr[j];
+        x[3] = x[4] = x[5] = 0.0;
+        if (chainParams.isSS == YES && chainId[j] % chainParams.numChains == 0)
+            {
+            run = chainId[j] / chainParams.numChains;
+            x[3] = marginalLnLSS[run];
+            x[4] = stepAcumulatorSS[run];
+            x[5] = stepScalerSS[run];
+            }
+        x += SWAP_SUMMARY_SIZE;
+        }
+    x = swapSummary + numGlobalChains * SWAP_SUMMARY_SIZE;
+    t0 = MPI_Wtime ();
+    ierror = MPI_Allgather (x, numLocalChains*SWAP_SUMMARY_SIZE, MPI_DOUBLE, swapSummary, numLocalChains*SWAP_SUMMARY_SIZE, MPI_DOUBLE, MPI_COMM_WORLD);
+    mpiTime[MPI_TIME_SWAP] += MPI_Wtime () - t0;
+    if (ierror != MPI_SUCCESS)
+        return (ERROR);
+
+    /* the slots are laid out by processor, so slot k belongs to processor k / numLocalChains */
+    heat    = swapHeat;
+    oldSlot = swapHeat + numGlobalChains;
+    newSlot = swapHeat + 2*numGlobalChains;
+    for (k=0; k<numGlobalChains; k++)
+        {
+        heat[k] = (int) swapSummary[k*SWAP_SUMMARY_SIZE];
+        oldSlot[heat[k]] = k;
+        }
+
+    /* make the swap decisions; all processors do this identically, but only processor 0 keeps count */
+    for (run=0; run<chainParams.numRuns; run++)
+        {
+        for (i=0; i<chainParams.numSwaps; i++)
+            {
+            GetSwappers (&swapA, &swapB, run);
+            tempA = Temperature (heat[swapA]);
+            tempB = Temperature (heat[swapB]);
+            lnLikeA = swapSummary[swapA*SWAP_SUMMARY_SIZE+1];
+            lnLikeB = swapSummary[swapB*SWAP_SUMMARY_SIZE+1];
+            if (chainParams.isSS == YES)
+                {
+                lnLikeA *= powerSS;
+                lnLikeB *= powerSS;
+                }
+            lnPriorA = swapSummary[swapA*SWAP_SUMMARY_SIZE+2];
+            lnPriorB = swapSummary[swapB*SWAP_SUMMARY_SIZE+2];
+            lnR = (tempB * (lnLikeA + lnPriorA) + tempA * (lnLikeB + lnPriorB)) - (tempA * (lnLikeA + lnPriorA) + tempB * (lnLikeB + lnPriorB));
+            if (lnR < -100.0)
+                r = 0.0;
+            else if (lnR > 0.0)
+                r = 1.0;
+            else
+                r = exp (lnR);
+
+            isSwapSuccessful = NO;
+            if (RandomNumber(&swapSeed) < r)
+                {
+                tempX = heat[swapA];
+                heat[swapA] = heat[swapB];
+                heat[swapB] = tempX;
+                isSwapSuccessful = YES;
+                }
+
+            if (proc_id == 0)
+                {
+                chI = heat[swapA];
+                chJ = heat[swapB];
+                if (heat[swapB] < heat[swapA])
+                    {
+                    chI = heat[swapB];
+                    chJ = heat[swapA];
+                    }
+                chI = chI % chainParams.numChains;
+                chJ = chJ % chainParams.numChains;
+                swapInfo[run][chJ][chI]++;
+                if (isSwapSuccessful == YES)
+                    swapInfo[run][chI][chJ]++;
+                }
+            }
+        }
+    for (k=0; k<numGlobalChains; k++)
+        newSlot[heat[k]] = k;
+
+    /* hand over the stepping-stone values of cold chains that changed processor */
+    if (chainParams.isSS == YES)
+        {
+        for (run=0; run<chainParams.numRuns; run++)
+            {
+            k = run * chainParams.numChains;
+            fromProc = oldSlot[k] / numLocalChains;
+            toProc   = newSlot[k] / numLocalChains;
+            if (fromProc == toProc)
+                continue;
+            if (proc_id == toProc)
+                {
+                x = swapSummary + oldSlot[k]*SWAP_SUMMARY_SIZE;
+                marginalLnLSS[run]    = x[3];
+                stepAcumulatorSS[run] = x[4];
+                stepScalerSS[run]     = x[5];
+                }
+            else if (proc_id == fromProc)
+                {
+                marginalLnLSS[run]    = 0.0;
+                stepAcumulatorSS[run] = 0.0;
+                stepScalerSS[run]     = 0.0;
+                }
+            }
+        }
+
+    /* post the move info transfers and adopt the new heats */
+    nMoveInfo = 7 * numUsedMoves;
+    firstSlot = proc_id * numLocalChains;
+    for (j=0; j<numLocalChains; j++)
+        {
+        oldHeat = chainId[j];
+        newHeat = heat[firstSlot+j];
+        if (oldHeat == newHeat)
+            continue;
+
+        toProc = newSlot[oldHeat] / numLocalChains;
+        if (toProc != proc_id)
+            {
+            buf = swapMoveInfo + j*nMoveInfo;
+            for (i=0; i<numUsedMoves; i++)
+                {
+                mv = usedMoves[i];
+                buf[0] = mv->nAccepted[oldHeat];
+                buf[1] = mv->nTried[oldHeat];
+                buf[2] = mv->nBatches[oldHeat];
+                buf[3] = mv->nTotAccepted[oldHeat];
+                buf[4] = mv->nTotTried[oldHeat];
+                buf[5] = mv->lastAcceptanceRate[oldHeat];
+                if (mv->moveType->numTuningParams > 0)
+                    buf[6] = mv->tuningParam[oldHeat][0];
+                else
+                    buf[6] = 0.0;
+                mv->nAccepted[oldHeat]          = 0;
+                mv->nTried[oldHeat]             = 0;
+                mv->nBatches[oldHeat]           = 0;
+                mv->nTotAccepted[oldHeat]       = 0;
+                mv->nTotTried[oldHeat]          = 0;
+                mv->lastAcceptanceRate[oldHeat] = 0.0;
+                if (mv->moveType->numTuningParams > 0)
+                    mv->tuningParam[oldHeat][0] = 0.0;
+                buf += 7;
+                }
+            ierror = MPI_Isend (swapMoveInfo + j*nMoveInfo, nMoveInfo, MPI_DOUBLE, toProc, oldHeat, MPI_COMM_WORLD, &swapRequest[j]);
+            if (ierror != MPI_SUCCESS)
+                return (ERROR);
+            }
+
+        fromProc = oldSlot[newHeat] / numLocalChains;
+        if (fromProc != proc_id)
+            {
+            ierror = MPI_Irecv (swapMoveInfo + (numLocalChains+j)*nMoveInfo, nMoveInfo, MPI_DOUBLE, fromProc, newHeat, MPI_COMM_WORLD, &swapRequest[numLocalChains+j]);
+            if (ierror != MPI_SUCCESS)
+                return (ERROR);
+            swapRecvHeat[j] = newHeat;
+            }
+        }
+    for (j=0; j<numLocalChains; j++)
+        chainId[j] = heat[firstSlot+j];
+
+    return (NO_ERROR);
+}
+#   endif
+
+
 /* Autotune Dirichlet move */
 void AutotuneDirichlet (MrBFlt acceptanceRate, MrBFlt targetRate, int batch, MrBFlt *alphaPi, MrBFlt minTuning, MrBFlt maxTuning)
 {
@@ -1313,72 +1934,83 @@ void AutotuneSlider (MrBFlt acceptanceRate, MrBFlt targetRate, int batch, MrBFlt
 }
 
 
-void BuildExhaustiveSearchTree (Tree *t, int chain, int nTaxInTree, TreeInfo *tInfo)
+/* BuildExhaustiveSearchBranch: Add leaf nTaxInTree of the exhaustive search at one of the 2*nTaxInTree-1 branches
+   of the tree and enumerate the trees with the remaining leaves; the tree is restored unless the search stops */
+void BuildExhaustiveSearchBranch (Tree *t, int chain, int nTaxInTree, int branch, TreeInfo *tInfo)
 {
-    int         i;
     TreeNode    *p, *q, *r;
-        
-    if (nTaxInTree == t->nIntNodes + 1) {
-        
-        /* Get downpass */
-        GetDownPass (t);
 
-        /* Calculate cost of this tree and add to counter */
-        tInfo->curScore = GetParsimonyLength (t, chain);
-        if (tInfo->curScore < tInfo->minScore)
-            {
-            tInfo->totalScore *= pow ((tInfo->warp/3.0) / (1.0 - tInfo->warp), tInfo->minScore - tInfo->curScore);
-            tInfo->totalScore += 1.0;
-            tInfo->minScore = tInfo->curScore;
-            }
-        else
-            tInfo->totalScore += pow (tInfo->warp/3.0, tInfo->curScore - tInfo->minScore) * pow (1.0-tInfo->warp, tInfo->minScore - tInfo->curScore);
-    }
+    /* find node to connect */
+    q=tInfo->leaf[nTaxInTree];
+
+    /* add using this ancestral node */
+    p=tInfo->vertex[nTaxInTree-1];
+    q->anc=p;
+    p->right=q;
+
+    /* find node to connect to */
+    if (branch>=nTaxInTree)
+        r=tInfo->vertex[branch-nTaxInTree];
+    else
+        r=tInfo->leaf[branch];
 
+    /* add to this node */
+    p->left=r;
+    if (r->anc==NULL)
+        p->anc=NULL;
     else {
+        p->anc=r->anc;
+        if (r->anc->left==r)
+            r->anc->left=p;
+        else
+            r->anc->right=p;
+    }
+    r->anc=p;
 
-        /* find node to connect */
-        q=tInfo->leaf[nTaxInTree];
+    /* next level */
+    BuildExhaustiveSearchTree (t, chain, nTaxInTree+1, tInfo);
 
-        /* add using this ancestral node */
-        p=tInfo->vertex[nTaxInTree-1];
-        q->anc=p;
-        p->right=q;
+    if (tInfo->stopScore > 0.0 && tInfo->totalScore >= tInfo->stopScore)
+        return;
 
-        for (i=0;i<2*nTaxInTree-1;i++) {
-            /* find node to connect to */
-            if (i>=nTaxInTree)
-                r=tInfo->vertex[i-nTaxInTree];
-            else
-                r=tInfo->leaf[i];
-
-            /* add to this node */
-            p->left=r;
-            if (r->anc==NULL)
-                p->anc=NULL;
-            else {
-                p->anc=r->anc;
-                if (r->anc->left==r)
-                    r->anc->left=p;
-                else
-                    r->anc->right=p;
+    /* restore tree before trying next possibility */
+    r->anc=p->anc;
+    if (r->anc!=NULL) {
+        if (r->anc->left==p)
+            r->anc->left=r;
+        else
+            r->anc->right=r;
+    }
+}
+
+
+void BuildExhaustiveSearchTree (Tree *t, int chain, int nTaxInTree, TreeInfo *tInfo)
+{
+    int         i;
+        
+    if (nTaxInTree == t->nIntNodes + 1) {
+        
+        /* Get downpass */
+        GetDownPass (t);
+
+        /* Calculate cost of this tree and add to counter */
+        tInfo->curScore = GetParsimonyLength (t, chain);
+        if (tInfo->curScore < tInfo->minScore)
+            {
+            tInfo->totalScore *= pow ((tInfo->warp/3.0) / (1.0 - tInfo->warp), tInfo->minScore - tInfo->curScore);
+            tInfo->totalScore += 1.0;
+            tInfo->minScore = tInfo->curScore;
             }
-            r->anc=p;
+        else
+            tInfo->totalScore += pow (tInfo->warp/3.0, tInfo->curScore - tInfo->minScore) * pow (1.0-tInfo->warp, tInfo->minScore - tInfo->curScore);
+    }
 
-            /* next level */
-            BuildExhaustiveSearchTree (t, chain, nTaxInTree+1, tInfo);
+    else {
 
+        for (i=0;i<2*nTaxInTree-1;i++) {
+            BuildExhaustiveSearchBranch (t, chain, nTaxInTree, i, tInfo);
             if (tInfo->stopScore > 0.0 && tInfo->totalScore >= tInfo->stopScore)
                 return;
-
-            /* restore tree before trying next possibility */
-            r->anc=p->anc;
-            if (r->anc!=NULL) {
-                if (r->anc->left==p)
-                    r->anc->left=r;
-                else
-                    r->anc->right=r;
-            }
         }
     }
 }
@@ -1386,57 +2018,302 @@ void BuildExhaustiveSearchTree (Tree *t, int chain, int nTaxInTree, TreeInfo *tI
 
 /*------------------------------------------------------------------
 |
-|   BuildParsTrees: Fill in trees using random add seq with parsimony
+|   BuildMLTrees: Fill in trees using random add seq with parsimony,
+|      then climb to a local maximum of the likelihood with NNI
+|      rearrangements and branch length optimization
 |
 ------------------------------------------------------------------*/
-int BuildParsTrees (RandLong *seed, int fromChain, int toChain)
+int BuildMLTrees (RandLong *seed, int fromChain, int toChain)
 {
-    int         k, chn;
+    int         i, k, chn, nNNIs, canSearch;
+    MrBFlt      lnL;
     Param       *p, *q;
     Tree        *tree;
 
-    /* Build starting trees for state 0 */
+    /* the likelihood functions need the chain ids, which are otherwise set up in RunChain */
+    assert (chainId == NULL);
+    chainId = (int *) SafeMalloc ((size_t)numLocalChains * sizeof(int));
+    if (!chainId)
+        return (ERROR);
+    SetChainIds ();
+
+    numBrlenDerivChecks = 0;
     for (chn=fromChain; chn<toChain; chn++)
         {
         for (k=0; k<numParams; k++)
             {
             p = &params[k];
-            if (p->paramType == P_TOPOLOGY)
+            if (p->paramType != P_TOPOLOGY)
+                continue;
+            assert (p->nSubParams == 1);
+            q = p->subParams[0];
+            tree = GetTree (q, chn, 0);
+            /* fixed topology */
+            if (p->paramId == TOPOLOGY_RCL_FIXED ||
+                p->paramId == TOPOLOGY_RCCL_FIXED ||
+                p->paramId == TOPOLOGY_CL_FIXED ||
+                p->paramId == TOPOLOGY_CCL_FIXED ||
+                p->paramId == TOPOLOGY_NCL_FIXED ||
+                p->paramId == TOPOLOGY_PARSIMONY_FIXED)
+                {
+                if (chn == fromChain)
+                    MrBayesPrint ("%s   Tree %s is fixed so a likelihood-based starting tree is not built\n", spacer, p->name);
+                continue;
+                }
+            /* constrained topology */
+            else if (tree->nConstraints > 0)
                 {
-                assert (p->nSubParams == 1);
-                q = p->subParams[0];
-                tree = GetTree (q, chn, 0);
-                /* fixed topology */
-                if (p->paramId == TOPOLOGY_RCL_FIXED ||
-                    p->paramId == TOPOLOGY_RCCL_FIXED ||
-                    p->paramId == TOPOLOGY_CL_FIXED ||
-                    p->paramId == TOPOLOGY_CCL_FIXED ||
-                    p->paramId == TOPOLOGY_NCL_FIXED ||
-                    p->paramId == TOPOLOGY_PARSIMONY_FIXED)
-                    {
-                    MrBayesPrint ("%s   Tree %s is fixed so a parsimony-based starting tree is not built\n", spacer, p->name);
-                    return (NO_ERROR);
-                    }
-                /* constrained topology */
-                else if (tree->nConstraints > 0)
-                    {
-                    MrBayesPrint ("%s   Tree %s is constrained and parsimony-based starting trees are not implemented for constrained trees (yet)\n", spacer, p->name);
-                    return (NO_ERROR);
-                    }
-                /* random topology */
-                else
+                if (chn == fromChain)
+                    MrBayesPrint ("%s   Tree %s is constrained and likelihood-based starting trees are not implemented for constrained trees (yet)\n", spacer, p->name);
+                continue;
+                }
+
+            /* parsimony start */
+            if (BuildStepwiseTree (tree, chn, &globalSeed) == ERROR)
+                goto errorExit;
+            if (InitializeTreeCalibrations (tree) == ERROR)
+                goto errorExit;
+            FillTopologySubParams(p, chn, 0, seed);
+
+            /* the search changes branch lengths of unrooted trees, and it needs the likelihood
+               of each change with all site rates summed over */
+            canSearch = YES;
+            if (tree->isRooted == YES || tree->isClock == YES || q->paramId == BRLENS_FIXED || chainParams.runWithData == NO)
+                canSearch = NO;
+            for (i=0; i<tree->nRelParts; i++)
+                {
+                if (modelSettings[tree->relParts[i]].gibbsGamma == YES)
+                    canSearch = NO;
+                }
+#   if defined (BEST_MPI_ENABLED)
+            canSearch = NO;
+#   endif
+            if (canSearch == NO)
+                {
+                if (chn == fromChain)
+                    MrBayesPrint ("%s   The likelihood search is not available for tree %s; the parsimony tree is used\n", spacer, p->name);
+                continue;
+                }
+
+            if (OptimizeMLTree (tree, chn, &lnL, &nNNIs) == ERROR)
+                goto errorExit;
+            MrBayesPrint ("%s      Run %d, chain %d -- %.6lf (%d NNIs)\n", spacer, chainId[chn] / chainParams.numChains + 1,
+                chainId[chn] % chainParams.numChains + 1, lnL, nNNIs);
+            }
+        }
+    if (chainParams.checkBrlenDerivs == YES)
+        MrBayesPrint ("%s   Branch length derivatives agreed with the tree lnL and finite differences for %d branches\n", spacer, numBrlenDerivChecks);
+
+    free (chainId);
+    chainId = NULL;
+    return (NO_ERROR);
+
+    errorExit:
+        free (chainId);
+        chainId = NULL;
+        return (ERROR);
+}
+
+
+/*------------------------------------------------------------------
+|
+|   BuildParsTrees: Fill in trees using random add seq with parsimony.
+|      The chains are shared by numParsThreads threads; each chain
+|      has its own seed, so the trees do not depend on the number of
+|      threads. With the Checkparstrees option, the trees are built
+|      again by a single thread and compared with the threaded trees
+|
+------------------------------------------------------------------*/
+int BuildParsTrees (RandLong *seed, int fromChain, int toChain)
+{
+    int         i, k, chn, numThreads, numChecked, *isBuilt=NULL;
+    RandLong    *chainSeed=NULL, *checkSeed=NULL;
+    Param       *p, *q;
+    Tree        *tree, **checkTree=NULL;
+    PARSWORK    *work=NULL;
+
+    /* find the trees to build */
+    isBuilt = (int *) SafeCalloc (numParams, sizeof(int));
+    chainSeed = (RandLong *) SafeCalloc (toChain - fromChain, sizeof(RandLong));
+    numThreads = (numParsThreads < toChain - fromChain ? numParsThreads : toChain - fromChain);
+    if (numThreads < 1)
+        numThreads = 1;
+    work = (PARSWORK *) SafeCalloc (numThreads, sizeof(PARSWORK));
+    if (!isBuilt || !chainSeed || !work)
+        goto errorExit;
+    for (k=0; k<numParams; k++)
+        {
+        p = &params[k];
+        if (p->paramType != P_TOPOLOGY)
+            continue;
+        assert (p->nSubParams == 1);
+        q = p->subParams[0];
+        tree = GetTree (q, fromChain, 0);
+        /* fixed topology */
+        if (p->paramId == TOPOLOGY_RCL_FIXED ||
+            p->paramId == TOPOLOGY_RCCL_FIXED ||
+            p->paramId == TOPOLOGY_CL_FIXED ||
+            p->paramId == TOPOLOGY_CCL_FIXED ||
+            p->paramId == TOPOLOGY_NCL_FIXED ||
+            p->paramId == TOPOLOGY_PARSIMONY_FIXED)
+            MrBayesPrint ("%s   Tree %s is fixed so a parsimony-based starting tree is not built\n", spacer, p->name);
+        /* constrained topology */
+        else if (tree->nConstraints > 0)
+            MrBayesPrint ("%s   Tree %s is constrained and parsimony-based starting trees are not implemented for constrained trees (yet)\n", spacer, p->name);
+        /* random topology */
+        else
+            isBuilt[k] = YES;
+        }
+
+    /* two draws per seed, so that the seeds are not successive states of the generator */
+    for (chn=fromChain; chn<toChain; chn++)
+        {
+        chainSeed[chn-fromChain] = (RandLong) (RandomNumber (&globalSeed) * 46340.0) * 46340;
+        chainSeed[chn-fromChain] += (RandLong) (RandomNumber (&globalSeed) * 46340.0) + 1;
+        }
+
+    /* keep copies of the trees and seeds for the single-thread check */
+    if (chainParams.checkParsTrees == YES)
+        {
+        checkSeed = (RandLong *) SafeCalloc (toChain - fromChain, sizeof(RandLong));
+        checkTree = (Tree **) SafeCalloc ((toChain - fromChain) * numParams, sizeof(Tree *));
+        if (!checkSeed || !checkTree)
+            goto errorExit;
+        for (chn=fromChain; chn<toChain; chn++)
+            {
+            checkSeed[chn-fromChain] = chainSeed[chn-fromChain];
+            for (k=0; k<numParams; k++)
+                {
+                if (isBuilt[k] == NO)
+                    continue;
+                i = (chn - fromChain) * numParams + k;
+                checkTree[i] = AllocateTree (numLocalTaxa);
+                if (!checkTree[i])
+                    goto errorExit;
+                CopyToTreeFromTree (checkTree[i], GetTree (params[k].subParams[0], chn, 0));
+                }
+            }
+        }
+
+    /* Build starting trees for state 0 */
+    for (i=0; i<numThreads; i++)
+        {
+        work[i].thread = i;
+        work[i].numThreads = numThreads;
+        work[i].fromChain = fromChain;
+        work[i].toChain = toChain;
+        work[i].chainSeed = chainSeed;
+        work[i].isBuilt = isBuilt;
+        }
+    if (RunParsThreads (&BuildParsTreesThread, work, numThreads) == ERROR)
+        goto errorExit;
+
+    /* build the trees again in the parsimony sets of the first thread, one chain after the other */
+    if (chainParams.checkParsTrees == YES)
+        {
+        numChecked = 0;
+        for (chn=fromChain; chn<toChain; chn++)
+            {
+            for (k=0; k<numParams; k++)
+                {
+                if (isBuilt[k] == NO)
+                    continue;
+                i = (chn - fromChain) * numParams + k;
+                if (BuildStepwiseTree (checkTree[i], chn, &checkSeed[chn-fromChain]) == ERROR)
+                    goto errorExit;
+                if (AreTopologiesSame (checkTree[i], GetTree (params[k].subParams[0], chn, 0)) == NO)
                     {
-                    if (BuildStepwiseTree (tree, chn, &globalSeed) == ERROR)
-                        return (ERROR);
+                    MrBayesPrint ("%s   Parsimony starting tree %s of chain %d differs from the tree built by a single thread\n",
+                        spacer, params[k].name, chn+1);
+                    goto errorExit;
                     }
-                if (InitializeTreeCalibrations (tree) == ERROR)
-                    return (ERROR);
-                FillTopologySubParams(p, chn, 0, seed);
+                numChecked++;
                 }
             }
+        MrBayesPrint ("%s   Parsimony starting trees of %d threads agreed with a single thread for %d trees\n",
+            spacer, numThreads, numChecked);
+        }
+
+    for (chn=fromChain; chn<toChain; chn++)
+        {
+        for (k=0; k<numParams; k++)
+            {
+            if (isBuilt[k] == NO)
+                continue;
+            p = &params[k];
+            tree = GetTree (p->subParams[0], chn, 0);
+            if (InitializeTreeCalibrations (tree) == ERROR)
+                goto errorExit;
+            FillTopologySubParams(p, chn, 0, seed);
+            }
         }
 
+    if (checkTree != NULL)
+        {
+        for (i=0; i<(toChain - fromChain) * numParams; i++)
+            {
+            if (checkTree[i] != NULL)
+                FreeTree (checkTree[i]);
+            }
+        free (checkTree);
+        }
+    free (checkSeed);
+    free (isBuilt);
+    free (chainSeed);
+    free (work);
     return (NO_ERROR);
+
+    errorExit:
+        if (checkTree != NULL)
+            {
+            for (i=0; i<(toChain - fromChain) * numParams; i++)
+                {
+                if (checkTree[i] != NULL)
+                    FreeTree (checkTree[i]);
+                }
+            free (checkTree);
+            }
+        free (checkSeed);
+        free (isBuilt);
+        free (chainSeed);
+        free (work);
+        return (ERROR);
+}
+
+
+/* BuildParsTreesThread: Build the parsimony starting trees of every numThreads-th chain, using the
+   parsimony sets of the thread for the interior nodes */
+void *BuildParsTreesThread (void *arg)
+{
+    int         i, k, chn, shift;
+    Tree        *tree;
+    PARSWORK    *work;
+
+    work = (PARSWORK *) arg;
+    shift = work->thread * numLocalTaxa;
+    for (chn=work->fromChain+work->thread; chn<work->toChain; chn+=work->numThreads)
+        {
+        for (k=0; k<numParams; k++)
+            {
+            if (work->isBuilt[k] == NO)
+                continue;
+            tree = GetTree (params[k].subParams[0], chn, 0);
+            for (i=0; i<tree->nNodes; i++)
+                {
+                if (tree->nodes[i].index >= numLocalTaxa)
+                    tree->nodes[i].index += shift;
+                }
+            if (BuildStepwiseTree (tree, chn, &work->chainSeed[chn-work->fromChain]) == ERROR)
+                work->rc = ERROR;
+            for (i=0; i<tree->nNodes; i++)
+                {
+                if (tree->nodes[i].index >= numLocalTaxa)
+                    tree->nodes[i].index -= shift;
+                }
+            }
+        }
+
+    return (NULL);
 }
 
 
@@ -1530,74 +2407,62 @@ int BuildStepwiseTree (Tree *t, int chain, RandLong *seed) {
 -------------------------------------------------------------------*/
 int CalcLikeAdgamma (int d, Param *param, int chain, MrBFlt *lnL)
 {
-    int             c, i, j, nRates, posit, lastCharId;
-    MrBFlt          logScaler, max, prob, *F,
-                    *oldF, *tempF, fSpace[2][MAX_RATE_CATS];
-    MrBFlt          *rP;
+    int             i, j, n, nRates, posit, jump, lastJump, *site;
+    MrBFlt          logScaler, max, prob, *F, *oldF, *tempF, fSpace[2][MAX_RATE_CATS],
+                    *rP, *row, **tiP;
     CLFlt           freq, *lnScaler;
     ModelInfo       *m;
-    ModelParams     *mp;
-    BitsLong        *inHMM;
     
     /* find nRates for first division in HMM */
     m = &modelSettings[d];
-    mp = &modelParams[d];
     nRates = m->numRateCats;
 
     /* calculate rate category frequencies */
     freq = (CLFlt) ((CLFlt) 1.0 / nRates);
 
-    /* find Markov trans probs */
+    /* find Markov trans probs; the powers up to the largest small jump  */
+    /* only need to be recalculated if they changed since the last call */
     F = GetParamSubVals (param,chain, state[chain]);
-    for (i=posit=0; i<nRates; i++)
-        for (j=0; j<nRates; j++)
-            markovTi[0][i][j] = F[posit++];
-    
-    /* precalculate Markov trans probs up to largest small jump */
-    /* but only if needed                                       */
-    for (i=1; i<MAX_SMALL_JUMP; i++)
+    if (nRates != markovTiRates || memcmp (F, markovTiVals, nRates * nRates * sizeof(MrBFlt)) != 0)
         {
-        if (hasMarkovTi[i] == YES)
+        for (i=posit=0; i<nRates; i++)
+            for (j=0; j<nRates; j++)
+                markovTi[0][i][j] = F[posit++];
+    
+        /* precalculate Markov trans probs up to largest small jump */
+        /* but only if needed                                       */
+        for (i=1; i<MAX_SMALL_JUMP; i++)
             {
-            if (hasMarkovTi[i-1] == YES || i == 1)
-                MultiplyMatrices(nRates, markovTi[i-1], markovTi[0], markovTi[i]);
-            else
-                MultiplyMatrixNTimes(nRates, markovTi[0], i+1, markovTi[i]);
+            if (hasMarkovTi[i] == YES)
+                {
+                if (hasMarkovTi[i-1] == YES || i == 1)
+                    MultiplyMatrices(nRates, markovTi[i-1], markovTi[0], markovTi[i]);
+                else
+                    MultiplyMatrixNTimes(nRates, markovTi[0], i+1, markovTi[i]);
+                }
             }
+
+        memcpy (markovTiVals, F, nRates * nRates * sizeof(MrBFlt));
+        markovTiRates = nRates;
         }
         
-    /* find site scaler for this chain and state */
-    lnScaler = m->scalers[m->siteScalerIndex[chain]];
-    
     /* find rate probs for this chain and state */
     rP = rateProbs[chain] + state[chain] * rateProbRowSize;
 
-    /* set bit vector indicating divisions in this HMM */
-    inHMM = (BitsLong *) SafeCalloc (((param->nRelParts/nBitsInALong) + 1), sizeof(BitsLong));
-    for (i=0; i<param->nRelParts; i++)
-        {
-        if (modelSettings[param->relParts[i]].shape ==
-            modelSettings[d].shape)
-            {
-            SetBit(param->relParts[i], inHMM);
-            }
-        }
-    
-    /* Perform the so-called forward algorithm of HMMs  */  
+    /* Perform the so-called forward algorithm of HMMs along the sites */
+    /* of the HMM, which were collected in InitAdGamma                 */
     /* set up the space for f(c,i) */
     F = fSpace[0];
     oldF = fSpace[1];
+    site = hmmSites + 3 * m->hmmSiteStart;
 
-    for (c=0; c<numChar; c++)
-        {
-        if (IsBitSet(partitionId[c][partitionNum] - 1, inHMM) == YES)
-            break;
-        }
+    /* find site scaler for the division of the first site */
+    m = &modelSettings[site[0]];
+    lnScaler = m->scalers[m->siteScalerIndex[chain]];
 
     /* fill in fi(0) */
     max = 0.0;
-    m = &modelSettings[partitionId[c][partitionNum] - 1];
-    posit = m->rateProbStart + (compCharPos[c] - m->compCharStart) * m->numRateCats;
+    posit = m->rateProbStart + site[1] * m->numRateCats;
 
     for (i=0; i<nRates; i++)
         {
@@ -1610,58 +2475,49 @@ int CalcLikeAdgamma (int d, Param *param, int chain, MrBFlt *lnL)
         F[i] /= max;
 
     /* set logscaler to the value from the first character */
-    logScaler = lnScaler[compCharPos[c]] +  log(max);
+    logScaler = lnScaler[site[1]] +  log(max);
 
     /* now step along the sequence to the end */
-    lastCharId = charInfo[c].charId;
-    for (c++; c<numChar; c++)
+    lastJump = 0;
+    for (n=1; n<modelSettings[d].numHmmSites; n++)
         {
-        /* skip if excluded */
-        if (charInfo[c].isExcluded == YES)
-            continue;
+        site += 3;
 
-        /* skip if part of same codon in translated protein model */
-        if ((mp->dataType == DNA || mp->dataType == RNA) && m->dataType == PROTEIN && charInfo[c].charId == lastCharId)
-            continue;
-        else
-            lastCharId = charInfo[c].charId;
-        
-        /* skip if not in HMM */
-        if (IsBitSet(partitionId[c][partitionNum] - 1, inHMM) == NO)
-            continue;
-        
         /* switch F and oldF, since the previous F is now old */
         tempF = F;
         F = oldF;
         oldF = tempF;
 
+        /* find the division of the site if it changed */
+        if (site[0] != site[-3])
+            {
+            m = &modelSettings[site[0]];
+            lnScaler = m->scalers[m->siteScalerIndex[chain]];
+            }
+
         /* find the position of the rate probs */
-        m = &modelSettings[partitionId[c][partitionNum] - 1];
-        posit = m->rateProbStart + (compCharPos[c] - m->compCharStart) * m->numRateCats;
+        posit = m->rateProbStart + site[1] * m->numRateCats;
                 
         /* calculate the HMM forward probs fi(x) at site x in HMM */
-        if (siteJump[c] <= MAX_SMALL_JUMP)
+        jump = site[2];
+        if (jump < BIG_JUMP)
             {
-            max = 0.0;
-            for (i=0; i<nRates; i++)
+            if (jump <= MAX_SMALL_JUMP)
+                tiP = markovTi[jump-1];
+            else    /* intermediate jump, calculate trans probs unless done for the previous site */
                 {
-                prob = 0.0;
-                for (j=0; j<nRates; j++)
-                    prob += markovTi[siteJump[c]-1][i][j] * oldF[j];
-                F[i] = rP[posit++] * prob;
-                if (F[i] > max)
-                    max = F[i];
+                if (jump != lastJump)
+                    MultiplyMatrixNTimes(nRates, markovTi[0], jump, markovTiN);
+                lastJump = jump;
+                tiP = markovTiN;
                 }
-            }
-        else if (siteJump[c] < BIG_JUMP)    /* intermediate jump, calculate trans probs */
-            {
-            MultiplyMatrixNTimes(nRates, markovTi[0], siteJump[c], markovTiN);
             max = 0.0;
             for (i=0; i<nRates; i++)
                 {
+                row = tiP[i];
                 prob = 0.0;
                 for (j=0; j<nRates; j++)
-                    prob += markovTiN[i][j] * oldF[j];
+                    prob += row[j] * oldF[j];
                 F[i] = rP[posit++] * prob;
                 if (F[i] > max)
                     max = F[i];
@@ -1669,24 +2525,27 @@ int CalcLikeAdgamma (int d, Param *param, int chain, MrBFlt *lnL)
             }
         else    /* big jump, use stationary freqs */
             {
+            prob = 0.0;
+            for (j=0; j<nRates; j++)
+                prob += (oldF[j] / freq);
             max = 0.0;
             for (i=0; i<nRates; i++)
                 {
-                prob = 0.0;
-                for (j=0; j<nRates; j++)
-                    prob += (oldF[j] / freq);
                 F[i] = rP[posit++] * prob;
                 if (F[i] > max)
                     max = F[i];
                 }
             }
 
-        /* rescale and adjust total scaler with HMM scaler and site scaler */
-        for (i=0; i<nRates; i++)
-            F[i] /= max;
-
-        logScaler += lnScaler[compCharPos[c]] +  log(max);
-
+        /* rescale and adjust total scaler with HMM scaler, but only when the */
+        /* forward probs get small, and always adjust it with the site scaler */
+        if (max < MIN_HMM_SCALER)
+            {
+            for (i=0; i<nRates; i++)
+                F[i] /= max;
+            logScaler += log(max);
+            }
+        logScaler += lnScaler[site[1]];
         }
     
     /* now pull the rate probs together at the end, F contains the vals needed */
@@ -1696,8 +2555,6 @@ int CalcLikeAdgamma (int d, Param *param, int chain, MrBFlt *lnL)
 
     (*lnL) = logScaler +  log(prob);
 
-    free (inHMM);
-
     return (NO_ERROR);
 }
 
@@ -1869,6 +2726,103 @@ void CalcTopoConvDiagn2 (int *nTrees)
 }
 
 
+/*------------------------------------------------------------------------
+|
+|   CheckBrlenDerivs: Check the branch length derivatives of the branch
+|      below p for the Checkbrlenderivs option. The log likelihood of the
+|      derivative functions at p->length has to agree with the division
+|      lnLs of the tree computed by the likelihood functions within a
+|      fixed tolerance, and the analytic first and second derivatives are
+|      compared with central differences of the log likelihood and of the
+|      first derivative. The step is a small fraction of the branch length
+|      v, or, if larger, the step needed to keep the rounding error of the
+|      difference quotient of lnL at a hundredth of the tolerance; if that
+|      step is more than half of v, one-sided second order differences are
+|      used instead of central ones. A derivative fails if it is off by
+|      more than a relative tolerance; d1 is measured against |d1| + |d2|v
+|      and d2 against |d2| + |d1|/v, so that values close to zero do not
+|      give false alarms. The same conditions as for GetBrlenDerivs apply;
+|      p->length is left unchanged.
+|
+------------------------------------------------------------------------*/
+int CheckBrlenDerivs (Tree *t, TreeNode *p, int chain)
+{
+    int         i, isCentral;
+    MrBFlt      v, h, roundingStep, tolerance, lnLTolerance, treeLnL, lnL, d1, d2, x[2], lnLAt[2], d1At[2], d2At, fd1, fd2;
+
+    tolerance = 1E-2;
+    lnLTolerance = 1E-3;
+
+    v = p->length;
+    if (GetBrlenDerivs (t, p, chain, &lnL, &d1, &d2) == ERROR)
+        return (ERROR);
+
+    /* the difference of two lnLs is only known to about 2*DBL_EPSILON*|lnL| */
+    h = 1E-3 * v;
+    roundingStep = 2.0 * DBL_EPSILON * fabs (lnL) / (1E-2 * tolerance * (fabs (d1) + fabs (d2) * v));
+    if (roundingStep > h)
+        h = roundingStep;
+    if (h <= 0.5 * v)
+        {
+        isCentral = YES;
+        x[0] = v - h;
+        x[1] = v + h;
+        }
+    else
+        {
+        isCentral = NO;
+        x[0] = v + h;
+        x[1] = v + 2.0 * h;
+        }
+
+    for (i=0; i<2; i++)
+        {
+        p->length = x[i];
+        if (GetBrlenDerivs (t, p, chain, &lnLAt[i], &d1At[i], &d2At) == ERROR)
+            {
+            p->length = v;
+            return (ERROR);
+            }
+        }
+    p->length = v;
+
+    /* branch lengths that are not possible are left to NewtonRaphsonBrlen */
+    if (lnL == MRBFLT_NEG_MAX || lnLAt[0] == MRBFLT_NEG_MAX || lnLAt[1] == MRBFLT_NEG_MAX)
+        return (NO_ERROR);
+
+    treeLnL = 0.0;
+    for (i=0; i<t->nRelParts; i++)
+        treeLnL += modelSettings[t->relParts[i]].lnLike[2*chain + state[chain]];
+    if (fabs (lnL - treeLnL) > lnLTolerance)
+        {
+        MrBayesPrint ("%s   Log likelihood %f of the branch length derivatives for node %d\n", spacer, lnL, p->index);
+        MrBayesPrint ("%s   differs from the log likelihood %f of the tree\n", spacer, treeLnL);
+        return (ERROR);
+        }
+
+    if (isCentral == YES)
+        {
+        fd1 = (lnLAt[1] - lnLAt[0]) / (2.0 * h);
+        fd2 = (d1At[1] - d1At[0]) / (2.0 * h);
+        }
+    else
+        {
+        fd1 = (4.0 * lnLAt[0] - lnLAt[1] - 3.0 * lnL) / (2.0 * h);
+        fd2 = (4.0 * d1At[0] - d1At[1] - 3.0 * d1) / (2.0 * h);
+        }
+    if (fabs (d1 - fd1) > tolerance * (fabs (fd1) + fabs (d2) * v)
+        || fabs (d2 - fd2) > tolerance * (fabs (fd2) + fabs (d1) / v))
+        {
+        MrBayesPrint ("%s   Branch length derivatives do not match central differences for node %d\n", spacer, p->index);
+        MrBayesPrint ("%s   (length %e, lnL %f): d1 = %e (%e), d2 = %e (%e)\n", spacer, v, lnL, d1, fd1, d2, fd2);
+        return (ERROR);
+        }
+    numBrlenDerivChecks++;
+
+    return (NO_ERROR);
+}
+
+
 int CheckTemperature (void)
 {
     if (chainParams.userDefinedTemps == YES)
@@ -1886,9 +2840,40 @@ int CheckTemperature (void)
 
 void CloseMBPrintFiles (void)
 {
-    int     i, n;
-
+    int         i, n;
 #   if defined (MPI_ENABLED)
+    int         k;
+    char        endStr[] = "end;\n";
+    MPI_Status  status;
+
+    /* the sample files are shared by all procs (see ReopenMBPrintFiles); proc 0 finishes the tree files */
+    if (sampleFile != NULL)
+        {
+        for (n=0; n<chainParams.numRuns && proc_id == 0; n++)
+            {
+            for (i=0; i<numTrees; i++)
+                {
+                k = n*(numTrees+2) + 2 + i;
+                if (sampleFile[k] != MPI_FILE_NULL)
+                    MPI_File_write_at (sampleFile[k], sampleFileEnd[k], endStr, (int) strlen (endStr), MPI_CHAR, &status);
+                }
+            }
+        for (k=0; k<numSampleFiles; k++)
+            {
+            if (sampleFile[k] != MPI_FILE_NULL)
+                MPI_File_close (&sampleFile[k]);
+            }
+        free (sampleFile);
+        free (sampleFileEnd);
+        free (sampleFileBytes);
+        sampleFile = NULL;
+        }
+    if (proc_id != 0)
+        return;
+#   endif
+
+#   if defined (BEST_MPI_ENABLED)
+    /* only proc 0 opened any files */
     if (proc_id != 0)
         return;
 #   endif
@@ -1896,6 +2881,7 @@ void CloseMBPrintFiles (void)
     for (n=0; n<chainParams.numRuns; n++)
         {
         SafeFclose (&fpParm[n]);
+        SafeFclose (&fpSiteLnL[n]);
 #if defined (PRINT_DUMP)
         SafeFclose (&fpDump[n]);
 #endif
@@ -1963,6 +2949,65 @@ PFNODE *CompactTree (PFNODE *p)
 }
 
 
+/* CompareSplitKeys: Compare function (SPLITKEY struct; sort by hash, then by id) for qsort */
+int CompareSplitKeys (const void *x, const void *y)
+{
+    const SPLITKEY  *a = (const SPLITKEY *) x, *b = (const SPLITKEY *) y;
+
+    if (a->hash < b->hash)
+        return -1;
+    else if (a->hash > b->hash)
+        return 1;
+    else
+        return a->id - b->id;
+}
+
+
+/* CopyExhaustiveSearchTree: Give a thread its own copy of the tree of an exhaustive parsimony search, with
+   the interior nodes moved to the parsimony sets of the thread */
+int CopyExhaustiveSearchTree (Tree *t, TreeInfo *tInfo, PARSWORK *work)
+{
+    int         i, nLeaves;
+    Tree        *s;
+    TreeNode    *p, *q;
+
+    s = &work->treeCopy;
+    *s = *t;
+    s->nodes = (TreeNode *) SafeMalloc (t->nNodes * sizeof(TreeNode));
+    s->allDownPass = (TreeNode **) SafeMalloc (t->nNodes * sizeof(TreeNode *));
+    s->intDownPass = (TreeNode **) SafeMalloc (t->nIntNodes * sizeof(TreeNode *));
+    work->tInfo.leaf = (TreeNode **) SafeMalloc (t->nNodes * sizeof(TreeNode *));
+    if (!s->nodes || !s->allDownPass || !s->intDownPass || !work->tInfo.leaf)
+        return (ERROR);
+    s->traversal = NULL;
+    s->nTraversal = -1;
+    work->t = s;
+
+    for (i=0; i<t->nNodes; i++)
+        {
+        p = &t->nodes[i];
+        q = &s->nodes[i];
+        *q = *p;
+        q->left  = (p->left  == NULL ? NULL : s->nodes + (p->left  - t->nodes));
+        q->right = (p->right == NULL ? NULL : s->nodes + (p->right - t->nodes));
+        q->anc   = (p->anc   == NULL ? NULL : s->nodes + (p->anc   - t->nodes));
+        }
+    s->root = s->nodes + (t->root - t->nodes);
+
+    nLeaves = t->nNodes - t->nIntNodes;
+    work->tInfo.vertex = work->tInfo.leaf + nLeaves;
+    for (i=0; i<nLeaves; i++)
+        work->tInfo.leaf[i] = s->nodes + (tInfo->leaf[i] - t->nodes);
+    for (i=0; i<t->nIntNodes; i++)
+        {
+        work->tInfo.vertex[i] = s->nodes + (tInfo->vertex[i] - t->nodes);
+        work->tInfo.vertex[i]->index += work->thread * numLocalTaxa;
+        }
+
+    return (NO_ERROR);
+}
+
+
 /*-----------------------------------------------------------------
 |
 |   CopyParams: copy parameters of touched divisions
@@ -2055,6 +3100,8 @@ void CopyParams (int chain)
         {
         m = &modelSettings[i];
         m->lnLike[toState] = m->lnLike[fromState];
+        if (m->siteLnLs != NULL)
+            m->siteLnLIndex[toState] = m->siteLnLIndex[fromState];
         if (m->parsModelId == YES)
             m->parsTreeLength[toState] = m->parsTreeLength[fromState];
         m->upDateCl = NO;
@@ -2218,34 +3265,188 @@ CLFlt DebugNodeScalers (TreeNode *p, int division, int chain)
 }
 
 
-/*----------------------------------------------------------------
-|
-|   DebugTreeScalers: Calculate DebugNodeScalers for each node and printit
-|
------------------------------------------------------------------*/
-void DebugTreeScalers(int chain, int d)
-{
-    int i;
-    TreeNode        *p;
-    ModelInfo       *m;
-    Tree            *tree;
-    
-    m = &modelSettings[d];
-    tree = GetTree(m->brlens, chain, state[chain]);
-    
-    if (m->parsModelId == NO)
+/*----------------------------------------------------------------
+|
+|   DebugTreeScalers: Calculate DebugNodeScalers for each node and printit
+|
+-----------------------------------------------------------------*/
+void DebugTreeScalers(int chain, int d)
+{
+    int i;
+    TreeNode        *p;
+    ModelInfo       *m;
+    Tree            *tree;
+    
+    m = &modelSettings[d];
+    tree = GetTree(m->brlens, chain, state[chain]);
+    
+    if (m->parsModelId == NO)
+        {
+        for (i=0; i<tree->nIntNodes; i++)
+            {
+            p = tree->intDownPass[i];
+            
+            if (m->unscaledNodes[chain][p->index] == 0)
+                {
+                printf ("Node:%d Sum scalers:%f\n",p->index,DebugNodeScalers(p, d, chain));
+                }
+            }
+        }
+}
+
+
+#if defined (BEST_MPI_ENABLED)
+/*----------------------------------------------------------------
+|
+|   DistributeDivisions: Decide which divisions (loci) are calculated
+|       on this processor in the BEST_MPI version. All processors run
+|       all chains in step; each one calculates the likelihoods and
+|       gene tree probabilities of its own divisions only, and these
+|       are summed across processors. Divisions sharing a gene tree or
+|       an adgamma HMM are kept together, and the resulting groups are
+|       handed out, most expensive first, to the least loaded processor.
+|
+-----------------------------------------------------------------*/
+int DistributeDivisions (void)
+{
+    int         d, e, g, root, numGroups, numProcDivs, *group, *groupProc;
+    MrBFlt      *groupCost, *procLoad, totalCost;
+    ModelInfo   *m;
+
+    /* Gibbs sampling draws random numbers for each site, and the site-based output needs
+       the conditional likelihoods of all divisions on proc 0 */
+    for (d=0; d<numCurrentDivisions; d++)
+        {
+        if (modelSettings[d].gibbsGamma == YES)
+            {
+            MrBayesPrint ("%s   Gibbs sampling of rate categories cannot be used when divisions are\n", spacer);
+            MrBayesPrint ("%s   distributed across processors\n", spacer);
+            return (ERROR);
+            }
+        }
+    if (inferAncStates == YES || inferSiteRates == YES || inferPosSel == YES || inferSiteOmegas == YES || chainParams.calcPbf == YES)
+        {
+        MrBayesPrint ("%s   Ancestral states, site parameters and site likelihoods cannot be sampled\n", spacer);
+        MrBayesPrint ("%s   when divisions are distributed across processors\n", spacer);
+        return (ERROR);
+        }
+
+    if (memAllocs[ALLOC_BESTMPI] == YES)
+        {
+        MrBayesPrint ("%s   Division buffers already allocated in DistributeDivisions\n", spacer);
+        return (ERROR);
+        }
+    isDivisionActive = (int *) SafeCalloc (numCurrentDivisions, sizeof(int));
+    divisionLnLike = (MrBFlt *) SafeCalloc (2*numCurrentDivisions+1, sizeof(MrBFlt));
+    group = (int *) SafeCalloc (2*numCurrentDivisions, sizeof(int));
+    groupCost = (MrBFlt *) SafeCalloc (numCurrentDivisions+num_procs, sizeof(MrBFlt));
+    if (!isDivisionActive || !divisionLnLike || !group || !groupCost)
+        {
+        MrBayesPrint ("%s   Problem allocating division buffers\n", spacer);
+        free (isDivisionActive);
+        free (divisionLnLike);
+        free (group);
+        free (groupCost);
+        return (ERROR);
+        }
+    memAllocs[ALLOC_BESTMPI] = YES;
+    groupProc = group + numCurrentDivisions;
+    procLoad = groupCost + numCurrentDivisions;
+
+    /* join divisions sharing a topology or a correlation parameter; the
+       root of a group is always its lowest division */
+    for (d=0; d<numCurrentDivisions; d++)
+        group[d] = d;
+    for (d=1; d<numCurrentDivisions; d++)
+        {
+        for (e=0; e<d; e++)
+            {
+            if (modelSettings[e].topology != modelSettings[d].topology
+                && (modelSettings[d].correlation == NULL || modelSettings[e].correlation != modelSettings[d].correlation))
+                continue;
+            for (g=d; group[g] != g; g=group[g])
+                ;
+            for (root=e; group[root] != root; root=group[root])
+                ;
+            if (g < root)
+                group[root] = g;
+            else
+                group[g] = root;
+            }
+        }
+    for (d=0; d<numCurrentDivisions; d++)
+        group[d] = group[group[d]];
+
+    /* the work of a division is roughly proportional to the number of
+       conditional likelihoods it updates */
+    totalCost = 0.0;
+    for (d=0; d<numCurrentDivisions; d++)
+        {
+        m = &modelSettings[d];
+        groupCost[group[d]] += (MrBFlt) m->numChars * m->numTiCats * m->numModelStates * m->numModelStates;
+        totalCost += (MrBFlt) m->numChars * m->numTiCats * m->numModelStates * m->numModelStates;
+        groupProc[d] = -1;
+        }
+
+    /* this is deterministic, so all processors arrive at the same assignment */
+    numGroups = 0;
+    while (1)
+        {
+        g = -1;
+        for (d=0; d<numCurrentDivisions; d++)
+            {
+            if (group[d] == d && groupProc[d] == -1 && (g == -1 || groupCost[d] > groupCost[g]))
+                g = d;
+            }
+        if (g == -1)
+            break;
+        root = 0;
+        for (e=1; e<num_procs; e++)
+            {
+            if (procLoad[e] < procLoad[root])
+                root = e;
+            }
+        groupProc[g] = root;
+        procLoad[root] += groupCost[g];
+        numGroups++;
+        }
+
+    for (d=0; d<numCurrentDivisions; d++)
+        {
+        if (groupProc[group[d]] == proc_id)
+            isDivisionActive[d] = YES;
+        else
+            isDivisionActive[d] = NO;
+        }
+
+    MrBayesPrint ("%s   Distributing %d division%s (%d independent group%s) over %d processor%s\n", spacer,
+        numCurrentDivisions, numCurrentDivisions == 1 ? "" : "s", numGroups, numGroups == 1 ? "" : "s",
+        num_procs, num_procs == 1 ? "" : "s");
+    if (num_procs <= 16)
         {
-        for (i=0; i<tree->nIntNodes; i++)
+        for (e=0; e<num_procs; e++)
             {
-            p = tree->intDownPass[i];
-            
-            if (m->unscaledNodes[chain][p->index] == 0)
+            numProcDivs = 0;
+            for (d=0; d<numCurrentDivisions; d++)
                 {
-                printf ("Node:%d Sum scalers:%f\n",p->index,DebugNodeScalers(p, d, chain));
+                if (groupProc[group[d]] == e)
+                    numProcDivs++;
                 }
+            MrBayesPrint ("%s      Processor %2d: %4d division%s, %5.1lf %% of the likelihood work\n", spacer, e,
+                numProcDivs, numProcDivs == 1 ? "" : "s", totalCost > 0.0 ? 100.0 * procLoad[e] / totalCost : 0.0);
             }
         }
+    if (numGroups < num_procs)
+        MrBayesPrint ("%s   WARNING: %d processor%s will only help with the rest of the chain\n", spacer,
+            num_procs - numGroups, num_procs - numGroups == 1 ? "" : "s");
+    MrBayesPrint ("\n");
+
+    free (group);
+    free (groupCost);
+
+    return (NO_ERROR);
 }
+#endif
 
 
 int DoMcmc (void)
@@ -2258,11 +3459,7 @@ int DoMcmc (void)
     char        *strBuf,*tmpcp;
     double      tmp;
 
-#   if defined (BEST_MPI_ENABLED)
-    Tree        *tree;
-#   endif
-
-#   if !defined (VISUAL) && !defined (MPI_ENABLED)
+#   if !defined (VISUAL) && !defined (MPI_ENABLED) && !defined (BEST_MPI_ENABLED)
     sighandler_t sigint_oldhandler, sigterm_oldhandler;
 #   endif
 
@@ -2384,6 +3581,14 @@ int DoMcmc (void)
     if (InitInvCondLikes() == ERROR)
         goto errorExit;
 
+    /* Initialize variables for Gibbs sampling of rate categories */
+    if (InitAugmentedModels () == ERROR)
+        goto errorExit;
+
+    /* Set up the site likelihood arrays if the site likelihoods are sampled. */
+    if (InitSiteLnLs () == ERROR)
+        goto errorExit;
+
     /* Allocate BEST chain variables */
     if (numTopologies > 1 && !strcmp(modelParams[0].topologyPr,"Speciestree"))
         AllocateBestChainVariables();
@@ -2545,6 +3750,14 @@ int DoMcmc (void)
             MrBayesPrint ("%s   Rebuilding starting trees using random addition sequences and parsimony\n", spacer);
             BuildParsTrees (&seed, 0, numLocalChains);
             }
+        else if (!strcmp(chainParams.startTree,"ML"))
+            {
+            MrBayesPrint ("%s   Rebuilding starting trees using random addition sequences, parsimony\n", spacer);
+            MrBayesPrint ("%s   and a likelihood search over NNIs and branch lengths (the substitution\n", spacer);
+            MrBayesPrint ("%s   model parameters are not optimized and keep their starting values):\n", spacer);
+            if (BuildMLTrees (&seed, 0, numLocalChains) == ERROR)
+                goto errorExit;
+            }
 
         /* Perturb start trees if requested */
         if (chainParams.numStartPerts > 0)
@@ -2571,6 +3784,12 @@ int DoMcmc (void)
             assert (IsTreeConsistent(&params[i], j, 0) == YES);
         }  */
 
+#   if defined (BEST_MPI_ENABLED)
+    /* Decide which divisions are calculated on this processor */
+    if (DistributeDivisions () == ERROR)
+        goto errorExit;
+#   endif
+
     /* Initialize vectors of print parameters */
     if (InitPrintParams () == ERROR)
         goto errorExit;
@@ -2579,7 +3798,7 @@ int DoMcmc (void)
 #   ifdef VISUAL
     SetConsoleCtrlHandler (CatchInterrupt, TRUE);
 #   else
-#       if !defined (MPI_ENABLED)
+#       if !defined (MPI_ENABLED) && !defined (BEST_MPI_ENABLED)
     /* we do not want to mess with the signal handling in MPI version */
     sigint_oldhandler  = signal(SIGINT, CatchInterrupt);
     sigterm_oldhandler = signal(SIGTERM, CatchInterrupt);
@@ -2594,7 +3813,7 @@ int DoMcmc (void)
 #   ifdef VISUAL
         SetConsoleCtrlHandler (CatchInterrupt, FALSE);
 #   else
-#       if !defined (MPI_ENABLED)
+#       if !defined (MPI_ENABLED) && !defined (BEST_MPI_ENABLED)
         signal(SIGINT, sigint_oldhandler);
         signal(SIGTERM, sigterm_oldhandler);
 #       endif
@@ -2608,7 +3827,7 @@ int DoMcmc (void)
 #   ifdef VISUAL
         SetConsoleCtrlHandler (CatchInterrupt, FALSE);
 #   else
-#       if !defined (MPI_ENABLED)
+#       if !defined (MPI_ENABLED) && !defined (BEST_MPI_ENABLED)
         signal(SIGINT, sigint_oldhandler);
         signal(SIGTERM, sigterm_oldhandler);
 #       endif
@@ -2620,7 +3839,7 @@ int DoMcmc (void)
 #   ifdef VISUAL
     SetConsoleCtrlHandler (CatchInterrupt, FALSE);
 #   else
-#       if !defined (MPI_ENABLED)
+#       if !defined (MPI_ENABLED) && !defined (BEST_MPI_ENABLED)
     signal(SIGINT, sigint_oldhandler);
     signal(SIGTERM, sigterm_oldhandler);
 #       endif
@@ -2768,6 +3987,48 @@ int DoSsParm (char *parmName, char *tkn)
                 return (ERROR);
                 }                
             }
+        else if (!strcmp(parmName, "Nblocks"))
+            {
+            if (expecting == Expecting(EQUALSIGN))
+                expecting = Expecting(NUMBER);
+            else if (expecting == Expecting(NUMBER))
+                {
+                sscanf (tkn, "%d", &tempI);
+                if (tempI < 1)
+                    {
+                    MrBayesPrint ("%s   Nblocks must be at least 1\n", spacer);
+                    return (ERROR);
+                    }
+                chainParams.numBlocksSS = tempI;
+                MrBayesPrint ("%s   Setting number of blocks in stepping-stone sampling to %d\n", spacer, chainParams.numBlocksSS);
+                expecting = Expecting(PARAMETER) | Expecting(SEMICOLON);
+                }
+            else 
+                {
+                return (ERROR);
+                }                
+            }
+        else if (!strcmp(parmName, "Block"))
+            {
+            if (expecting == Expecting(EQUALSIGN))
+                expecting = Expecting(NUMBER);
+            else if (expecting == Expecting(NUMBER))
+                {
+                sscanf (tkn, "%d", &tempI);
+                if (tempI < 1)
+                    {
+                    MrBayesPrint ("%s   Block must be at least 1\n", spacer);
+                    return (ERROR);
+                    }
+                chainParams.blockSS = tempI;
+                MrBayesPrint ("%s   Setting block of steps to sample in stepping-stone sampling to %d\n", spacer, chainParams.blockSS);
+                expecting = Expecting(PARAMETER) | Expecting(SEMICOLON);
+                }
+            else 
+                {
+                return (ERROR);
+                }                
+            }
         else
             {
             return (ERROR);
@@ -3864,20 +5125,214 @@ int DoMcmcParm (char *parmName, char *tkn)
                 if (IsArgValid(tkn, tempStr) == NO_ERROR)
                     {
                     if (!strcmp(tempStr, "Yes"))
-                        chainParams.orderTaxa = YES;
+                        chainParams.orderTaxa = YES;
+                    else
+                        chainParams.orderTaxa = NO;
+                    }
+                else
+                    {
+                    MrBayesPrint ("%s   Invalid argument for ordertaxa\n", spacer);
+                    free(tempStr);
+                    return (ERROR);
+                    }
+                if (chainParams.orderTaxa == YES)
+                    MrBayesPrint ("%s   Setting ordertaxa to yes\n", spacer);
+                else
+                    MrBayesPrint ("%s   Setting ordertaxa to no\n", spacer);
+                expecting = Expecting(PARAMETER) | Expecting(SEMICOLON);
+                }
+            else
+                {
+                free(tempStr);
+                return (ERROR);
+                }
+            }
+        /* set Pbf (chainParams.calcPbf) *****************************************************/
+        else if (!strcmp(parmName, "Pbf"))
+            {
+            if (expecting == Expecting(EQUALSIGN))
+                expecting = Expecting(ALPHA);
+            else if (expecting == Expecting(ALPHA))
+                {
+                if (IsArgValid(tkn, tempStr) == NO_ERROR)
+                    {
+                    if (!strcmp(tempStr, "Yes"))
+                        chainParams.calcPbf = YES;
+                    else
+                        chainParams.calcPbf = NO;
+                    }
+                else
+                    {
+                    MrBayesPrint ("%s   Invalid argument for pbf\n", spacer);
+                    free(tempStr);
+                    return (ERROR);
+                    }
+                if (chainParams.calcPbf == YES)
+                    MrBayesPrint ("%s   Setting pbf to yes\n", spacer);
+                else
+                    MrBayesPrint ("%s   Setting pbf to no\n", spacer);
+                expecting = Expecting(PARAMETER) | Expecting(SEMICOLON);
+                }
+            else
+                {
+                free(tempStr);
+                return (ERROR);
+                }
+            }
+        /* reject the settings of the earlier pseudo-BF sampler (chainParams.pbf...) ***************/
+        else if (!strcmp(parmName, "Pbfinitburnin") || !strcmp(parmName, "Pbfsamplefreq") ||
+                 !strcmp(parmName, "Pbfsampletime") || !strcmp(parmName, "Pbfsampleburnin"))
+            {
+            MrBayesPrint ("%s   Error: \"%s\" is not used. With pbf=yes, the site log likelihoods are sampled\n", spacer, parmName);
+            MrBayesPrint ("%s   every \"Samplefreq\" generations, and the samples within the burnin set by\n", spacer);
+            MrBayesPrint ("%s   \"Relburnin\", \"Burninfrac\" and \"Burnin\" are left out of the summary.\n", spacer);
+            free (tempStr);
+            return (ERROR);
+            }
+        /* set Append (chainParams.append) *********************************************/
+        else if (!strcmp(parmName, "Append"))
+            {
+            if (expecting == Expecting(EQUALSIGN))
+                expecting = Expecting(ALPHA);
+            else if (expecting == Expecting(ALPHA))
+                {
+                if (IsArgValid(tkn, tempStr) == NO_ERROR)
+                    {
+                    if (!strcmp(tempStr, "Yes"))
+                        chainParams.append = YES;
+                    else
+                        chainParams.append = NO;
+                    }
+                else
+                    {
+                    MrBayesPrint ("%s   Invalid argument for append\n", spacer);
+                    free(tempStr);
+                    return (ERROR);
+                    }
+                if (chainParams.append == YES)
+                    MrBayesPrint ("%s   Setting append to yes\n", spacer);
+                else
+                    MrBayesPrint ("%s   Setting append to no\n", spacer);
+                expecting = Expecting(PARAMETER) | Expecting(SEMICOLON);
+                }
+            else
+                {
+                free(tempStr);
+                return (ERROR);
+                }
+            }
+        /* set Autotune (chainParams.autotune) *********************************************/
+        else if (!strcmp(parmName, "Autotune"))
+            {
+            if (expecting == Expecting(EQUALSIGN))
+                expecting = Expecting(ALPHA);
+            else if (expecting == Expecting(ALPHA))
+                {
+                if (IsArgValid(tkn, tempStr) == NO_ERROR)
+                    {
+                    if (!strcmp(tempStr, "Yes"))
+                        chainParams.autotune = YES;
+                    else
+                        chainParams.autotune = NO;
+                    }
+                else
+                    {
+                    MrBayesPrint ("%s   Invalid argument for Autotune\n", spacer);
+                    free(tempStr);
+                    return (ERROR);
+                    }
+                if (chainParams.autotune == YES)
+                    MrBayesPrint ("%s   Setting Autotune to yes\n", spacer);
+                else
+                    MrBayesPrint ("%s   Setting Autotune to no\n", spacer);
+                expecting = Expecting(PARAMETER) | Expecting(SEMICOLON);
+                }
+            else
+                {
+                free(tempStr);
+                return (ERROR);
+                }
+            }
+        /* set Tunefreq (tuneFreq) ************************************************************/
+        else if (!strcmp(parmName, "Tunefreq"))
+            {
+            if (expecting == Expecting(EQUALSIGN))
+                expecting = Expecting(NUMBER);
+            else if (expecting == Expecting(NUMBER))
+                {
+                sscanf (tkn, "%d", &tempI);
+                if (tempI < 10)
+                    {
+                    MrBayesPrint ("%s   Autotuning frequency must be at least 10\n", spacer);
+                    free(tempStr);
+                    return (ERROR);
+                    }
+                chainParams.tuneFreq = tempI;
+                MrBayesPrint ("%s   Setting autotuning frequency to %d\n", spacer, chainParams.tuneFreq);
+                expecting = Expecting(PARAMETER) | Expecting(SEMICOLON);
+                }
+            else 
+                {
+                free(tempStr);
+                return (ERROR);
+                }
+            }
+        /* set Profile (chainParams.profile) ***********************************************/
+        else if (!strcmp(parmName, "Profile"))
+            {
+            if (expecting == Expecting(EQUALSIGN))
+                expecting = Expecting(ALPHA);
+            else if (expecting == Expecting(ALPHA))
+                {
+                if (IsArgValid(tkn, tempStr) == NO_ERROR)
+                    {
+                    if (!strcmp(tempStr, "Yes"))
+                        chainParams.profile = YES;
+                    else
+                        chainParams.profile = NO;
+                    }
+                else
+                    {
+                    MrBayesPrint ("%s   Invalid argument for Profile\n", spacer);
+                    free(tempStr);
+                    return (ERROR);
+                    }
+                if (chainParams.profile == YES)
+                    MrBayesPrint ("%s   Setting Profile to yes\n", spacer);
+                else
+                    MrBayesPrint ("%s   Setting Profile to no\n", spacer);
+                expecting = Expecting(PARAMETER) | Expecting(SEMICOLON);
+                }
+            else
+                {
+                free(tempStr);
+                return (ERROR);
+                }
+            }
+        /* set Checkbrlenderivs (chainParams.checkBrlenDerivs) *****************************/
+        else if (!strcmp(parmName, "Checkbrlenderivs"))
+            {
+            if (expecting == Expecting(EQUALSIGN))
+                expecting = Expecting(ALPHA);
+            else if (expecting == Expecting(ALPHA))
+                {
+                if (IsArgValid(tkn, tempStr) == NO_ERROR)
+                    {
+                    if (!strcmp(tempStr, "Yes"))
+                        chainParams.checkBrlenDerivs = YES;
                     else
-                        chainParams.orderTaxa = NO;
+                        chainParams.checkBrlenDerivs = NO;
                     }
                 else
                     {
-                    MrBayesPrint ("%s   Invalid argument for ordertaxa\n", spacer);
+                    MrBayesPrint ("%s   Invalid argument for Checkbrlenderivs\n", spacer);
                     free(tempStr);
                     return (ERROR);
                     }
-                if (chainParams.orderTaxa == YES)
-                    MrBayesPrint ("%s   Setting ordertaxa to yes\n", spacer);
+                if (chainParams.checkBrlenDerivs == YES)
+                    MrBayesPrint ("%s   Setting Checkbrlenderivs to yes\n", spacer);
                 else
-                    MrBayesPrint ("%s   Setting ordertaxa to no\n", spacer);
+                    MrBayesPrint ("%s   Setting Checkbrlenderivs to no\n", spacer);
                 expecting = Expecting(PARAMETER) | Expecting(SEMICOLON);
                 }
             else
@@ -3886,8 +5341,8 @@ int DoMcmcParm (char *parmName, char *tkn)
                 return (ERROR);
                 }
             }
-        /* set Append (chainParams.append) *********************************************/
-        else if (!strcmp(parmName, "Append"))
+        /* set Checkparstrees (chainParams.checkParsTrees) *********************************/
+        else if (!strcmp(parmName, "Checkparstrees"))
             {
             if (expecting == Expecting(EQUALSIGN))
                 expecting = Expecting(ALPHA);
@@ -3896,20 +5351,20 @@ int DoMcmcParm (char *parmName, char *tkn)
                 if (IsArgValid(tkn, tempStr) == NO_ERROR)
                     {
                     if (!strcmp(tempStr, "Yes"))
-                        chainParams.append = YES;
+                        chainParams.checkParsTrees = YES;
                     else
-                        chainParams.append = NO;
+                        chainParams.checkParsTrees = NO;
                     }
                 else
                     {
-                    MrBayesPrint ("%s   Invalid argument for append\n", spacer);
+                    MrBayesPrint ("%s   Invalid argument for Checkparstrees\n", spacer);
                     free(tempStr);
                     return (ERROR);
                     }
-                if (chainParams.append == YES)
-                    MrBayesPrint ("%s   Setting append to yes\n", spacer);
+                if (chainParams.checkParsTrees == YES)
+                    MrBayesPrint ("%s   Setting Checkparstrees to yes\n", spacer);
                 else
-                    MrBayesPrint ("%s   Setting append to no\n", spacer);
+                    MrBayesPrint ("%s   Setting Checkparstrees to no\n", spacer);
                 expecting = Expecting(PARAMETER) | Expecting(SEMICOLON);
                 }
             else
@@ -3918,8 +5373,8 @@ int DoMcmcParm (char *parmName, char *tkn)
                 return (ERROR);
                 }
             }
-        /* set Autotune (chainParams.autotune) *********************************************/
-        else if (!strcmp(parmName, "Autotune"))
+        /* set Checkautoweight (chainParams.checkAutoweight) *******************************/
+        else if (!strcmp(parmName, "Checkautoweight"))
             {
             if (expecting == Expecting(EQUALSIGN))
                 expecting = Expecting(ALPHA);
@@ -3928,20 +5383,20 @@ int DoMcmcParm (char *parmName, char *tkn)
                 if (IsArgValid(tkn, tempStr) == NO_ERROR)
                     {
                     if (!strcmp(tempStr, "Yes"))
-                        chainParams.autotune = YES;
+                        chainParams.checkAutoweight = YES;
                     else
-                        chainParams.autotune = NO;
+                        chainParams.checkAutoweight = NO;
                     }
                 else
                     {
-                    MrBayesPrint ("%s   Invalid argument for Autotune\n", spacer);
+                    MrBayesPrint ("%s   Invalid argument for Checkautoweight\n", spacer);
                     free(tempStr);
                     return (ERROR);
                     }
-                if (chainParams.autotune == YES)
-                    MrBayesPrint ("%s   Setting Autotune to yes\n", spacer);
+                if (chainParams.checkAutoweight == YES)
+                    MrBayesPrint ("%s   Setting Checkautoweight to yes\n", spacer);
                 else
-                    MrBayesPrint ("%s   Setting Autotune to no\n", spacer);
+                    MrBayesPrint ("%s   Setting Checkautoweight to no\n", spacer);
                 expecting = Expecting(PARAMETER) | Expecting(SEMICOLON);
                 }
             else
@@ -3950,25 +5405,33 @@ int DoMcmcParm (char *parmName, char *tkn)
                 return (ERROR);
                 }
             }
-        /* set Tunefreq (tuneFreq) ************************************************************/
-        else if (!strcmp(parmName, "Tunefreq"))
+        /* set Autoweight (chainParams.autoweight) *****************************************/
+        else if (!strcmp(parmName, "Autoweight"))
             {
             if (expecting == Expecting(EQUALSIGN))
-                expecting = Expecting(NUMBER);
-            else if (expecting == Expecting(NUMBER))
+                expecting = Expecting(ALPHA);
+            else if (expecting == Expecting(ALPHA))
                 {
-                sscanf (tkn, "%d", &tempI);
-                if (tempI < 10)
+                if (IsArgValid(tkn, tempStr) == NO_ERROR)
                     {
-                    MrBayesPrint ("%s   Autotuning frequency must be at least 10\n", spacer);
+                    if (!strcmp(tempStr, "Yes"))
+                        chainParams.autoweight = YES;
+                    else
+                        chainParams.autoweight = NO;
+                    }
+                else
+                    {
+                    MrBayesPrint ("%s   Invalid argument for Autoweight\n", spacer);
                     free(tempStr);
                     return (ERROR);
                     }
-                chainParams.tuneFreq = tempI;
-                MrBayesPrint ("%s   Setting autotuning frequency to %d\n", spacer, chainParams.tuneFreq);
+                if (chainParams.autoweight == YES)
+                    MrBayesPrint ("%s   Setting Autoweight to yes\n", spacer);
+                else
+                    MrBayesPrint ("%s   Setting Autoweight to no\n", spacer);
                 expecting = Expecting(PARAMETER) | Expecting(SEMICOLON);
                 }
-            else 
+            else
                 {
                 free(tempStr);
                 return (ERROR);
@@ -4019,7 +5482,8 @@ int DoMcmcParm (char *parmName, char *tkn)
 
 int DoSs (void)
 {
-    int ret, oldBurnin;
+    int     ret, oldBurnin, oldNumGen;
+    char    oldChainFileName[100];
 
     if (chainParams.numGen/chainParams.sampleFreq <= chainParams.burninSS)
         {/*Do not change print out to generations vs samples because of danger of overflow*/
@@ -4027,6 +5491,37 @@ int DoSs (void)
         return ERROR;
         }
 
+    /* the steps sampled by this analysis; with several blocks, each block is sampled by a separate analysis */
+    if (chainParams.numBlocksSS > chainParams.numStepsSS)
+        {
+        MrBayesPrint ("%s   Nblocks (%d) cannot be larger than Nsteps (%d)\n", spacer, chainParams.numBlocksSS, chainParams.numStepsSS);
+        return ERROR;
+        }
+    if (chainParams.blockSS > chainParams.numBlocksSS)
+        {
+        MrBayesPrint ("%s   Block (%d) cannot be larger than Nblocks (%d)\n", spacer, chainParams.blockSS, chainParams.numBlocksSS);
+        return ERROR;
+        }
+    firstStepSS = (chainParams.blockSS-1)*chainParams.numStepsSS/chainParams.numBlocksSS + 1;
+    lastStepSS  = chainParams.blockSS*chainParams.numStepsSS/chainParams.numBlocksSS;
+    strcpy (oldChainFileName, chainParams.chainFileName);
+    if (chainParams.numBlocksSS > 1)
+        {
+        if (strlen(chainParams.chainFileName) + 12 > 100)
+            {
+            MrBayesPrint ("%s   File name %s is too long for block output files\n", spacer, chainParams.chainFileName);
+            return ERROR;
+            }
+        /* the summary commands should use the name shared by all blocks */
+        if (fileNameChanged == YES)
+            {
+            SetFileNames();
+            fileNameChanged = NO;
+            }
+        sprintf (chainParams.chainFileName + strlen(chainParams.chainFileName), ".block%d", chainParams.blockSS);
+        }
+    oldNumGen = chainParams.numGen;
+
     oldBurnin = chainParams.burninSS;;
     stepRelativeBurninSS = chainParams.relativeBurnin;
 
@@ -4039,6 +5534,11 @@ int DoSs (void)
     ret=DoMcmc();
 
     chainParams.isSS = NO;
+    if (chainParams.numBlocksSS > 1)
+        {
+        chainParams.numGen = oldNumGen;
+        strcpy (chainParams.chainFileName, oldChainFileName);
+        }
     chainParams.burninSS = oldBurnin;
     chainParams.relativeBurnin = stepRelativeBurninSS;
 
@@ -4052,10 +5552,24 @@ int DoSsp (void)
 }
 
 
+/*----------------------------------------------------------------------
+|
+|   ExhaustiveParsimonySearch: Enumerate the trees of the subtree t and
+|      sum their scores in tInfo, relative to the best score. The trees
+|      fall into three branches, one for each place of the third leaf.
+|      Without a stop score, the branches are shared by numParsThreads
+|      threads and their sums are kept in tInfo. With a stop score, the
+|      search stops at the tree where the sum reaches it, and the tree
+|      is left in that state; the sums kept by the previous search of
+|      the same subtree give the branch to search.
+|
+------------------------------------------------------------------------*/
 int ExhaustiveParsimonySearch (Tree *t, int chain, TreeInfo *tInfo)
 {
-    int         i, j, k;
+    int         i, j, k, numThreads;
+    MrBFlt      sumScore, warpRatio;
     TreeNode    *p;
+    PARSWORK    *work;
     
     for (i=j=k=0; i<t->nNodes; i++)
         {
@@ -4072,9 +5586,106 @@ int ExhaustiveParsimonySearch (Tree *t, int chain, TreeInfo *tInfo)
     tInfo->leaf[t->nIntNodes+1]->left = tInfo->vertex[0];
     tInfo->vertex[0]->anc = tInfo->leaf[t->nIntNodes+1];
 
-    BuildExhaustiveSearchTree (t, chain, 2, tInfo);
+    if (t->nIntNodes < 2)
+        {
+        BuildExhaustiveSearchTree (t, chain, 2, tInfo);
+        return (NO_ERROR);
+        }
+
+    if (tInfo->stopScore > 0.0)
+        {
+        sumScore = tInfo->totalScore;
+        for (i=0; i<2; i++)
+            {
+            if (sumScore + tInfo->branchScore[i] >= tInfo->stopScore)
+                break;
+            sumScore += tInfo->branchScore[i];
+            }
+        tInfo->totalScore = sumScore;
+        BuildExhaustiveSearchBranch (t, chain, 2, i, tInfo);
+        if (tInfo->totalScore < tInfo->stopScore)
+            {
+            /* missed by rounding, stop at the last tree of the branch */
+            tInfo->stopScore = tInfo->totalScore;
+            tInfo->totalScore = sumScore;
+            BuildExhaustiveSearchBranch (t, chain, 2, i, tInfo);
+            }
+        return (NO_ERROR);
+        }
+
+    numThreads = (numParsThreads < 3 ? numParsThreads : 3);
+    work = (PARSWORK *) SafeCalloc (numThreads, sizeof(PARSWORK));
+    if (!work)
+        return (ERROR);
+    for (i=0; i<numThreads; i++)
+        {
+        work[i].thread = i;
+        work[i].numThreads = numThreads;
+        work[i].chain = chain;
+        work[i].tInfo = *tInfo;
+        if (i == 0)
+            work[i].t = t;
+        else if (CopyExhaustiveSearchTree (t, tInfo, &work[i]) == ERROR)
+            goto errorExit;
+        }
+    if (RunParsThreads (&ExhaustiveSearchThread, work, numThreads) == ERROR)
+        goto errorExit;
+
+    /* the sum of each branch is relative to the best score in that branch */
+    warpRatio = (tInfo->warp/3.0) / (1.0 - tInfo->warp);
+    for (i=0; i<3; i++)
+        {
+        if (work[i % numThreads].minScore[i] < tInfo->minScore)
+            tInfo->minScore = work[i % numThreads].minScore[i];
+        }
+    for (i=0; i<3; i++)
+        {
+        tInfo->branchScore[i] = work[i % numThreads].tInfo.branchScore[i] * pow (warpRatio, work[i % numThreads].minScore[i] - tInfo->minScore);
+        tInfo->totalScore += tInfo->branchScore[i];
+        }
 
+    for (i=1; i<numThreads; i++)
+        {
+        free (work[i].treeCopy.nodes);
+        free (work[i].treeCopy.allDownPass);
+        free (work[i].treeCopy.intDownPass);
+        free (work[i].tInfo.leaf);
+        }
+    free (work);
     return (NO_ERROR);
+
+    errorExit:
+        for (i=1; i<numThreads; i++)
+            {
+            free (work[i].treeCopy.nodes);
+            free (work[i].treeCopy.allDownPass);
+            free (work[i].treeCopy.intDownPass);
+            free (work[i].tInfo.leaf);
+            }
+        free (work);
+        return (ERROR);
+}
+
+
+/* ExhaustiveSearchThread: Enumerate every numThreads-th branch of an exhaustive parsimony search */
+void *ExhaustiveSearchThread (void *arg)
+{
+    int         i;
+    MrBFlt      minScore;
+    PARSWORK    *work;
+
+    work = (PARSWORK *) arg;
+    minScore = work->tInfo.minScore;
+    for (i=work->thread; i<3; i+=work->numThreads)
+        {
+        work->tInfo.minScore = minScore;
+        work->tInfo.totalScore = 0.0;
+        BuildExhaustiveSearchBranch (work->t, work->chain, 2, i, &work->tInfo);
+        work->tInfo.branchScore[i] = work->tInfo.totalScore;
+        work->minScore[i] = work->tInfo.minScore;
+        }
+
+    return (NULL);
 }
 
 
@@ -4083,7 +5694,7 @@ int ExtendChainQuery ()
     int             extendChain, additionalCycles;
     char            s[100];
     
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     if (proc_id == 0)
         {
         MrBayesPrint ("\n");
@@ -4443,7 +6054,7 @@ void FreeChainMemory (void)
     /* free model variables for Gibbs gamma */
     for (i=0; i<numCurrentDivisions; i++)
         {
-        if (modelSettings[i].gibbsGamma == YES)
+        if (modelSettings[i].gibbsGamma == YES && modelSettings[i].catLike != NULL)
             {
             if (modelSettings[i].pInvar != NULL)
                 nRates = modelSettings[i].numRateCats + 1;
@@ -4462,6 +6073,9 @@ void FreeChainMemory (void)
             free (modelSettings[i].tiIndex);
             free (modelSettings[i].catLike);
             free (modelSettings[i].catLnScaler);
+            modelSettings[i].tiIndex = NULL;
+            modelSettings[i].catLike = NULL;
+            modelSettings[i].catLnScaler = NULL;
             }
         }
 
@@ -4628,6 +6242,16 @@ void FreeChainMemory (void)
             free (m->ancStateCondLikes);
             m->ancStateCondLikes = NULL;
             }
+        if (m->siteLnLs)
+            {
+            free (m->siteLnLs);
+            m->siteLnLs = NULL;
+            }
+        if (m->siteLnLIndex)
+            {
+            free (m->siteLnLIndex);
+            m->siteLnLIndex = NULL;
+            }
 
 #   if defined (BEAGLE_ENABLED)
         if (m->useBeagle == NO)
@@ -4667,6 +6291,31 @@ void FreeChainMemory (void)
         free (curLnL);
         memAllocs[ALLOC_CURLNL] = NO;
         }
+#   if defined (MPI_ENABLED)
+    if (memAllocs[ALLOC_SWAPBUFFERS] == YES) /*alloc in RunChain()*/
+        {
+        MPI_Waitall (2*numLocalChains, swapRequest, MPI_STATUSES_IGNORE);
+        free (swapSummary);
+        free (swapRequest);
+        free (swapHeat);
+        memAllocs[ALLOC_SWAPBUFFERS] = NO;
+        }
+#   endif
+#   if defined (BEST_MPI_ENABLED)
+    if (memAllocs[ALLOC_BESTMPI] == YES) /*alloc in DistributeDivisions()*/
+        {
+        free (isDivisionActive);
+        free (divisionLnLike);
+        isDivisionActive = NULL;
+        divisionLnLike = NULL;
+        memAllocs[ALLOC_BESTMPI] = NO;
+        }
+#   endif
+    if (siteLnLChars != NULL) /*alloc in InitSiteLnLs()*/
+        {
+        free (siteLnLChars);
+        siteLnLChars = NULL;
+        }
     if (memAllocs[ALLOC_SS] == YES) /*alloc in mcmc()*/
         {
         free (marginalLnLSS);
@@ -4719,6 +6368,8 @@ void FreeChainMemory (void)
         {
         free (siteJump);
         siteJump = NULL;
+        free (hmmSites);
+        hmmSites = NULL;
         memAllocs[ALLOC_SITEJUMP] = NO;
         }
     if (memAllocs[ALLOC_MARKOVTIS] == YES)  /*alloc in InitAdGamma() */
@@ -4745,6 +6396,8 @@ void FreeChainMemory (void)
         {
         free (partition[0]);
         free (partition);
+        free (splitKeys);
+        free (treeSplits);
         for (i=0; i<numTopologies; i++)
             Tfree (partFreqTreeRoot[i]);
         free (partFreqTreeRoot);
@@ -4761,6 +6414,7 @@ void FreeChainMemory (void)
         if (fpParm != NULL)
             free (fpParm);
         fpParm = NULL;
+        fpSiteLnL = NULL;
         fpTree = NULL;
         fpMcmc = NULL;
         fpSS = NULL;
@@ -4787,25 +6441,220 @@ void FreeChainMemory (void)
         free (topologyPrintIndex);
         memAllocs[ALLOC_PRINTPARAM] = NO;
         }
-    if (memAllocs[ALLOC_TFILEPOS] == YES)
+    if (memAllocs[ALLOC_SPLITRING] == YES)
         {
-        free (chainParams.tFilePos);
-        chainParams.tFilePos = NULL;
-        memAllocs[ALLOC_TFILEPOS] = NO;
+        for (i=0; i<chainParams.numRuns * numTopologies; i++)
+            FreeSplitRing (&chainParams.splitRing[i]);
+        free (chainParams.splitRing);
+        chainParams.splitRing = NULL;
+        memAllocs[ALLOC_SPLITRING] = NO;
         }
-    if (memAllocs[ALLOC_TREELIST] == YES)
+    if (memAllocs[ALLOC_TOPOLIST] == YES)
         {
         for (i=0; i<chainParams.numRuns * numTopologies; i++)
-            EraseTreeList (&chainParams.treeList[i]);
-        free (chainParams.treeList);
-        chainParams.treeList = NULL;
-        memAllocs[ALLOC_TREELIST] = NO;
+            FreePackedTopologyList (&chainParams.topoList[i]);
+        for (i=0; i<numTopologies; i++)
+            FreeSplitPool (&chainParams.splitPool[i]);
+        free (chainParams.topoList);
+        free (chainParams.splitPool);
+        chainParams.topoList = NULL;
+        chainParams.splitPool = NULL;
+        memAllocs[ALLOC_TOPOLIST] = NO;
         }
     if (memAllocs[ALLOC_BEST] == YES)
         {
         FreeBestChainVariables();
         memAllocs[ALLOC_BEST] = NO;
         }
+    if (autoweightInfo != NULL) /* alloc in RunChain() */
+        {
+        free (autoweightInfo);
+        autoweightInfo = NULL;
+        }
+    if (moveTime != NULL) /* alloc in RunChain() */
+        {
+        free (moveTime);
+        moveTime = NULL;
+        divisionLikeTime = NULL;
+        }
+    ScratchFree ();
+}
+
+
+/* FreePackedTopologyList: Free space for packed topology list */
+void FreePackedTopologyList (PackedTopologyList *list)
+{
+    free (list->splitIds);
+    free (list->repeats);
+    list->splitIds = NULL;
+    list->repeats = NULL;
+    list->nSplits = list->capacity = list->first = list->numStored = 0;
+}
+
+
+/* FreeSplitPool: Free space for split pool */
+void FreeSplitPool (SplitPool *pool)
+{
+    free (pool->bits);
+    free (pool->hash);
+    free (pool->refCount);
+    free (pool->freeIds);
+    free (pool->table);
+    pool->bits = pool->hash = NULL;
+    pool->refCount = pool->freeIds = pool->table = NULL;
+    pool->numSplits = pool->numFree = pool->capacity = pool->tableSize = 0;
+}
+
+
+/* FreeSplitRing: Free space for split ring */
+void FreeSplitRing (SplitRing *ring)
+{
+    free (ring->splits);
+    ring->splits = NULL;
+    ring->nSplits = ring->capacity = ring->first = ring->numSamples = 0;
+}
+
+
+/*-----------------------------------------------------------------------
+|
+|   FullClockTreePriorRatio: Calculate the ln prior ratio on the node
+|       depths of a clock tree from the full prior of the new and the
+|       old tree. Calibrations are dealt with in LogClockTreePriorRatio.
+|
+------------------------------------------------------------------------*/
+int FullClockTreePriorRatio (Param *param, int chain, MrBFlt clockRate, MrBFlt *lnPriorRatio)
+{
+    int             sS;
+    MrBFlt          oldLnPrior, newLnPrior, theta, N, growth, sF, *sR, *eR, *fR;
+    Model           *mp;
+    ModelInfo       *m;
+    Tree            *newTree, *oldTree;
+
+    (*lnPriorRatio) = 0.0;
+    
+    mp = &modelParams[param->relParts[0]];
+    m  = &modelSettings[param->relParts[0]];
+    
+    newTree = GetTree (m->brlens, chain, state[chain]);
+    oldTree = GetTree (m->brlens, chain, state[chain] ^ 1);
+
+    if (m->clockPrId == CLOCKPR_COALESCENCE)
+        {
+        /* coalescence prior */
+        /* first calculate theta as 4*N*mu, 3*N*mu or 2*N*mu */
+        N = *(GetParamVals (m->popSize, chain, state[chain]));
+        theta = m->ploidyFactor * N * clockRate;
+        /* deal with growth */
+        if (m->isGrowthFixed == YES)
+            growth = mp->growthFix;
+        else
+            growth = *(GetParamVals (m->growthRate, chain, state[chain]));
+        if (LnCoalescencePriorPr (oldTree, &oldLnPrior, theta, growth) == ERROR)
+            {
+            MrBayesPrint ("%s   Problem calculating prior for coalescence process\n", spacer);
+            return (ERROR);
+            }
+        if (LnCoalescencePriorPr (newTree, &newLnPrior, theta, growth) == ERROR)
+            {
+            MrBayesPrint ("%s   Problem calculating prior for coalescence process\n", spacer);
+            return (ERROR);
+            }
+        (*lnPriorRatio) = (newLnPrior - oldLnPrior);
+        }
+    else if (m->clockPrId == CLOCKPR_BIRTHDEATH)
+        {
+        /* birth-death prior */
+        sR = GetParamVals (m->speciationRates, chain, state[chain]);
+        eR = GetParamVals (m->extinctionRates, chain, state[chain]);
+        sS = m->sampleStratId;
+        sF = mp->sampleProb;
+        if (LnBirthDeathPriorPr (oldTree, clockRate, &oldLnPrior, *sR, *eR, sS, sF) == ERROR)
+            {
+            MrBayesPrint ("%s   Problem calculating prior for birth-death process\n", spacer);
+            return (ERROR);
+            }
+        if (LnBirthDeathPriorPr (newTree, clockRate, &newLnPrior, *sR, *eR, sS, sF) == ERROR)
+            {
+            MrBayesPrint ("%s   Problem calculating prior for birth-death process\n", spacer);
+            return (ERROR);
+            }
+        (*lnPriorRatio) = (newLnPrior - oldLnPrior);
+        }
+    else if (m->clockPrId == CLOCKPR_FOSSILIZATION)
+        {
+        /* fossilized birth-death prior */
+        sR = GetParamVals (m->speciationRates, chain, state[chain]);
+        eR = GetParamVals (m->extinctionRates, chain, state[chain]);
+        fR = GetParamVals (m->fossilizationRates, chain, state[chain]);
+        sF = mp->sampleProb;
+        sS = m->sampleStratId;
+        if (LnFossilizationPriorPr (oldTree, clockRate, &oldLnPrior, sR, eR, fR, sF, sS) == ERROR)
+            {
+            MrBayesPrint ("%s   Problem calculating prior for fossilized birth-death process\n", spacer);
+            return (ERROR);
+            }
+        if (LnFossilizationPriorPr (newTree, clockRate, &newLnPrior, sR, eR, fR, sF, sS) == ERROR)
+            {
+            MrBayesPrint ("%s   Problem calculating prior for fossilized birth-death process\n", spacer);
+            return (ERROR);
+            }
+        (*lnPriorRatio) = (newLnPrior - oldLnPrior);
+        }
+    else if (m->clockPrId == CLOCKPR_UNIFORM)
+        {
+        oldLnPrior = LnUniformPriorPr(oldTree, clockRate);
+        newLnPrior = LnUniformPriorPr(newTree, clockRate);
+        (*lnPriorRatio) = (newLnPrior - oldLnPrior);
+        }
+    else if (m->clockPrId == CLOCKPR_SPCOAL)
+        {
+        // Defer this calculation to the BEST code
+        }
+
+    return (NO_ERROR);
+}
+
+
+/*------------------------------------------------------------------------
+|
+|   GetBrlenDerivs: Get the log likelihood of tree t and its first and
+|      second derivatives with respect to the length of the branch below
+|      p, summed over the divisions of the tree. The branch length is
+|      taken from p->length. Cond likes and ti probs must be up to date
+|      for the length of the branch used in the last down pass, and the
+|      final (up pass) cond likes must be current for p->anc.
+|
+------------------------------------------------------------------------*/
+int GetBrlenDerivs (Tree *t, TreeNode *p, int chain, MrBFlt *lnL, MrBFlt *d1, MrBFlt *d2)
+{
+    int         d, division;
+    MrBFlt      x, x1, x2;
+    ModelInfo   *m;
+
+    *lnL = *d1 = *d2 = 0.0;
+    for (d=0; d<t->nRelParts; d++)
+        {
+        division = t->relParts[d];
+        m = &modelSettings[division];
+        if (m->BrlenDerivs == NULL || m->useBeagle == YES)
+            {
+            MrBayesPrint ("%s   Branch length derivatives are not available for division %d\n", spacer, division+1);
+            return (ERROR);
+            }
+        if (m->BrlenDerivs (p, division, chain, &x, &x1, &x2) == ERROR)
+            return (ERROR);
+        if (x == MRBFLT_NEG_MAX)
+            {
+            *lnL = MRBFLT_NEG_MAX;
+            *d1 = *d2 = 0.0;
+            return (NO_ERROR);
+            }
+        *lnL += x;
+        *d1 += x1;
+        *d2 += x2;
+        }
+
+    return (NO_ERROR);
 }
 
 
@@ -4987,7 +6836,7 @@ int GetParsimonyBrlens (Tree *t, int chain, MrBFlt *brlens)
     
     /* Get final parsimony state sets */
     GetParsDP(t, t->root->left, chain);
-    GetParsFP(t, t->root, chain);
+    GetParsFP(t, t->root->left, chain);
     
     /* Get all branch lengths, looping over divisions */
     for (n=0; n<t->nRelParts; n++)      
@@ -5269,14 +7118,47 @@ void GetSwappers (int *swapA, int *swapB, int run)
 }
 
 
-void GetTempDownPassSeq (TreeNode *p, int *i, TreeNode **dp)
-{
-    if (p != NULL)
+void GetTempDownPassSeq (TreeNode *p, int *i, TreeNode **dp)
+{
+    if (p != NULL)
+        {
+        GetTempDownPassSeq (p->left,  i, dp);
+        GetTempDownPassSeq (p->right, i, dp);
+        dp[(*i)++] = p;
+        }
+}
+
+
+/* GetTreeSplits: Copy the nontrivial splits of a tree, in down-pass order, to consecutive rows of splits,
+   using partition as scratch space. Returns the number of splits */
+int GetTreeSplits (Tree *tree, BitsLong *splits)
+{
+    int         i, j, nTaxa;
+    TreeNode    *p;
+
+    if (tree->isRooted == YES)
+        nTaxa = tree->nNodes - tree->nIntNodes - 1;
+    else
+        nTaxa = tree->nNodes - tree->nIntNodes;
+
+    for (i=0; i<nTaxa; i++)
         {
-        GetTempDownPassSeq (p->left,  i, dp);
-        GetTempDownPassSeq (p->right, i, dp);
-        dp[(*i)++] = p;
+        ClearBits(partition[i], nLongsNeeded);
+        SetBit(i, partition[i]);
+        }
+
+    for (i=0; i<tree->nIntNodes-1; i++)
+        {
+        p = tree->intDownPass[i];
+        assert (p->index >= tree->nNodes - tree->nIntNodes - (tree->isRooted == YES ? 1 : 0));
+        for (j=0; j<nLongsNeeded; j++)
+            {
+            partition[p->index][j] = partition[p->left->index][j] | partition[p->right->index][j];
+            splits[i*nLongsNeeded+j] = partition[p->index][j];
+            }
         }
+
+    return (tree->nIntNodes - 1);
 }
 
 
@@ -5289,6 +7171,11 @@ MrBFlt GibbsSampleGamma (int chain, int division, RandLong *seed)
     ModelInfo       *m;
     Tree            *t;
     TreeNode        *p;
+#   if defined (SSE_ENABLED)
+    int             j;
+    CLFlt           f4[4];
+    __m128          mMaxLnScaler, mLnScaler, mMask, mSum, mZero;
+#   endif
 
     m = &modelSettings[division];
 
@@ -5378,7 +7265,59 @@ MrBFlt GibbsSampleGamma (int chain, int division, RandLong *seed)
         }
 
     /* Now Gibbs sample the rate categories */
-    for (c=0; c<m->numChars; c++)
+    c = 0;
+#   if defined (SSE_ENABLED)
+    /* work on four characters at a time; the categories are sampled in character order as below */
+    mZero = _mm_setzero_ps ();
+    for (; c+4<=m->numChars; c+=4)
+        {
+        /* find max scaler */
+        mMaxLnScaler = _mm_loadu_ps (catLnScaler[0] + c);
+        for (k=1; k<nRateCats; k++)
+            {
+            mLnScaler = _mm_loadu_ps (catLnScaler[k] + c);
+            mMask = _mm_and_ps (_mm_cmpgt_ps (mLnScaler, mMaxLnScaler), _mm_cmpgt_ps (_mm_loadu_ps (catLike[k] + c), mZero));
+            mMaxLnScaler = _mm_or_ps (_mm_and_ps (mMask, mLnScaler), _mm_andnot_ps (mMask, mMaxLnScaler));
+            }
+        /* scale values */
+        for (k=0; k<nRateCats; k++)
+            {
+            _mm_storeu_ps (f4, _mm_sub_ps (_mm_loadu_ps (catLnScaler[k] + c), mMaxLnScaler));
+            for (j=0; j<4; j++)
+                {
+                if (f4[j] < -100.0)
+                    catLike[k][c+j] = 0.0;
+                else
+                    {
+                    if (f4[j] != 0.0)
+                        catLike[k][c+j] *= (CLFlt) exp (f4[j]);
+                    /* take the temperature into account */
+                    if (id != 0)
+                        catLike[k][c+j] = (CLFlt) pow(catLike[k][c+j], temp);
+                    }
+                }
+            }
+        /* get cumulative sum */
+        mSum = _mm_loadu_ps (catLike[0] + c);
+        for (k=1; k<nRateCats; k++)
+            {
+            mSum = _mm_add_ps (mSum, _mm_loadu_ps (catLike[k] + c));
+            _mm_storeu_ps (catLike[k] + c, mSum);
+            }
+        /* randomly sample a category; multiply by total to avoid scaling probs */
+        for (j=c; j<c+4; j++)
+            {
+            ran = RandomNumber(seed) * catLike[nRateCats-1][j];
+            for (k=0; k<nRateCats; k++)
+                {
+                if (ran < catLike[k][j])
+                    break;
+                }
+            rateCat[j] = k;
+            }
+        }
+#   endif
+    for (; c<m->numChars; c++)
         {
         /* find max scaler */
         maxLnScaler = catLnScaler[0][c];
@@ -5437,6 +7376,21 @@ MrBFlt GibbsSampleGamma (int chain, int division, RandLong *seed)
 }
 
 
+/* HashSplit: Hash a split bitset (used for the split pool) */
+BitsLong HashSplit (BitsLong *p, int nLongs)
+{
+    int         i;
+    BitsLong    h = 0;
+
+    for (i=0; i<nLongs; i++)
+        h ^= p[i] + (BitsLong) 0x9E3779B9 + (h << 6) + (h >> 2);
+
+    h *= (BitsLong) 0x9E3779B9;
+
+    return h ^ (h >> 16);
+}
+
+
 /*------------------------------------------------------------------------
 |
 |   InitAdGamma: initialize variables for adgamma model.
@@ -5444,8 +7398,9 @@ MrBFlt GibbsSampleGamma (int chain, int division, RandLong *seed)
 -------------------------------------------------------------------------*/
 int InitAdGamma (void)
 {
-    int         d, c, i, j, k, maxRates, *corrModel;
+    int         d, c, i, j, k, n, first, lastCharId, maxRates, *corrModel;
     ModelInfo   *m;
+    ModelParams *mp;
     
     /* take care of adgamma model */
     if (chainHasAdgamma == NO)
@@ -5466,11 +7421,15 @@ int InitAdGamma (void)
         return ERROR;
         }
     siteJump = (int *) SafeCalloc (numChar, sizeof(int));
-    if (siteJump)
+    hmmSites = (int *) SafeMalloc (3 * numChar * sizeof(int));
+    if (siteJump && hmmSites)
         memAllocs[ALLOC_SITEJUMP] = YES;
     else
         {
-        MrBayesPrint ("%s   Problem allocating siteJump in InitAdGamma (%d ints)\n", spacer, numChar);
+        MrBayesPrint ("%s   Problem allocating siteJump in InitAdGamma (%d ints)\n", spacer, 4*numChar);
+        free (siteJump);
+        free (hmmSites);
+        siteJump = hmmSites = NULL;
         free (corrModel);
         return ERROR;
         }
@@ -5560,6 +7519,57 @@ int InitAdGamma (void)
             }
         }
 
+    /* collect the sites visited by the forward algorithm of each HMM, so that */
+    /* CalcLikeAdgamma does not need to scan the characters in every call    */
+    for (i=1, n=0; i<=k; i++)
+        {
+        for (c=0; c<numChar; c++)
+            {
+            if (corrModel[partitionId[c][partitionNum] - 1] == i)
+                break;
+            }
+        d = partitionId[c][partitionNum] - 1;
+        mp = &modelParams[d];
+        m = &modelSettings[d];
+        first = n;
+        hmmSites[3*n]   = d;
+        hmmSites[3*n+1] = compCharPos[c] - m->compCharStart;
+        hmmSites[3*n+2] = 0;
+        n++;
+        lastCharId = charInfo[c].charId;
+        for (c++; c<numChar; c++)
+            {
+            /* skip if excluded */
+            if (charInfo[c].isExcluded == YES)
+                continue;
+
+            /* skip if part of same codon in translated protein model */
+            if ((mp->dataType == DNA || mp->dataType == RNA) && m->dataType == PROTEIN && charInfo[c].charId == lastCharId)
+                continue;
+            else
+                lastCharId = charInfo[c].charId;
+
+            /* skip if not in HMM */
+            d = partitionId[c][partitionNum] - 1;
+            if (corrModel[d] != i)
+                continue;
+
+            m = &modelSettings[d];
+            hmmSites[3*n]   = d;
+            hmmSites[3*n+1] = compCharPos[c] - m->compCharStart;
+            hmmSites[3*n+2] = siteJump[c];
+            n++;
+            }
+        for (d=0; d<numCurrentDivisions; d++)
+            {
+            if (corrModel[d] == i)
+                {
+                modelSettings[d].hmmSiteStart = first;
+                modelSettings[d].numHmmSites = n - first;
+                }
+            }
+        }
+
     /* allocate MarkovTis (space needed for calculations) */
     if (memAllocs[ALLOC_MARKOVTIS] == YES)
         {
@@ -5568,6 +7578,7 @@ int InitAdGamma (void)
         return ERROR;
         }
 
+    markovTiRates = 0;
     for (i=0; i<MAX_SMALL_JUMP; i++)
         {
         if (hasMarkovTi[i] == YES || i == 0)    /* base matrix always needed */
@@ -5673,13 +7684,13 @@ int InitAugmentedModels (void)
         m = &modelSettings[d];
         if (m->gibbsGamma == NO)
                 continue;
-        m->tiIndex = (int *) SafeMalloc (numLocalChains * m->numChars * sizeof (int));
+        m->tiIndex = (int *) SafeCalloc (numLocalChains * m->numChars, sizeof (int));
         if (!m->tiIndex)
             return ERROR;
-        m->catLike = (CLFlt ***) SafeMalloc (numLocalChains * sizeof (CLFlt **));
+        m->catLike = (CLFlt ***) SafeCalloc (numLocalChains, sizeof (CLFlt **));
         if (!m->catLike)
             return ERROR;
-        m->catLnScaler = (CLFlt ***) SafeMalloc (numLocalChains * sizeof (CLFlt **));
+        m->catLnScaler = (CLFlt ***) SafeCalloc (numLocalChains, sizeof (CLFlt **));
         if (!m->catLnScaler)
             return ERROR;
         if (m->pInvar == NULL)
@@ -5888,6 +7899,10 @@ int InitChainCondLikes (void)
             m->numFloatsPerVec = 0;
             }
 
+        /* the Gibbs gamma kernels use SSE with the standard cond like layout */
+        if (m->useBeagle == NO && (m->CondLikeDown == &CondLikeDown_NUC4_GibbsGamma_SSE || m->CondLikeDown == &CondLikeDown_Gen_GibbsGamma_SSE))
+            MrBayesPrint ("%s   Using SSE Gibbs gamma likelihood calculator for division %d (single-precision)\n", spacer, d+1);
+        else
 #   endif
         if (m->useBeagle == NO && m->useVec == VEC_NONE)
             MrBayesPrint ("%s   Using standard non-SSE likelihood calculator for division %d (%s-precision)\n", spacer, d+1, (sizeof(CLFlt) == 4 ? "single" : "double"));
@@ -5924,7 +7939,7 @@ int InitChainCondLikes (void)
                         numReps = m->numRateCats * m->numOmegaCats;
                     k = m->numVecChars * m->numFloatsPerVec * m->numModelStates * numReps;
                     
-                    if (m->useVec == VEC_AVX)
+                    if (m->useVec == VEC_AVX || m->useVec == VEC_FMA)
                         m->condLikes[i] = (CLFlt*) AlignedMalloc (k * sizeof(CLFlt), 32);
                     else
                         m->condLikes[i] = (CLFlt*) AlignedMalloc (k * sizeof(CLFlt), 16);
@@ -6442,6 +8457,11 @@ int InitChainCondLikes (void)
             continue;
 
         i = (m->numModelStates + 1) * m->numModelStates * m->numTiCats;
+#   if defined (SSE_ENABLED)
+        /* the SSE Gibbs gamma kernels keep transposed transition probabilities, padded to four states, here */
+        if (m->gibbsGamma == YES)
+            i = (m->numModelStates + 4) * m->numModelStates * m->numTiCats;
+#   endif
         if (i > j)
             j = i;
         }
@@ -6612,7 +8632,7 @@ int InitInvCondLikes (void)
         if ( m->useVec != VEC_NONE )
             {
             c1 = m->numVecChars * m->numFloatsPerVec * m->numModelStates;
-            if (m->useVec == VEC_AVX)
+            if (m->useVec == VEC_AVX || m->useVec == VEC_FMA)
                 m->invCondLikes = (CLFlt *) AlignedMalloc (c1 * sizeof(CLFlt), 32);
             else
                 m->invCondLikes = (CLFlt *) AlignedMalloc (c1 * sizeof(CLFlt), 16);
@@ -6796,6 +8816,18 @@ int InitParsSets (void)
     /* to represent continuous characters (determines weight of these chars) */
     nParsStatesForCont = 3;
 
+    /* the parsimony starting trees and exhaustive searches may be shared by several threads,
+       except with the parsimony model, which keeps the sets of the chains after those of the nodes */
+    numParsThreads = 1;
+#   if defined (THREADS_ENABLED)
+    numParsThreads = nPThreads;
+    for (d=0; d<numCurrentDivisions; d++)
+        {
+        if (modelSettings[d].parsModelId == YES)
+            numParsThreads = 1;
+        }
+#   endif
+
     /* find number and size of parsimony sets and node lengths */
     for (d=0; d<numCurrentDivisions; d++)
         {
@@ -6817,10 +8849,11 @@ int InitParsSets (void)
         nIntNodes = GetTree(m->brlens,0,0)->nIntNodes;
         nNodes    = GetTree(m->brlens,0,0)->nNodes;
         
-        /* Calculate number of parsimony sets */
+        /* Calculate number of parsimony sets; each thread has its own sets for the interior nodes,
+           offset by numLocalTaxa from those of the previous thread */
         m->numParsSets = numLocalTaxa;
-        if (m->parsimonyBasedMove == YES || !strcmp(chainParams.startTree, "Parsimony"))
-            m->numParsSets += nIntNodes;
+        if (m->parsimonyBasedMove == YES || !strcmp(chainParams.startTree, "Parsimony") || !strcmp(chainParams.startTree, "ML"))
+            m->numParsSets += nIntNodes + (numParsThreads - 1) * numLocalTaxa;
         if (m->parsModelId == YES)
             m->numParsSets += (numLocalChains + 1) * nIntNodes;
 
@@ -7161,6 +9194,71 @@ int InitPrintParams (void)
 }
 
 
+/*------------------------------------------------------------------------
+|
+|   InitSiteLnLs: Set up the site log likelihood arrays, and the sites
+|       printed to the .sitelnl files, if the site likelihoods are sampled
+|       (mcmc pbf=yes)
+|
+-------------------------------------------------------------------------*/
+int InitSiteLnLs (void)
+{
+    int         c, d, i, *isTaken;
+    ModelInfo   *m;
+
+    if (chainParams.calcPbf == NO)
+        return (NO_ERROR);
+
+    /* the calculator stores the site lnLs of each chain state in one of two arrays; see LaunchLogLikeForDivision */
+    for (d=0; d<numCurrentDivisions; d++)
+        {
+        m = &modelSettings[d];
+        if (m->parsModelId == YES || m->correlation != NULL || m->gibbsGamma == YES || m->useBeagle == YES)
+            {
+            MrBayesPrint ("%s   Site likelihoods (pbf=yes) cannot be sampled for division %d, which uses a\n", spacer, d+1);
+            MrBayesPrint ("%s   parsimony or adgamma model, Gibbs sampling of rate categories or Beagle\n", spacer);
+            return (ERROR);
+            }
+        m->siteLnLs = (MrBFlt *) SafeCalloc (2 * numLocalChains * m->numChars, sizeof(MrBFlt));
+        /* like lnLike, the index is copied for all chains by ResetChainIds on proc 0 in the MPI version */
+        m->siteLnLIndex = (int *) SafeCalloc (2 * numGlobalChains, sizeof(int));
+        if (!m->siteLnLs || !m->siteLnLIndex)
+            {
+            MrBayesPrint ("%s   Problem allocating site likelihoods\n", spacer);
+            return (ERROR);
+            }
+        }
+
+    /* one column for each model site, in the order of the characters; doublets and codons are one site */
+    isTaken = (int *) SafeCalloc (numChar, sizeof(int));
+    siteLnLChars = (int *) SafeMalloc (numChar * sizeof(int));
+    if (!isTaken || !siteLnLChars)
+        {
+        MrBayesPrint ("%s   Problem allocating site likelihood characters\n", spacer);
+        free (isTaken);
+        return (ERROR);
+        }
+    numSiteLnLChars = 0;
+    for (c=0; c<numChar; c++)
+        {
+        if (charInfo[c].isExcluded == YES || isTaken[c] == YES)
+            continue;
+        siteLnLChars[numSiteLnLChars++] = c;
+        if (modelSettings[partitionId[c][partitionNum]-1].nCharsPerSite > 1)
+            {
+            for (i=c+1; i<numChar; i++)
+                {
+                if (charInfo[i].charId == charInfo[c].charId)
+                    isTaken[i] = YES;
+                }
+            }
+        }
+    free (isTaken);
+
+    return (NO_ERROR);
+}
+
+
 int IsPFNodeEmpty (PFNODE *p)
 {
     int i;
@@ -7204,20 +9302,106 @@ PFNODE *LargestNonemptyPFNode (PFNODE *p, int *i, int j)
 }
 
 
+/*-----------------------------------------------------------------------
+|
+|   LocalClockTreePriorRatio: Calculate the ln prior ratio on the node
+|       depths of a clock tree from the nodes whose depths differ between
+|       the new and the old tree. This is possible for the birth-death
+|       prior with random sampling, which has one term per interior node,
+|       and for the uniform prior on trees without dated interior nodes,
+|       which only depends on the tree age, provided that the tree age
+|       did not change. Local moves such as Move_NodeSliderClock and
+|       Move_NNIClock then only need the terms of a few nodes, or none.
+|       Returns NO if the prior ratio has to be calculated from the full
+|       prior of both trees.
+|
+------------------------------------------------------------------------*/
+int LocalClockTreePriorRatio (Param *param, int chain, MrBFlt clockRate, MrBFlt *lnPriorRatio)
+{
+    int             i, isBirthDeath;
+    MrBFlt          sR, eR, sF=1.0, lambda=0.0, mu=0.0;
+    Model           *mp;
+    ModelInfo       *m;
+    Tree            *newTree, *oldTree;
+    TreeNode        *p, *q;
+
+    mp = &modelParams[param->relParts[0]];
+    m  = &modelSettings[param->relParts[0]];
+    
+    if (m->clockPrId == CLOCKPR_BIRTHDEATH && m->sampleStratId == SAMPLESTRAT_RANDOM)
+        isBirthDeath = YES;
+    else if (m->clockPrId == CLOCKPR_UNIFORM)
+        isBirthDeath = NO;
+    else
+        return (NO);
+
+    newTree = GetTree (m->brlens, chain, state[chain]);
+    oldTree = GetTree (m->brlens, chain, state[chain] ^ 1);
+
+    /* the terms of the tree age must be the same */
+    if (newTree->nNodes != oldTree->nNodes || newTree->nIntNodes != oldTree->nIntNodes ||
+        newTree->root->left->index != oldTree->root->left->index ||
+        newTree->root->left->nodeDepth != oldTree->root->left->nodeDepth)
+        return (NO);
+
+    if (isBirthDeath == YES)
+        {
+        /* transform to standard variables as in LnBirthDeathPriorPrRandom */
+        sR = *GetParamVals (m->speciationRates, chain, state[chain]);
+        eR = *GetParamVals (m->extinctionRates, chain, state[chain]);
+        sF = mp->sampleProb;
+        lambda = sR / (1.0 - eR);
+        mu     = eR * lambda;
+        if (AreDoublesEqual(lambda, mu, ETA) == YES)
+            return (NO);
+        }
+
+    (*lnPriorRatio) = 0.0;
+    for (i=0; i<newTree->nNodes; i++)
+        {
+        /* the trees are copies of each other, so nodes with the same index are in the same place */
+        p = newTree->nodes + i;
+        q = oldTree->nodes + i;
+        if (p->index != q->index)
+            return (NO);
+        if (p->anc == NULL || p->index == newTree->root->left->index)
+            continue;
+        if (isBirthDeath == NO)
+            {
+            /* any dated node other than the root makes the uniform prior depend on the node depths */
+            if (p->isDated == YES || q->isDated == YES)
+                return (NO);
+            }
+        else if ((p->left == NULL) != (q->left == NULL))
+            return (NO);
+        else if (p->left != NULL && p->nodeDepth != q->nodeDepth)
+            {
+            (*lnPriorRatio) += LnP1Subsample(p->nodeDepth / clockRate, lambda, mu, sF);
+            (*lnPriorRatio) -= LnP1Subsample(q->nodeDepth / clockRate, lambda, mu, sF);
+            }
+        }
+
+    return (YES);
+}
+
+
 /* ln prior ratio for clock trees */
 int LogClockTreePriorRatio (Param *param, int chain, MrBFlt *lnPriorRatio)
 {
-    MrBFlt          oldLnPrior, newLnPrior, theta, N, growth, clockRate, sF, *sR, *eR, *fR;
-    char            *sS;
-    Model           *mp;
+    MrBFlt          clockRate;
     ModelInfo       *m;
     Tree            *newTree, *oldTree;
     TreeNode        *p, *q=NULL;
     int             i, j;
+    MrBFlt          t=0.0;
+#   if defined (DEBUG_CLOCKTREEPRIOR)
+    MrBFlt          fullLnPriorRatio;
+#   endif
 
     (*lnPriorRatio) = 0.0;
+    if (moveTime != NULL)
+        t = ProfileTime ();
     
-    mp = &modelParams[param->relParts[0]];
     m  = &modelSettings[param->relParts[0]];
     
     newTree = GetTree (m->brlens, chain, state[chain]);
@@ -7228,84 +9412,21 @@ int LogClockTreePriorRatio (Param *param, int chain, MrBFlt *lnPriorRatio)
     else
         clockRate = 1.0;
     
-    /* calculate prior ratio on brlens of clock tree */
-    if (!strcmp(mp->clockPr,"Coalescence"))
-        {
-        /* coalescence prior */
-        /* first calculate theta as 4*N*mu, 3*N*mu or 2*N*mu */
-        N = *(GetParamVals (m->popSize, chain, state[chain]));
-        if (!strcmp(mp->ploidy, "Diploid"))
-            theta = 4 * N * clockRate;
-        else if (!strcmp(mp->ploidy, "Zlinked"))
-            theta = 3 * N * clockRate;
-        else
-            theta = 2 * N * clockRate;
-        /* deal with growth */
-        if (!strcmp(mp->growthPr, "Fixed"))
-            growth = mp->growthFix;
-        else
-            growth = *(GetParamVals (m->growthRate, chain, state[chain]));
-        if (LnCoalescencePriorPr (oldTree, &oldLnPrior, theta, growth) == ERROR)
-            {
-            MrBayesPrint ("%s   Problem calculating prior for coalescence process\n", spacer);
-            return (ERROR);
-            }
-        if (LnCoalescencePriorPr (newTree, &newLnPrior, theta, growth) == ERROR)
-            {
-            MrBayesPrint ("%s   Problem calculating prior for coalescence process\n", spacer);
-            return (ERROR);
-            }
-        (*lnPriorRatio) = (newLnPrior - oldLnPrior);
-        }
-    else if (!strcmp(mp->clockPr,"Birthdeath"))
-        {
-        /* birth-death prior */
-        sR = GetParamVals (m->speciationRates, chain, state[chain]);
-        eR = GetParamVals (m->extinctionRates, chain, state[chain]);
-        sS = mp->sampleStrat;
-        sF = mp->sampleProb;
-        if (LnBirthDeathPriorPr (oldTree, clockRate, &oldLnPrior, *sR, *eR, sS, sF) == ERROR)
-            {
-            MrBayesPrint ("%s   Problem calculating prior for birth-death process\n", spacer);
-            return (ERROR);
-            }
-        if (LnBirthDeathPriorPr (newTree, clockRate, &newLnPrior, *sR, *eR, sS, sF) == ERROR)
-            {
-            MrBayesPrint ("%s   Problem calculating prior for birth-death process\n", spacer);
-            return (ERROR);
-            }
-        (*lnPriorRatio) = (newLnPrior - oldLnPrior);
-        }
-    else if (!strcmp(mp->clockPr,"Fossilization"))
+    /* calculate prior ratio on brlens of clock tree, from the changed nodes only if possible */
+    if (LocalClockTreePriorRatio (param, chain, clockRate, lnPriorRatio) == YES)
         {
-        /* fossilized birth-death prior */
-        sR = GetParamVals (m->speciationRates, chain, state[chain]);
-        eR = GetParamVals (m->extinctionRates, chain, state[chain]);
-        fR = GetParamVals (m->fossilizationRates, chain, state[chain]);
-        sF = mp->sampleProb;
-        sS = mp->sampleStrat;
-        if (LnFossilizationPriorPr (oldTree, clockRate, &oldLnPrior, sR, eR, fR, sF, sS) == ERROR)
-            {
-            MrBayesPrint ("%s   Problem calculating prior for fossilized birth-death process\n", spacer);
+#   if defined (DEBUG_CLOCKTREEPRIOR)
+        if (FullClockTreePriorRatio (param, chain, clockRate, &fullLnPriorRatio) == ERROR)
             return (ERROR);
-            }
-        if (LnFossilizationPriorPr (newTree, clockRate, &newLnPrior, sR, eR, fR, sF, sS) == ERROR)
+        if (fabs (fullLnPriorRatio - (*lnPriorRatio)) > 1E-6)
             {
-            MrBayesPrint ("%s   Problem calculating prior for fossilized birth-death process\n", spacer);
+            MrBayesPrint ("%s   ERROR: Local clock tree prior ratio %e differs from full ratio %e\n", spacer, (*lnPriorRatio), fullLnPriorRatio);
             return (ERROR);
             }
-        (*lnPriorRatio) = (newLnPrior - oldLnPrior);
-        }
-    else if (!strcmp(mp->clockPr,"Uniform"))
-        {
-        oldLnPrior = LnUniformPriorPr(oldTree, clockRate);
-        newLnPrior = LnUniformPriorPr(newTree, clockRate);
-        (*lnPriorRatio) = (newLnPrior - oldLnPrior);
-        }
-    else if (!strcmp(mp->clockPr,"Speciestreecoalescence"))
-        {
-        // Defer this calculation to the BEST code
+#   endif
         }
+    else if (FullClockTreePriorRatio (param, chain, clockRate, lnPriorRatio) == ERROR)
+        return (ERROR);
 
     assert (*lnPriorRatio > NEG_INFINITY);
 
@@ -7331,6 +9452,9 @@ int LogClockTreePriorRatio (Param *param, int chain, MrBFlt *lnPriorRatio)
             }
         }
 
+    if (moveTime != NULL)
+        priorTime += ProfileTime () - t;
+
     return (NO_ERROR);
 }
 
@@ -7344,7 +9468,8 @@ MrBFlt LogLike (int chain)
 {
     int             i, d;
     ModelInfo       *m;
-    MrBFlt          chainLnLike, lnL;
+    MrBFlt          chainLnLike, lnL, t=0.0;
+    Tree            *tree;
                         
     /* initialize chain cond like */
     chainLnLike = 0.0;
@@ -7359,28 +9484,67 @@ MrBFlt LogLike (int chain)
     /* Cycle through divisions and recalculate tis and cond likes as necessary. */
     /* Code below does not try to avoid recalculating ti probs for divisions    */
     /* that could share ti probs with other divisions.                          */
+#   if defined (BEST_MPI_ENABLED)
+    /* each processor only fills in the lnLs of its own divisions */
+    for (d=0; d<2*numCurrentDivisions+1; d++)
+        divisionLnLike[d] = 0.0;
+#   endif
+
+    /* Collect the interior nodes that need work once for each tree, so that   */
+    /* the divisions sharing a tree do not have to walk its nodes again.       */
+    for (d=0; d<numCurrentDivisions; d++)
+        GetTree (modelSettings[d].brlens, chain, state[chain])->nTraversal = -1;
+    for (d=0; d<numCurrentDivisions; d++)
+        {
+#   if defined (BEST_MPI_ENABLED)
+        if (isDivisionActive[d] == NO)
+            continue;
+#   endif
+        m = &modelSettings[d];
+        tree = GetTree (m->brlens, chain, state[chain]);
+        if (m->upDateCl == YES && tree->nTraversal < 0 && GetTraversal (tree) == ERROR)
+            {
+            abortMove = YES;
+#   if defined (BEST_MPI_ENABLED)
+            break;              /* the divisions below are skipped, but we still take part in the sum */
+#   else
+            return MRBFLT_NEG_MAX;
+#   endif
+            }
+        }
+
     for (d=0; d<numCurrentDivisions; d++)
         {
-        
 #   if defined (BEST_MPI_ENABLED)
         if (isDivisionActive[d] == NO)
             continue;
 #   endif
         m = &modelSettings[d];
-        if (m->upDateCl == YES) 
+        if (m->upDateCl == YES && abortMove == NO)
             {   
             /* Work has been delegated to a separate function so we can wrap    */
             /* a thread around it                                               */              
+            if (divisionLikeTime != NULL)
+                t = ProfileTime ();
             LaunchLogLikeForDivision(chain, d, &(m->lnLike[2 * chain + state[chain]]));
+            if (divisionLikeTime != NULL)
+                divisionLikeTime[d] += ProfileTime () - t;
             }
+#   if defined (BEST_MPI_ENABLED)
+        /* the other processors are waiting for us in the sum below */
+        if (abortMove == YES)
+            break;
+        divisionLnLike[d] = m->lnLike[2*chain + state[chain]];
+#   else
         if (abortMove == YES)
             return MRBFLT_NEG_MAX;
         chainLnLike += m->lnLike[2*chain + state[chain]];   
+#   endif
         }
         
 
     /* unmark all divisions */
-    if (chainHasAdgamma == YES)
+    if (chainHasAdgamma == YES && abortMove == NO)
         {
         for (d=0; d<numCurrentDivisions; d++)
             {
@@ -7400,14 +9564,22 @@ MrBFlt LogLike (int chain)
             if (m->upDateCl == YES && m->correlation != NULL && m->mark != YES)
                 {
                 lnL = 0.0;
+                if (divisionLikeTime != NULL)
+                    t = ProfileTime ();
                 CalcLikeAdgamma(d, m->correlation, chain, &lnL);
+                if (divisionLikeTime != NULL)
+                    divisionLikeTime[d] += ProfileTime () - t;
 
                 /* store the value for the cases where the HMM is not touched */
                 m->lnLike[2*chain + state[chain]] =  lnL;
                 
                 /* add it to chainLnLike - it was not added above since the division */
                 /* lnL was set to zero after the update call to Likelihood_Adgamma */
+#   if defined (BEST_MPI_ENABLED)
+                divisionLnLike[numCurrentDivisions + d] = lnL;
+#   else
                 chainLnLike += lnL;
+#   endif
                 
                 /* set mark for other divisions in the HMM
                    (i.e., those with the same correlation parameter AND the same shape parameter) */
@@ -7422,10 +9594,61 @@ MrBFlt LogLike (int chain)
             }
         }
 
+#   if defined (BEST_MPI_ENABLED)
+    /* Assemble the division lnLs across processors and add them up in division order,
+       so that the result does not depend on the number of processors */
+    divisionLnLike[2*numCurrentDivisions] = (abortMove == YES ? 1.0 : 0.0);
+    if (MPI_Allreduce (MPI_IN_PLACE, divisionLnLike, 2*numCurrentDivisions+1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD) != MPI_SUCCESS)
+        MrBayesPrint ("%s   Problem assembling division likelihoods\n", spacer);
+    if (divisionLnLike[2*numCurrentDivisions] > 0.0)
+        {
+        abortMove = YES;
+        return MRBFLT_NEG_MAX;
+        }
+    for (d=0; d<2*numCurrentDivisions; d++)
+        chainLnLike += divisionLnLike[d];
+#   endif
+
     return (chainLnLike);   
 }
 
 
+/*-----------------------------------------------------------------
+|
+|   LogLikeTree: log likelihood of the chain after a change to the
+|       touched nodes of tree t, which is not part of an mcmc move.
+|       The new cond likes must be kept or discarded with
+|       AcceptTreeChange before the next change. The division lnLs
+|       of the tree are saved in the unused state of the chain so
+|       that AcceptTreeChange can restore them.
+|
+-----------------------------------------------------------------*/
+MrBFlt LogLikeTree (Tree *t, int chain)
+{
+    int         i;
+    MrBFlt      lnL;
+    ModelInfo   *m;
+
+    for (i=0; i<t->nRelParts; i++)
+        {
+        m = &modelSettings[t->relParts[i]];
+        m->lnLike[2*chain + (state[chain] ^ 1)] = m->lnLike[2*chain + state[chain]];
+        m->upDateCl = YES;
+        }
+
+    /* the likelihood functions take their temporary arrays from the scratch space */
+    ScratchReset ();
+
+    abortMove = NO;
+    lnL = LogLike (chain);
+    if (abortMove == YES)
+        lnL = MRBFLT_NEG_MAX;
+    abortMove = NO;
+
+    return (lnL);
+}
+
+
 MrBFlt LogOmegaPrior (MrBFlt w1, MrBFlt w2, MrBFlt w3)
 {
 
@@ -7519,13 +9742,16 @@ MrBFlt LogDirPrior (Tree *t, ModelParams *mp, int PV)
 }
 
 
+/* Full log prior of the current state of a chain. The run does not recompute it: curLnPr[chain]
+   is updated from the lnPriorRatio of each accepted move and travels with the chain in swaps, so
+   this is called when the chains are initialized and, in debug builds, to check the running value
+   after every move and swap. */
 MrBFlt LogPrior (int chain)
 {
-    int             i, j, c, n, nStates, *nEvents, sumEvents, *ist, nRates, nParts[6];
+    int             i, j, c, n, nStates, *nEvents, sumEvents, *ist, nRates, nParts[6], sS;
     const int       *rateCat;
     MrBFlt          *st, *sst, lnPrior, sum, x, clockRate, theta, popSize, growth, *alphaDir, newProp[190],
                     sF, *sR, *eR, *fR,  freq, pInvar, lambda, sigma, nu, igrvar, **rateMultiplier;
-    char            *sS;
     CLFlt           *nSitesOfPat;
     Param           *p;
     ModelParams     *mp;
@@ -7540,15 +9766,6 @@ MrBFlt LogPrior (int chain)
     for (n=0; n<numParams; n++)
         {
         p = &params[n];
-#   if defined (MPI_BEST_ENABLED)
-        /* We skip all parameters that are not handled on this processor. The scheme used here
-           requires that parameters either be unique to one partition (processor) or that they
-           are shared across all partitions and that the first processor has all the relevant
-           information about that parameter. */
-        if (isDivisionActive[p->relParts[0]] == NO)
-            continue;
-#   endif
-        
         st  = GetParamVals (p, chain, state[chain]);
         sst = GetParamSubVals (p, chain, state[chain]);
         mp = &modelParams[p->relParts[0]];
@@ -7890,13 +10107,8 @@ MrBFlt LogPrior (int chain)
                     /* coalescence prior */
                     popSize   = *(GetParamVals (m->popSize, chain, state[chain]));
                     clockRate = *(GetParamVals (m->clockRate, chain, state[chain]));
-                    if (strcmp(mp->ploidy, "Diploid") == 0)
-                        theta = 4.0 * popSize * clockRate;
-                    else if (strcmp(mp->ploidy, "Zlinked") == 0)
-                        theta = 3.0 * popSize * clockRate;
-                    else
-                        theta = 2.0 * popSize * clockRate;
-                    if (!strcmp(mp->growthPr, "Fixed"))
+                    theta = m->ploidyFactor * popSize * clockRate;
+                    if (m->isGrowthFixed == YES)
                         growth = mp->growthFix;
                     else
                         growth = *(GetParamVals (m->growthRate, chain, state[chain]));
@@ -7911,7 +10123,7 @@ MrBFlt LogPrior (int chain)
                     /* birth-death prior */
                     sR = GetParamVals (m->speciationRates, chain, state[chain]);
                     eR = GetParamVals (m->extinctionRates, chain, state[chain]);
-                    sS = mp->sampleStrat;
+                    sS = m->sampleStratId;
                     sF = mp->sampleProb;
                     if (m->clockRate != NULL)
                         clockRate = *(GetParamVals (m->clockRate, chain, state[chain]));
@@ -7930,7 +10142,7 @@ MrBFlt LogPrior (int chain)
                     eR = GetParamVals (m->extinctionRates, chain, state[chain]);
                     fR = GetParamVals (m->fossilizationRates, chain, state[chain]);
                     sF = mp->sampleProb;
-                    sS = mp->sampleStrat;
+                    sS = m->sampleStratId;
                     if (m->clockRate != NULL)
                         clockRate = *(GetParamVals (m->clockRate, chain, state[chain]));
                     else
@@ -8194,27 +10406,21 @@ MrBFlt LogPrior (int chain)
         }
     assert (lnPrior == lnPrior);
 
-#   if defined (BEST_MPI_ENABLED)
-    /* Assemble prior probabilities across processors */
-    myLnPrior = lnPrior;
-    MPI_AllReduce (&myLnPrior, &lnPrior, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-#   endif
-
     return (lnPrior);
 }
 
 
-int LnBirthDeathPriorPr (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt sR, MrBFlt eR, char *sS, MrBFlt sF)
+int LnBirthDeathPriorPr (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt sR, MrBFlt eR, int sS, MrBFlt sF)
 {
-    if (!strcmp(sS, "Random")) 
+    if (sS == SAMPLESTRAT_RANDOM)
         {
         return LnBirthDeathPriorPrRandom (t, clockRate, prob, sR, eR, sF);
         }
-    else if (!strcmp(sS, "Diversity")) 
+    else if (sS == SAMPLESTRAT_DIVERSITY)
         {
         return LnBirthDeathPriorPrDiversity (t, clockRate, prob, sR, eR, sF);
         }
-    else if (!strcmp(sS, "Cluster")) 
+    else if (sS == SAMPLESTRAT_CLUSTER)
         {
         return LnBirthDeathPriorPrCluster (t, clockRate, prob, sR, eR, sF);
         }
@@ -8284,8 +10490,8 @@ int LnBirthDeathPriorPrRandom (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt s
         return (ERROR);
         }
 
-    /* allocate space for the speciation times */
-    nt = (MrBFlt *)SafeMalloc((size_t)(t->nIntNodes) * sizeof(MrBFlt));
+    /* get space for the speciation times */
+    nt = (MrBFlt *) ScratchCalloc (t->nIntNodes, sizeof (MrBFlt));
     if (!nt)
         {
         MrBayesPrint ("\n   ERROR: Problem allocating nt\n");
@@ -8317,9 +10523,6 @@ int LnBirthDeathPriorPrRandom (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt s
     if (t->root->left->isDated == NO)
         (*prob) += mp->treeAgePr.LnPriorProb(tmrca, mp->treeAgePr.priorParams);
 
-    /* free memory */
-    free (nt);
-    
     return (NO_ERROR);
 }
 
@@ -8351,8 +10554,8 @@ int LnBirthDeathPriorPrDiversity (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFl
         return (ERROR);
         }
 
-    /* allocate space for the speciation times */
-    nt = (MrBFlt *)SafeMalloc((size_t)(t->nIntNodes) * sizeof(MrBFlt));
+    /* get space for the speciation times */
+    nt = (MrBFlt *) ScratchCalloc (t->nIntNodes, sizeof (MrBFlt));
     if (!nt)
         {
         MrBayesPrint ("\n   ERROR: Problem allocating nt\n");
@@ -8392,9 +10595,6 @@ int LnBirthDeathPriorPrDiversity (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFl
     if (t->root->left->isDated == NO)
         (*prob) += mp->treeAgePr.LnPriorProb(tmrca, mp->treeAgePr.priorParams);
 
-    /* free memory */
-    free (nt);
-    
     return (NO_ERROR);
 }
 
@@ -8426,8 +10626,8 @@ int LnBirthDeathPriorPrCluster (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt
         return (ERROR);
         }
 
-    /* allocate space for the speciation times */
-    nt = (MrBFlt *)SafeMalloc((size_t)(t->nIntNodes) * sizeof(MrBFlt));
+    /* get space for the speciation times */
+    nt = (MrBFlt *) ScratchCalloc (t->nIntNodes, sizeof (MrBFlt));
     if (!nt)
         {
         MrBayesPrint ("\n   ERROR: Problem allocating nt\n");
@@ -8467,9 +10667,6 @@ int LnBirthDeathPriorPrCluster (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt
     if (t->root->left->isDated == NO)
         (*prob) += mp->treeAgePr.LnPriorProb(tmrca, mp->treeAgePr.priorParams);
 
-    /* free memory */
-    free (nt);
-    
     return (NO_ERROR);
 }
 
@@ -8610,20 +10807,20 @@ MrBFlt  LnPi_fossil (MrBFlt t, MrBFlt *t_f, int sl, MrBFlt *c1, MrBFlt *c2, MrBF
 }
 
 
-int LnFossilizationPriorPr (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt *sR, MrBFlt *eR, MrBFlt *fR, MrBFlt sF, char *sS)
+int LnFossilizationPriorPr (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt *sR, MrBFlt *eR, MrBFlt *fR, MrBFlt sF, int sS)
 {
     /* fossilization priors 
      //chi */
     
-    if (!strcmp(sS, "FossilTip"))
+    if (sS == SAMPLESTRAT_FOSSILTIP)
         return LnFossilizedBDPriorFossilTip (t, clockRate, prob, sR, eR, fR, sF);
-    else if (!strcmp(sS, "Random"))
+    else if (sS == SAMPLESTRAT_RANDOM)
         return LnFossilizedBDPriorRandom    (t, clockRate, prob, sR, eR, fR, sF);
-    else if (!strcmp(sS, "Diversity"))
+    else if (sS == SAMPLESTRAT_DIVERSITY)
         return LnFossilizedBDPriorDiversity (t, clockRate, prob, sR, eR, fR, sF);
     else
         {
-        MrBayesPrint ("%s   Sampling strategy %s for fossilized birth-death process not implemented\n", spacer, sS);
+        MrBayesPrint ("%s   Sampling strategy for fossilized birth-death process not implemented\n", spacer);
         return (ERROR);
         }
 }
@@ -8805,7 +11002,7 @@ int LnFossilizedBDPriorRandom (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt *
     /* Fossils are sampled with piecewise constant rates in the past.
        Extant taxa are sampled uniformly at random at present. */
     
-    int         i, j, i1, i2, i3,  sl,  K, M, E;
+    int         i, j, i1, i2, i3,  sl,  K, M, E, nShifts;
     MrBFlt      x, tmrca, *t_f, *lambda, *mu, *psi, *rho, *netDiver, *turnOver, *sampProp, *c1, *c2, *p_t;
     TreeNode    *p;
     Model       *mp;
@@ -8815,8 +11012,9 @@ int LnFossilizedBDPriorRandom (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt *
     /* time of most recent common ancestor */
     tmrca = t->root->left->nodeDepth / clockRate;
     
-    /* alloc memory for time of each shift, t_f[sl] = 0 */
-    t_f = (MrBFlt *)SafeMalloc((size_t)(mp->fossilSamplingNum + mp->birthRateShiftNum + mp->deathRateShiftNum +1) * sizeof(MrBFlt));
+    /* get workspace for time of each shift, t_f[sl] = 0, and for the other parameters */
+    nShifts = mp->fossilSamplingNum + mp->birthRateShiftNum + mp->deathRateShiftNum +1;
+    t_f = (MrBFlt *) ScratchCalloc (11 * nShifts, sizeof (MrBFlt));
     if (!t_f)
         {
         MrBayesPrint ("%s   ERROR: Problem allocating t_f in LnFossilizedBDPriorRandom\n", spacer);
@@ -8828,23 +11026,17 @@ int LnFossilizedBDPriorRandom (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt *
     t_f[sl] = 0.0;
     assert (t_f[0] < tmrca);
 
-    /* alloc memory for the other parameters */
-    lambda   = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    mu       = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    psi      = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    rho      = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    netDiver = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    turnOver = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    sampProp = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    c1       = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    c2       = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    p_t      = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    if (!lambda || !mu || !psi || !rho || !netDiver || !turnOver || !sampProp || !c1 || !c2 || !p_t)
-        {
-        MrBayesPrint ("%s   ERROR: Problem allocating memory in LnFossilizedBDPriorRandom\n", spacer);
-        free(lambda); free(mu); free(psi); free(rho); free(netDiver); free(turnOver); free(sampProp); free(c1); free(c2); free(p_t);
-        return (ERROR);
-        }
+    /* the other parameters follow t_f in the workspace (sl+1 <= nShifts) */
+    lambda   = t_f + nShifts;
+    mu       = lambda + nShifts;
+    psi      = mu + nShifts;
+    rho      = psi + nShifts;
+    netDiver = rho + nShifts;
+    turnOver = netDiver + nShifts;
+    sampProp = turnOver + nShifts;
+    c1       = sampProp + nShifts;
+    c2       = c1 + nShifts;
+    p_t      = c2 + nShifts;
     
     /* initialization */
     i1 = i2 = i3 = 0;
@@ -8969,10 +11161,6 @@ int LnFossilizedBDPriorRandom (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt *
     printf ("prob=%lf\n", *prob);
 #   endif
     
-    /* free memory */
-    free(t_f);
-    free(lambda); free(mu); free(psi); free(rho); free(netDiver); free(turnOver); free(sampProp); free(c1); free(c2); free(p_t);
-    
     return (NO_ERROR);
 }
 
@@ -8990,7 +11178,7 @@ int LnFossilizedBDPriorDiversity (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFl
     /* Fossils are sampled with piecewise constant rates in the past.
        Extant taxa are sampled with prop sF to maximize diversity. */
     
-    int         i, j, i1, i2, i3,  sl,  K, M, E;
+    int         i, j, i1, i2, i3,  sl,  K, M, E, nShifts;
     MrBFlt      x, tmrca, *t_f, x_cut, M_x, *lambda, *mu, *psi, *rho, *netDiver, *turnOver, *sampProp, *c1, *c2, *p_t;
     TreeNode    *p;
     Model       *mp;
@@ -9000,8 +11188,9 @@ int LnFossilizedBDPriorDiversity (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFl
     /* time of most recent common ancestor */
     tmrca = t->root->left->nodeDepth / clockRate;
     
-    /* alloc memory for time of each shift, t_f[sl] = 0, t_f[sl-1] = x_cut */
-    t_f = (MrBFlt *)SafeMalloc((size_t)(mp->fossilSamplingNum + mp->birthRateShiftNum + mp->deathRateShiftNum +2) * sizeof(MrBFlt));
+    /* get workspace for time of each shift, t_f[sl] = 0, t_f[sl-1] = x_cut, and for the other parameters */
+    nShifts = mp->fossilSamplingNum + mp->birthRateShiftNum + mp->deathRateShiftNum +2;
+    t_f = (MrBFlt *) ScratchCalloc (11 * nShifts, sizeof (MrBFlt));
     if (!t_f)
         {
         MrBayesPrint ("%s   ERROR: Problem allocating t_f in LnFossilizedBDPriorDiversity\n", spacer);
@@ -9032,23 +11221,17 @@ int LnFossilizedBDPriorDiversity (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFl
     t_f[sl-1] = x_cut * 0.95;  // x_cut
     assert (t_f[0] < tmrca);
 
-    /* alloc memory for the other parameters */
-    lambda   = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    mu       = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    psi      = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    rho      = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    netDiver = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    turnOver = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    sampProp = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    c1       = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    c2       = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    p_t      = (MrBFlt *)SafeMalloc((size_t)(sl+1) * sizeof(MrBFlt));
-    if (!lambda || !mu || !psi || !rho || !netDiver || !turnOver || !sampProp || !c1 || !c2 || !p_t)
-        {
-        MrBayesPrint ("%s   ERROR: Problem allocating memory in LnFossilizedBDPriorDiversity\n", spacer);
-        free(lambda); free(mu); free(psi); free(rho); free(netDiver); free(turnOver); free(sampProp); free(c1); free(c2); free(p_t);
-        return (ERROR);
-        }
+    /* the other parameters follow t_f in the workspace (sl+1 <= nShifts) */
+    lambda   = t_f + nShifts;
+    mu       = lambda + nShifts;
+    psi      = mu + nShifts;
+    rho      = psi + nShifts;
+    netDiver = rho + nShifts;
+    turnOver = netDiver + nShifts;
+    sampProp = turnOver + nShifts;
+    c1       = sampProp + nShifts;
+    c2       = c1 + nShifts;
+    p_t      = c2 + nShifts;
     
     /* initialization */
     i1 = i2 = i3 = 0;
@@ -9182,10 +11365,6 @@ int LnFossilizedBDPriorDiversity (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFl
     printf ("prob=%lf\n", *prob);
 #   endif
     
-    /* free memory */
-    free(t_f);
-    free(lambda); free(mu); free(psi); free(rho); free(netDiver); free(turnOver); free(sampProp); free(c1); free(c2); free(p_t);
-    
     return (NO_ERROR);
 }
 
@@ -9251,8 +11430,8 @@ int LnCoalescencePriorPr (Tree *t, MrBFlt *prob, MrBFlt theta, MrBFlt growth)
     MrBFlt          *ct, tempD, lastCoalescenceTime, coalescenceTime, intervalLength;
     TreeNode        *p;
 
-    /* allocate space for the coalescence times */
-    ct = (MrBFlt *)SafeMalloc((size_t)(t->nIntNodes) * sizeof(MrBFlt));
+    /* get space for the coalescence times */
+    ct = (MrBFlt *) ScratchCalloc (t->nIntNodes, sizeof (MrBFlt));
     if (!ct)
         {
         MrBayesPrint ("\n   ERROR: Problem allocating ct\n");
@@ -9309,9 +11488,6 @@ int LnCoalescencePriorPr (Tree *t, MrBFlt *prob, MrBFlt theta, MrBFlt growth)
 
     /* printf ("coal pr = %lf theta = %lf, nNodes = %d, nt = %d tempD = %lf\n", *prob, theta, nNodes, numLocalTaxa, tempD); */
 
-    /* free memory */
-    free (ct);
-    
     return (NO_ERROR);
 }
 
@@ -9349,8 +11525,8 @@ int LnCoalescencePriorPr (Tree *t, MrBFlt *prob, MrBFlt theta, MrBFlt growth)
 ---------------------------------------------------------------------------------*/
 MrBFlt LnUniformPriorPr (Tree *t, MrBFlt clockRate)
 {
-    int         i, j, k, *nLineages=NULL, nDatedTips, nLineagesIn, nLineagesOut, nTips;
-    MrBFlt      lnProb, treeAge, *nodeDepths=NULL;
+    int         i, j, k, *nLineages, nDatedTips, nLineagesIn, nLineagesOut, nTips;
+    MrBFlt      lnProb, treeAge, *nodeDepths;
     TreeNode    *p, *root;
     Model       *mp;
 
@@ -9397,6 +11573,10 @@ MrBFlt LnUniformPriorPr (Tree *t, MrBFlt clockRate)
     i = 0;
     ColorClusters (t->root->left, &i);
 
+    /* Allocate space for node depths and lineage counts; no subtree has more dated tips than the tree has nodes */
+    nodeDepths = (MrBFlt *) ScratchCalloc (t->nNodes+1, sizeof(MrBFlt));
+    nLineages = (int *) ScratchCalloc (t->nNodes, sizeof(int));
+
     /* Get the probability for each subtree */
     for (i=0; i<t->nIntNodes; i++)
         {
@@ -9411,9 +11591,7 @@ MrBFlt LnUniformPriorPr (Tree *t, MrBFlt clockRate)
 
         /* Create an array containing the sorted times */
 
-        /* Allocate space for node depths */
         nDatedTips = NumDatedTips (root);
-        nodeDepths = (MrBFlt *) SafeRealloc ((void *)nodeDepths, (nDatedTips+1)*sizeof(MrBFlt));
 
         /* Get the dated node depths and sort them. The call to GetDatedNodeDepths also
            returns the root node depth into nodeDepths, which is convenient. For now, this
@@ -9429,7 +11607,6 @@ MrBFlt LnUniformPriorPr (Tree *t, MrBFlt clockRate)
         /* Get probability due to sorting of interior node depths */
         
         /* First get the potential number of lineages leaving each interval j at time nodeDepths[j+1] */
-        nLineages = (int *) SafeRealloc ((void *)nLineages, nDatedTips*sizeof(int));
         for (j=0; j<nDatedTips; j++)
             nLineages[j] = j+1;
         
@@ -9481,9 +11658,6 @@ MrBFlt LnUniformPriorPr (Tree *t, MrBFlt clockRate)
 
         }
 
-    free (nodeDepths);
-    free (nLineages);
-
     assert (lnProb > NEG_INFINITY);
 
     return lnProb;
@@ -9495,356 +11669,68 @@ MrBFlt LnUniformPriorPr (Tree *t, MrBFlt clockRate)
 |   NewtonRaphsonBrlen: Find one maximum likelihood branch length using
 |      the Newton-Raphson method. This function assumes that the tree is
 |      a non-clock tree. For clock trees, you have to optimize the node
-|      depths instead.
+|      depths instead. The same conditions as for GetBrlenDerivs apply;
+|      on return, p->length is the new branch length but the ti probs
+|      and cond likes still refer to the old one.
 |
 ------------------------------------------------------------------------*/
 int NewtonRaphsonBrlen (Tree *t, TreeNode *p, int chain)
 {
-    int         c, i, j, s, k, n, d, division, nIterations, maxNumIterations,
-                index, *rateCat, r;
-    MrBFlt      vOld, *pi, *cijk, *eigenValues, *catRate, baseRate, length, theRate, tolerance,
-                expLambdaV[64], pInvar=0.0, likeI=0.0, sum=0.0, sum1, sum2, beta, w, v, x, y, expBetaV,
-                expWV, kappa, bigPi, *ptr;
-    CLFlt       *nSitesOfPat, *clP, *clA, *tiP, *tiP1, *tiP2, like, like1, like2, CLsum, CLsum1, CLsum2,
-                freq, sumLike1, sumLike2, *lnScaler=NULL, *clInvar=NULL;
-    ModelInfo   *m;
-
-    /* TODO: Standard model (also check RES for ascertainment bias) */
-    tolerance = 0.001;
-    maxNumIterations = 5;
-    
-    nIterations = 0;
-    do {
-        /* reset f'(v) and f''(v) sums */
-        sumLike1 = sumLike2 = 0.0;
-        
-        /* cycle over character partitions */
-        for (d=0; d<t->nRelParts; d++)
-            {
-            division = t->relParts[d];
-
-            /* get pointer to model */
-            m = &modelSettings[division];
-            
-            /* get number of model states */
-            n = m->numModelStates;
-            
-            /* find conditional likelihoods */
-            clP = m->condLikes[m->condLikeIndex[chain][p->index     ]];
-            clA = m->condLikes[m->condLikeIndex[chain][p->anc->index]];
-            
-            /* get state frequencies */
-            pi = GetParamSubVals (m->stateFreq, chain, state[chain]);
-    
-            /* get base rate */
-            theRate = 1.0;
-            baseRate = GetRate (division, chain);
-
-            /* get category rates */
-            if (m->shape == NULL)
-                catRate = &theRate;
-            else
-                catRate = GetParamSubVals (m->shape, chain, state[chain]);
-    
-            /* find category frequencies and some additional stuff for the invar model */
-            if (m->pInvar == NULL)
-                freq =  (CLFlt) (1.0 /  m->numRateCats);
-            else
-                {
-                /* invariable sites model */
-                pInvar = * GetParamVals(m->pInvar, chain, state[chain]);
-                freq = (CLFlt) ((1.0 - pInvar) /  m->numRateCats);
-                baseRate /= (1.0 - pInvar);
-                clInvar = m->invCondLikes;
-                lnScaler = m->scalers[m->siteScalerIndex[chain]];
-                }
-
-            /* find the branch lengths times any correction factor to make them
-               in terms of expected number of substitutions per character */
-            length = p->length;
-            if (m->dataType == DNA || m->dataType == RNA)
-                {
-                if (m->nucModelId == NUCMODEL_DOUBLET)
-                    length *= 2.0;
-                else if (m->nucModelId == NUCMODEL_CODON)
-                    length *= 3.0;
-                }
-
-            /* find nSitesOfPat */
-            nSitesOfPat = numSitesOfPat + ((chainId[chain] % chainParams.numChains)*numCompressedChars) + m->compCharStart;
-            
-            /* get tiProbs for current length; use the scratch location */
-            FlipTiProbsSpace(m, chain, p->index);
-            m->TiProbs (p, division, chain);
-            tiP = m->tiProbs[m->tiProbsIndex[chain][p->index]];
-            FlipTiProbsSpace(m, chain, p->index);
-
-            /* allocate space for first and second derivatives */
-            tiP1 = (CLFlt *) SafeCalloc (2*m->tiProbLength, sizeof (CLFlt));
-            if (!tiP1)
-                return (ERROR);
-            tiP2 = tiP1 + m->tiProbLength;
-            
-            /* calculate first and second derivatives of P(v): P'(v) and P''(v) */
-            index = 0;
-            if (m->TiProbs == &TiProbs_Fels || m->TiProbs == &TiProbs_Res)
-                {
-                /* calculate beta */
-                sum = 0.0;
-                for (i=0; i<m->numModelStates; i++)
-                    for (j=i+1; j<m->numModelStates; j++)
-                        sum += pi[i]*pi[j];
-                beta = 0.5 / sum;
+    int         nIterations, maxNumIterations;
+    MrBFlt      v, vBest, step, tolerance, lnL, lnLBest, d1, d2;
 
-                /* calculate derivatives */
-                for (k=0; k<m->numRateCats; k++)
-                    {
-                    v = length * catRate[k] * baseRate;
-                    expBetaV = exp (- beta * v);
-                    for (i=0; i<m->numModelStates; i++)
-                        {
-                        for (j=0; j<m->numModelStates; j++)
-                            {
-                            if (i == j)
-                                {
-                                x = - beta * (1.0 - pi[j]) * expBetaV;
-                                tiP1[index] = (CLFlt) x;
-                                tiP2[index] = (CLFlt) (- beta * x);
-                                }
-                            else
-                                {
-                                x = beta * pi[j] * expBetaV;
-                                tiP1[index] = (CLFlt) x;
-                                tiP2[index] = (CLFlt) (- beta * x);
-                                }
-                            index++;
-                            }
-                        }
-                    }
-                }
-            else if (m->TiProbs == &TiProbs_Hky)
-                {
-                /* get kappa */
-                kappa =  *GetParamVals (m->tRatio, chain, state[chain]);
-    
-                /* calculate beta */
-                sum = 0.0;
-                for (i=0; i<m->numModelStates; i++)
-                    {
-                    for (j=i+1; j<m->numModelStates; j++)
-                        {
-                        if (j - i == 2)
-                            sum += kappa * pi[i] * pi[j];
-                        else
-                            sum += pi[i] * pi[j];
-                        }
-                    }
-                beta = 0.5 / sum;
+    if (t->isRooted == YES || t->isClock == YES)
+        {
+        MrBayesPrint ("%s   Newton-Raphson branch lengths need an unrooted non-clock tree\n", spacer);
+        return (ERROR);
+        }
 
-                /* calculate derivatives */
-                for (k=0; k<m->numRateCats; k++)
-                    {
-                    v = length * catRate[k] * baseRate;
-                    expBetaV = exp (- beta * v);
-                    for (i=0; i<m->numModelStates; i++)
-                        {
-                        for (j=0; j<m->numModelStates; j++)
-                            {
-                            s = (j + 2) % 4;
-                            bigPi = pi[j] + pi[s];
-                            w = (1.0 + bigPi * (kappa - 1.0)) * beta;
-                            expWV = exp (- w * v);
-                            if (i == j)
-                                {
-                                x = - beta * ((pi[j]/bigPi) - pi[j]) * expBetaV;
-                                y = - w * (pi[s]/bigPi) * expWV;
-                                tiP1[index] = (CLFlt) (x + y);
-                                tiP2[index] = (CLFlt) (- beta * x - w * y);
-                                }
-                            else if (abs(i-j) == 2)
-                                {
-                                x = - beta * pi[j] * ((pi[j]/bigPi) - pi[j]) * expBetaV;
-                                y = w * (pi[j]/bigPi) * expWV;
-                                tiP1[index] = (CLFlt) (x + y);
-                                tiP2[index] = (CLFlt) (- beta * x - w * y);
-                                }
-                            else
-                                {
-                                x = beta * pi[j] * expBetaV;
-                                tiP1[index] = (CLFlt) x;
-                                tiP2[index] = (CLFlt) (- beta * x);
-                                }
-                            index++;
-                            }
-                        }
-                    }
-                }
-            else if (m->TiProbs == &TiProbs_Gen || m->TiProbs == &TiProbs_GenCov)
-                {
-                /* get eigenvalues and cijk pointers */
-                eigenValues = m->cijks[m->cijkIndex[chain]];
-                cijk        = eigenValues + (2 * n);
+    tolerance = 1E-6;
+    maxNumIterations = 20;
 
-                /* calculate P'(v) and P''(v) */
-                for (k=0; k<m->numRateCats; k++)
-                    {
-                    v = length * catRate[k];
-                    for (s=0; s<n; s++)
-                        expLambdaV[s] =  exp(eigenValues[s] * v);
-                    ptr = cijk;
-                    for (i=0; i<n; i++)
-                        {
-                        for (j=0; j<n; j++)
-                            {
-                            sum1 = sum2 = 0.0;
-                            for (s=0; s<n; s++)
-                                {
-                                if (fabs(eigenValues[s]) > 0.000001)
-                                    {
-                                    x = eigenValues[s] * (*ptr++) * expLambdaV[s];
-                                    sum1 += x;
-                                    sum2 += eigenValues[s] * x;
-                                    }
-                                else
-                                    ptr += n;
-                                }
-                            tiP1[index] = (CLFlt) ((sum1 < 0.0) ? 0.0 : sum);
-                            tiP2[index] = (CLFlt) ((sum2 < 0.0) ? 0.0 : sum);
-                            index++;
-                            }
-                        }
-                    }
-                }
-            else if (m->TiProbs == &TiProbs_GenCov)
-                {
-                /* get eigenvalues and cijk pointers */
-                eigenValues = m->cijks[m->cijkIndex[chain]];
-                cijk        = eigenValues + (2 * n);
+    /* compare the derivatives with central differences if requested */
+    if (chainParams.checkBrlenDerivs == YES && CheckBrlenDerivs (t, p, chain) == ERROR)
+        return (ERROR);
 
-                /* calculate P'(v) and P''(v) */
-                for (k=0; k<m->numTiCats; k++)
-                    {
-                    if (m->numRateCats > 1)
-                        v = length * catRate[k];
-                    else
-                        v = length;
-                    for (s=0; s<n; s++)
-                        expLambdaV[s] =  exp(eigenValues[s] * v);
-                    for (i=0; i<n; i++)
-                        {
-                        for (j=0; j<n; j++)
-                            {
-                            sum1 = sum2 = 0.0;
-                            for (s=0; s<n; s++)
-                                {
-                                if (fabs(eigenValues[s]) > 0.000001)
-                                    {
-                                    x = eigenValues[s] * (*cijk++) * expLambdaV[s];
-                                    sum1 += x;
-                                    sum2 += eigenValues[s] * x;
-                                    }
-                                }
-                            tiP1[index] = (CLFlt) ((sum1 < 0.0) ? 0.0 : sum);
-                            tiP2[index] = (CLFlt) ((sum2 < 0.0) ? 0.0 : sum);
-                            index++;
-                            }
-                        }
-                    /* get new eigenvalues and cijks */
-                    eigenValues += m->cijkLength / m->nCijkParts;
-                    cijk         = eigenValues + 2 * n;
-                    }
-                }
-            /* calculate f(v), f'(v) and f''(v) for this partition */
-            /* note that the scalers are irrelevant because they disappear when
-               we take the derivative of the log likelihood */
-            if (m->gibbsGamma == YES)
-                {
-                /* find rate category index */
-                rateCat = m->tiIndex + chain*m->numChars;
-                for (c=0; c<m->numChars; c++)
-                    {
-                    like = like1 = like2 = 0.0;
-                    r = rateCat[c];
-                    if (r < m->numRateCats)
-                        {
-                        index = r*m->numModelStates*m->numModelStates;
-                        for (j=0; j<n; j++)
-                            {
-                            CLsum = CLsum1 = CLsum2 = 0.0;
-                            for (i=0; i<n; i++, index++)
-                                {
-                                CLsum += clP[i] * tiP[index];
-                                CLsum1 += clP[i] * tiP1[index];
-                                CLsum2 += clP[i] * tiP2[index];
-                                }
-                            like += CLsum * (CLFlt) pi[j] * clA[j];
-                            like1 += CLsum1 * (CLFlt) pi[j] * clA[j];
-                            like2 += CLsum2 * (CLFlt) pi[j] * clA[j];
-                            }
-                        like *= freq;
-                        sumLike1 += nSitesOfPat[c] * (like1 / like);
-                        sumLike2 += nSitesOfPat[c] * (like2 * like - like1 * like1) / (like * like);
-                        }
-                    clP += n;
-                    }
-                }
-            else
-                {
-                for (c=0; c<m->numChars; c++)
-                    {
-                    like = like1 = like2 = 0.0;
-                    index = 0;
-                    for (k=0; k<m->numTiCats; k++)
-                        {
-                        for (j=0; j<n; j++)
-                            {
-                            CLsum = CLsum1 = CLsum2 = 0.0;
-                            for (i=0; i<n; i++, index++)
-                                {
-                                CLsum += clP[i] * tiP[index];
-                                CLsum1 += clP[i] * tiP1[index];
-                                CLsum2 += clP[i] * tiP2[index];
-                                }
-                            like += CLsum * (CLFlt) pi[j] * clA[j];
-                            like1 += CLsum1 * (CLFlt) pi[j] * clA[j];
-                            like2 += CLsum2 * (CLFlt) pi[j] * clA[j];
-                            }
-                        clP += n;
-                        }
-                    like *= freq;
-                    if (m->pInvar != NULL)
-                        {
-                        /* get right like; like1 and like2 not affected */;
-                        for (i=0; i<n; i++)
-                            likeI += (*clInvar++) * pi[i];
-                        likeI *= pInvar;
-                        if (lnScaler[c] < -200.0)
-                            {
-                            /* we are not going to be able to exponentiate the scaling factor */
-                            if (likeI > 1E-70)
-                                {
-                                /* forget about like; it is going to be insignificant compared to likeI */
-                                like = (CLFlt) likeI;
-                                }
-                            else
-                                {
-                                /* treat likeI as if 0.0, that is, ignore it completely */
-                                like = like + (CLFlt)(0.0);
-                                }
-                            }
-                        else    /* take both likeI and like into account */
-                            like = like + (CLFlt) (likeI * exp (-lnScaler[c]));
-                        }
-                    sumLike1 += nSitesOfPat[c] * (like1 / like);
-                    sumLike2 += nSitesOfPat[c] * (like2 * like - like1 * like1) / (like * like);
-                    }
-                }
-            free (tiP1);
+    /* Newton-Raphson steps, halving the step if the likelihood drops and
+       moving by a factor of two where the likelihood is not concave */
+    v = vBest = p->length;
+    lnLBest = MRBFLT_NEG_MAX;
+    step = 0.0;
+    for (nIterations=0; nIterations<maxNumIterations; nIterations++)
+        {
+        p->length = v;
+        if (GetBrlenDerivs (t, p, chain, &lnL, &d1, &d2) == ERROR)
+            {
+            p->length = vBest;
+            return (ERROR);
+            }
+        if (lnL < lnLBest)
+            {
+            step /= 2.0;
+            v = vBest + step;
+            if (fabs (step) < tolerance)
+                break;
+            continue;
             }
-        vOld = p->length;
-        p->length -= sumLike2 / sumLike1;
-        nIterations++;
-        } while (fabs(p->length - vOld) > tolerance && nIterations < maxNumIterations);
+        vBest = v;
+        lnLBest = lnL;
+        if (d2 < 0.0)
+            step = - d1 / d2;
+        else if (d1 > 0.0)
+            step = v;
+        else
+            step = - v / 2.0;
+        v += step;
+        if (v < BRLENS_MIN)
+            v = BRLENS_MIN;
+        else if (v > BRLENS_MAX)
+            v = BRLENS_MAX;
+        step = v - vBest;
+        if (fabs (step) < tolerance)
+            break;
+        }
+    p->length = vBest;
 
     return (NO_ERROR);
 }
@@ -9968,209 +11854,344 @@ FILE *OpenNewMBPrintFile (char *fileName)
             else
                 {
                 MrBayesPrint ("%s   Appending to file \"%s\"\n", spacer, fileName);
-                return (OpenTextFileA(fileName));
-                }
-            }
-
-        else
-            {
-            /* file is not present */
-            return (OpenTextFileW(fileName));
-            }
-        }
-}
-
-
-int PickProposal (RandLong *seed, int chainIndex)
-{
-    MrBFlt      ran;
-    int         i;
-
-    ran = RandomNumber(seed);
-    
-    for (i=0; usedMoves[i]->cumProposalProb[chainIndex] <= ran; i++);
-        
-    return i;
-}
-
-
-/* Calculate positive selection probabilities */
-int PosSelProbs (TreeNode *p, int division, int chain)
-{
-    int             c, j, k, nStates;
-    MrBFlt          catLike, *like, *bs, *omegaCatFreq, *omega,
-                    posProb, *ps, sum;
-    CLFlt           **clP;
-    ModelInfo       *m;
-    
-    /* find model partition */
-    m = &modelSettings[division];
-
-    /* allocate space for conditional likelihood pointer array and site likelihood array */
-    clP  = (CLFlt **) calloc (m->numOmegaCats, sizeof(CLFlt *));
-    like = (MrBFlt *) calloc (m->numOmegaCats, sizeof(MrBFlt));
-    if (!clP || !like)
-        {
-        MrBayesPrint ("%s   ERROR: Out of memory in PosSelProbs\n", spacer);
-        free (clP);
-        free (like);
-        return (ERROR);
-        }
-    
-    /* number of states */
-    nStates = m->numModelStates;
-
-    /* find conditional likelihoods */
-    clP[0] = m->condLikes[m->condLikeIndex[chain][p->index]];
-    for (k=1; k<m->numOmegaCats; k++)
-        clP[k] = clP[0] + k*m->numModelStates*m->numChars;
-    
-    /* find base frequencies */
-    bs = GetParamSubVals (m->stateFreq, chain, state[chain]);
-    
-    /* find category frequencies */
-    omegaCatFreq = GetParamSubVals (m->omega, chain, state[chain]);
-    
-    /* get category omegas */
-    omega = GetParamVals (m->omega, chain, state[chain]);
-
-    /* find posSelProbs */
-    ps = posSelProbs + m->compCharStart;
-    for (c=0; c<m->numChars; c++)
-        {
-        sum = 0.0;
-        for (k=0; k<m->numOmegaCats; k++)
-            {
-            like[k] = 0.0;
-            catLike = 0.0;
-            for (j=0; j<nStates; j++)
-                catLike += clP[k][j] * bs[j];
-            like[k] = catLike * omegaCatFreq[k];
-            sum += like[k];
-            clP[k] += nStates;
+                return (OpenTextFileA(fileName));
+                }
             }
-        posProb = 0.0;
-        for (k=0; k<m->numOmegaCats; k++)
+
+        else
             {
-            if (omega[k] > 1.0)
-                posProb += like[k] / sum;
+            /* file is not present */
+            return (OpenTextFileW(fileName));
             }
-        ps[c] = posProb;
         }
-
-    free (clP);
-    free (like);
-    
-    return NO_ERROR;
 }
 
 
-#if defined (SSE_ENABLED)
-/* Calculate positive selection probabilities (SSE version) */
-int PosSelProbs_SSE (TreeNode *p, int division, int chain)
+#if defined (MPI_ENABLED)
+/* OpenSampleFile: Open a .p, .sitelnl or .t file on all processors for writing with MPI-IO (collective) */
+int OpenSampleFile (char *name, int fileIndex)
 {
-    int             i, c1, c2, j, k, nStates;
-    CLFlt           **catLike, *siteLike;
-    MrBFlt          *bs, *omegaCatFreq, *omega,
-                    posProb, *ps;
-    __m128          m1, m2, *clPtr, **clP, mSiteLike, *mCatLike;
-    ModelInfo       *m;
-    
-    /* find model partition */
-    m = &modelSettings[division];
-    
-    /* number of states */
-    nStates = m->numModelStates;
-    
-    /* find base frequencies */
-    bs = GetParamSubVals (m->stateFreq, chain, state[chain]);
-    
-    /* find category frequencies */
-    omegaCatFreq = GetParamSubVals (m->omega, chain, state[chain]);
-    
-    /* get category omegas */
-    omega = GetParamVals (m->omega, chain, state[chain]);
-    /* allocate space for category likelihood arrays */
-    catLike = (CLFlt **) calloc (m->numOmegaCats, sizeof(CLFlt *));
-    mCatLike = (__m128 *) calloc (m->numOmegaCats, sizeof(__m128));
-    if (!catLike || !mCatLike)
+    char        fileName[200];
+
+    strcpy (fileName, workingDir);
+    strncat (fileName, name, 199 - strlen(fileName));
+
+    if (MPI_File_open (MPI_COMM_WORLD, fileName, MPI_MODE_WRONLY, MPI_INFO_NULL, &sampleFile[fileIndex]) != MPI_SUCCESS)
         {
-        MrBayesPrint ("%s   ERROR: Out of memory in PosSelProbs_SSE\n", spacer);
-        free (catLike);
-        free (mCatLike);
+        MrBayesPrint ("%s   Could not open file \"%s\" on processor %d\n", spacer, name, proc_id);
+        sampleFile[fileIndex] = MPI_FILE_NULL;
         return (ERROR);
         }
 
-    /* find conditional likelihood pointers */
-    clPtr = (__m128 *) m->condLikes[m->condLikeIndex[chain][p->index]];
-    clP   = m->clP_SSE;
-    for (k=0; k<m->numOmegaCats; k++)
+    return (NO_ERROR);
+}
+#endif
+
+
+/*----------------------------------------------------------------------
+|
+|   OptimizeMLBrlens: One round of branch length optimization in the
+|      likelihood search of tree t. If all divisions of the tree have
+|      analytic derivatives, the lengths are found with Newton-Raphson
+|      from a single up pass, backing off towards the old lengths if
+|      the joint change does not improve the likelihood. Otherwise
+|      each length in turn is moved to the top of a parabola fitted
+|      in log length, if that improves the likelihood. lnL holds the
+|      current log likelihood and is updated.
+|
+------------------------------------------------------------------------*/
+int OptimizeMLBrlens (Tree *t, int chain, MrBFlt minV, MrBFlt maxV, MrBFlt *lnL)
+{
+    int         i, j, d, useDerivs;
+    MrBFlt      lnLNew, v, x, step, curv, f[2];
+    TreeNode    *p, *q;
+    ModelInfo   *m;
+
+    useDerivs = YES;
+    for (d=0; d<t->nRelParts; d++)
         {
-        clP[k] = clPtr;
-        clPtr += m->numVecChars * nStates;
-        catLike[k] = (CLFlt *) (&(mCatLike[k]));
+        m = &modelSettings[t->relParts[d]];
+        if (m->BrlenDerivs == NULL || m->CondLikeUp == NULL || m->useBeagle == YES)
+            useDerivs = NO;
         }
-    siteLike = (CLFlt *) (&mSiteLike);
-    
-    /* find posSelProbs */
-    ps = posSelProbs + m->compCharStart;
-    for (c1=c2=0; c1<m->numVecChars; c1++)
+
+    if (useDerivs == YES)
         {
-        mSiteLike = _mm_setzero_ps ();
-        for (k=0; k<m->numOmegaCats; k++)
+        /* final cond likes of the current tree */
+        for (d=0; d<t->nRelParts; d++)
             {
-            mCatLike[k] = _mm_setzero_ps();
-            m1 = _mm_setzero_ps ();
-            for (j=0; j<nStates; j++)
+            m = &modelSettings[t->relParts[d]];
+            for (i=t->nIntNodes-1; i>=0; i--)
+                m->CondLikeUp (t->intDownPass[i], t->relParts[d], chain);
+            }
+
+        /* the derivatives for a branch only depend on its own length,
+           so the new lengths can be set as we go */
+        for (i=0; i<t->nNodes; i++)
+            {
+            p = t->allDownPass[i];
+            if (p->anc == NULL)
+                continue;
+            p->d = p->length;
+            ScratchReset ();
+            if (NewtonRaphsonBrlen (t, p, chain) == ERROR)
+                return (ERROR);
+            if (p->length < minV)
+                p->length = minV;
+            else if (p->length > maxV)
+                p->length = maxV;
+            p->upDateTi = YES;
+            if (p->left != NULL)
+                p->upDateCl = YES;
+            }
+
+        for (j=0; j<4; j++)
+            {
+            lnLNew = LogLikeTree (t, chain);
+            if (lnLNew >= *lnL)
                 {
-                m2 = _mm_mul_ps (clP[k][j], _mm_set1_ps ((CLFlt)bs[j]));
-                m1 = _mm_add_ps (m1, m2);
+                AcceptTreeChange (t, chain, YES);
+                *lnL = lnLNew;
+                break;
                 }
-            mCatLike[k] = _mm_mul_ps (m1, _mm_set1_ps ((CLFlt)omegaCatFreq[k]));
-            mSiteLike = _mm_add_ps (mSiteLike, mCatLike[k]);
-            clP[k] += nStates;
-            }
+            AcceptTreeChange (t, chain, NO);
 
-        for (i=0; i<m->numFloatsPerVec && c2 < m->numChars; ++i, ++c2)
+            /* halve the changes, or return to the old lengths after the last try */
+            for (i=0; i<t->nNodes; i++)
+                {
+                p = t->allDownPass[i];
+                if (p->anc == NULL)
+                    continue;
+                if (j == 3)
+                    {
+                    p->length = p->d;
+                    continue;
+                    }
+                p->length = 0.5 * (p->length + p->d);
+                p->upDateTi = YES;
+                if (p->left != NULL)
+                    p->upDateCl = YES;
+                }
+            }
+        }
+    else
+        {
+        /* a step of 0.5 in log length; the likelihood is evaluated one step up and
+           one step down and then at the top of the parabola through the three points */
+        step = 0.5;
+        for (i=0; i<t->nNodes; i++)
             {
-            posProb = 0.0;
-            for (k=0; k<m->numOmegaCats; k++)
+            p = t->allDownPass[i];
+            if (p->anc == NULL)
+                continue;
+            v = p->length;
+            f[0] = f[1] = *lnL;
+            for (j=0; j<4; j++)
                 {
-                if (omega[k] > 1.0)
+                if (j < 2)
+                    x = (j == 0 ? step : -step);
+                else if (j == 2)
                     {
-                    posProb += catLike[k][i] / siteLike[i];
+                    curv = f[0] - 2.0 * (*lnL) + f[1];
+                    if (curv < 0.0)
+                        x = 0.5 * step * (f[1] - f[0]) / curv;
+                    else
+                        x = (f[0] > f[1] ? 2.0 : -2.0) * step;
+                    if (x > 2.0 * step)
+                        x = 2.0 * step;
+                    else if (x < -2.0 * step)
+                        x = -2.0 * step;
+                    }
+                else
+                    {
+                    /* the top of the parabola was no better; fall back on the best point */
+                    if (f[0] <= *lnL && f[1] <= *lnL)
+                        break;
+                    x = (f[0] > f[1] ? step : -step);
+                    }
+                p->length = v * exp (x);
+                if (p->length < minV)
+                    p->length = minV;
+                else if (p->length > maxV)
+                    p->length = maxV;
+                if (p->length == v)
+                    continue;
+
+                /* touch the branch as in Move_BrLen */
+                p->upDateTi = YES;
+                if (p->anc->anc == NULL)
+                    p->upDateCl = YES;
+                for (q=p; q->anc->anc!=NULL; q=q->anc)
+                    q->anc->upDateCl = YES;
+
+                lnLNew = LogLikeTree (t, chain);
+                if (j >= 2 && lnLNew > *lnL)
+                    {
+                    AcceptTreeChange (t, chain, YES);
+                    *lnL = lnLNew;
+                    break;
                     }
+                AcceptTreeChange (t, chain, NO);
+                p->length = v;
+                if (j < 2)
+                    f[j] = lnLNew;
                 }
-            ps[c2] = posProb;
             }
         }
+
+    return (NO_ERROR);
+}
+
+
+/*----------------------------------------------------------------------
+|
+|   OptimizeMLTree: Climb to a local maximum of the likelihood from the
+|      current topology and branch lengths of the unrooted tree t,
+|      alternating rounds of branch length optimization and of NNI
+|      rearrangements around each interior branch. A rearrangement is
+|      kept if it improves the likelihood with the current branch
+|      lengths. The search starts and ends with all cond likes of the
+|      chain calculated and the update flags reset.
+|
+------------------------------------------------------------------------*/
+int OptimizeMLTree (Tree *t, int chain, MrBFlt *lnL, int *nNNIs)
+{
+    int         i, k, round, nSwaps, maxRounds;
+    MrBFlt      lnLNew, lnLOld, minV, maxV, tolerance;
+    TreeNode    *p, *u, *a, *c, *q;
+    ModelParams *mp;
+
+    maxRounds = 20;
+    tolerance = 0.001;
+
+    /* stay within the bounds of the branch length prior */
+    mp = &modelParams[t->relParts[0]];
+    minV = BRLENS_MIN;
+    maxV = BRLENS_MAX;
+    if (modelSettings[t->relParts[0]].brlens->paramId == BRLENS_UNI)
+        {
+        if (mp->brlensUni[0] > minV)
+            minV = mp->brlensUni[0];
+        if (mp->brlensUni[1] < maxV)
+            maxV = mp->brlensUni[1];
+        }
+    for (i=0; i<t->nNodes; i++)
+        {
+        p = t->allDownPass[i];
+        if (p->anc != NULL && p->length > maxV)
+            p->length = maxV;
+        }
+
+    /* likelihood of the starting tree from scratch */
+    TouchAllTrees (chain);
+    TouchAllCijks (chain);
+    TouchAllPartitions ();
+    ScratchReset ();
+    abortMove = NO;
+    *lnL = LogLike (chain);
+    abortMove = NO;
+    for (i=0; i<numTrees; i++)
+        AcceptTreeChange (GetTreeFromIndex (i, chain, state[chain]), chain, YES);
+
+    *nNNIs = 0;
+    for (round=0; round<maxRounds; round++)
+        {
+        lnLOld = *lnL;
+        if (OptimizeMLBrlens (t, chain, minV, maxV, lnL) == ERROR)
+            return (ERROR);
+
+        /* the nodes array does not change order when the tree is rearranged */
+        nSwaps = 0;
+        for (i=0; i<t->nNodes; i++)
+            {
+            p = t->nodes + i;
+            if (p->left == NULL || p->anc == NULL || p->anc->anc == NULL)
+                continue;
+            u = p->anc;
+            for (k=0; k<2; k++)
+                {
+                /* swap a descendant a of p with the sibling c of p */
+                a = (k == 0 ? p->left : p->right);
+                c = (u->left == p ? u->right : u->left);
+                if (p->left == a)
+                    p->left = c;
+                else
+                    p->right = c;
+                if (u->left == c)
+                    u->left = a;
+                else
+                    u->right = a;
+                a->anc = u;
+                c->anc = p;
+                for (q=p; q->anc!=NULL; q=q->anc)
+                    q->upDateCl = YES;
+                GetDownPass (t);
+
+                lnLNew = LogLikeTree (t, chain);
+                if (lnLNew > *lnL + tolerance)
+                    {
+                    AcceptTreeChange (t, chain, YES);
+                    *lnL = lnLNew;
+                    nSwaps++;
+                    break;
+                    }
+                AcceptTreeChange (t, chain, NO);
+
+                /* swap back */
+                if (p->left == c)
+                    p->left = a;
+                else
+                    p->right = a;
+                if (u->left == a)
+                    u->left = c;
+                else
+                    u->right = c;
+                a->anc = p;
+                c->anc = u;
+                GetDownPass (t);
+                }
+            }
+        *nNNIs += nSwaps;
+
+        if (*lnL - lnLOld < 1.0)
+            break;
+        }
+
+    return (NO_ERROR);
+}
+
+
+int PickProposal (RandLong *seed, int chainIndex)
+{
+    MrBFlt      ran;
+    int         i;
+
+    ran = RandomNumber(seed);
     
-    free (catLike);
-    free (mCatLike);
-    
-    return NO_ERROR;
+    for (i=0; usedMoves[i]->cumProposalProb[chainIndex] <= ran; i++);
+        
+    return i;
 }
-#endif
 
 
-/* Calculate omega values for each site */
-int SiteOmegas (TreeNode *p, int division, int chain)
+/* Calculate positive selection probabilities and omega values for each site from one pass over the root cond likes */
+int SiteOmegaProbs (TreeNode *p, int division, int chain)
 {
     int             c, j, k, nStates;
     MrBFlt          catLike, *like, *bs, *omegaCatFreq, *omega,
-                    siteOmega, *ps, sum;
+                    posProb, siteOmega, *ps, *so, sum;
     CLFlt           **clP;
     ModelInfo       *m;
     
     /* find model partition */
     m = &modelSettings[division];
-    
+
     /* allocate space for conditional likelihood pointer array and site likelihood array */
     clP  = (CLFlt **) calloc (m->numOmegaCats, sizeof(CLFlt *));
     like = (MrBFlt *) calloc (m->numOmegaCats, sizeof(MrBFlt));
     if (!clP || !like)
         {
-        MrBayesPrint ("%s   ERROR: Out of memory in SiteOmegas\n", spacer);
+        MrBayesPrint ("%s   ERROR: Out of memory in SiteOmegaProbs\n", spacer);
         free (clP);
         free (like);
         return (ERROR);
@@ -10193,8 +12214,9 @@ int SiteOmegas (TreeNode *p, int division, int chain)
     /* get category omegas */
     omega = GetParamVals (m->omega, chain, state[chain]);
 
-    /* find site omegas (using posSelProbs space) */
+    /* find posSelProbs and site omegas (stored after the posSelProbs) */
     ps = posSelProbs + m->compCharStart;
+    so = posSelProbs + numCompressedChars + m->compCharStart;
     for (c=0; c<m->numChars; c++)
         {
         sum = 0.0;
@@ -10208,12 +12230,17 @@ int SiteOmegas (TreeNode *p, int division, int chain)
             sum += like[k];
             clP[k] += nStates;
             }
-        siteOmega = 0.0;
+        posProb = siteOmega = 0.0;
         for (k=0; k<m->numOmegaCats; k++)
             {
+            if (omega[k] > 1.0)
+                posProb += like[k] / sum;
             siteOmega += (like[k]/sum) * omega[k];
             }
-        ps[c] = siteOmega;
+        if (m->printPosSel == YES)
+            ps[c] = posProb;
+        if (m->printSiteOmegas == YES)
+            so[c] = siteOmega;
         }
 
     free (clP);
@@ -10224,13 +12251,13 @@ int SiteOmegas (TreeNode *p, int division, int chain)
 
 
 #if defined (SSE_ENABLED)
-/* Calculate omega values for each site (SSE version) */
-int SiteOmegas_SSE (TreeNode *p, int division, int chain)
+/* Calculate positive selection probabilities and omega values for each site (SSE version) */
+int SiteOmegaProbs_SSE (TreeNode *p, int division, int chain)
 {
     int             i, c1, c2, j, k, nStates;
     CLFlt           **catLike, *siteLike;
     MrBFlt          *bs, *omegaCatFreq, *omega,
-                    siteOmega, *ps;
+                    posProb, siteOmega, *ps, *so;
     __m128          m1, m2, *clPtr, **clP, mSiteLike, *mCatLike;
     ModelInfo       *m;
     
@@ -10254,12 +12281,12 @@ int SiteOmegas_SSE (TreeNode *p, int division, int chain)
     mCatLike = (__m128 *) calloc (m->numOmegaCats, sizeof(__m128));
     if (!catLike || !mCatLike)
         {
-        MrBayesPrint ("%s   ERROR: Out of memory in SiteOmegas_SSE\n", spacer);
+        MrBayesPrint ("%s   ERROR: Out of memory in SiteOmegaProbs_SSE\n", spacer);
         free (catLike);
         free (mCatLike);
         return (ERROR);
         }
-    
+
     /* find conditional likelihood pointers */
     clPtr = (__m128 *) m->condLikes[m->condLikeIndex[chain][p->index]];
     clP   = m->clP_SSE;
@@ -10271,8 +12298,9 @@ int SiteOmegas_SSE (TreeNode *p, int division, int chain)
         }
     siteLike = (CLFlt *) (&mSiteLike);
     
-    /* find site omegas (using posSelProbs space) */
+    /* find posSelProbs and site omegas (stored after the posSelProbs) */
     ps = posSelProbs + m->compCharStart;
+    so = posSelProbs + numCompressedChars + m->compCharStart;
     for (c1=c2=0; c1<m->numVecChars; c1++)
         {
         mSiteLike = _mm_setzero_ps ();
@@ -10289,15 +12317,20 @@ int SiteOmegas_SSE (TreeNode *p, int division, int chain)
             mSiteLike = _mm_add_ps (mSiteLike, mCatLike[k]);
             clP[k] += nStates;
             }
-        
+
         for (i=0; i<m->numFloatsPerVec && c2 < m->numChars; ++i, ++c2)
             {
-            siteOmega = 0.0;
+            posProb = siteOmega = 0.0;
             for (k=0; k<m->numOmegaCats; k++)
                 {
+                if (omega[k] > 1.0)
+                    posProb += catLike[k][i] / siteLike[i];
                 siteOmega += (catLike[k][i] / siteLike[i]) * omega[k];
                 }
-            ps[c2] = siteOmega;
+            if (m->printPosSel == YES)
+                ps[c2] = posProb;
+            if (m->printSiteOmegas == YES)
+                so[c2] = siteOmega;
             }
         }
     
@@ -10338,12 +12371,13 @@ int PreparePrintFiles (void)
     fpSS = NULL;
     fpParm = NULL;
     fpTree = NULL;  
-    fpParm = (FILE **) SafeCalloc (chainParams.numRuns, sizeof (FILE *));
+    fpParm = (FILE **) SafeCalloc (2 * chainParams.numRuns, sizeof (FILE *));
     if (fpParm == NULL)
         {
         MrBayesPrint ("%s   Could not allocate fpParm in PreparePrintFiles\n", spacer);
         return ERROR;
         }
+    fpSiteLnL = fpParm + chainParams.numRuns;
     memAllocs[ALLOC_FILEPOINTERS] = YES;
     fpTree = (FILE ***) SafeCalloc (chainParams.numRuns, sizeof (FILE **));
     if (fpTree == NULL)
@@ -10452,6 +12486,20 @@ int PreparePrintFiles (void)
             return (ERROR);
             }
 
+        if (chainParams.calcPbf == YES)
+            {
+            if (chainParams.numRuns == 1)
+                sprintf (fileName, "%s.sitelnl", localFileName);
+            else
+                sprintf (fileName, "%s.run%d.sitelnl", localFileName, n+1);
+            if ((fpSiteLnL[n] = OpenNewMBPrintFile (fileName)) == NULL)
+                {
+                noWarn = oldNoWarn;
+                autoOverwrite = oldAutoOverwrite;
+                return (ERROR);
+                }
+            }
+
         for (i=0; i<numTrees; i++)
             {
             if (numTrees == 1 && chainParams.numRuns == 1)
@@ -11093,7 +13141,19 @@ int PrintCheckPoint (int gen)
 
 #if defined (MPI_ENABLED)
     int         sumErrors=0,ierror;
-    MrBFlt      r, sum;
+    MrBFlt      r[MAX_RUNS], sum[MAX_RUNS];
+#endif
+
+#if defined (MPI_ENABLED)
+    /* tuning parameters of swapped heats may still be on their way */
+    if (WaitForSwappedMoveInfo (-1) == ERROR)
+        nErrors++;
+#endif
+
+#if defined (BEST_MPI_ENABLED)
+    /* the chains are replicated on all processors, so proc 0 checkpoints for everyone */
+    if (proc_id != 0)
+        return (NO_ERROR);
 #endif
 
     /* use high precision for checkpointing */
@@ -11147,20 +13207,18 @@ int PrintCheckPoint (int gen)
         for (j=0; j<chainParams.numRuns ; j++)
             {
             if (stepAcumulatorSS[j]==0)
-                r=0;
+                r[j]=0;
             else
-                r = log (stepAcumulatorSS[j]) + stepScalerSS[j];
-            ierror = MPI_Reduce (&r,&sum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-            if (ierror != MPI_SUCCESS)
-                {
-                MrBayesPrint ("%s   Problem with MPI_Reduce\n", spacer);
-                return ERROR;
-                }
-            if (proc_id == 0)
-                {
-                MrBayesPrintf (fp, " %.4f", sum);
-                }
+                r[j] = log (stepAcumulatorSS[j]) + stepScalerSS[j];
+            }
+        ierror = MPI_Reduce (r, sum, chainParams.numRuns, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (ierror != MPI_SUCCESS)
+            {
+            MrBayesPrint ("%s   Problem with MPI_Reduce\n", spacer);
+            return ERROR;
             }
+        for (j=0; j<chainParams.numRuns && proc_id == 0; j++)
+            MrBayesPrintf (fp, " %.4f", sum[j]);
 #       else
         for (j=0; j<chainParams.numRuns ; j++)
             {
@@ -11879,14 +13937,127 @@ int PrintMCMCDiagnosticsToFile (int curGen)
             }
         }
 
-    MrBayesPrintf (fpMcmc, "\n");
-    fflush (fpMcmc);
+    MrBayesPrintf (fpMcmc, "\n");
+    fflush (fpMcmc);
+
+#if defined MPI_ENABLED
+    /* Redistribute the move info in the parallel version, so that
+       swapping occurs correctly; only necessary on processor 0 */
+    RedistributeMoveInfo();
+#endif
+
+    return (NO_ERROR);
+}
+
+
+/*-----------------------------------------------------------------------
+|
+|   PrintMoveProfile: Print the time spent in each move, summed over the
+|       chains, and write it to the .profile file. The proposal time
+|       includes the prior ratios computed by the moves themselves, except
+|       for the clock tree and multispecies coalescent priors, which are
+|       charged to the prior timer. Copying covers both the copying of the
+|       chain state before the move and the restoring after a rejection.
+|       The time per accepted proposal is the cost to weigh against the
+|       benefit of a move when setting the proposal probabilities. The
+|       size of the scratch space used by the moves and priors is printed
+|       as well, together with the number of heap allocations made in the
+|       chain steps and the last generation with such an allocation.
+|
+------------------------------------------------------------------------*/
+int PrintMoveProfile (int numStepHeapAllocs, int lastHeapAllocGen)
+{
+    int         i, j, nTried, nAccepted;
+    MrBFlt      *x, total;
+    char        fileName[220];
+    FILE        *fp;
+    MCMCMove    *mv;
+
+#   if defined (MPI_ENABLED)
+    /* each processor has timed its own chains */
+    if (MPI_Reduce (proc_id == 0 ? MPI_IN_PLACE : moveTime, moveTime, numUsedMoves*NUM_PROFILE_TIMERS + numCurrentDivisions,
+        MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD) != MPI_SUCCESS ||
+        MPI_Reduce (proc_id == 0 ? MPI_IN_PLACE : &numStepHeapAllocs, &numStepHeapAllocs, 1,
+        MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD) != MPI_SUCCESS ||
+        MPI_Reduce (proc_id == 0 ? MPI_IN_PLACE : &lastHeapAllocGen, &lastHeapAllocGen, 1,
+        MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD) != MPI_SUCCESS)
+        {
+        MrBayesPrint ("%s   Problem collecting move profile\n", spacer);
+        return (ERROR);
+        }
+    if (proc_id != 0)
+        return (NO_ERROR);
+#   elif defined (BEST_MPI_ENABLED)
+    /* all processors run all chains, so the slowest one decides the move
+       times, while each division is calculated on a single processor */
+    if (MPI_Reduce (proc_id == 0 ? MPI_IN_PLACE : moveTime, moveTime, numUsedMoves*NUM_PROFILE_TIMERS,
+        MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD) != MPI_SUCCESS ||
+        MPI_Reduce (proc_id == 0 ? MPI_IN_PLACE : divisionLikeTime, divisionLikeTime, numCurrentDivisions,
+        MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD) != MPI_SUCCESS ||
+        MPI_Reduce (proc_id == 0 ? MPI_IN_PLACE : &lastHeapAllocGen, &lastHeapAllocGen, 1,
+        MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD) != MPI_SUCCESS)
+        {
+        MrBayesPrint ("%s   Problem collecting move profile\n", spacer);
+        return (ERROR);
+        }
+    if (proc_id != 0)
+        return (NO_ERROR);
+#   endif
+
+    sprintf (fileName, "%s.profile", chainParams.chainFileName);
+    if ((fp = OpenTextFileW (fileName)) == NULL)
+        {
+        MrBayesPrint ("%s   Problem opening profile file\n", spacer);
+        return (ERROR);
+        }
+    fprintf (fp, "Type\tName\tTried\tAccepted\tProposal\tPrior\tLikelihood\tCopying\tTotal\tTimePerAccepted\n");
+
+    MrBayesPrint ("\n%s   Time spent in the moves (seconds, all chains):\n\n", spacer);
+    MrBayesPrint ("%s          Tried  Accepted  Proposal     Prior     Like.   Copying     Total  ms/accpt   Move\n", spacer);
+    MrBayesPrint ("%s      ------------------------------------------------------------------------------------------\n", spacer);
+    for (i=0; i<numUsedMoves; i++)
+        {
+        mv = usedMoves[i];
+        x = moveTime + i*NUM_PROFILE_TIMERS;
+        nTried = nAccepted = 0;
+        for (j=0; j<numGlobalChains; j++)
+            {
+            nTried += mv->nTotTried[j];
+            nAccepted += mv->nTotAccepted[j];
+            }
+        total = 0.0;
+        for (j=0; j<NUM_PROFILE_TIMERS; j++)
+            total += x[j];
+        MrBayesPrint ("%s      %9d %9d %9.2f %9.2f %9.2f %9.2f %9.2f", spacer, nTried, nAccepted,
+            x[PROFILE_PROPOSAL], x[PROFILE_PRIOR], x[PROFILE_LIKE], x[PROFILE_COPY], total);
+        fprintf (fp, "Move\t%s\t%d\t%d\t%e\t%e\t%e\t%e\t%e", mv->name, nTried, nAccepted,
+            x[PROFILE_PROPOSAL], x[PROFILE_PRIOR], x[PROFILE_LIKE], x[PROFILE_COPY], total);
+        if (nAccepted > 0)
+            {
+            MrBayesPrint (" %9.3f   %s\n", 1000.0*total/nAccepted, mv->name);
+            fprintf (fp, "\t%e\n", total/nAccepted);
+            }
+        else
+            {
+            MrBayesPrint ("        NA   %s\n", mv->name);
+            fprintf (fp, "\tNA\n");
+            }
+        }
+    MrBayesPrint ("%s      ------------------------------------------------------------------------------------------\n", spacer);
+
+    MrBayesPrint ("\n%s   Likelihood time by partition (seconds, all chains):\n\n", spacer);
+    for (i=0; i<numCurrentDivisions; i++)
+        {
+        MrBayesPrint ("%s      Partition %-4d %9.2f\n", spacer, i+1, divisionLikeTime[i]);
+        fprintf (fp, "Partition\t%d\tNA\tNA\tNA\tNA\t%e\tNA\t%e\tNA\n", i+1, divisionLikeTime[i], divisionLikeTime[i]);
+        }
 
-#if defined MPI_ENABLED
-    /* Redistribute the move info in the parallel version, so that
-       swapping occurs correctly; only necessary on processor 0 */
-    RedistributeMoveInfo();
-#endif
+    MrBayesPrint ("\n%s   Scratch space: %lu bytes\n", spacer, (unsigned long) ScratchSize ());
+    MrBayesPrint ("%s   Heap allocations in the chain steps: %d, the last one in generation %d\n", spacer,
+        numStepHeapAllocs, lastHeapAllocGen);
+
+    SafeFclose (&fp);
+    MrBayesPrint ("\n%s   Move profile written to file \"%s\"\n", spacer, fileName);
 
     return (NO_ERROR);
 }
@@ -11993,6 +14164,103 @@ int PrintMPISlaves (FILE *fp)
 
     return (NO_ERROR);
 }
+
+
+/*-----------------------------------------------------------------------
+|
+|   PrintMPITimes: Gather the communication timers of all processors on
+|       proc 0 and print how the time of the run loop was spent. Compute
+|       is the loop time not spent in any of the timed communication
+|       phases. With many processors, only the minimum, mean and maximum
+|       of each column are printed.
+|
+------------------------------------------------------------------------*/
+int PrintMPITimes (double loopTime)
+{
+    int         i, j, ierror, minProc[NUM_MPI_TIMERS+2], maxProc[NUM_MPI_TIMERS+2];
+    double      x[NUM_MPI_TIMERS+2], *all=NULL, *y, mean[NUM_MPI_TIMERS+2];
+    char        *rowName[3] = {"Min", "Mean", "Max"};
+
+    /* columns are total, compute and the timers */
+    x[0] = loopTime;
+    x[1] = loopTime;
+    for (i=0; i<NUM_MPI_TIMERS; i++)
+        {
+        x[i+2] = mpiTime[i];
+        x[1] -= mpiTime[i];
+        }
+
+    if (proc_id == 0)
+        {
+        all = (double *) SafeMalloc ((size_t)num_procs * (NUM_MPI_TIMERS+2) * sizeof(double));
+        if (!all)
+            return (ERROR);
+        }
+    ierror = MPI_Gather (x, NUM_MPI_TIMERS+2, MPI_DOUBLE, all, NUM_MPI_TIMERS+2, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (ierror != MPI_SUCCESS)
+        {
+        MrBayesPrint ("%s   Problem gathering MPI timers\n", spacer);
+        free (all);
+        return (ERROR);
+        }
+    if (proc_id != 0)
+        return (NO_ERROR);
+
+    MrBayesPrint ("\n%s   Time spent in the run loop by each processor (seconds):\n\n", spacer);
+    MrBayesPrint ("%s                    Total   Compute      Swap   Samples  Diagnost  Checkpnt     Other\n", spacer);
+    MrBayesPrint ("%s      -------------------------------------------------------------------------------\n", spacer);
+    if (num_procs <= 16)
+        {
+        for (i=0; i<num_procs; i++)
+            {
+            y = all + i*(NUM_MPI_TIMERS+2);
+            MrBayesPrint ("%s      Proc %-4d", spacer, i);
+            for (j=0; j<NUM_MPI_TIMERS+2; j++)
+                MrBayesPrint (" %9.2f", y[j]);
+            MrBayesPrint ("\n");
+            }
+        }
+    else
+        {
+        for (j=0; j<NUM_MPI_TIMERS+2; j++)
+            {
+            mean[j] = 0.0;
+            minProc[j] = maxProc[j] = 0;
+            for (i=0; i<num_procs; i++)
+                {
+                y = all + i*(NUM_MPI_TIMERS+2);
+                mean[j] += y[j];
+                if (y[j] < all[minProc[j]*(NUM_MPI_TIMERS+2)+j])
+                    minProc[j] = i;
+                if (y[j] > all[maxProc[j]*(NUM_MPI_TIMERS+2)+j])
+                    maxProc[j] = i;
+                }
+            mean[j] /= num_procs;
+            }
+        for (i=0; i<3; i++)
+            {
+            MrBayesPrint ("%s      %-9s", spacer, rowName[i]);
+            for (j=0; j<NUM_MPI_TIMERS+2; j++)
+                {
+                if (i == 0)
+                    MrBayesPrint (" %9.2f", all[minProc[j]*(NUM_MPI_TIMERS+2)+j]);
+                else if (i == 1)
+                    MrBayesPrint (" %9.2f", mean[j]);
+                else
+                    MrBayesPrint (" %9.2f", all[maxProc[j]*(NUM_MPI_TIMERS+2)+j]);
+                }
+            MrBayesPrint ("\n");
+            }
+        MrBayesPrint ("%s      Proc of max", spacer);
+        for (j=0; j<NUM_MPI_TIMERS+2; j++)
+            MrBayesPrint (" %*d", j == 0 ? 7 : 9, maxProc[j]);
+        MrBayesPrint ("\n");
+        }
+    MrBayesPrint ("%s      -------------------------------------------------------------------------------\n", spacer);
+
+    free (all);
+    return (NO_ERROR);
+}
 #endif
 
 
@@ -12098,6 +14366,73 @@ int PrintParsMatrix (void)
 }
 
 
+/*------------------------------------------------------------------------
+|
+|   PrintSiteLnLs: Print the site log likelihoods of the current state of
+|       a chain to printString, for the .sitelnl file; the header goes
+|       with the start state. There may be many sites, so the values are
+|       added with AppendToPrintString rather than AddToPrintString.
+|
+-------------------------------------------------------------------------*/
+int PrintSiteLnLs (int curGen, int coldId)
+{
+    int         c, i, s, tempStrSize;
+    size_t      len;
+    char        *tempStr;
+    ModelInfo   *m;
+
+    printStringSize = tempStrSize = TEMPSTRSIZE;
+    printString = (char *) SafeMalloc ((size_t)printStringSize * sizeof(char));
+    tempStr = (char *) SafeMalloc ((size_t)tempStrSize * sizeof(char));
+    if (!printString || !tempStr)
+        {
+        MrBayesPrint ("%s   Problem allocating printString in PrintSiteLnLs\n", spacer);
+        goto errorExit;
+        }
+    *printString = '\0';
+    len = 0;
+
+    if (curGen == 0)
+        {
+        SafeSprintf (&tempStr, &tempStrSize, "[ID: %s]\nGen", stamp);
+        if (AppendToPrintString (tempStr, &len) == ERROR)
+            goto errorExit;
+        for (i=0; i<numSiteLnLChars; i++)
+            {
+            SafeSprintf (&tempStr, &tempStrSize, "\tlnL(%d)", siteLnLChars[i]+1);
+            if (AppendToPrintString (tempStr, &len) == ERROR)
+                goto errorExit;
+            }
+        if (AppendToPrintString ("\n", &len) == ERROR)
+            goto errorExit;
+        }
+
+    SafeSprintf (&tempStr, &tempStrSize, "%d", curGen);
+    if (AppendToPrintString (tempStr, &len) == ERROR)
+        goto errorExit;
+    s = 2 * coldId + state[coldId];
+    for (i=0; i<numSiteLnLChars; i++)
+        {
+        c = siteLnLChars[i];
+        m = &modelSettings[partitionId[c][partitionNum]-1];
+        SafeSprintf (&tempStr, &tempStrSize, "\t%.4f", m->siteLnLs[(2 * coldId + m->siteLnLIndex[s]) * m->numChars + compCharPos[c] - m->compCharStart]);
+        if (AppendToPrintString (tempStr, &len) == ERROR)
+            goto errorExit;
+        }
+    if (AppendToPrintString ("\n", &len) == ERROR)
+        goto errorExit;
+
+    free (tempStr);
+    return (NO_ERROR);
+
+    errorExit:
+        free (printString);
+        free (tempStr);
+        printString = NULL;
+        return (ERROR);
+}
+
+
 /*------------------------------------------------------------------
 |
 |   PrintSiteRates_Gen: general n-state models with rate variation
@@ -12318,7 +14653,7 @@ int PrintStates (int curGen, int coldId)
 {
     int             d, i, j, k, k1, compressedCharPosition, *printedChar=NULL, origAlignmentChars[3];
     char            *partString=NULL, stateString[4];
-    MrBFlt          *st, *sst, sum;
+    MrBFlt          *st, *sst, sum, *siteOmegas=NULL;
     Param           *p;
     ModelInfo       *m;
     Tree            *tree;
@@ -12354,15 +14689,29 @@ int PrintStates (int curGen, int coldId)
             MrBayesPrint ("%s   posSelProbs not free in PrintStates\n", spacer);
             goto errorExit;
             }
-        posSelProbs = (MrBFlt *)SafeMalloc((size_t)numCompressedChars * sizeof(MrBFlt));
+        /* the site omegas are stored after the positive selection probs */
+        posSelProbs = (MrBFlt *)SafeMalloc(2 * (size_t)numCompressedChars * sizeof(MrBFlt));
         if (!posSelProbs)
             {
-            MrBayesPrint ("%s   Problem allocating posSelProbs (%d)\n", spacer, numCompressedChars * sizeof(MrBFlt));
+            MrBayesPrint ("%s   Problem allocating posSelProbs (%d)\n", spacer, 2 * numCompressedChars * sizeof(MrBFlt));
             goto errorExit;
             }
-        for (i=0; i<numCompressedChars; i++)
+        for (i=0; i<2*numCompressedChars; i++)
             posSelProbs[i] =  -10.0;
+        siteOmegas = posSelProbs + numCompressedChars;
         memAllocs[ALLOC_POSSELPROBS] = YES;
+
+        /* one pass over the root cond likes of each division gives both positive selection probs and site omegas */
+        for (d=0; d<numCurrentDivisions; d++)
+            {
+            m = &modelSettings[d];
+            if (m->printPosSel == YES || m->printSiteOmegas == YES)
+                {
+                tree = GetTree(m->brlens, coldId, state[coldId]);
+                if (m->SiteOmegaProbs (tree->root->left, d, coldId) == ERROR)
+                    goto errorExit;
+                }
+            }
         }
     if (inferPosSel == YES || inferSiteOmegas == YES || inferSiteRates == YES || inferAncStates == YES)
         {
@@ -12512,16 +14861,6 @@ int PrintStates (int curGen, int coldId)
             {
             for (i=0; i<numChar; i++)
                 printedChar[i] = NO;
-            for (d=0; d<numCurrentDivisions; d++)
-                {
-                m = &modelSettings[d];
-                tree = GetTree(m->brlens, coldId, state[coldId]);
-                if (m->printPosSel == YES)
-                    {
-                    if (m->PosSelProbs (tree->root->left, d, coldId) == ERROR)
-                        goto errorExit;
-                    }
-                }
             /* for (i=0; i<numChar; i++)
                 printf ("%4d -- %3d %3d\n", i, compCharPos[i], compColPos[i]); */
             for (i=0; i<numChar; i++)
@@ -12549,22 +14888,12 @@ int PrintStates (int curGen, int coldId)
             {
             for (i=0; i<numChar; i++)
                 printedChar[i] = NO;
-            for (d=0; d<numCurrentDivisions; d++)
-                {
-                m = &modelSettings[d];
-                tree = GetTree(m->brlens, coldId, state[coldId]);
-                if (m->printSiteOmegas == YES)
-                    {
-                    if (m->SiteOmegas (tree->root->left, d, coldId) == ERROR)
-                        goto errorExit;
-                    }
-                }
             /* for (i=0; i<numChar; i++)
                 printf ("%4d -- %3d %3d\n", i, compCharPos[i], compColPos[i]); */
             for (i=0; i<numChar; i++)
                 {
                 compressedCharPosition = compCharPos[i];
-                if (posSelProbs[compressedCharPosition] >= 0.0 && printedChar[i] == NO && charInfo[i].isExcluded == NO)
+                if (siteOmegas[compressedCharPosition] >= 0.0 && printedChar[i] == NO && charInfo[i].isExcluded == NO)
                     {
                     for (j=k=0; j<numChar; j++)
                         {
@@ -12917,22 +15246,7 @@ int PrintStates (int curGen, int coldId)
        probability that each site is a positively selected one here. */
     if (inferPosSel == YES)
         {
-        /* loop over the divisions, calculating the probability of being in the positively
-           selected class for each relevant partition */
-        for (d=0; d<numCurrentDivisions; d++)
-            {
-            m = &modelSettings[d];
-            tree = GetTree(m->brlens, coldId, state[coldId]);
-            if (m->printPosSel == YES)
-                {
-                if (m->PosSelProbs (tree->root->left, d, coldId) == ERROR)
-                    {
-                    goto errorExit;
-                    }
-                }
-            }
-
-        /* print the probabilities for the appropriate sites in the original alignment */
+        /* print the probabilities, calculated above, for the appropriate sites in the original alignment */
         for (i=0; i<numChar; i++)
             printedChar[i] = NO;
         for (i=0; i<numChar; i++)
@@ -12959,28 +15273,13 @@ int PrintStates (int curGen, int coldId)
     /* If the user wants omega values for each site, we print those here. */
     if (inferSiteOmegas == YES)
         {
-        /* loop over the divisions, calculating the omega value for each site */
-        for (d=0; d<numCurrentDivisions; d++)
-            {
-            m = &modelSettings[d];
-            tree = GetTree(m->brlens, coldId, state[coldId]);
-            if (m->printSiteOmegas == YES)
-                {
-                if (m->SiteOmegas (tree->root->left, d, coldId) == ERROR)
-                    {
-                    goto errorExit;
-                    }
-                }
-            }
-
-        /* print the site omegas for the appropriate sites in the original alignment */
-        /* note that we use posSelProbs to pass values between SiteOmegas and this function */
+        /* print the site omegas, calculated above, for the appropriate sites in the original alignment */
         for (i=0; i<numChar; i++)
             printedChar[i] = NO;
         for (i=0; i<numChar; i++)
             {
             compressedCharPosition = compCharPos[i];
-            if (posSelProbs[compressedCharPosition] >= 0.0 && printedChar[i] == NO && charInfo[i].isExcluded == NO)
+            if (siteOmegas[compressedCharPosition] >= 0.0 && printedChar[i] == NO && charInfo[i].isExcluded == NO)
                 {
                 for (j=k=0; j<numChar; j++)
                     {
@@ -12990,10 +15289,10 @@ int PrintStates (int curGen, int coldId)
                         printedChar[j] = YES;
                         }
                     }
-                SafeSprintf (&tempStr, &tempStrSize, "\t%s", MbPrintNum(posSelProbs[compressedCharPosition]));
+                SafeSprintf (&tempStr, &tempStrSize, "\t%s", MbPrintNum(siteOmegas[compressedCharPosition]));
                 if (AddToPrintString (tempStr) == ERROR) goto errorExit;
                 /* printf ("%4d -> (%3d,%3d,%3d) %1.25le\n", i, origAlignmentChars[0]+1, origAlignmentChars[1]+1,
-                                                                origAlignmentChars[2]+1, posSelProbs[compressedCharPosition]); */
+                                                                origAlignmentChars[2]+1, siteOmegas[compressedCharPosition]); */
                 }
             }
         }
@@ -13004,7 +15303,7 @@ int PrintStates (int curGen, int coldId)
         if (memAllocs[ALLOC_POSSELPROBS] == YES)
             free (posSelProbs);
         memAllocs[ALLOC_POSSELPROBS] = NO;
-        free (printedChar);
+        SAFEFREE (printedChar);
         }
 
     /* if user wants ancestral states for constrained nodes, we obtain and print those here */
@@ -13017,10 +15316,22 @@ int PrintStates (int curGen, int coldId)
                 {
                 mp = &modelParams[d];
                 tree = GetTree (m->brlens, coldId, state[coldId]);
-                for (i=j=tree->nIntNodes - 1; i>=0; i--)
+                /* only the printed nodes and their ancestors need the up pass */
+                for (i=0; i<tree->nNodes; i++)
+                    tree->allDownPass[i]->marked = NO;
+                for (i=0; i<tree->nIntNodes; i++)
+                    {
+                    node = tree->intDownPass[i];
+                    if (node->left->marked == YES || node->right->marked == YES)
+                        node->marked = YES;
+                    else if (node->isLocked == YES && mp->activeConstraints[node->lockID] == YES && definedConstraintsType[node->lockID] == HARD)
+                        node->marked = YES;
+                    }
+                for (i=tree->nIntNodes-1; i>=0; i--)
                     {
                     node = tree->intDownPass[i];
-                    m->CondLikeUp (node, d, coldId);
+                    if (node->marked == YES && m->CondLikeUp (node, d, coldId) == ERROR)
+                        goto errorExit;
                     }
                 for (k=0; k<numDefinedConstraints; k++)
                     {
@@ -13067,393 +15378,173 @@ int PrintStates (int curGen, int coldId)
 ------------------------------------------------------------------------*/
 int PrintStatesToFiles (int curGen)
 {
-    int             i, j, chn, coldId, runId;
+    int             i, j, chn, coldId, runId, nSplits, addToCounters, nErrors;
     MrBFlt          clockRate;
     Tree            *tree=NULL;
     Param           *param;
 #   if defined (MPI_ENABLED)
-    int             id, x, doesThisProcHaveId, procWithChain, ierror, tag, nErrors, sumErrors;
+    int             x[MAX_RUNS], procWithChain[MAX_RUNS], ierror;
+    double          t0;
     MPI_Status      status;
 #   endif
+#   if defined (BEST_MPI_ENABLED)
+    MrBFlt          lnSum[2], maxLnSum[2];
+#   endif
 
-#   if !defined (MPI_ENABLED)
+    nErrors = 0;
 
-    /* print parameter values and trees (single-processor version) */
+#   if defined (BEST_MPI_ENABLED)
+    /* the chains are replicated on all processors; make sure they have not drifted apart */
+    lnSum[0] = 0.0;
     for (chn=0; chn<numLocalChains; chn++)
+        lnSum[0] += curLnL[chn] + curLnPr[chn];
+    lnSum[1] = -lnSum[0];
+    if (MPI_Allreduce (lnSum, maxLnSum, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD) != MPI_SUCCESS)
+        return (ERROR);
+    if (maxLnSum[0] != -maxLnSum[1])
         {
-        if ((chainId[chn] % chainParams.numChains) == 0)
-            {
-            coldId = chn;
-            runId = chainId[chn] / chainParams.numChains;
-
-            /* print parameter values */
-            if (PrintStates (curGen, coldId) == ERROR)
-                return (ERROR);
-            fprintf (fpParm[runId], "%s", printString);
-            fflush (fpParm[runId]);
-            free(printString);
+        MrBayesPrint ("%s   The processors are out of step at generation %d\n", spacer, curGen);
+        return (ERROR);
+        }
 
-            /* print trees */
-            for (i=0; i<numPrintTreeParams; i++)
-                {
-                param = printTreeParam[i];
-                tree = GetTree(param, coldId, state[coldId]);
-                if (param->paramType == P_TOPOLOGY)
-                    {
-                    if (tree->isClock == YES)
-                        clockRate = *GetParamVals(modelSettings[tree->relParts[0]].clockRate, coldId, state[coldId]);
-                    else
-                        clockRate = 0.0;
-                    if (PrintTree (curGen, param, coldId, NO, clockRate) == ERROR)
-                        return (ERROR);
-                    }
-                else
-                    {
-                    if (tree->isClock == YES)
-                        clockRate = *GetParamVals(modelSettings[tree->relParts[0]].clockRate, coldId, state[coldId]);
-                    else
-                        clockRate = 0.0;
-                    if (PrintTree (curGen, param, coldId, YES, clockRate) == ERROR)
-                        return (ERROR);
-                    }
+    /* proc 0 prints the samples and keeps the convergence diagnostics for everyone */
+    if (proc_id != 0)
+        return (NO_ERROR);
+#   endif
 
-                fprintf (fpTree[runId][i], "%s", printString);
-                fflush (fpTree[runId][i]);
-                free(printString);
+    /* are tree samples added to the topological convergence diagnostic counters? */
+    addToCounters = NO;
+    if (chainParams.mcmcDiagn == YES && chainParams.numRuns > 1
+        && (chainParams.relativeBurnin == YES || curGen >= chainParams.chainBurnIn * chainParams.sampleFreq))
+        addToCounters = YES;
 
-                j = printTreeTopologyIndex[i];
-                if (j<numTopologies)
-                    {
-                    if (chainParams.mcmcDiagn == YES && chainParams.numRuns > 1)
-                        {
-                        if (chainParams.relativeBurnin == YES || curGen >= chainParams.chainBurnIn * chainParams.sampleFreq)
-                            {
-                            if (AddTreeToPartitionCounters (tree, j, runId) == ERROR)
-                                return ERROR;
-                            if (chainParams.relativeBurnin == YES && chainParams.saveTrees == YES && (noWarn == NO || curGen <= chainParams.stopTreeGen))
-                                {
-                                ResetTopologyFromTree (chainParams.dtree, tree);
-                                if (AddToTreeList (&chainParams.treeList[numTopologies*runId+j], chainParams.dtree) == ERROR)
-                                    return (ERROR);
-                                }
-                            }
-                        }
-                    }
-                }
+#   if defined (MPI_ENABLED)
+    /* In the parallel version, the processor holding the cold chain of a run writes the samples of that
+       run directly to the .p, .sitelnl and .t files, which all processors keep open with MPI-IO (see
+       ReopenMBPrintFiles). Only the splits needed for the convergence diagnostics are sent to proc 0. */
+    for (runId=0; runId<chainParams.numRuns; runId++)
+        {
+        x[runId] = 0;
+        for (chn=0; chn<numLocalChains; chn++)
+            {
+            if (chainId[chn] == runId * chainParams.numChains)
+                x[runId] = proc_id;
             }
         }
-#   else
-    /* print parameter values and trees (parallel version) */
-    
-    /* Wait for all of the processors to get to this point before starting the printing. */
-    ierror = MPI_Barrier (MPI_COMM_WORLD);
+    t0 = MPI_Wtime ();
+    ierror = MPI_Allreduce (x, procWithChain, chainParams.numRuns, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    mpiTime[MPI_TIME_SAMPLES] += MPI_Wtime () - t0;
     if (ierror != MPI_SUCCESS)
         {
-        MrBayesPrint ("%s   Problem at chain barrier.\n", spacer);
-        return ERROR;
+        MrBayesPrint ("%s   Problem finding processor with chain to print.\n", spacer);
+        return (ERROR);
         }
-    tag = nErrors = 0;
-        
-    /* Loop over runs. */
+#   endif
+
     for (runId=0; runId<chainParams.numRuns; runId++)
         {
-        /* Get the ID of the chain we want to print. Remember, the ID's should be numbered
-           0, 1, 2, ..., numChains X numRuns. Chains numbered 0, numChains, 2 X numChains, ...
-           are cold. */
-        id = runId * chainParams.numChains;
-        
-        /* Does this processor have the chain? */
-        doesThisProcHaveId = NO;
-        coldId = 0;
+        coldId = -1;
         for (chn=0; chn<numLocalChains; chn++)
             {
-            if (chainId[chn] == id)
-                {
-                doesThisProcHaveId = YES;
+            if (chainId[chn] == runId * chainParams.numChains)
                 coldId = chn;
-                break;
-                }
-            }
-        
-        /* Tell all the processors which has the chain we want to print. We do this using the MPI_AllReduce
-           function. If the processor does not have the chain, then it initializes x = 0. If it does
-           have the chain, then x = proc_id. When the value of x is summed over all the processors, the sum
-           should be the proc_id of the processor with the chain. Possible values are 0, 1, 2, num_procs-1. 
-           Note that every processor knows procWithChain because we are using MPI_Allreduce, instead of MPI_Reduce. */
-        x = 0;
-        if (doesThisProcHaveId == YES)
-            x = proc_id;
-        ierror = MPI_Allreduce (&x, &procWithChain, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-        if (ierror != MPI_SUCCESS)
-            {
-            MrBayesPrint ("%s   Problem finding processor with chain to print.\n", spacer);
-            return (ERROR);
-            }
-
-        /* ****************************************************************************************************/
-        /* print parameter values *****************************************************************************/
-        
-        /* Fill printString with the contents to be printed on proc_id = 0. Note
-           that printString is allocated in the function. */
-        if (doesThisProcHaveId == YES)
-            {
-            if (PrintStates (curGen, coldId) == ERROR)
-                nErrors++;
-            }
-        MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-        if (sumErrors > 0)
-            {
-            MrBayesPrint ("%s   Problem with PrintStates.\n", spacer);
-            return ERROR;
-            }
-        
-        /* First communication: Send/receive the length of the printString. */
-        if (proc_id == 0 || proc_id == procWithChain)
-            {
-            if (procWithChain != 0)
-                {
-                if (proc_id == procWithChain)
-                    {
-                    /* Find out how large the string is, and send the information to proc_id = 0. */
-                    ierror = MPI_Send (&printStringSize, 1, MPI_LONG, 0, tag, MPI_COMM_WORLD);
-                    if (ierror != MPI_SUCCESS)
-                        nErrors++;
-                    }
-                else
-                    {
-                    /* Receive the length of the string from proc_id = procWithChain, and then allocate
-                       printString to be that length. */
-                    ierror = MPI_Recv (&printStringSize, 1, MPI_LONG, procWithChain, tag, MPI_COMM_WORLD, &status);
-                    if (ierror != MPI_SUCCESS)
-                        {
-                        MrBayesPrint ("%s   Problem receiving printStringSize from proc_id = %d\n", spacer, procWithChain);
-                        nErrors++;
-                        }
-                    printString = (char *)SafeMalloc((size_t)printStringSize * sizeof(char));
-                    if (!printString)
-                        {
-                        MrBayesPrint ("%s   Problem allocating printString (%d)\n", spacer, printStringSize * sizeof(char));
-                        nErrors++;
-                        }
-                    strcpy (printString, "");
-                    }
-                }
-            }
-        MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-        if (sumErrors > 0)
-            {
-            MrBayesPrint ("%s   Problem with first communication (states).\n", spacer);
-            return ERROR;
             }
 
-        /* Second communication: Send/receive the printString. */
-        if (proc_id == 0 || proc_id == procWithChain)
+#   if defined (MPI_ENABLED)
+        if (coldId == -1)
             {
-            if (procWithChain != 0)
-                {                   
-                if (proc_id == procWithChain)
-                    {
-                    /* Send the printString to proc_id = 0. After we send the string to proc_id = 0, we can
-                       free it. */
-                    ierror = MPI_Send (&printString[0], (int)printStringSize, MPI_CHAR, 0, tag, MPI_COMM_WORLD);
-                    if (ierror != MPI_SUCCESS)
-                        nErrors++;
-                    free(printString);
-                    }
-                else
+            /* the run is printed elsewhere; proc 0 collects the splits for the diagnostics */
+            if (proc_id == 0 && addToCounters == YES)
+                {
+                for (i=0; i<numPrintTreeParams; i++)
                     {
-                    /* Receive the printString from proc_id = procWithChain. */
-                    ierror = MPI_Recv (&printString[0], (int)printStringSize, MPI_CHAR, procWithChain, tag, MPI_COMM_WORLD, &status);
+                    j = printTreeTopologyIndex[i];
+                    if (j >= numTopologies)
+                        continue;
+                    nSplits = GetTree (printTreeParam[i], 0, state[0])->nIntNodes - 1;
+                    t0 = MPI_Wtime ();
+                    ierror = MPI_Recv (treeSplits, nSplits*nLongsNeeded, MPI_UNSIGNED_LONG, procWithChain[runId], runId*numPrintTreeParams+i, MPI_COMM_WORLD, &status);
+                    mpiTime[MPI_TIME_SAMPLES] += MPI_Wtime () - t0;
                     if (ierror != MPI_SUCCESS)
                         {
-                        MrBayesPrint ("%s   Problem receiving printString from proc_id = %d\n", spacer, procWithChain);
+                        MrBayesPrint ("%s   Problem receiving splits from proc_id = %d\n", spacer, procWithChain[runId]);
                         nErrors++;
                         }
+                    else if (AddSplitsToDiagnostics (treeSplits, nSplits, j, runId, curGen) == ERROR)
+                        nErrors++;
                     }
                 }
+            continue;
             }
-        MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-        if (sumErrors > 0)
-            {
-            MrBayesPrint ("%s   Problem with second communication (states).\n", spacer);
-            return ERROR;
-            }
+#   endif
 
-        /* Print the string with the parameter information if we are proc_id = 0. */
-        if (proc_id == 0)
-            {
-            fprintf (fpParm[runId], "%s", printString);
-            fflush (fpParm[runId]);
-            free(printString);
-            }
+        /* print parameter values */
+        if (PrintStates (curGen, coldId) == ERROR || WriteSampleString (runId, 0) == ERROR)
+            nErrors++;
 
-        /* ****************************************************************************************************/
-        /* print trees ****************************************************************************************/
+        /* print site likelihoods */
+        if (chainParams.calcPbf == YES && (PrintSiteLnLs (curGen, coldId) == ERROR
+            || WriteSampleString (runId, 1) == ERROR))
+            nErrors++;
 
+        /* print trees */
         for (i=0; i<numPrintTreeParams; i++)
             {
-            /* Print trees to file. */
+            param = printTreeParam[i];
+            tree = GetTree(param, coldId, state[coldId]);
+            if (tree->isClock == YES)
+                clockRate = *GetParamVals(modelSettings[tree->relParts[0]].clockRate, coldId, state[coldId]);
+            else
+                clockRate = 0.0;
+            if (PrintTree (curGen, param, coldId, param->paramType == P_TOPOLOGY ? NO : YES, clockRate) == ERROR
+                || WriteSampleString (runId, 2 + i) == ERROR)
+                nErrors++;
 
-            /* Fill printString with the contents to be printed on proc_id = 0. Note
-               that printString is allocated in the function. */
-            if (doesThisProcHaveId == YES)
+            j = printTreeTopologyIndex[i];
+            if (j < numTopologies && addToCounters == YES)
                 {
-                param = printTreeParam[i];
-                tree = GetTree(param, coldId, state[coldId]);
-                if (param->paramType == P_TOPOLOGY)
-                    {
-                    if (tree->isClock == YES)
-                        clockRate = *GetParamVals(modelSettings[tree->relParts[0]].clockRate, coldId, state[coldId]);
-                    else
-                        clockRate = 0.0;
-                    if (PrintTree (curGen, param, coldId, NO, clockRate) == ERROR)
-                        nErrors++;
-                    }
-                else
+                nSplits = GetTreeSplits (tree, treeSplits);
+#   if defined (MPI_ENABLED)
+                if (proc_id != 0)
                     {
-                    if (tree->isClock == YES)
-                        clockRate = *GetParamVals(modelSettings[tree->relParts[0]].clockRate, coldId, state[coldId]);
-                    else
-                        clockRate = 0.0;
-                    if (PrintTree (curGen, param, coldId, YES, clockRate) == ERROR)
+                    t0 = MPI_Wtime ();
+                    ierror = MPI_Send (treeSplits, nSplits*nLongsNeeded, MPI_UNSIGNED_LONG, 0, runId*numPrintTreeParams+i, MPI_COMM_WORLD);
+                    mpiTime[MPI_TIME_SAMPLES] += MPI_Wtime () - t0;
+                    if (ierror != MPI_SUCCESS)
                         nErrors++;
+                    continue;
                     }
-                }
-            MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-            if (sumErrors > 0)
-                {
-                MrBayesPrint ("%s   Problem with printing trees.\n", spacer);
-                return ERROR;
-                }
-                
-            /* First communication: Send/receive the length of the printString. */
-            if (proc_id == 0 || proc_id == procWithChain)
-                {
-                if (procWithChain != 0)
-                    {
-                    if (proc_id == procWithChain)
-                        {
-                        /* Find out how large the string is, and send the information to proc_id = 0. */
-                        ierror = MPI_Send (&printStringSize, 1, MPI_LONG, 0, tag, MPI_COMM_WORLD);
-                        if (ierror != MPI_SUCCESS)
-                            nErrors++;
-                        }
-                    else
-                        {
-                        /* Receive the length of the string from proc_id = procWithChain, and then allocate
-                           printString to be that length. */
-                        ierror = MPI_Recv (&printStringSize, 1, MPI_LONG, procWithChain, tag, MPI_COMM_WORLD, &status);
-                        if (ierror != MPI_SUCCESS)
-                            {
-                            MrBayesPrint ("%s   Problem receiving printStringSize from proc_id = %d\n", spacer, procWithChain);
-                            nErrors++;
-                            }
-                        printString = (char *)SafeMalloc((size_t)printStringSize * sizeof(char));
-                        if (!printString)
-                            {
-                            MrBayesPrint ("%s   Problem allocating printString (%d)\n", spacer, printStringSize * sizeof(char));
-                            nErrors++;
-                            }
-                        strcpy (printString, "");
-                        }
-                    }
-                }
-            MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-            if (sumErrors > 0)
-                {
-                MrBayesPrint ("%s   Problem with first communication (states).\n", spacer);
-                return ERROR;
-                }
-
-            /* Second communication: Send/receive the printString. */
-            if (proc_id == 0 || proc_id == procWithChain)
-                {
-                if (procWithChain != 0)
-                    {                   
-                    if (proc_id == procWithChain)
-                        {
-                        /* Send the printString to proc_id = 0. After we send the string to proc_id = 0, we can
-                           free it. */
-                        ierror = MPI_Send (&printString[0], (int)printStringSize, MPI_CHAR, 0, tag, MPI_COMM_WORLD);
-                        if (ierror != MPI_SUCCESS)
-                            nErrors++;
-                        free(printString);
-                        }
-                    else
-                        {
-                        /* Receive the printString from proc_id = procWithChain. */
-                        ierror = MPI_Recv (&printString[0], (int)printStringSize, MPI_CHAR, procWithChain, tag, MPI_COMM_WORLD, &status);
-                        if (ierror != MPI_SUCCESS)
-                            {
-                            MrBayesPrint ("%s   Problem receiving printString from proc_id = %d\n", spacer, procWithChain);
-                            nErrors++;
-                            }
-                        }
-                    }
-                }
-            MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-            if (sumErrors > 0)
-                {
-                MrBayesPrint ("%s   Problem with second communication (states).\n", spacer);
-                return ERROR;
-                }
-
-            /* Print the string with the parameter information if we are proc_id = 0. */
-            if (proc_id == 0)
-                {
-                fprintf (fpTree[runId][i], "%s", printString);
-                fflush (fpTree[runId][i]);
-                j = printTreeTopologyIndex[i];
-                if (j < numTopologies)
-                    {
-                    if (chainParams.numRuns > 1 && chainParams.mcmcDiagn == YES)
-                        {
-                        if (chainParams.relativeBurnin == YES || curGen >= chainParams.chainBurnIn * chainParams.sampleFreq)
-                            {
-                            char *s = NULL;
-                            StripComments (printString);
-                            /* if it is the first tree, we strip out the translate block first (twice) */
-                            if (curGen==0) {
-                                if (strtok (printString, ";")==NULL) /* get translate lock */
-                                    return (ERROR);
-                                if (strtok (NULL, ";")==NULL)
-                                    return (ERROR);
-                                if (strtok (NULL, "\n\t\r ")==NULL) /* get 'tree' */
-                                    return (ERROR);
-                                }
-                            else {
-                                if (strtok (printString, "\n\t\r ")==NULL) /* get 'tree' */
-                                    return (ERROR);
-                                }
-                            if (strtok (NULL, " =")==NULL)  /* get 'rep.xxxx' */
-                                return (ERROR);
-                            if ((s = strtok (NULL, " =;"))==NULL)  /* get Newick string */
-                                return (ERROR);
-                            ResetTopology (chainParams.dtree, s);
-                            if (AddTreeToPartitionCounters (chainParams.dtree, j, runId) == ERROR)
-                                return ERROR;
-                            if (chainParams.relativeBurnin == YES && chainParams.saveTrees == YES && (noWarn == NO || curGen <= chainParams.stopTreeGen))
-                                {
-                                if (AddToTreeList (&chainParams.treeList[runId*numTopologies+j], chainParams.dtree) == ERROR)
-                                    return (ERROR);
-                                }
-                            }
-                        }
-                    }
-                free(printString);
+#   endif
+                if (AddSplitsToDiagnostics (treeSplits, nSplits, j, runId, curGen) == ERROR)
+                    nErrors++;
                 }
             }
+        }
 
-        /* Have all of the chains wait here, until the string has been successfully printed on proc_id = 0. */
-        ierror = MPI_Barrier (MPI_COMM_WORLD);
-        if (ierror != MPI_SUCCESS)
-            {
-            MrBayesPrint ("%s   Problem at chain barrier.\n", spacer);
-            return ERROR;
-            }
+#   if defined (MPI_ENABLED)
+    /* Move the ends of the sample files past what was written, and let all processors return an error if
+       any of them had one. The errors were counted rather than returned, so that the splits were still sent. */
+    sampleFileBytes[numSampleFiles] = nErrors;
+    t0 = MPI_Wtime ();
+    ierror = MPI_Allreduce (MPI_IN_PLACE, sampleFileBytes, numSampleFiles + 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    mpiTime[MPI_TIME_SAMPLES] += MPI_Wtime () - t0;
+    if (ierror != MPI_SUCCESS)
+        {
+        MrBayesPrint ("%s   Problem updating the sample files\n", spacer);
+        return (ERROR);
+        }
+    for (i=0; i<numSampleFiles; i++)
+        {
+        sampleFileEnd[i] += sampleFileBytes[i];
+        sampleFileBytes[i] = 0;
         }
+    nErrors = sampleFileBytes[numSampleFiles];
+    sampleFileBytes[numSampleFiles] = 0;
 #   endif
-        
+
+    if (nErrors > 0)
+        return (ERROR);
+
     return (NO_ERROR);
 }
 
@@ -14148,46 +16239,78 @@ int PrintTree (int curGen, Param *treeParam, int chain, int showBrlens, MrBFlt c
 
 
 #if defined (MPI_ENABLED)
+/*-----------------------------------------------------------------------
+|
+|   ReassembleMoveInfo: Sum the move info of all chains on proc 0. The
+|       counts of all chains and moves are packed into one reduction;
+|       processors hold zeros for the heats they do not have.
+|
+------------------------------------------------------------------------*/
 int ReassembleMoveInfo (void)
 {
     int             i, n, ierror;
-    double          x[7], sum[7];
+    double          *x, *sum, *y, t0;
     MCMCMove        *mv;
 
-    for (n=0; n<numGlobalChains; n++)
+    if (WaitForSwappedMoveInfo (-1) == ERROR)
+        return (ERROR);
+
+    x = (double *) SafeMalloc (2 * 7 * numGlobalChains * numUsedMoves * sizeof(double));
+    if (!x)
+        return (ERROR);
+    sum = x + 7 * numGlobalChains * numUsedMoves;
+
+    for (n=0, y=x; n<numGlobalChains; n++)
         {
         for (i=0; i<numUsedMoves; i++)
             {
             mv = usedMoves[i];
 
             /* collect counts */
-            x[0] = mv->nAccepted[n];
-            x[1] = mv->nTried[n];
-            x[2] = mv->nBatches[n];
-            x[3] = mv->nTotAccepted[n];
-            x[4] = mv->nTotTried[n];
-            x[5] = mv->lastAcceptanceRate[n];
+            y[0] = mv->nAccepted[n];
+            y[1] = mv->nTried[n];
+            y[2] = mv->nBatches[n];
+            y[3] = mv->nTotAccepted[n];
+            y[4] = mv->nTotTried[n];
+            y[5] = mv->lastAcceptanceRate[n];
             if (mv->moveType->Autotune != NULL)
-                x[6]=mv->tuningParam[n][0];
+                y[6] = mv->tuningParam[n][0];
+            else
+                y[6] = 0.0;
+            y += 7;
+            }
+        }
 
-            ierror = MPI_Allreduce (&x, &sum, 7, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-            if (ierror != MPI_SUCCESS)
-                return (ERROR);
+    t0 = MPI_Wtime ();
+    ierror = MPI_Reduce (x, sum, 7 * numGlobalChains * numUsedMoves, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    mpiTime[MPI_TIME_DIAGN] += MPI_Wtime () - t0;
+    if (ierror != MPI_SUCCESS)
+        {
+        free (x);
+        return (ERROR);
+        }
 
-            if (proc_id == 0)
+    if (proc_id == 0)
+        {
+        for (n=0, y=sum; n<numGlobalChains; n++)
+            {
+            for (i=0; i<numUsedMoves; i++)
                 {
-                mv->nAccepted[n]          = (int)sum[0];
-                mv->nTried[n]             = (int)sum[1];
-                mv->nBatches[n]           = (int)sum[2];
-                mv->nTotAccepted[n]       = (int)sum[3];
-                mv->nTotTried[n]          = (int)sum[4];
-                mv->lastAcceptanceRate[n] = (MrBFlt)sum[5];
+                mv = usedMoves[i];
+                mv->nAccepted[n]          = (int)y[0];
+                mv->nTried[n]             = (int)y[1];
+                mv->nBatches[n]           = (int)y[2];
+                mv->nTotAccepted[n]       = (int)y[3];
+                mv->nTotTried[n]          = (int)y[4];
+                mv->lastAcceptanceRate[n] = (MrBFlt)y[5];
                 if (mv->moveType->Autotune != NULL)
-                    mv->tuningParam[n][0]=(MrBFlt)sum[6];
+                    mv->tuningParam[n][0] = (MrBFlt)y[6];
+                y += 7;
                 }
             }
         }
 
+    free (x);
     return (NO_ERROR);
 }
 
@@ -14560,50 +16683,88 @@ int ReassembleParamVals (int *curId)
 }
 
 
+/*-----------------------------------------------------------------------
+|
+|   ReassembleSwapInfo: Add the swap counts of all processors to those
+|       of proc 0 in one reduction
+|
+------------------------------------------------------------------------*/
 int ReassembleSwapInfo (void)
 {
-    int i, j, n, x, sum, ierror;
-    
-    for (n=0; n<chainParams.numRuns; n++)
+    int     i, j, n, k, nSwapInfo, *x, *sum, ierror;
+    double  t0;
+
+    nSwapInfo = chainParams.numRuns * chainParams.numChains * chainParams.numChains;
+    x = (int *) SafeMalloc (2 * nSwapInfo * sizeof(int));
+    if (!x)
+        return (ERROR);
+    sum = x + nSwapInfo;
+
+    for (n=k=0; n<chainParams.numRuns; n++)
         {
         for (i=0; i<chainParams.numChains; i++)
             {
             for (j=0; j<chainParams.numChains; j++)
                 {
-                if (i != j)
-                    {
-                    if (proc_id == 0)
-                        x = 0;
-                    else
-                        x = swapInfo[n][i][j];
-                    ierror = MPI_Allreduce (&x, &sum, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-                    if (ierror != MPI_SUCCESS)
-                        return (ERROR);
-                    if (proc_id == 0)
-                        swapInfo[n][i][j] += sum;
-                    else
-                        swapInfo[n][i][j] = 0;
-                    }
+                if (proc_id == 0 || i == j)
+                    x[k++] = 0;
+                else
+                    x[k++] = swapInfo[n][i][j];
                 }
             }
         }
 
+    t0 = MPI_Wtime ();
+    ierror = MPI_Reduce (x, sum, nSwapInfo, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    mpiTime[MPI_TIME_DIAGN] += MPI_Wtime () - t0;
+    if (ierror != MPI_SUCCESS)
+        {
+        free (x);
+        return (ERROR);
+        }
+
+    for (n=k=0; n<chainParams.numRuns; n++)
+        {
+        for (i=0; i<chainParams.numChains; i++)
+            {
+            for (j=0; j<chainParams.numChains; j++, k++)
+                {
+                if (i == j)
+                    continue;
+                if (proc_id == 0)
+                    swapInfo[n][i][j] += sum[k];
+                else
+                    swapInfo[n][i][j] = 0;
+                }
+            }
+        }
+
+    free (x);
     return (NO_ERROR);
 }
 
 
 int ReassembleTuningParams (void)
 {
-    int        i, j, k, lower, ierror;
+    int        i, j, k, lower, nValues, ierror;
     MrBFlt     *x, *sum;
     
-    x = (MrBFlt *) SafeCalloc (2*numUsedMoves, sizeof(MrBFlt));
-    sum = x + numUsedMoves;
+    if (WaitForSwappedMoveInfo (-1) == ERROR)
+        return (ERROR);
 
     lower = numGlobalChains / num_procs;
     if (numGlobalChains % num_procs != 0)
         lower++;
 
+    /* the tuning parameters of all chains not on proc 0 are collected in one reduction */
+    nValues = (numGlobalChains - lower) * numUsedMoves;
+    if (nValues == 0)
+        return (NO_ERROR);
+    x = (MrBFlt *) SafeCalloc (2*nValues, sizeof(MrBFlt));
+    if (!x)
+        return (ERROR);
+    sum = x + nValues;
+
     for (i=lower; i<numGlobalChains; i++)
         {
         for (j=0; j<numLocalChains; j++)
@@ -14615,24 +16776,25 @@ int ReassembleTuningParams (void)
         for (k=0; k<numUsedMoves; k++)
             {
             if (j != numLocalChains && usedMoves[k]->moveType->numTuningParams > 0) /* we have the tuning parameter of interest */
-                x[k] = usedMoves[k]->tuningParam[i][0];
-            else
-                x[k] = 0.0;
+                x[(i-lower)*numUsedMoves+k] = usedMoves[k]->tuningParam[i][0];
             }
+        }
 
-        ierror = MPI_Allreduce (x, sum, numUsedMoves, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-        if (ierror != MPI_SUCCESS)
-            {
-            free (x);
-            return (ERROR);
-            }
+    ierror = MPI_Reduce (x, sum, nValues, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (ierror != MPI_SUCCESS)
+        {
+        free (x);
+        return (ERROR);
+        }
 
-        if (proc_id == 0)
+    if (proc_id == 0)
+        {
+        for (i=lower; i<numGlobalChains; i++)
             {
             for (k=0; k<numUsedMoves; k++)
                 {
                 if (usedMoves[k]->moveType->numTuningParams > 0)
-                    usedMoves[k]->tuningParam[i][0] = sum[k];
+                    usedMoves[k]->tuningParam[i][0] = sum[(i-lower)*numUsedMoves+k];
                 }
             }
         }
@@ -15051,6 +17213,34 @@ int RedistributeTuningParams (void)
 #endif
 
 
+/* ReleaseSplitFromPool: Release a reference to a split in a split pool, removing the split when it is unused */
+void ReleaseSplitFromPool (SplitPool *pool, int id)
+{
+    int     i, j, k, mask;
+
+    if (--pool->refCount[id] > 0)
+        return;
+
+    /* find the slot of the split and delete it from the hash table by shifting back the entries after it */
+    mask = pool->tableSize - 1;
+    for (i=(int)(pool->hash[id] & mask); pool->table[i] != id; i=(i+1) & mask)
+        ;
+    pool->table[i] = -1;
+    for (j=(i+1) & mask; pool->table[j] != -1; j=(j+1) & mask)
+        {
+        k = (int)(pool->hash[pool->table[j]] & mask);
+        if ((i <= j && (k <= i || k > j)) || (i > j && k <= i && k > j))
+            {
+            pool->table[i] = pool->table[j];
+            pool->table[j] = -1;
+            i = j;
+            }
+        }
+
+    pool->freeIds[pool->numFree++] = id;
+}
+
+
 /* RemovePartition: Remove a partition from the tree keeping track of partition frequencies */
 int RemovePartition (PFNODE *r, BitsLong *p, int runId)
 {
@@ -15099,40 +17289,69 @@ int RemovePartition (PFNODE *r, BitsLong *p, int runId)
 }
 
 
-/* RemoveTreeFromPartitionCounters: Break a tree into partitions and remove those from counters */
-int RemoveTreeFromPartitionCounters (Tree *tree, int treeId, int runId)
+/* RemoveTopologyFromPartitionCounters: Remove the oldest sample in a packed topology list from partition counters */
+int RemoveTopologyFromPartitionCounters (PackedTopologyList *list, int treeId, int runId)
 {
-    int         i, j, nTaxa;
-    TreeNode    *p;
+    int         i, *x;
+    SplitPool   *pool = list->pool;
 
-    if (tree->isRooted == YES)
-        nTaxa = tree->nNodes - tree->nIntNodes - 1;
-    else
-        nTaxa = tree->nNodes - tree->nIntNodes;
-
-    for (i=0; i<nTaxa; i++)
+    if (list->numStored == 0)
         {
-        ClearBits(partition[i], nLongsNeeded);
-        SetBit(i, partition[i]);
+        MrBayesPrint ("%s   Tree list empty\n", spacer);
+        return (ERROR);
         }
 
-    for (i=0; i<tree->nIntNodes-1; i++)
+    x = list->splitIds + (size_t)list->first*list->nSplits;
+    for (i=0; i<list->nSplits; i++)
         {
-        p = tree->intDownPass[i];
-        assert (p->index >= tree->nNodes - tree->nIntNodes - (tree->isRooted == YES ? 1 : 0));
-        for (j=0; j<nLongsNeeded; j++)
+        if ((RemovePartition (partFreqTreeRoot[treeId], pool->bits + (size_t)x[i]*pool->nLongs, runId)) == ERROR)
             {
-            partition[p->index][j] = partition[p->left->index][j] | partition[p->right->index][j];
+            MrBayesPrint ("%s   Could not remove partition %d in RemoveTopologyFromPartitionCounters\n", spacer, i);
+            ShowParts(stdout,pool->bits + (size_t)x[i]*pool->nLongs,numLocalTaxa);
+            return ERROR;
             }
-        
-        if ((RemovePartition (partFreqTreeRoot[treeId], partition[p->index], runId)) == ERROR)
+        }
+
+    /* drop the topology once all its consecutive samples are gone */
+    if (--list->repeats[list->first] == 0)
+        {
+        for (i=0; i<list->nSplits; i++)
+            ReleaseSplitFromPool (pool, x[i]);
+        list->first = (list->first + 1) % list->capacity;
+        list->numStored--;
+        }
+
+    return NO_ERROR;
+}
+
+
+/* RemoveTreeFromSplitRing: Remove the oldest tree sample in a split ring from partition counters */
+int RemoveTreeFromSplitRing (SplitRing *ring, int treeId, int runId)
+{
+    int         i;
+    BitsLong    *x;
+
+    if (ring->numSamples == 0)
+        {
+        MrBayesPrint ("%s   Split ring empty\n", spacer);
+        return (ERROR);
+        }
+
+    x = ring->splits + (size_t)ring->first*ring->nSplits*nLongsNeeded;
+    for (i=0; i<ring->nSplits; i++)
+        {
+        if ((RemovePartition (partFreqTreeRoot[treeId], x, runId)) == ERROR)
             {
-            MrBayesPrint ("%s   Could not remove partition %d in RemoveTreeFromPartitionCounters\n", spacer, p->index);
-            ShowParts(stdout,partition[p->index],numLocalTaxa);
+            MrBayesPrint ("%s   Could not remove partition %d in RemoveTreeFromSplitRing\n", spacer, i);
+            ShowParts(stdout,x,numLocalTaxa);
             return ERROR;
             }
+        x += nLongsNeeded;
         }
 
+    ring->first = (ring->first + 1) % ring->capacity;
+    ring->numSamples--;
+
     return NO_ERROR;
 }
 
@@ -15140,158 +17359,30 @@ int RemoveTreeFromPartitionCounters (Tree *tree, int treeId, int runId)
 /* RemoveTreeSamples: Remove tree samples from partition counters */
 int RemoveTreeSamples (int from, int to)
 {
-    int         i, j, k, longestLine, line;
-    char        c, *s, *lineBuf=0;
-    FILE        *fp;
-    Tree        *t;
-    TreeList    *treeList;
-    char        *tempStr;
-    int         tempStrSize = TEMPSTRSIZE;
+    int         i, j, k;
 
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     if (proc_id != 0)
         return (NO_ERROR);
 #   endif
 
-    tempStr = (char *) SafeMalloc((size_t)tempStrSize * sizeof(char));
-    if (!tempStr)
-        {
-        MrBayesPrint ("%s   Problem allocating tempString (%d)\n", spacer, tempStrSize * sizeof(char));
-        return (ERROR);
-        }
-
-    if (chainParams.saveTrees == YES)
-        {
-        for (i=0; i<numTopologies; i++)
-            {
-            t = chainParams.dtree;
-            if (topologyParam[i]->tree[0]->isRooted == YES)
-                t->isRooted = YES;
-            else
-                t->isRooted = NO;
-
-            for (j=0; j<chainParams.numRuns; j++)
-                {               
-                treeList = &chainParams.treeList[j*numTopologies + i];
-                
-                for (k=from; k<=to; k++)
-                    {
-                    GetFromTreeList (treeList, t);
-                    if (RemoveTreeFromPartitionCounters (t, i, j) == ERROR)
-                        {
-                        SafeFclose (&fp);
-                        free (tempStr);
-                        free (lineBuf);
-                        return (ERROR);
-                        }
-                    }
-                }
-            }
-        }
-    else
+    /* the splits of the samples were kept in memory, so there is no need to rebuild or read back in any trees */
+    for (i=0; i<numTopologies; i++)
         {
-        for (i=0; i<numTopologies; i++)
+        for (j=0; j<chainParams.numRuns; j++)
             {
-            t = chainParams.dtree;
-
-            for (j=0; j<chainParams.numRuns; j++)
+            for (k=from; k<=to; k++)
                 {
-                if (numPrintTreeParams == 1)
-                    {
-                    if (chainParams.numRuns == 1)
-                        SafeSprintf (&tempStr, &tempStrSize, "%s.t", chainParams.chainFileName);
-                    else
-                        SafeSprintf (&tempStr, &tempStrSize, "%s.run%d.t", chainParams.chainFileName, j+1);
-                    }
-                else
+                if (chainParams.saveTrees == YES)
                     {
-                    if (chainParams.numRuns == 1)
-                        SafeSprintf (&tempStr, &tempStrSize, "%s.tree%d.t", chainParams.chainFileName, topologyPrintIndex[i]+1);
-                    else
-                        SafeSprintf (&tempStr, &tempStrSize, "%s.tree%d.run%d.t", chainParams.chainFileName, topologyPrintIndex[i]+1, j+1);
-                    }
-
-                if ((fp = OpenTextFileR (tempStr)) == NULL)
-                        {
-                        free (tempStr);
+                    if (RemoveTopologyFromPartitionCounters (&chainParams.topoList[j*numTopologies + i], i, j) == ERROR)
                         return (ERROR);
-                        }
-                
-                if (from == 1)
-                    {
-                    longestLine = LongestLine(fp);
-                    lineBuf = (char *) SafeCalloc (longestLine+2,sizeof(char));
-                    fseek (fp, LastBlock(fp, lineBuf, longestLine), SEEK_SET);
-                    fseek (fp, FirstTree(fp, lineBuf, longestLine), SEEK_SET);
-                    fgetpos (fp, &chainParams.tFilePos[j*numTopologies+i]);
-                    free(lineBuf);
-                    lineBuf = NULL;
-                    }
-                fsetpos (fp, &chainParams.tFilePos[j*numTopologies+i]);
-
-                longestLine = 0;
-                for (k=0; k<=to-from; k++)
-                    {
-                    line = 0;
-                    do {
-                        line++;
-                        } while ((c = fgetc(fp)) != '\r' && c != '\n');
-                    
-                    if (line > longestLine)
-                        longestLine = line;
-                    
-                    while ((c = fgetc(fp)) == '\r' || c == '\n')
-                        ;
-                    }
-
-                lineBuf = (char *) SafeCalloc (longestLine + 10, sizeof (char));
-                if (!lineBuf)
-                    {
-                    SafeFclose (&fp);
-                    free (tempStr);
-                    return (ERROR);
                     }
-                fsetpos (fp, &chainParams.tFilePos[j*numTopologies+i]);
-                /* The fsetpos and fgetpos pair are affected by writing to the file,
-                    at least on Windows systems. The effect is to put the subsequent
-                    fsetpos back a few positions. The following code will deal with this
-                    problem without affecting systems where this does not happen. */
-                do { c = fgetc(fp);
-                } while (c != 't');
-
-                for (k=from; k<=to; k++)
+                else
                     {
-                    if (fgets (lineBuf, longestLine + 5, fp) == NULL) 
-                        {
-                        free (tempStr);
-                        free (lineBuf);
-                        return ERROR;
-                        }
-
-                    s = strtok (lineBuf, " ");
-                    for (s = strtok (NULL, ";"); *s != '('; s++)
-                        ;
-                    
-                    StripComments (s);
-                    if (ResetTopology (t, s) == ERROR)
-                        {
-                        SafeFclose (&fp);
-                        free (tempStr);
-                        free (lineBuf);
-                        return (ERROR);
-                        }
-                    
-                    if (RemoveTreeFromPartitionCounters (t, i, j) == ERROR)
-                        {
-                        SafeFclose (&fp);
-                        free (tempStr);
-                        free (lineBuf);
+                    if (RemoveTreeFromSplitRing (&chainParams.splitRing[j*numTopologies + i], i, j) == ERROR)
                         return (ERROR);
-                        }
                     }
-                fgetpos (fp, &chainParams.tFilePos[j*numTopologies+i]);
-                free (lineBuf);
-                SafeFclose (&fp);
                 }
             }
         }
@@ -15302,20 +17393,61 @@ int RemoveTreeSamples (int from, int to)
         partFreqTreeRoot[i] = CompactTree (partFreqTreeRoot[i]);
         }
 
-    free (tempStr);
     return (NO_ERROR);
 }
 
 
+/*----------------------------------------------------------------------
+|
+|   ReopenMBPrintFiles: Reopen print files for appending. In the MPI
+|      version, the processor holding the cold chain of a run prints the
+|      samples of that run (see PrintStatesToFiles), so once proc 0 has
+|      prepared the .p, .sitelnl and .t files, all processors open them
+|      with MPI-IO. The samples are written at explicit offsets, which are
+|      kept the same on all processors, rather than relying on the append
+|      semantics of the file system, which do not hold on NFS.
+|
+------------------------------------------------------------------------*/
 int ReopenMBPrintFiles (void)
 {
     int     i, n;
-    char    fileName[120], localFileName[100];
+    char    fileName[140], localFileName[100];
     
-    /* Take care of the mpi procs that do not have a file */
 #   if defined (MPI_ENABLED)
-    if (proc_id != 0)
-        return (NO_ERROR);
+    int     nErrors = 0;
+
+    if (proc_id == 0)
+        {
+        /* flush and close what proc 0 has written so far */
+        for (n=0; n<chainParams.numRuns; n++)
+            {
+            SafeFclose (&fpParm[n]);
+            SafeFclose (&fpSiteLnL[n]);
+            for (i=0; i<numTrees; i++)
+                SafeFclose (&fpTree[n][i]);
+            }
+        }
+    else
+        {
+        /* the other procs have no file pointers, but FreeChainMemory has to close the sample files on all procs */
+        memAllocs[ALLOC_FILEPOINTERS] = YES;
+        }
+
+    numSampleFiles = chainParams.numRuns * (numTrees + 2);
+    sampleFile = (MPI_File *) SafeMalloc ((size_t)numSampleFiles * sizeof (MPI_File));
+    sampleFileEnd = (MPI_Offset *) SafeCalloc ((size_t)numSampleFiles, sizeof (MPI_Offset));
+    sampleFileBytes = (int *) SafeCalloc ((size_t)numSampleFiles + 1, sizeof (int));
+    if (!sampleFile || !sampleFileEnd || !sampleFileBytes)
+        {
+        MrBayesPrint ("%s   Could not allocate sample files in ReopenMBPrintFiles\n", spacer);
+        free (sampleFile);
+        free (sampleFileEnd);
+        free (sampleFileBytes);
+        sampleFile = NULL;
+        return (ERROR);
+        }
+    for (i=0; i<numSampleFiles; i++)
+        sampleFile[i] = MPI_FILE_NULL;
 #   endif
 
     /* Get root of local file name */
@@ -15329,8 +17461,28 @@ int ReopenMBPrintFiles (void)
         else
             sprintf (fileName, "%s.run%d.p", localFileName, n+1);
 
+#   if defined (MPI_ENABLED)
+        if (OpenSampleFile (fileName, n*(numTrees+2)) == ERROR)
+            nErrors++;
+#   else
         if ((fpParm[n] = OpenTextFileA (fileName)) == NULL)
             return (ERROR);
+#   endif
+
+        if (chainParams.calcPbf == YES)
+            {
+            if (chainParams.numRuns == 1)
+                sprintf (fileName, "%s.sitelnl", localFileName);
+            else
+                sprintf (fileName, "%s.run%d.sitelnl", localFileName, n+1);
+#   if defined (MPI_ENABLED)
+            if (OpenSampleFile (fileName, n*(numTrees+2) + 1) == ERROR)
+                nErrors++;
+#   else
+            if ((fpSiteLnL[n] = OpenTextFileA (fileName)) == NULL)
+                return (ERROR);
+#   endif
+            }
 
         for (i=0; i<numTrees; i++)
             {
@@ -15343,13 +17495,36 @@ int ReopenMBPrintFiles (void)
             else
                 sprintf (fileName, "%s.tree%d.run%d.t", localFileName, i+1, n+1);
 
+#   if defined (MPI_ENABLED)
+            if (OpenSampleFile (fileName, n*(numTrees+2) + 2 + i) == ERROR)
+                nErrors++;
+#   else
             if ((fpTree[n][i] = OpenTextFileA (fileName)) == NULL)
                 return (ERROR);
+#   endif
             }
         }
 
+#   if defined (MPI_ENABLED)
+    /* the samples go after what proc 0 has written */
+    for (i=0; i<numSampleFiles && proc_id == 0; i++)
+        {
+        if (sampleFile[i] != MPI_FILE_NULL && MPI_File_get_size (sampleFile[i], &sampleFileEnd[i]) != MPI_SUCCESS)
+            nErrors++;
+        }
+    if (MPI_Bcast (sampleFileEnd, numSampleFiles, MPI_OFFSET, 0, MPI_COMM_WORLD) != MPI_SUCCESS)
+        nErrors++;
+    if (nErrors > 0)
+        return (ERROR);
+#   endif
+
+#   if defined (MPI_ENABLED)
+    if (proc_id != 0)
+        return (NO_ERROR);
+#   endif
+
     /* Reopen the .mcmc file */
-    if (chainParams.mcmcDiagn == YES)
+    if (chainParams.mcmcDiagn == YES && fpMcmc == NULL)
         {
         sprintf (fileName, "%s.mcmc", localFileName);
 
@@ -15365,7 +17540,7 @@ int ReopenMBPrintFiles (void)
         else
             sprintf (fileName, "%s.run%d.dump", localFileName, n+1);
 
-        if ((fpDump[n] = OpenTextFileA (fileName)) == NULL)
+        if (fpDump[n] == NULL && (fpDump[n] = OpenTextFileA (fileName)) == NULL)
             return (ERROR);
         }
 #   endif
@@ -15648,6 +17823,53 @@ void ResetFlips (int chain)
 }
 
 
+/*-----------------------------------------------------------------------
+|
+|   ResetMoveWeights: Restore the relative proposal probabilities set
+|       before the run, after printing the probabilities adapted at
+|       generation reweightGen (0 if none was changed), and free the
+|       adaptation info.
+|
+------------------------------------------------------------------------*/
+void ResetMoveWeights (int reweightGen)
+{
+    int         i, j;
+    MrBFlt      *oldProb, sumOld, sumNew;
+
+    oldProb = autoweightInfo + 3*numUsedMoves*numGlobalChains;
+
+    if (reweightGen > 0)
+        {
+        sumOld = sumNew = 0.0;
+        for (i=0; i<numUsedMoves; i++)
+            {
+            sumOld += oldProb[i*numGlobalChains];
+            sumNew += usedMoves[i]->relProposalProb[0];
+            }
+        MrBayesPrint ("\n%s   Proposal probabilities adapted at generation %d", spacer, reweightGen);
+        if (chainParams.numChains > 1)
+            MrBayesPrint (" in the \"cold\" chain");
+        if (chainParams.numRuns > 1)
+            MrBayesPrint (" of run 1");
+        MrBayesPrint (":\n\n");
+        MrBayesPrint ("%s         Before     After   Move\n", spacer);
+        for (i=0; i<numUsedMoves; i++)
+            MrBayesPrint ("%s      %6.2f %%  %6.2f %%   %s\n", spacer, 100.0*oldProb[i*numGlobalChains]/sumOld,
+                100.0*usedMoves[i]->relProposalProb[0]/sumNew, usedMoves[i]->name);
+        }
+    else
+        MrBayesPrint ("\n%s   The proposal probabilities were not changed by the adaptation\n", spacer);
+
+    for (i=0; i<numUsedMoves; i++)
+        for (j=0; j<numGlobalChains; j++)
+            usedMoves[i]->relProposalProb[j] = oldProb[i*numGlobalChains + j];
+    SetCumProposalProbs ();
+
+    free (autoweightInfo);
+    autoweightInfo = NULL;
+}
+
+
 /*-------------------------------------------------------------------
 |
 |   ResetScalersPartition: reset scaler nodes of the given tree by appropriately setting isScalerNode array.
@@ -15748,7 +17970,7 @@ int ReusePreviousResults (int *numSamples, int steps)
 
     (*numSamples) = 0;
 
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     if (proc_id != 0)
         return (NO_ERROR);
 #   endif
@@ -15763,12 +17985,13 @@ int ReusePreviousResults (int *numSamples, int steps)
     fpSS = NULL;
     fpParm = NULL;
     fpTree = NULL;  
-    fpParm = (FILE **) SafeCalloc (chainParams.numRuns, sizeof (FILE *));
+    fpParm = (FILE **) SafeCalloc (2 * chainParams.numRuns, sizeof (FILE *));
     if (fpParm == NULL)
         {
         MrBayesPrint ("%s   Could not allocate fpParm in ReusePreviousResults\n", spacer);
         return ERROR;
         }
+    fpSiteLnL = fpParm + chainParams.numRuns;
     memAllocs[ALLOC_FILEPOINTERS] = YES;
     fpTree = (FILE ***) SafeCalloc (chainParams.numRuns, sizeof (FILE **));
     if (fpTree == NULL)
@@ -15809,6 +18032,26 @@ int ReusePreviousResults (int *numSamples, int steps)
         else if (CopyResults(fpParm[n],bkupName+strlen(workingDir),numPreviousGen) == ERROR)
             return (ERROR);
 
+        if (chainParams.calcPbf == YES)
+            {
+            if (chainParams.numRuns == 1)
+                sprintf (fileName, "%s%s.sitelnl", workingDir, localFileName);
+            else
+                sprintf (fileName, "%s%s.run%d.sitelnl", workingDir, localFileName, n+1);
+            strcpy(bkupName,fileName);
+            strcat(bkupName,"~");
+            remove(bkupName);
+            if (rename(fileName,bkupName) != 0)
+                {
+                MrBayesPrint ("%s   Could not rename file %s\n", spacer, fileName);
+                return ERROR;
+                }
+            if ((fpSiteLnL[n] = OpenNewMBPrintFile (fileName+strlen(workingDir))) == NULL)
+                return (ERROR);
+            else if (CopyResults(fpSiteLnL[n],bkupName+strlen(workingDir),numPreviousGen) == ERROR)
+                return (ERROR);
+            }
+
         for (i=0; i<numTrees; i++)
             {
             if (numTrees == 1 && chainParams.numRuns == 1)
@@ -15889,13 +18132,169 @@ int ReusePreviousResults (int *numSamples, int steps)
 }
 
 
+/*-----------------------------------------------------------------------
+|
+|   ReweightMoves: Adapt the relative proposal probabilities to the cost
+|       and mixing of the moves, using the time, the squared jumps in the
+|       log posterior of accepted proposals and the number of tries of
+|       each move and chain collected in autoweightInfo. Each move is
+|       compared with the other moves of the same parameter: its
+|       probability is scaled by its squared jump per second relative to
+|       their mean, by at most AUTOWEIGHT_MAX_FACTOR, and the sum of the
+|       probabilities of the parameter is kept, so that the balance
+|       between the parameters is not changed. The old probabilities are
+|       kept in autoweightInfo for ResetMoveWeights. numChanged is set to
+|       the number of probabilities, over moves and chains, that were
+|       changed. With the Checkautoweight option, the probabilities of
+|       the moves of a parameter that were not limited by
+|       AUTOWEIGHT_MAX_FACTOR have to change in proportion to their
+|       squared jumps per second, and it is an error if no probability
+|       was changed in this way.
+|
+------------------------------------------------------------------------*/
+int ReweightMoves (int *numChanged)
+{
+    int         i, j, k, isChanged, numUnlimited, numUnlimitedChanged, numProportional;
+    MrBFlt      *x, *oldProb, sumProb, sumEff, meanEff, newSum, factor, ratio, minRatio=0.0, maxRatio=0.0;
+    MCMCMove    *mv;
+
+    *numChanged = numProportional = 0;
+    oldProb = autoweightInfo + 3*numUsedMoves*numGlobalChains;
+
+#   if defined (MPI_ENABLED)
+    /* a chain has been timed on the processors it has been on */
+    if (MPI_Allreduce (MPI_IN_PLACE, autoweightInfo, 3*numUsedMoves*numGlobalChains, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD) != MPI_SUCCESS)
+        {
+        MrBayesPrint ("%s   Problem collecting move times\n", spacer);
+        return (ERROR);
+        }
+#   elif defined (BEST_MPI_ENABLED)
+    /* all processors run all chains; use the times of the slowest one
+       so that all processors pick the same probabilities */
+    if (MPI_Allreduce (MPI_IN_PLACE, autoweightInfo, 3*numUsedMoves*numGlobalChains, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD) != MPI_SUCCESS)
+        {
+        MrBayesPrint ("%s   Problem collecting move times\n", spacer);
+        return (ERROR);
+        }
+#   endif
+
+    for (j=0; j<numGlobalChains; j++)
+        {
+        for (i=0; i<numUsedMoves; i++)
+            {
+            /* the first move of each parameter takes care of all of them */
+            for (k=0; k<i; k++)
+                if (usedMoves[k]->parm == usedMoves[i]->parm)
+                    break;
+            if (k < i)
+                continue;
+
+            /* mean squared jump per second of the moves, weighted by their probabilities */
+            sumProb = sumEff = 0.0;
+            for (k=i; k<numUsedMoves; k++)
+                {
+                mv = usedMoves[k];
+                x = autoweightInfo + 3*(k*numGlobalChains + j);
+                if (mv->parm != usedMoves[i]->parm || x[2] < AUTOWEIGHT_MIN_TRIES || x[0] <= 0.0)
+                    continue;
+                sumProb += mv->relProposalProb[j];
+                sumEff += mv->relProposalProb[j] * x[1] / x[0];
+                }
+            if (sumEff <= 0.0)
+                continue;
+            meanEff = sumEff / sumProb;
+
+            /* scale the probabilities, then restore their sum */
+            sumProb = newSum = 0.0;
+            for (k=i; k<numUsedMoves; k++)
+                {
+                mv = usedMoves[k];
+                if (mv->parm != usedMoves[i]->parm)
+                    continue;
+                x = autoweightInfo + 3*(k*numGlobalChains + j);
+                factor = 1.0;
+                if (x[2] >= AUTOWEIGHT_MIN_TRIES && x[0] > 0.0)
+                    {
+                    factor = x[1] / x[0] / meanEff;
+                    if (factor > AUTOWEIGHT_MAX_FACTOR)
+                        factor = AUTOWEIGHT_MAX_FACTOR;
+                    else if (factor < 1.0 / AUTOWEIGHT_MAX_FACTOR)
+                        factor = 1.0 / AUTOWEIGHT_MAX_FACTOR;
+                    }
+                sumProb += mv->relProposalProb[j];
+                mv->relProposalProb[j] *= factor;
+                newSum += mv->relProposalProb[j];
+                }
+            for (k=i; k<numUsedMoves; k++)
+                {
+                if (usedMoves[k]->parm == usedMoves[i]->parm)
+                    usedMoves[k]->relProposalProb[j] *= sumProb / newSum;
+                }
+
+            /* count the changed probabilities; the ratio of the change of the probability
+               to the squared jump per second has to be the same for the unlimited moves */
+            numUnlimited = numUnlimitedChanged = 0;
+            for (k=i; k<numUsedMoves; k++)
+                {
+                mv = usedMoves[k];
+                if (mv->parm != usedMoves[i]->parm)
+                    continue;
+                isChanged = NO;
+                if (fabs (mv->relProposalProb[j] - oldProb[k*numGlobalChains + j]) > 1E-6 * oldProb[k*numGlobalChains + j])
+                    {
+                    isChanged = YES;
+                    (*numChanged)++;
+                    }
+                x = autoweightInfo + 3*(k*numGlobalChains + j);
+                if (x[2] < AUTOWEIGHT_MIN_TRIES || x[0] <= 0.0 || x[1] <= 0.0)
+                    continue;
+                factor = x[1] / x[0] / meanEff;
+                if (factor >= AUTOWEIGHT_MAX_FACTOR || factor <= 1.0 / AUTOWEIGHT_MAX_FACTOR)
+                    continue;
+                ratio = mv->relProposalProb[j] / oldProb[k*numGlobalChains + j] / (x[1] / x[0]);
+                if (numUnlimited == 0 || ratio < minRatio)
+                    minRatio = ratio;
+                if (numUnlimited == 0 || ratio > maxRatio)
+                    maxRatio = ratio;
+                numUnlimited++;
+                if (isChanged == YES)
+                    numUnlimitedChanged++;
+                }
+            if (numUnlimited > 1)
+                numProportional += numUnlimitedChanged;
+            if (chainParams.checkAutoweight == YES && numUnlimited > 1 && maxRatio - minRatio > 1E-6 * maxRatio)
+                {
+                MrBayesPrint ("%s   The proposal probabilities of the moves of %s did not change in\n", spacer, usedMoves[i]->parm->name);
+                MrBayesPrint ("%s   proportion to their squared jumps per second in chain %d\n", spacer, j+1);
+                return (ERROR);
+                }
+            }
+        }
+
+    if (chainParams.checkAutoweight == YES && numProportional == 0)
+        {
+        MrBayesPrint ("%s   No proposal probability was changed in proportion to its squared jump per\n", spacer);
+        MrBayesPrint ("%s   second; the moves may have been tried fewer than %d times in the second\n", spacer, AUTOWEIGHT_MIN_TRIES);
+        MrBayesPrint ("%s   half of the burnin\n", spacer);
+        return (ERROR);
+        }
+
+    SetCumProposalProbs ();
+
+    return (NO_ERROR);
+}
+
+
 int RunChain (RandLong *seed)
 {
-    int         i, j, n, chn, swapA=0, swapB=0, whichMove, acceptMove;
+    int         i, j, n, chn, whichMove, acceptMove;
     int         lastDiagnostics;    // the sample no. when last diagnostic was performed
     int         removeFrom, removeTo=0;
     int         stopChain, nErrors;
+    int         autoweightStartGen=0, autoweightEndGen=0, reweightGen=0;
+    int         heapAllocs, numStepHeapAllocs=0, lastHeapAllocGen=0, numWeightsChanged;
     MrBFlt      r=0.0, lnLikelihoodRatio, lnPriorRatio, lnProposalRatio, lnLike=0.0, lnPrior=0.0, f=0.0, CPUTime;
+    MrBFlt      autoweightTime=0.0, lnJump=0.0, *weightInfo;
     MCMCMove    *theMove, *mv;
     time_t      startingT, endingT, stoppingT1, stoppingT2;
     clock_t     previousCPUTime, currentCPUTime;
@@ -15903,6 +18302,9 @@ int RunChain (RandLong *seed)
     int         run, samplesCountSS=0, stepIndexSS=0, numGenInStepSS=0, numGenOld, lastStepEndSS=0, numGenInStepBurninSS=0;
     MrBFlt      stepLengthSS=0, meanSS, varSS, *tempX;
     char        ckpFileName[220], bkupFileName[220];
+#   if !defined (MPI_ENABLED)
+    int         swapA=0, swapB=0;
+#   endif
 
 #   if defined (BEAGLE_ENABLED)
     int         ResetScalersNeeded;  //set to YES if we need to reset node->scalerNode, used in old style rescaling;
@@ -15924,9 +18326,9 @@ int RunChain (RandLong *seed)
 #   endif
 
 #   if defined (MPI_ENABLED)
-    int         ierror, sumErrors;
-    MrBFlt      best, sum=0.0;
-    MPI_Status  status;
+    int         ierror, sumErrors, x[2], sumX[2];
+    MrBFlt      rSS[MAX_RUNS], sumSS[MAX_RUNS];
+    double      t0, loopTime;
 #   endif
 #   if defined (DEBUG_RUNCHAIN)
     ModelInfo   *m;
@@ -16074,6 +18476,33 @@ int RunChain (RandLong *seed)
             for (j=0; j<chainParams.numChains; j++)
                 swapInfo[n][i][j] = 0;
 
+#   if defined (MPI_ENABLED)
+    /* allocate space for swap rounds */
+    if (chainParams.numChains > 1 && memAllocs[ALLOC_SWAPBUFFERS] == NO)
+        {
+        swapSummary = (MrBFlt *) SafeCalloc ((numGlobalChains + numLocalChains) * SWAP_SUMMARY_SIZE + 2 * numLocalChains * 7 * numUsedMoves, sizeof (MrBFlt));
+        swapRequest = (MPI_Request *) SafeMalloc (2 * numLocalChains * sizeof (MPI_Request));
+        swapHeat = (int *) SafeMalloc ((3 * numGlobalChains + numLocalChains) * sizeof (int));
+        if (!swapSummary || !swapRequest || !swapHeat)
+            {
+            free (swapSummary);
+            free (swapRequest);
+            free (swapHeat);
+            nErrors++;
+            }
+        else
+            {
+            swapMoveInfo = swapSummary + (numGlobalChains + numLocalChains) * SWAP_SUMMARY_SIZE;
+            swapRecvHeat = swapHeat + 3 * numGlobalChains;
+            for (i=0; i<2*numLocalChains; i++)
+                swapRequest[i] = MPI_REQUEST_NULL;
+            for (i=0; i<numLocalChains; i++)
+                swapRecvHeat[i] = -1;
+            memAllocs[ALLOC_SWAPBUFFERS] = YES;
+            }
+        }
+#   endif
+
     /* set up counters for topological convergence diagnostics */
     /* allocate tree used for some topological convergence diagnostics */
     if (chainParams.mcmcDiagn == YES && chainParams.numRuns > 1)
@@ -16089,29 +18518,44 @@ int RunChain (RandLong *seed)
             /* we have to remove trees later on */
             if (chainParams.saveTrees == YES)
                 {
-                if (chainParams.treeList)
+                if (chainParams.topoList || chainParams.splitPool)
                     nErrors++;
                 else 
                     {
-                    chainParams.treeList = (TreeList *) SafeCalloc (chainParams.numRuns*numTopologies, sizeof (TreeList));
-                    if (!chainParams.treeList)
+                    chainParams.splitPool = (SplitPool *) SafeCalloc (numTopologies, sizeof (SplitPool));
+                    chainParams.topoList = (PackedTopologyList *) SafeCalloc (chainParams.numRuns*numTopologies, sizeof (PackedTopologyList));
+                    if (!chainParams.splitPool || !chainParams.topoList)
                         nErrors++;
                     }
-                if (nErrors == 0)
-                    memAllocs[ALLOC_TREELIST] = YES;
-                if (noWarn == YES)
-                    chainParams.stopTreeGen = (int) (chainParams.numGen * chainParams.burninFraction);
-                else
-                    chainParams.stopTreeGen = chainParams.numGen;
+                if (nErrors == 0)
+                    {
+                    /* the runs share one split pool for each topology */
+                    for (i=0; i<numTopologies; i++)
+                        {
+                        chainParams.splitPool[i].nLongs = nLongsNeeded;
+                        for (j=0; j<chainParams.numRuns; j++)
+                            chainParams.topoList[j*numTopologies+i].pool = &chainParams.splitPool[i];
+                        }
+                    memAllocs[ALLOC_TOPOLIST] = YES;
+                    }
                 }
             else /* if (chainParams.saveTrees == NO) */
                 {
-                chainParams.tFilePos = (fpos_t*) SafeRealloc ((void *)chainParams.tFilePos, chainParams.numRuns*numTopologies*sizeof (fpos_t));
-                if (!chainParams.tFilePos)
+                if (chainParams.splitRing)
                     nErrors++;
                 else
-                    memAllocs[ALLOC_TFILEPOS] = YES;
+                    {
+                    chainParams.splitRing = (SplitRing *) SafeCalloc (chainParams.numRuns*numTopologies, sizeof (SplitRing));
+                    if (!chainParams.splitRing)
+                        nErrors++;
+                    }
+                if (nErrors == 0)
+                    memAllocs[ALLOC_SPLITRING] = YES;
                 }
+            if (noWarn == YES && chainParams.isSS == NO)
+                chainParams.stopTreeGen = (int) (chainParams.numGen * chainParams.burninFraction);
+            else
+                chainParams.stopTreeGen = chainParams.numGen;
             }
 #   if defined (MPI_ENABLED)
             }
@@ -16265,6 +18709,12 @@ int RunChain (RandLong *seed)
             MrBayesPrint ("%s   ple of sampling frequency. That is why, in total it will be taken %d    \n", spacer, chainParams.numGen);
             MrBayesPrint ("%s   generations instead of requested %d.                                    \n", spacer, numGenOld);
             }
+        if (chainParams.numBlocksSS > 1)
+            {
+            chainParams.numGen = chainParams.burninSS * chainParams.sampleFreq + (lastStepSS-firstStepSS+1)*numGenInStepSS;
+            MrBayesPrint ("%s   This analysis samples block %d of %d, i.e. steps %d to %d, in a total of  \n", spacer, chainParams.blockSS, chainParams.numBlocksSS, firstStepSS, lastStepSS);
+            MrBayesPrint ("%s   %d generations, starting with the initial burnin at the power of step %d.\n", spacer, chainParams.numGen, firstStepSS);
+            }
         MrBayesPrint ("\n");
         if ((numGenInStepSS-numGenInStepBurninSS)/chainParams.sampleFreq < 1)
             {
@@ -16276,19 +18726,24 @@ int RunChain (RandLong *seed)
         if (numPreviousGen==0 || numPreviousGen < chainParams.burninSS * chainParams.sampleFreq)
             {
             lastStepEndSS = chainParams.burninSS * chainParams.sampleFreq;
-            stepIndexSS = chainParams.numStepsSS-1;
+            stepIndexSS = chainParams.numStepsSS-firstStepSS;
             if (numPreviousGen != 0)
                 removeTo=(numPreviousGen/chainParams.sampleFreq)+1;
             if (chainParams.startFromPriorSS==YES)
                 {
-                // powerSS = BetaQuantile (chainParams.alphaSS, 1.0, (MrBFlt)(chainParams.numStepsSS-1-stepIndexSS)/(MrBFlt)chainParams.numStepsSS);
-                powerSS = 0.0;
+                if (firstStepSS == 1)
+                    powerSS = 0.0;
+                else
+                    powerSS = BetaQuantile (chainParams.alphaSS, 1.0, (MrBFlt)(chainParams.numStepsSS-1-stepIndexSS)/(MrBFlt)chainParams.numStepsSS);
                 stepLengthSS = BetaQuantile (chainParams.alphaSS, 1.0, (MrBFlt)(chainParams.numStepsSS-stepIndexSS)/(MrBFlt)chainParams.numStepsSS)-powerSS;
                 }
             else
                 {
                 powerSS = BetaQuantile (chainParams.alphaSS, 1.0, (MrBFlt)stepIndexSS/(MrBFlt)chainParams.numStepsSS);
-                stepLengthSS = 1.0-powerSS;
+                if (firstStepSS == 1)
+                    stepLengthSS = 1.0-powerSS;
+                else
+                    stepLengthSS = BetaQuantile (chainParams.alphaSS, 1.0, (MrBFlt)(stepIndexSS+1)/(MrBFlt)chainParams.numStepsSS)-powerSS;
                 }
             samplesCountSS=0;
             }
@@ -16299,7 +18754,7 @@ int RunChain (RandLong *seed)
             removeTo        = chainParams.burninSS + (stepIndexSS*numGenInStepSS+numGenInStepBurninSS)/chainParams.sampleFreq + 1;
             if (numPreviousGen < (removeTo-1)*chainParams.sampleFreq)
                 removeTo=numPreviousGen/chainParams.sampleFreq+1;
-            stepIndexSS     = chainParams.numStepsSS-1-stepIndexSS;
+            stepIndexSS     = chainParams.numStepsSS-firstStepSS-stepIndexSS;
             if (chainParams.startFromPriorSS==YES)
                 {
                 powerSS = BetaQuantile (chainParams.alphaSS, 1.0, (MrBFlt)(chainParams.numStepsSS-1-stepIndexSS)/(MrBFlt)chainParams.numStepsSS);
@@ -16345,7 +18800,7 @@ int RunChain (RandLong *seed)
     /* Append to previous analysis if this is requested, otherwise just open new print files */
     if (chainParams.append == YES)
         {
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     if (proc_id == 0) {
 #   endif
         /* We get the number of samples in i */
@@ -16378,24 +18833,23 @@ int RunChain (RandLong *seed)
                         j = i;
                     if (j < i)
                         {
-                        if (AddTreeSamples(1,j,chainParams.saveTrees) == ERROR) nErrors++;
+                        if (AddTreeSamples(1,j,YES) == ERROR) nErrors++;
                         if (AddTreeSamples(j+1,i,NO) == ERROR) nErrors++;
                         /* Since we never need to remove trees from partition counter after total burnin we put NO in the last argument */
                         }
                     else
                         {
-                        if (AddTreeSamples(1,i,chainParams.saveTrees) == ERROR) nErrors++;
+                        if (AddTreeSamples(1,i,YES) == ERROR) nErrors++;
                         }
                     }
                 else
                     {
-                    if (SetFilePositions(removeTo) == ERROR) nErrors++;
-                    if (AddTreeSamples(removeTo+1,i,chainParams.saveTrees) == ERROR) nErrors++;
+                    if (AddTreeSamples(removeTo+1,i,YES) == ERROR) nErrors++;
                     }
                 }
             else if (chainParams.chainBurnIn < i)
                 {
-                if (AddTreeSamples(chainParams.chainBurnIn,i-1,chainParams.saveTrees) == ERROR) nErrors++;
+                if (AddTreeSamples(chainParams.chainBurnIn,i-1,NO) == ERROR) nErrors++;
                 }
             }
         if (nErrors == 0)
@@ -16411,7 +18865,7 @@ int RunChain (RandLong *seed)
             MrBayesPrint ("\n");
             MrBayesPrint ("%s   Chain results (continued from previous run; %d generations requested):\n\n", spacer, chainParams.numGen);
             }
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
         }
 #   endif
 
@@ -16473,6 +18927,16 @@ int RunChain (RandLong *seed)
             MrBayesPrint ("%s    Error appending to previous run\n", spacer);
             return ERROR;
             }            
+#   elif defined (BEST_MPI_ENABLED)
+        /* only proc 0 has read the previous results */
+        if (chainParams.isSS == YES)
+            MPI_Bcast (marginalLnLSS, chainParams.numRuns, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        MPI_Bcast (&nErrors, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (nErrors > 0)
+            {
+            MrBayesPrint ("%s    Error appending to previous run\n", spacer);
+            return ERROR;
+            }
 #   else
         if (nErrors == 1)
             {
@@ -16495,6 +18959,17 @@ int RunChain (RandLong *seed)
         CloseMBPrintFiles();
         return ERROR;
         }
+
+    /* samples are printed by the processor holding the cold chain */
+    if (ReopenMBPrintFiles () == ERROR)
+        nErrors++;
+    MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (sumErrors > 0)
+        {
+        MrBayesPrint ("%s   Error reopening print files on at least one processor\n", spacer);
+        CloseMBPrintFiles();
+        return ERROR;
+        }
 #   else
     if (nErrors > 0)
         {
@@ -16582,7 +19057,7 @@ int RunChain (RandLong *seed)
         if (chainParams.isSS == YES)
             {
             if (chainParams.burninSS == 0)
-                MrBayesPrint("%s   Sampling step 1 out of %d steps...\n\n",spacer, chainParams.numStepsSS);
+                MrBayesPrint("%s   Sampling step %d out of %d steps...\n\n",spacer, firstStepSS, chainParams.numStepsSS);
 
             /*Printing SS header*/
             MrBayesPrintf (fpSS, "[LEGEND: The file contains statistics on the Steppingstone Sampling.]\n");
@@ -16611,6 +19086,48 @@ int RunChain (RandLong *seed)
             }
         }
 
+    /* only the run loop is profiled */
+    if (chainParams.profile == YES)
+        {
+        free (moveTime);
+        moveTime = (MrBFlt *) SafeCalloc ((size_t)numUsedMoves*NUM_PROFILE_TIMERS + (size_t)numCurrentDivisions, sizeof (MrBFlt));
+        if (!moveTime)
+            return (ERROR);
+        divisionLikeTime = moveTime + numUsedMoves*NUM_PROFILE_TIMERS;
+        }
+
+    /* adapt the proposal probabilities in the second half of the burnin, if requested */
+    if (chainParams.autoweight == YES)
+        {
+        if (chainParams.isSS == YES)
+            autoweightEndGen = chainParams.burninSS * chainParams.sampleFreq;
+        else if (chainParams.relativeBurnin == YES)
+            autoweightEndGen = (int) (chainParams.burninFraction * chainParams.numGen);
+        else
+            autoweightEndGen = chainParams.chainBurnIn * chainParams.sampleFreq;
+        autoweightStartGen = autoweightEndGen / 2;
+        if (autoweightStartGen < numPreviousGen || autoweightEndGen <= autoweightStartGen || autoweightEndGen >= chainParams.numGen)
+            MrBayesPrint ("%s   Not adapting the proposal probabilities: the burnin is too short or has already been run\n", spacer);
+        else
+            {
+            free (autoweightInfo);
+            autoweightInfo = (MrBFlt *) SafeCalloc (4 * (size_t)numUsedMoves * (size_t)numGlobalChains, sizeof (MrBFlt));
+            if (!autoweightInfo)
+                return (ERROR);
+            /* keep the old probabilities for ResetMoveWeights */
+            weightInfo = autoweightInfo + 3*numUsedMoves*numGlobalChains;
+            for (i=0; i<numUsedMoves; i++)
+                for (j=0; j<numGlobalChains; j++)
+                    weightInfo[i*numGlobalChains + j] = usedMoves[i]->relProposalProb[j];
+            }
+        }
+
+#   if defined (MPI_ENABLED)
+    for (i=0; i<NUM_MPI_TIMERS; i++)
+        mpiTime[i] = 0.0;
+    loopTime = MPI_Wtime ();
+#   endif
+
     for (n=numPreviousGen+1; n<=chainParams.numGen; n++) /* begin run chain */
         {
         currentCPUTime = clock();
@@ -16624,9 +19141,27 @@ int RunChain (RandLong *seed)
         if (requestAbortRun == YES && ConfirmAbortRun() == 1)
             return ABORT;
 
+        /* the proposal probabilities are fixed from the end of the burnin */
+        if (autoweightInfo != NULL && n == autoweightEndGen + 1)
+            {
+            if (ReweightMoves (&numWeightsChanged) == ERROR)
+                return (ERROR);
+            if (numWeightsChanged > 0)
+                reweightGen = autoweightEndGen;
+            }
+
         // RandLong oldSeed = *seed;  /* record the old seed for debugging */
         for (chn=0; chn<numLocalChains; chn++)
             {
+#   if defined (MPI_ENABLED)
+            /* we need the move info of the heat if it was just swapped in from another processor */
+            if (WaitForSwappedMoveInfo (chn) == ERROR)
+                {
+                MrBayesPrint ("%s   Problem receiving move info of swapped chain\n", spacer);
+                nErrors++;
+                }
+#   endif
+
             /* Do Gibbs resampling of rate categories for current state if time to do so */
             for (i=0; i<numCurrentDivisions; i++)
                 {
@@ -16634,6 +19169,20 @@ int RunChain (RandLong *seed)
                     curLnL[chn] += GibbsSampleGamma (chn, i, seed);
                 }
 
+            /* scratch space used by the previous chain is free again; the heap allocations
+               of the chain step are counted, and should stop early in the run */
+            ScratchReset ();
+            heapAllocs = HeapAllocs ();
+
+            /* the copying of the state is charged to the move picked below */
+            if (moveTime != NULL)
+                {
+                lastMoveTime = ProfileTime ();
+                priorTime = 0.0;
+                }
+            if (autoweightInfo != NULL && n > autoweightStartGen && n <= autoweightEndGen)
+                autoweightTime = ProfileTime ();
+
             /* First copy everything from current state of chain to new state.   */
             /* The global variable state[chain] gives state.                     */
 
@@ -16647,23 +19196,19 @@ int RunChain (RandLong *seed)
             /* all calculations will be done on this state   */
             state[chn] ^= 1;  /* XORing with 1 switches between 0 and 1 */
 
+            /* gene tree probabilities cached for the new state are about to become stale */
+            if (memAllocs[ALLOC_BEST] == YES)
+                InvalidateGeneTreeLnPr (chn);
+
             /* decide which move to make */
             whichMove = PickProposal(seed, chainId[chn]);
             theMove = usedMoves[whichMove];
+            if (moveTime != NULL)
+                AddMoveTime (whichMove, PROFILE_COPY);
 #   if defined SHOW_MOVE
             printf ("Making move '%s'\n", theMove->name);
 #   endif
 
-#   if defined (BEST_MPI_ENABLED)
-            bestCycleGen = n % (numNonTreeMoves + numTreeMoves + numBestMoves);
-            if (bestCycleGen < numNonTreeMoves)
-                PickNonTreeProposal(seed, chainId[chn]);
-            else if (bestCycleGen < numNonTreeMoves + numTreeMoves)
-                PickTreeProposal(seed, chainId[chn]);
-            else
-                PickBestProposal(chainId[chn]);
-#   endif
-
             /* set prior and proposal ratios */
             lnProposalRatio = 0.0;
             lnPriorRatio = 0.0;
@@ -16712,10 +19257,16 @@ int RunChain (RandLong *seed)
                 abortMove = YES;
                 }
 
+            if (moveTime != NULL)
+                AddMoveTime (whichMove, PROFILE_PROPOSAL);
+
             /* abortMove is set to YES if the calculation fails because the likelihood is too small */
             if (abortMove == NO)
                 lnLike = LogLike(chn);
 
+            if (moveTime != NULL)
+                AddMoveTime (whichMove, PROFILE_LIKE);
+
             /* calculate acceptance probability */
             if (abortMove == NO)
                 {
@@ -16818,10 +19369,30 @@ int RunChain (RandLong *seed)
                 {
                 /* if the move is accepted then let the chain stay in the new state */
                 /* store the likelihood and prior of the chain */
+                lnJump = lnLike + lnPrior - curLnL[chn] - curLnPr[chn];
                 curLnL[chn] = lnLike;
                 curLnPr[chn] = lnPrior;
                 }
 
+            if (moveTime != NULL)
+                AddMoveTime (whichMove, PROFILE_COPY);
+
+            if (HeapAllocs () != heapAllocs)
+                {
+                numStepHeapAllocs += HeapAllocs () - heapAllocs;
+                lastHeapAllocGen = n;
+                }
+
+            /* record the cost and the squared jump of the move for ReweightMoves */
+            if (autoweightInfo != NULL && n > autoweightStartGen && n <= autoweightEndGen)
+                {
+                weightInfo = autoweightInfo + 3*(whichMove*numGlobalChains + chainId[chn]);
+                weightInfo[0] += ProfileTime () - autoweightTime;
+                if (acceptMove == YES)
+                    weightInfo[1] += lnJump * lnJump;
+                weightInfo[2] += 1.0;
+                }
+
             /* check if time to autotune */
             if (theMove->nTried[i] >= chainParams.tuneFreq)
                 {
@@ -16847,23 +19418,29 @@ int RunChain (RandLong *seed)
 
             }
 
-        /* attempt swap(s) Non-blocking for MPI if no swap with external process. */
+        /* attempt swap(s). For MPI, one collective per round; move info of swapped heats is received while the next generation runs */
         if (chainParams.numChains > 1 && n % chainParams.swapFreq == 0)
             {
+#   if defined (MPI_ENABLED)
+            if (AttemptSwapRound (seed) == ERROR)
+                {
+                MrBayesPrint ("%s   Unsuccessful swap of states\n", spacer);
+                nErrors++;
+                }
+#   else
             for (i = 0; i<chainParams.numRuns; i++)
                 {
                 for (j = 0; j<chainParams.numSwaps; j++)
-                    GetSwappers (&swapA, &swapB, i);
-                if (AttemptSwap (swapA, swapB, seed) == ERROR)
                     {
-                    MrBayesPrint ("%s   Unsuccessful swap of states\n", spacer);
-#   if defined (MPI_ENABLED)
-                    nErrors++;
-#   else
-                    return ERROR;
-#   endif
+                    GetSwappers (&swapA, &swapB, i);
+                    if (AttemptSwap (swapA, swapB, seed) == ERROR)
+                        {
+                        MrBayesPrint ("%s   Unsuccessful swap of states\n", spacer);
+                        return ERROR;
+                        }
                     }
                 }
+#   endif
             }
 
         /* print information to screen. Non-blocking for MPI */
@@ -16879,16 +19456,9 @@ int RunChain (RandLong *seed)
 
         /* print information to files */
         /* this will also add tree samples to topological convergence diagnostic counters */
+        /* for MPI, errors of the swap round are picked up by the single check after printing */
         if (n == chainParams.numGen || n % chainParams.sampleFreq == 0)
             {
-#   if defined (MPI_ENABLED)
-            MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-            if (sumErrors > 0)
-                {
-                MrBayesPrint ("%s   Aborting run.\n");
-                return ERROR;
-                }
-#   endif
             if (PrintStatesToFiles (n) == ERROR)
                 {
                 MrBayesPrint("%s   Error in printing states to files\n");
@@ -16899,7 +19469,9 @@ int RunChain (RandLong *seed)
 #   endif
                 }
 #   if defined (MPI_ENABLED)
+            t0 = MPI_Wtime ();
             MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+            mpiTime[MPI_TIME_OTHER] += MPI_Wtime () - t0;
             if (sumErrors > 0)
                 {
                 MrBayesPrint ("%s   Aborting run.\n");
@@ -16920,7 +19492,7 @@ int RunChain (RandLong *seed)
                 /* we need some space for coming output */
                 MrBayesPrint ("\n");
                 /* remove tree samples if using burninpercentage */
-                /* the following function returns immediately in MPI if proc_id != 0 */
+                /* the following function returns immediately in MPI if proc_id != 0; errors are checked after the diagnostics are printed */
                 if (chainParams.relativeBurnin == YES && chainParams.isSS == NO)
                     {
                     removeFrom = removeTo;
@@ -16937,14 +19509,6 @@ int RunChain (RandLong *seed)
 #   endif
                             }
                         }
-#   if defined (MPI_ENABLED)
-                    MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-                    if (sumErrors > 0)
-                        {
-                        MrBayesPrint ("%s   Aborting run.\n");
-                        return ERROR;
-                        }
-#   endif
                     }
 
                 lastDiagnostics = (n/chainParams.sampleFreq)+1; /* +1 because we always have start tree sampled*/
@@ -16954,7 +19518,7 @@ int RunChain (RandLong *seed)
                     }
                 else
                     i = lastDiagnostics - chainParams.chainBurnIn;
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
                 if (proc_id == 0)
                     {
 #   endif
@@ -17039,13 +19603,7 @@ int RunChain (RandLong *seed)
                     }
                 if (chainParams.allComps == YES)
                     PrintTopConvInfo ();
-#   if defined (MPI_ENABLED)
-                    }
-                ierror = MPI_Bcast (&stopChain, 1, MPI_INT, 0, MPI_COMM_WORLD);
-                if (ierror != MPI_SUCCESS)
-                    {
-                    MrBayesPrint ("%s   Problem broadcasting stop value\n", spacer);
-                    nErrors++;
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
                     }
 #   endif
                 }
@@ -17061,12 +19619,21 @@ int RunChain (RandLong *seed)
 #   endif
                 }
 #   if defined (MPI_ENABLED)
-            MPI_Allreduce (&nErrors, &sumErrors, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-            if (sumErrors > 0)
+            /* one collective checks for errors and passes the stop value from proc 0 to the others */
+            x[0] = nErrors;
+            x[1] = (proc_id == 0 && stopChain == YES) ? 1 : 0;
+            t0 = MPI_Wtime ();
+            ierror = MPI_Allreduce (x, sumX, 2, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+            mpiTime[MPI_TIME_DIAGN] += MPI_Wtime () - t0;
+            if (ierror != MPI_SUCCESS || sumX[0] > 0)
                 {
                 MrBayesPrint ("%s   Aborting run.\n");
                 return ERROR;
                 }
+            stopChain = (sumX[1] > 0 ? YES : NO);
+#   elif defined (BEST_MPI_ENABLED)
+            /* the convergence diagnostics are only kept by proc 0 */
+            MPI_Bcast (&stopChain, 1, MPI_INT, 0, MPI_COMM_WORLD);
 #   endif
             }
 
@@ -17149,20 +19716,20 @@ int RunChain (RandLong *seed)
                     for (j=0; j<chainParams.numRuns ; j++)
                         {
                         if (stepAcumulatorSS[j]==0)
-                            r=0;
+                            rSS[j]=0;
                         else
-                            r = log (stepAcumulatorSS[j]/samplesCountSS) + stepScalerSS[j];
-                        ierror = MPI_Reduce (&r,&sum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-                        if (ierror != MPI_SUCCESS)
-                            {
-                            MrBayesPrint ("%s   Problem with MPI_Reduce\n", spacer);
-                            return ERROR;
-                            }
-                        if (proc_id == 0)
-                            {
-                            MrBayesPrintf (fpSS, "\t%.6f", sum);
-                            }
+                            rSS[j] = log (stepAcumulatorSS[j]/samplesCountSS) + stepScalerSS[j];
+                        }
+                    t0 = MPI_Wtime ();
+                    ierror = MPI_Reduce (rSS, sumSS, chainParams.numRuns, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+                    mpiTime[MPI_TIME_OTHER] += MPI_Wtime () - t0;
+                    if (ierror != MPI_SUCCESS)
+                        {
+                        MrBayesPrint ("%s   Problem with MPI_Reduce\n", spacer);
+                        return ERROR;
                         }
+                    for (j=0; j<chainParams.numRuns && proc_id == 0; j++)
+                        MrBayesPrintf (fpSS, "\t%.6f", sumSS[j]);
 #   else
                     for (j=0; j<chainParams.numRuns ; j++)
                         {
@@ -17217,20 +19784,26 @@ int RunChain (RandLong *seed)
                     }
                 else
                     {
-                    MrBayesPrint("\n%s   Sampling step 1 out of %d steps...\n\n",spacer, chainParams.numStepsSS);
+                    MrBayesPrint("\n%s   Sampling step %d out of %d steps...\n\n",spacer, firstStepSS, chainParams.numStepsSS);
                     }
 
                 if (chainParams.backupCheckSS !=0 && (chainParams.numStepsSS-stepIndexSS-1)% chainParams.backupCheckSS == 0)
                     {
                     /* print check-point file. Blocking for MPI */
+#   if defined (MPI_ENABLED)
+                    t0 = MPI_Wtime ();
+#   endif
                     ERROR_TEST2("Error before printing checkpoint",return(ERROR),);
                     if (PrintCheckPoint (n) == ERROR)
                         {
                         nErrors++;
                         }
                     ERROR_TEST2("Error in printing checkpoint",return(ERROR),);
-                       
 #   if defined (MPI_ENABLED)
+                    mpiTime[MPI_TIME_CHECKPOINT] += MPI_Wtime () - t0;
+#   endif
+                       
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
                 if (proc_id == 0)
                     {
 #   endif
@@ -17245,7 +19818,7 @@ int RunChain (RandLong *seed)
                     strcpy (bkupFileName, ckpFileName);
                     strcat (bkupFileName, "~");
                     rename (bkupFileName,ckpFileName);
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
                     } /* end of if (proc_id == 0)*/
 #   endif
                     }
@@ -17255,12 +19828,18 @@ int RunChain (RandLong *seed)
         /* print check-point file. Blocking for MPI */
         if (chainParams.checkPoint == YES && (n % chainParams.checkFreq == 0))
             {
+#   if defined (MPI_ENABLED)
+            t0 = MPI_Wtime ();
+#   endif
             ERROR_TEST2("Error before printing checkpoint",return(ERROR),);
             if (PrintCheckPoint (n) == ERROR)
                 {
                 nErrors++;
                 }
             ERROR_TEST2("Error in printing checkpoint",return(ERROR),);
+#   if defined (MPI_ENABLED)
+            mpiTime[MPI_TIME_CHECKPOINT] += MPI_Wtime () - t0;
+#   endif
             }
 
         } /* end run chain */
@@ -17299,7 +19878,15 @@ int RunChain (RandLong *seed)
     /* Make sure current state is reset and values copied back to state 0.
        Note that this can be tricky for Metropolis-coupled chains because
        the chain ids may necessitate some swapping of values among chains. */
+#   if defined (MPI_ENABLED)
+    /* this gathers the parameter values and tuning parameters on proc 0, so it is timed with the loop */
+    t0 = MPI_Wtime ();
+#   endif
     ResetChainIds ();
+#   if defined (MPI_ENABLED)
+    mpiTime[MPI_TIME_OTHER] += MPI_Wtime () - t0;
+    loopTime = MPI_Wtime () - loopTime;
+#   endif
 
     MrBayesPrint ("\n");
     if (difftime (endingT, startingT) > 3600.0)
@@ -17326,57 +19913,25 @@ int RunChain (RandLong *seed)
 #   endif
 
 #   if defined (MPI_ENABLED)
+    if (PrintMPITimes (loopTime) == ERROR)
+        return (ERROR);
+
     /* find the best likelihoods across all of the processors */
-    ierror = MPI_Barrier (MPI_COMM_WORLD);
+    ierror = MPI_Reduce (proc_id == 0 ? MPI_IN_PLACE : maxLnL0, maxLnL0, numGlobalChains, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
     if (ierror != MPI_SUCCESS)
         {
-        MrBayesPrint ("%s   Problem at chain barrier\n", spacer);
-        return (ERROR);
-        }
-    for (j=0; j<numGlobalChains; j++)
-        {
-        best = maxLnL0[j];
-        for (i=1; i<num_procs; i++)
-            {
-            if (proc_id == 0)
-                {
-                ierror = MPI_Recv (&maxLnL0[j], 1, MPI_DOUBLE, i, i, MPI_COMM_WORLD, &status);
-                if (ierror != MPI_SUCCESS)
-                    { 
-                    MrBayesPrint ("%s   Problem with MPI_Recv", spacer);
-                    return ERROR;
-                    }
-                if (maxLnL0[j] > best)
-                    best = maxLnL0[j];
-                }
-            else if (proc_id == i)
-                {
-                ierror = MPI_Send (&maxLnL0[j], 1, MPI_DOUBLE, 0, i, MPI_COMM_WORLD);
-                if (ierror != MPI_SUCCESS)
-                    {
-                    MrBayesPrint ("%s   Problem with MPI_Send\n", spacer);
-                    return ERROR;
-                    }
-                }
-            }
-        maxLnL0[j] = best;
+        MrBayesPrint ("%s   Problem with MPI_Reduce\n", spacer);
+        return ERROR;
         }
 
     /* Collecting  marginal log likelihoods if SS is used */
     if (chainParams.isSS == YES)
         {
-        for (j=0; j<chainParams.numRuns ; j++)
+        ierror = MPI_Reduce (proc_id == 0 ? MPI_IN_PLACE : marginalLnLSS, marginalLnLSS, chainParams.numRuns, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (ierror != MPI_SUCCESS)
             {
-            ierror = MPI_Reduce (&marginalLnLSS[j],&r, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-            if (ierror != MPI_SUCCESS)
-                {
-                MrBayesPrint ("%s   Problem with MPI_Send\n", spacer);
-                return ERROR;
-                }
-            if (proc_id == 0)
-                {
-                marginalLnLSS[j]=r;
-                }
+            MrBayesPrint ("%s   Problem with MPI_Reduce\n", spacer);
+            return ERROR;
             }
         }
 #   endif
@@ -17405,16 +19960,27 @@ int RunChain (RandLong *seed)
     if (chainParams.isSS == YES)
         {
         MrBayesPrint ("\n");
-        MrBayesPrint ("%s   Marginal likelihood (in natural log units) estimated using stepping-stone sampling based on\n", spacer);
-        MrBayesPrint ("%s   %d steps with %d generations (%d samples) within each step. \n\n", spacer, chainParams.numStepsSS, numGenInStepSS, numGenInStepSS/chainParams.sampleFreq);
-        MrBayesPrint ("%s       Run   Marginal likelihood (ln)\n",spacer);
+        if (chainParams.numBlocksSS > 1)
+            {
+            MrBayesPrint ("%s   Contribution of steps %d to %d (block %d of %d) to the marginal likelihood\n", spacer, firstStepSS, lastStepSS, chainParams.blockSS, chainParams.numBlocksSS);
+            MrBayesPrint ("%s   (in natural log units), with %d generations (%d samples) within each step.\n\n", spacer, numGenInStepSS, numGenInStepSS/chainParams.sampleFreq);
+            MrBayesPrint ("%s       Run   Contribution (ln)\n",spacer);
+            }
+        else
+            {
+            MrBayesPrint ("%s   Marginal likelihood (in natural log units) estimated using stepping-stone sampling based on\n", spacer);
+            MrBayesPrint ("%s   %d steps with %d generations (%d samples) within each step. \n\n", spacer, chainParams.numStepsSS, numGenInStepSS, numGenInStepSS/chainParams.sampleFreq);
+            MrBayesPrint ("%s       Run   Marginal likelihood (ln)\n",spacer);
+            }
         MrBayesPrint ("%s       ------------------------------\n",spacer);
         for (j=0; j<chainParams.numRuns; j++)
             {
             MrBayesPrint ("%s       %3d    %9.2f   \n", spacer, j+1, marginalLnLSS[j]);
             }
         MrBayesPrint ("%s       ------------------------------\n",spacer);
-        if (chainParams.numRuns > 1)
+        if (chainParams.numBlocksSS > 1)
+            MrBayesPrint ("%s   When all blocks are finished, 'sumss nblocks=%d' combines their contributions.\n\n", spacer, chainParams.numBlocksSS);
+        else if (chainParams.numRuns > 1)
             {
             MeanVarianceLog(marginalLnLSS,chainParams.numRuns,&meanSS,&varSS,NULL);
             MrBayesPrint ("%s       Mean:  %9.2f\n\n",spacer,meanSS);
@@ -17459,11 +20025,11 @@ int RunChain (RandLong *seed)
                 for (i=0; i<numTopologies; i++)
                     {
                     MrBayesPrint ("%s   Topology %d.\n", spacer, i+1);
-                    PrintPlot (tempX, splitfreqSS+i*chainParams.numStepsSS, chainParams.numStepsSS);
+                    PrintPlot (tempX+firstStepSS-1, splitfreqSS+i*chainParams.numStepsSS+firstStepSS-1, lastStepSS-firstStepSS+1);
                     }
                 }
             else
-                PrintPlot (tempX, splitfreqSS, chainParams.numStepsSS);
+                PrintPlot (tempX+firstStepSS-1, splitfreqSS+firstStepSS-1, lastStepSS-firstStepSS+1);
 
             free(tempX);
             }
@@ -17482,6 +20048,10 @@ int RunChain (RandLong *seed)
         }
 #   endif
 
+    /* summarize the site likelihoods; problems are reported but do not fail the run */
+    if (chainParams.calcPbf == YES)
+        SummarizeSiteLnLs ();
+
     /* print acceptance rates for the moves */
     for (j=0; j<chainParams.numChains*chainParams.numRuns; j++)
         {
@@ -17526,6 +20096,17 @@ int RunChain (RandLong *seed)
             }
         }
 
+    if (moveTime != NULL)
+        {
+        /* problems with the profile are reported but do not fail the run */
+        PrintMoveProfile (numStepHeapAllocs, lastHeapAllocGen);
+        free (moveTime);
+        moveTime = divisionLikeTime = NULL;
+        }
+
+    if (autoweightInfo != NULL)
+        ResetMoveWeights (reweightGen);
+
 #   if defined MPI_ENABLED
     /* Redistribute move info in case it is needed in a follow-up run */
     RedistributeMoveInfo();
@@ -17578,6 +20159,59 @@ int RunChain (RandLong *seed)
 }
 
 
+/*----------------------------------------------------------------------
+|
+|   RunParsThreads: Run threadFxn on the work of numThreads threads and
+|      wait for them to finish. The work of thread 0 is done by the
+|      calling thread, as is all work if threads are not enabled or
+|      cannot be started.
+|
+------------------------------------------------------------------------*/
+int RunParsThreads (void *(*threadFxn)(void *), PARSWORK *work, int numThreads)
+{
+    int         i;
+#   if defined (THREADS_ENABLED)
+    int         *isStarted;
+    pthread_t   *threads;
+
+    threads = (pthread_t *) SafeMalloc (numThreads * sizeof(pthread_t));
+    isStarted = (int *) SafeCalloc (numThreads, sizeof(int));
+    if (!threads || !isStarted)
+        {
+        free (threads);
+        free (isStarted);
+        return (ERROR);
+        }
+    for (i=1; i<numThreads; i++)
+        {
+        if (pthread_create (&threads[i], NULL, threadFxn, &work[i]) == 0)
+            isStarted[i] = YES;
+        }
+    threadFxn (&work[0]);
+    for (i=1; i<numThreads; i++)
+        {
+        if (isStarted[i] == YES)
+            pthread_join (threads[i], NULL);
+        else
+            threadFxn (&work[i]);
+        }
+    free (threads);
+    free (isStarted);
+#   else
+    for (i=0; i<numThreads; i++)
+        threadFxn (&work[i]);
+#   endif
+
+    for (i=0; i<numThreads; i++)
+        {
+        if (work[i].rc == ERROR)
+            return (ERROR);
+        }
+
+    return (NO_ERROR);
+}
+
+
 int SafeSprintf (char **target, int *targetLen, char *fmt, ...)
 {
     va_list    argp;
@@ -17673,115 +20307,48 @@ void SetChainIds (void)
                 for (i=0; i<(numGlobalChains / num_procs) + 1; i++)
                     id++;
                 }
-            /* procs above the remainder have one less chain
-               than procs below */
-            else
-                {
-                for (i=0; i<(numGlobalChains / num_procs); i++)
-                    id++;
-                }
-            }
-        }
-#   else
-
-    int chn;
-    
-    for (chn=0; chn<numLocalChains; chn++)
-        chainId[chn] = chn;
-
-#   endif
-        
-}
-
-
-/* It sets chainParams.tFilePos[] to point immidiatly after sampled tree in position "samplePos" for all .t files. */
-int SetFilePositions (int samplePos)
-{
-    int i, j, k, longestLine;
-    BitsLong    lastBlock;
-    char    *lineBuf;
-    FILE    *fp;
-    char    *tempStr;
-    int     tempStrSize = TEMPSTRSIZE;
-
-#   if defined (MPI_ENABLED)
-    if (proc_id != 0)
-        return (NO_ERROR);
-#   endif
-
-    tempStr = (char *) SafeMalloc((size_t)tempStrSize * sizeof(char));
-    if (!tempStr)
-        {
-        MrBayesPrint ("%s   Problem allocating tempString (%d)\n", spacer, tempStrSize * sizeof(char));
-        return (ERROR);
-        }
-
-    for (i=0; i<numTopologies; i++)
-        {
-        for (j=0; j<chainParams.numRuns; j++)
-            {
-            if (numPrintTreeParams == 1)
-                {
-                if (chainParams.numRuns == 1)
-                    SafeSprintf (&tempStr, &tempStrSize, "%s.t", chainParams.chainFileName);
-                else
-                    SafeSprintf (&tempStr, &tempStrSize, "%s.run%d.t", chainParams.chainFileName, j+1);
-                }
+            /* procs above the remainder have one less chain
+               than procs below */
             else
                 {
-                if (chainParams.numRuns == 1)
-                    SafeSprintf (&tempStr, &tempStrSize, "%s.tree%d.t", chainParams.chainFileName, i+1);
-                else
-                    SafeSprintf (&tempStr, &tempStrSize, "%s.tree%d.run%d.t", chainParams.chainFileName, i+1, j+1);
-                }
-
-            if ((fp = OpenBinaryFileR (tempStr)) == NULL) 
-                {
-                MrBayesPrint ("%s   Problem openning file %s.\n", spacer, tempStr);
-                free (tempStr);
-                return (ERROR);
+                for (i=0; i<(numGlobalChains / num_procs); i++)
+                    id++;
                 }
+            }
+        }
+#   else
 
-            longestLine = LongestLine (fp);
-            SafeFclose (&fp);
-
-            if ((fp = OpenTextFileR (tempStr)) == NULL) 
-                {
-                free (tempStr);
-                return (ERROR);
-                }
+    int chn;
+    
+    for (chn=0; chn<numLocalChains; chn++)
+        chainId[chn] = chn;
 
-            lineBuf = (char *) SafeCalloc (longestLine + 10, sizeof (char));
-            if (!lineBuf)
-                {
-                SafeFclose (&fp);
-                free (tempStr);
-                return (ERROR);
-                }
+#   endif
+        
+}
 
-            lastBlock = LastBlock (fp, lineBuf, longestLine);
-            fseek (fp, lastBlock, SEEK_SET);
-            fseek (fp, FirstTree(fp, lineBuf, longestLine), SEEK_SET);
 
-            for (k=0; k<samplePos; k++)
-                {
-                if (fgets (lineBuf, longestLine + 5, fp) == NULL) 
-                    {
-                    MrBayesPrint ("%s   Not enough records in file %s.\n", spacer, tempStr);
-                    SafeFclose (&fp);
-                    free (tempStr);
-                    free (lineBuf);
-                    return ERROR;
-                    }
-                }
-            fgetpos (fp, &chainParams.tFilePos[j*numTopologies+i]);
+/* SetCumProposalProbs: Set the cumulative proposal probabilities of the used moves
+   from their relative proposal probabilities */
+void SetCumProposalProbs (void)
+{
+    int         i, j;
+    MrBFlt      sum, cumSum;
 
-            SafeFclose (&fp);
-            free (lineBuf);
-            } /* next run */
-        } /* next tree */
-    free (tempStr);
-    return (NO_ERROR);
+    for (j=0; j<chainParams.numChains*chainParams.numRuns; j++)
+        {
+        sum = 0.0;
+        for (i=0; i<numUsedMoves; i++)
+            {
+            sum += usedMoves[i]->relProposalProb[j];
+            }
+        cumSum = 0.0;
+        for (i=0; i<numUsedMoves; i++)
+            {
+            cumSum += usedMoves[i]->relProposalProb[j];
+            usedMoves[i]->cumProposalProb[j] = cumSum / sum;
+            }
+        }
 }
 
 
@@ -17855,15 +20422,27 @@ int SetLikeFunctions (void)
                             m->CondLikeRoot = &CondLikeRoot_Gen;
                             m->CondLikeScaler = &CondLikeScaler_Gen;
                             m->Likelihood = &Likelihood_Gen;
+#   if defined (SSE_ENABLED)
+                            if (m->printAncStates == YES || m->printSiteRates == YES)
+                                {
+                                MrBayesPrint ("%s   Non-SSE version of conditional likelihood calculator will be used for division %d\n", spacer, i+1);
+                                MrBayesPrint ("%s   due to request of reporting 'ancestral states' or 'site rates'.\n", spacer);
+                                }
+                            else if (m->correlation == NULL)
+                                {
+                                m->useVec = VEC_SSE;
+                                m->numFloatsPerVec = 4;
+                                m->CondLikeDown = &CondLikeDown_Gen_SSE;
+                                m->CondLikeRoot = &CondLikeRoot_Gen_SSE;
+                                m->CondLikeScaler = &CondLikeScaler_Gen_SSE;
+                                m->Likelihood = &Likelihood_Gen_SSE;
+                                }
+#   endif
                             }
                         if (m->correlation != NULL)
                             m->Likelihood = &Likelihood_Adgamma;
-                        else
-                            m->Likelihood = &Likelihood_Gen;
-                        if (m->nCijkParts == 1)
-                            m->TiProbs = &TiProbs_Gen;
-                        else if (m->nCijkParts > 1)
-                            m->TiProbs = &TiProbs_GenCov;
+                        m->TiProbs = &TiProbs_Cov;
+                        m->CondLikeUp = &CondLikeUp_Gen;
                         m->PrintAncStates = &PrintAncStates_NUC4;
                         m->PrintSiteRates = &PrintSiteRates_Gen;
                         }
@@ -17912,7 +20491,8 @@ int SetLikeFunctions (void)
 #endif
 #endif
                             /* Should be sse versions if we want to handle m->printAncStates == YES || inferSiteRates == YES.
-                            For now just set to NULL for early error detection if functions anyway got called by mistake */
+                            For now just set to NULL for early error detection if functions anyway got called by mistake;
+                            the up pass for the branch length derivatives is set at the end of this function */
                             m->CondLikeUp = NULL;
                             m->PrintAncStates = NULL;
                             m->PrintSiteRates = NULL;
@@ -18036,8 +20616,7 @@ int SetLikeFunctions (void)
                         m->CondLikeRoot   = &CondLikeRoot_NY98;
                         m->CondLikeScaler = &CondLikeScaler_NY98;
                         m->Likelihood     = &Likelihood_NY98;
-                        m->PosSelProbs    = &PosSelProbs;
-                        m->SiteOmegas     = &SiteOmegas;
+                        m->SiteOmegaProbs = &SiteOmegaProbs;
 #   if defined (SSE_ENABLED)
                         if (m->printAncStates == YES || m->printSiteRates == YES)
                             {
@@ -18052,8 +20631,7 @@ int SetLikeFunctions (void)
                             m->CondLikeRoot   = &CondLikeRoot_NY98_SSE;
                             m->CondLikeScaler = &CondLikeScaler_NY98_SSE;
                             m->Likelihood     = &Likelihood_NY98_SSE;
-                            m->PosSelProbs    = &PosSelProbs_SSE;
-                            m->SiteOmegas     = &SiteOmegas_SSE;
+                            m->SiteOmegaProbs = &SiteOmegaProbs_SSE;
                             }
 #   endif
                         }
@@ -18156,8 +20734,8 @@ int SetLikeFunctions (void)
                     else
                         m->Likelihood = &Likelihood_Adgamma;
                     }
-                if (m->numModelStates > 20 && m->nCijkParts > 1)
-                    m->TiProbs = &TiProbs_GenCov;
+                if (m->numModelStates > 20)
+                    m->TiProbs = &TiProbs_Cov;
                 else
                     m->TiProbs = &TiProbs_Gen;
                 m->CondLikeUp = &CondLikeUp_Gen;
@@ -18235,7 +20813,53 @@ int SetLikeFunctions (void)
             MrBayesPrint ("%s   ERROR: Data should be one of these types!\n", spacer);
             return ERROR;
             }
-        
+
+        /* branch length derivatives need the up pass; the SIMD cond like layouts are dealt with below */
+        m->BrlenDerivs = NULL;
+        if (m->Likelihood == &Likelihood_NUC4 && m->CondLikeUp == &CondLikeUp_NUC4)
+            m->BrlenDerivs = &BrlenDerivs_NUC4;
+        else if ((m->Likelihood == &Likelihood_Gen || m->Likelihood == &Likelihood_NY98) && m->CondLikeUp == &CondLikeUp_Gen)
+            m->BrlenDerivs = &BrlenDerivs_Gen;
+        else if (m->Likelihood == &Likelihood_Std)
+            m->BrlenDerivs = &BrlenDerivs_Std;
+
+#   if defined (SSE_ENABLED)
+        /* the up pass uses the plain cond like layout but may still use SSE over the states of each character */
+        if (m->useVec == VEC_NONE && m->CondLikeUp == &CondLikeUp_NUC4)
+            m->CondLikeUp = &CondLikeUp_NUC4_SSE;
+        else if (m->useVec == VEC_NONE && m->CondLikeUp == &CondLikeUp_Gen)
+            m->CondLikeUp = &CondLikeUp_Gen_SSE;
+
+        /* the SIMD layouts, with one state of several characters in each vector, have their own up pass */
+        if (m->Likelihood == &Likelihood_NUC4_SSE || m->Likelihood == &Likelihood_Gen_SSE || m->Likelihood == &Likelihood_NY98_SSE)
+            {
+            m->CondLikeUp  = &CondLikeUp_Vec_SSE;
+            m->BrlenDerivs = &BrlenDerivs_Vec_SSE;
+            }
+#       if defined (AVX_ENABLED)
+        else if (m->Likelihood == &Likelihood_NUC4_AVX
+#           if defined (FMA_ENABLED)
+                 || m->Likelihood == &Likelihood_NUC4_FMA
+#           endif
+                 )
+            {
+            m->CondLikeUp  = &CondLikeUp_Vec_AVX;
+            m->BrlenDerivs = &BrlenDerivs_Vec_AVX;
+            }
+#       endif
+
+        /* the same holds for the Gibbs gamma kernels, which use a single rate category per character */
+        if (m->useVec == VEC_NONE && m->CondLikeDown == &CondLikeDown_NUC4_GibbsGamma)
+            {
+            m->CondLikeDown = &CondLikeDown_NUC4_GibbsGamma_SSE;
+            m->CondLikeRoot = &CondLikeRoot_NUC4_GibbsGamma_SSE;
+            }
+        else if (m->useVec == VEC_NONE && m->CondLikeDown == &CondLikeDown_Gen_GibbsGamma)
+            {
+            m->CondLikeDown = &CondLikeDown_Gen_GibbsGamma_SSE;
+            m->CondLikeRoot = &CondLikeRoot_Gen_GibbsGamma_SSE;
+            }
+#   endif
         }
 
     return NO_ERROR;
@@ -18399,11 +21023,8 @@ int SetUpPartitionCounters (void)
 {
     int     i;
     
-#   if defined (MPI_ENABLED)
-    /* we only keep partition counters on proc 0 in the MPI version */
-    if (proc_id != 0)
-        return (NO_ERROR);
-#   endif
+    /* in the MPI version, the partition counters are only filled on proc 0, but all procs
+       need the split space because the proc holding a cold chain extracts the splits of its trees */
     nLongsNeeded = 1 + (numLocalTaxa - 1) / nBitsInALong;
     
     if (memAllocs[ALLOC_PFCOUNTERS] == YES)
@@ -18432,6 +21053,25 @@ int SetUpPartitionCounters (void)
         MrBayesPrint ("%s   Failed to allocate partFreqTreeRoot in SetUpPartitionCounters\n", spacer);
         return ERROR;
         }
+    splitKeys = (SPLITKEY *) SafeCalloc (2*numLocalTaxa, sizeof (SPLITKEY));
+    if (splitKeys == NULL)
+        {
+        free (partFreqTreeRoot);
+        free (partition[0]);
+        free (partition);
+        MrBayesPrint ("%s   Failed to allocate splitKeys in SetUpPartitionCounters\n", spacer);
+        return ERROR;
+        }
+    treeSplits = (BitsLong *) SafeCalloc (numLocalTaxa * nLongsNeeded, sizeof (BitsLong));
+    if (treeSplits == NULL)
+        {
+        free (splitKeys);
+        free (partFreqTreeRoot);
+        free (partition[0]);
+        free (partition);
+        MrBayesPrint ("%s   Failed to allocate treeSplits in SetUpPartitionCounters\n", spacer);
+        return ERROR;
+        }
     memAllocs[ALLOC_PFCOUNTERS] = YES;
 
     for (i=1; i<2*numLocalTaxa; i++)
@@ -18526,7 +21166,7 @@ int SetUpTermState (void)
             }
 
 #   if defined SSE_ENABLED
-        if (m->dataType != STANDARD && m->gibbsGamma == NO)
+        if (m->useVec != VEC_NONE)
             numComprChars = m->numVecChars * m->numFloatsPerVec;
         else
             numComprChars = m->numChars;
@@ -18595,7 +21235,7 @@ int SetUpTermState (void)
 int SetUsedMoves (void)
 {
     int         i, j, moveIndex, numGlobalChains;
-    MrBFlt      prob, sum, cumSum;
+    MrBFlt      prob;
 
     /* first count moves */
     numUsedMoves = 0;
@@ -18659,20 +21299,7 @@ int SetUsedMoves (void)
         }
 
     /* set cumulative proposal probabilities */
-    for (j=0; j<numGlobalChains; j++)
-        {
-        sum = 0.0;
-        for (i=0; i<numUsedMoves; i++)
-            {
-            sum += usedMoves[i]->relProposalProb[j];
-            }
-        cumSum = 0.0;
-        for (i=0; i<numUsedMoves; i++)
-            {
-            cumSum += usedMoves[i]->relProposalProb[j];
-            usedMoves[i]->cumProposalProb[j] = cumSum / sum;
-            }
-        }
+    SetCumProposalProbs ();
 
     /* reset acceptance probability values */
     for (i=0; i<numUsedMoves; i++)
@@ -18847,6 +21474,140 @@ PFNODE *SmallestNonemptyPFNode (PFNODE *p, int *i, int j)
 }
 
 
+/*------------------------------------------------------------------------
+|
+|   SummarizeSiteLnLs: Summarize the site log likelihoods sampled after the
+|       burnin (relburnin, burninfrac, burnin) in the .sitelnl files. The
+|       log pseudo-marginal likelihood (LPML) is the sum over sites of the
+|       log conditional predictive ordinates, CPO = 1 / E[1 / L(site)];
+|       the LPML difference between two models is the log pseudo-Bayes
+|       factor. WAIC = -2 (lppd - pWAIC), where lppd is the sum over sites
+|       of log E[L(site)] and pWAIC the sum of the variances of lnL(site).
+|
+-------------------------------------------------------------------------*/
+int SummarizeSiteLnLs (void)
+{
+    int         i, k, n, run, numSamples, numBurnin, longestLine;
+    char        fileName[220], *strBuf=NULL, *word;
+    MrBFlt      x, delta, lpml, lppd, pWaic, *lnSumInvLike=NULL, *lnSumLike=NULL, *mean=NULL, *sumSq=NULL;
+    FILE        *fp=NULL;
+
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
+    if (proc_id != 0)
+        return (NO_ERROR);
+#   endif
+
+    lnSumInvLike = (MrBFlt *) SafeMalloc (4 * numSiteLnLChars * sizeof(MrBFlt));
+    if (!lnSumInvLike)
+        {
+        MrBayesPrint ("%s   Problem allocating site likelihood summary\n", spacer);
+        return (ERROR);
+        }
+    lnSumLike = lnSumInvLike + numSiteLnLChars;
+    mean = lnSumLike + numSiteLnLChars;
+    sumSq = mean + numSiteLnLChars;
+
+    MrBayesPrint ("\n");
+    MrBayesPrint ("%s   Site likelihoods (in natural log units) summarized over %d sites:\n\n", spacer, numSiteLnLChars);
+    MrBayesPrint ("%s       Run   Samples        LPML        lppd       pWAIC        WAIC\n", spacer);
+    MrBayesPrint ("%s       ------------------------------------------------------------\n", spacer);
+
+    for (run=0; run<chainParams.numRuns; run++)
+        {
+        if (chainParams.numRuns == 1)
+            sprintf (fileName, "%s.sitelnl", chainParams.chainFileName);
+        else
+            sprintf (fileName, "%s.run%d.sitelnl", chainParams.chainFileName, run+1);
+        if ((fp = OpenBinaryFileR (fileName)) == NULL)
+            goto errorExit;
+        longestLine = LongestLine (fp) + 10;
+        SafeFclose (&fp);
+        free (strBuf);
+        strBuf = (char *) SafeMalloc (longestLine * sizeof(char));
+        if (!strBuf || (fp = OpenTextFileR (fileName)) == NULL)
+            goto errorExit;
+
+        /* the sample lines are the ones starting with the generation */
+        numSamples = 0;
+        while (fgets (strBuf, longestLine, fp) != NULL)
+            {
+            if (isdigit (strBuf[0]))
+                numSamples++;
+            }
+        if (chainParams.relativeBurnin == YES)
+            numBurnin = (int) (numSamples * chainParams.burninFraction);
+        else
+            numBurnin = chainParams.chainBurnIn;
+        if (numSamples - numBurnin < 2)
+            {
+            MrBayesPrint ("%s       %3d   Too few samples after the burnin\n", spacer, run+1);
+            SafeFclose (&fp);
+            continue;
+            }
+
+        rewind (fp);
+        k = n = 0;
+        while (fgets (strBuf, longestLine, fp) != NULL)
+            {
+            if (!isdigit (strBuf[0]) || k++ < numBurnin)
+                continue;
+            n++;
+            word = strtok (strBuf, "\t\n");
+            for (i=0; i<numSiteLnLChars; i++)
+                {
+                if ((word = strtok (NULL, "\t\n")) == NULL)
+                    {
+                    MrBayesPrint ("%s   Too few site likelihoods in sample %d of file %s\n", spacer, k, fileName);
+                    goto errorExit;
+                    }
+                x = atof (word);
+                if (n == 1)
+                    {
+                    lnSumInvLike[i] = -x;
+                    lnSumLike[i] = mean[i] = x;
+                    sumSq[i] = 0.0;
+                    continue;
+                    }
+                /* add exp(-x) and exp(x) to the sums in log space */
+                if (-x > lnSumInvLike[i])
+                    lnSumInvLike[i] = -x + log (1.0 + exp (lnSumInvLike[i] + x));
+                else
+                    lnSumInvLike[i] += log (1.0 + exp (-x - lnSumInvLike[i]));
+                if (x > lnSumLike[i])
+                    lnSumLike[i] = x + log (1.0 + exp (lnSumLike[i] - x));
+                else
+                    lnSumLike[i] += log (1.0 + exp (x - lnSumLike[i]));
+                delta = x - mean[i];
+                mean[i] += delta / n;
+                sumSq[i] += delta * (x - mean[i]);
+                }
+            }
+        SafeFclose (&fp);
+
+        lpml = lppd = pWaic = 0.0;
+        for (i=0; i<numSiteLnLChars; i++)
+            {
+            lpml += log ((MrBFlt) n) - lnSumInvLike[i];
+            lppd += lnSumLike[i] - log ((MrBFlt) n);
+            pWaic += sumSq[i] / (n - 1);
+            }
+        MrBayesPrint ("%s       %3d  %8d  %10.2f  %10.2f  %10.2f  %10.2f\n", spacer, run+1, n, lpml, lppd, pWaic, -2.0 * (lppd - pWaic));
+        }
+    MrBayesPrint ("%s       ------------------------------------------------------------\n", spacer);
+    MrBayesPrint ("%s   The difference in LPML between two models is their log pseudo-Bayes factor.\n", spacer);
+
+    free (strBuf);
+    free (lnSumInvLike);
+    return (NO_ERROR);
+
+errorExit:
+    SafeFclose (&fp);
+    free (strBuf);
+    free (lnSumInvLike);
+    return (ERROR);
+}
+
+
 /* Talloc: Allocate space for a new node in the tree keeping track of partition frequencies */
 PFNODE *Talloc (void)
 {
@@ -19039,6 +21800,127 @@ MrBFlt TreeLength (Param *param, int chain)
 }
 
 
+#if defined (MPI_ENABLED)
+/*------------------------------------------------------------------
+|
+|   WaitForSwappedMoveInfo: Complete the move info transfers posted
+|       by AttemptSwapRound for local chain chn, or for all local
+|       chains (including outstanding sends) if chn is negative
+|
+-------------------------------------------------------------------*/
+int WaitForSwappedMoveInfo (int chn)
+{
+    int         i, j, first, last, h, nMoveInfo, ierror;
+    MrBFlt      *buf;
+    double      t0;
+    MCMCMove    *mv;
+
+    if (memAllocs[ALLOC_SWAPBUFFERS] == NO)
+        return (NO_ERROR);
+
+    t0 = MPI_Wtime ();
+    if (chn < 0)
+        {
+        ierror = MPI_Waitall (2*numLocalChains, swapRequest, MPI_STATUSES_IGNORE);
+        first = 0;
+        last = numLocalChains;
+        }
+    else
+        {
+        if (swapRecvHeat[chn] < 0)
+            return (NO_ERROR);
+        ierror = MPI_Wait (&swapRequest[numLocalChains+chn], MPI_STATUS_IGNORE);
+        first = chn;
+        last = chn + 1;
+        }
+    mpiTime[MPI_TIME_SWAP] += MPI_Wtime () - t0;
+    if (ierror != MPI_SUCCESS)
+        return (ERROR);
+
+    nMoveInfo = 7 * numUsedMoves;
+    for (j=first; j<last; j++)
+        {
+        h = swapRecvHeat[j];
+        if (h < 0)
+            continue;
+        buf = swapMoveInfo + (numLocalChains+j)*nMoveInfo;
+        for (i=0; i<numUsedMoves; i++)
+            {
+            mv = usedMoves[i];
+            mv->nAccepted[h]          = (int)buf[0];
+            mv->nTried[h]             = (int)buf[1];
+            mv->nBatches[h]           = (int)buf[2];
+            mv->nTotAccepted[h]       = (int)buf[3];
+            mv->nTotTried[h]          = (int)buf[4];
+            mv->lastAcceptanceRate[h] = buf[5];
+            if (mv->moveType->numTuningParams > 0)
+                mv->tuningParam[h][0] = buf[6];
+            buf += 7;
+            }
+        swapRecvHeat[j] = -1;
+        }
+
+    return (NO_ERROR);
+}
+#endif
+
+
+/*----------------------------------------------------------------------
+|
+|   WriteSampleString: Write printString to the .p (whichFile = 0),
+|       .sitelnl (1) or .t file (2 + tree index) of a run and free it.
+|       In the MPI version, the string goes after the end of the file at
+|       the last update of the ends (see PrintStatesToFiles) and what
+|       this processor has written since.
+|
+------------------------------------------------------------------------*/
+int WriteSampleString (int runId, int whichFile)
+{
+#   if defined (MPI_ENABLED)
+    int         len, ierror, fileIndex;
+    MPI_Status  status;
+
+    fileIndex = runId*(numTrees+2) + whichFile;
+    len = (int) strlen (printString);
+    ierror = MPI_File_write_at (sampleFile[fileIndex], sampleFileEnd[fileIndex] + sampleFileBytes[fileIndex],
+                                printString, len, MPI_CHAR, &status);
+    free (printString);
+    if (ierror != MPI_SUCCESS)
+        {
+        MrBayesPrint ("%s   Problem writing sample on processor %d\n", spacer, proc_id);
+        return (ERROR);
+        }
+    sampleFileBytes[fileIndex] += len;
+#   else
+    FILE        *fp;
+
+    if (whichFile == 0)
+        fp = fpParm[runId];
+    else if (whichFile == 1)
+        fp = fpSiteLnL[runId];
+    else
+        fp = fpTree[runId][whichFile-2];
+    fprintf (fp, "%s", printString);
+    fflush (fp);
+    free (printString);
+#   endif
+
+    return (NO_ERROR);
+}
+
+
+/* ProfileTime: Current time in seconds for the move profile: wall-clock time
+   in the parallel versions, processor time of the process otherwise */
+MrBFlt ProfileTime (void)
+{
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
+    return (MPI_Wtime ());
+#   else
+    return ((MrBFlt) clock () / CLOCKS_PER_SEC);
+#   endif
+}
+
+
 /* proportion of ancestral fossils in a FBD tree */
 MrBFlt PropAncFossil (Param *param, int chain)
 {
@@ -18,17 +18,17 @@ int     GetParsimonyBrlens (Tree *t, int chain, MrBFlt *brlens);
 MrBFlt  GetParsimonyLength (Tree *t, int chain);
 void    GetParsimonySubtreeRootstate (Tree *t, TreeNode *root, int chain);
 MrBFlt  GetRate (int division, int chain);
-int     LnBirthDeathPriorPr (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt sR, MrBFlt eR, char *sS, MrBFlt sF);
+int     LnBirthDeathPriorPr (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt sR, MrBFlt eR, int sS, MrBFlt sF);
 int     LnCoalescencePriorPr (Tree *t, MrBFlt *prob, MrBFlt theta, MrBFlt growth);
 MrBFlt  LnUniformPriorPr (Tree *t, MrBFlt clockRate);
-int     LnFossilizationPriorPr (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt *sR, MrBFlt *eR, MrBFlt *fR, MrBFlt sF, char *sS);
+int     LnFossilizationPriorPr (Tree *t, MrBFlt clockRate, MrBFlt *prob, MrBFlt *sR, MrBFlt *eR, MrBFlt *fR, MrBFlt sF, int sS);
 int     LogClockTreePriorRatio (Param *param, int chain, MrBFlt *lnPriorRatio);
 MrBFlt  LogDirPrior (Tree *t, ModelParams *mp, int PV);
 MrBFlt  LogOmegaPrior (MrBFlt w1, MrBFlt w2, MrBFlt w3);
 FILE    *OpenNewMBPrintFile (char *fileName);
+MrBFlt  ProfileTime (void);
 int     ResetScalersPartition (int *isScalerNode, Tree* t, unsigned rescaleFreq);
 int     SafeSprintf (char **target, int *targetLen, char *fmt, ...);
-int     SetFilePositions (int samplePos);
 MrBFlt  TreeLength (Param *param, int chain);
 
 #endif  /* __MCMC_H__ */
@@ -3303,8 +3303,6 @@ int DoLsetParm (char *parmName, char *tkn)
                             {
                             if (!strcmp(tempStr, "Yes"))
                                 {
-                                MrBayesPrint ("%s   Downsampling of site rates ('usegibbs = yes') disabled temporarily because of conflict with likelihood calculators\n", spacer);
-                                return (ERROR);
                                 strcpy(modelParams[i].useGibbs, "Yes");
                                 }
                             else
@@ -3810,7 +3808,7 @@ int DoPlot (void)
     SumpFileInfo    fileInfo;
     ParameterSample *parameterSamples;
     
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     if (proc_id != 0)
         return NO_ERROR;
 #   endif
@@ -17811,6 +17809,8 @@ int SetModelInfo (void)
 
         m->gibbsGamma = NO;
         m->gibbsFreq = 0;
+        m->catLike = NULL;
+        m->catLnScaler = NULL;
 
         m->parsimonyBasedMove = NO;
 
@@ -17954,6 +17954,47 @@ int SetModelInfo (void)
         else
             m->parsModelId = NO;
 
+        /* clock tree prior and its settings, resolved here so that the prior calculations
+           during the run do not have to compare strings */
+        if (!strcmp(mp->clockPr, "Birthdeath"))
+            m->clockPrId = CLOCKPR_BIRTHDEATH;
+        else if (!strcmp(mp->clockPr, "Coalescence"))
+            m->clockPrId = CLOCKPR_COALESCENCE;
+        else if (!strcmp(mp->clockPr, "Fossilization"))
+            m->clockPrId = CLOCKPR_FOSSILIZATION;
+        else if (!strcmp(mp->clockPr, "Speciestreecoalescence"))
+            m->clockPrId = CLOCKPR_SPCOAL;
+        else if (!strcmp(mp->clockPr, "Fixed"))
+            m->clockPrId = CLOCKPR_FIXED;
+        else /* if (!strcmp(mp->clockPr, "Uniform")) */
+            m->clockPrId = CLOCKPR_UNIFORM;
+
+        if (!strcmp(mp->sampleStrat, "Diversity"))
+            m->sampleStratId = SAMPLESTRAT_DIVERSITY;
+        else if (!strcmp(mp->sampleStrat, "Cluster"))
+            m->sampleStratId = SAMPLESTRAT_CLUSTER;
+        else if (!strcmp(mp->sampleStrat, "FossilTip"))
+            m->sampleStratId = SAMPLESTRAT_FOSSILTIP;
+        else /* if (!strcmp(mp->sampleStrat, "Random")) */
+            m->sampleStratId = SAMPLESTRAT_RANDOM;
+
+        if (!strcmp(mp->ploidy, "Diploid"))
+            m->ploidyFactor = 4.0;
+        else if (!strcmp(mp->ploidy, "Zlinked"))
+            m->ploidyFactor = 3.0;
+        else /* if (!strcmp(mp->ploidy, "Haploid")) */
+            m->ploidyFactor = 2.0;
+
+        if (!strcmp(mp->popVarPr, "Equal"))
+            m->isPopSizeVar = NO;
+        else
+            m->isPopSizeVar = YES;
+
+        if (!strcmp(mp->growthPr, "Fixed"))
+            m->isGrowthFixed = YES;
+        else
+            m->isGrowthFixed = NO;
+
         /* number of rate categories */
         if (activeParams[P_SHAPE][i] > 0)
             {
@@ -17962,7 +18003,7 @@ int SetModelInfo (void)
             else
                 m->numRateCats = mp->numGammaCats;
             }
-        else if (activeParams[P_MIXTURE_RATES] > 0)
+        else if (activeParams[P_MIXTURE_RATES][i] > 0)
             m->numRateCats = mp->numMixtCats;
         else
             m->numRateCats = 1;
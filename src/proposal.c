@@ -325,7 +325,7 @@ int Move_Adgamma (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio,
 {
     /* Change correlation parameter (-1, 1) of adgamma model */
 
-    int         i, isValidP;
+    int         isValidP;
     MrBFlt      oldP, newP, window, minP, maxP, ran, *markovTiValues;
     ModelParams *mp;
 
@@ -377,12 +377,10 @@ int Move_Adgamma (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio,
     /* fill in new Markov trans probs */
     AutodGamma (markovTiValues, newP, mp->numGammaCats);
         
-    /* Set update flags for all partitions that share this rho. Note that the conditional
-       likelihood update flags have been set before we even call this function. */
-    for (i=0; i<param->nRelParts; i++)
-        TouchAllTreeNodes(&modelSettings[param->relParts[i]],chain);
-
-    /* Update flags for divisions already set */
+    /* Rho only enters the HMM over the site rate probabilities at the root, so the transition
+       probabilities and conditional likelihoods of the tree stay valid and we do not touch the
+       tree nodes. The division update flags, which have been set before we even call this
+       function, are enough to recalculate the rate probabilities and the HMM. */
 
     return (NO_ERROR);
 }
@@ -641,7 +639,7 @@ int Move_ClockRate_M (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRa
         t = GetTreeFromIndex(i, chain, state[chain]);
         if (t->isClock == NO)
             continue;
-        if (!strcmp(modelParams[t->relParts[0]].clockPr, "Fixed"))
+        if (modelSettings[t->relParts[0]].clockPrId == CLOCKPR_FIXED)
             continue;
 
         oldT = GetTreeFromIndex(i, chain, 1^state[chain]);
@@ -665,19 +663,14 @@ int Move_ClockRate_M (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRa
 
         /* prior ratio for coalecent tree, as theta is changed */
         mp = &modelParams[t->relParts[0]];
-        if (!strcmp(mp->clockPr,"Coalescence"))
+        m = &modelSettings[t->relParts[0]];
+        if (m->clockPrId == CLOCKPR_COALESCENCE)
             {
-            m = &modelSettings[t->relParts[0]];
             N = *GetParamVals(m->popSize, chain, state[chain]);
-            if (!strcmp(mp->ploidy, "Diploid"))
-                N *= 4.0;
-            else if (!strcmp(mp->ploidy, "Zlinked"))
-                N *= 3.0;
-            else
-                N *= 2.0;
+            N *= m->ploidyFactor;
             oldTheta = N * oldRate;
             newTheta = N * newRate;
-            if (!strcmp(mp->growthPr, "Fixed"))
+            if (m->isGrowthFixed == YES)
                 growth = mp->growthFix;
             else
                 growth = *GetParamVals(m->growthRate, chain, state[chain]);
@@ -1579,7 +1572,7 @@ int Move_Extinction (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRat
     int         i, isValidM, valIndex;
     MrBFlt      *valPtr, oldM, newM, window, minM, maxM, *sR, *eR, sF, *fR, oldLnPrior, newLnPrior,
                 oldProp[2], newProp[2], x, y, *alphaDir, clockRate;
-    char        *sS;
+    int         sS;
     ModelParams *mp;
     ModelInfo   *m;
     Tree        *t;
@@ -1626,10 +1619,10 @@ int Move_Extinction (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRat
     sR = GetParamVals (m->speciationRates, chain, state[chain]);
     eR = GetParamVals (param, chain, state[chain]);
     sF = mp->sampleProb;
-    sS = mp->sampleStrat;
+    sS = m->sampleStratId;
     clockRate = *GetParamVals (m->clockRate, chain, state[chain]);
     
-    if (!strcmp(mp->clockPr,"Birthdeath"))
+    if (m->clockPrId == CLOCKPR_BIRTHDEATH)
         {
         if (LnBirthDeathPriorPr (t, clockRate, &oldLnPrior, *sR, *eR, sS, sF) == ERROR)
             {
@@ -1643,7 +1636,7 @@ int Move_Extinction (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRat
             return (ERROR);
             }
         }
-    else if (!strcmp(mp->clockPr,"Fossilization"))
+    else if (m->clockPrId == CLOCKPR_FOSSILIZATION)
         {
         fR = GetParamVals (m->fossilizationRates, chain, state[chain]);
         if (LnFossilizationPriorPr (t, clockRate, &oldLnPrior, sR, eR, fR, sF, sS) == ERROR)
@@ -1690,7 +1683,7 @@ int Move_Fossilization (Param *param, int chain, RandLong *seed, MrBFlt *lnPrior
     int         i, isValidM, valIndex;
     MrBFlt      *valPtr, oldM, newM, window, minM, maxM, *sR, *eR, sF, *fR, oldLnPrior, newLnPrior,
                 oldProp[2], newProp[2], x, y, *alphaDir, clockRate;
-    char        *sS;
+    int         sS;
     ModelParams *mp;
     ModelInfo   *m;
     Tree        *t;
@@ -1738,7 +1731,7 @@ int Move_Fossilization (Param *param, int chain, RandLong *seed, MrBFlt *lnPrior
     eR = GetParamVals (m->extinctionRates, chain, state[chain]);
     fR = GetParamVals (param, chain, state[chain]);
     sF = mp->sampleProb;
-    sS = mp->sampleStrat;
+    sS = m->sampleStratId;
     clockRate = *GetParamVals(m->clockRate, chain, state[chain]);
 
     if (LnFossilizationPriorPr (t, clockRate, &oldLnPrior, sR, eR, fR, sF, sS) == ERROR)
@@ -5045,8 +5038,8 @@ int Move_GeneRate_Dir (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorR
     MrBFlt      alphaPi, *value, *subValue, numSites, *alphaDir, x, y, sum,
                 rate_pot, *dirParm, *oldRate, *newRate;
 
-    /* allocate memory */
-    dirParm = (MrBFlt *) SafeCalloc (3*(numTopologies-1), sizeof(MrBFlt));
+    /* get scratch space */
+    dirParm = (MrBFlt *) ScratchCalloc (3*(numTopologies-1), sizeof(MrBFlt));
     oldRate = dirParm + numCurrentDivisions;
     newRate = dirParm + 2*numCurrentDivisions;
 
@@ -5146,8 +5139,6 @@ int Move_GeneRate_Dir (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorR
         if (modelSettings[param->relParts[i]].nCijkParts > 1)
             modelSettings[param->relParts[i]].upDateCijk = YES;
 
-    free (dirParm);
-
     return (NO_ERROR);
 }
 
@@ -5155,7 +5146,6 @@ int Move_GeneRate_Dir (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorR
 int Move_Growth_M (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio, MrBFlt *lnProposalRatio, MrBFlt *mvp)
 {
     MrBFlt          oldG, newG, lambda, minG, maxG, ran, oldLnPrior, newLnPrior, curTheta;
-    ModelParams     *mp;
     ModelInfo       *m;
     Tree            *t;
 
@@ -5164,14 +5154,8 @@ int Move_Growth_M (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio
 
     /* get model params */
     m = &modelSettings[param->relParts[0]];
-    mp = &modelParams[param->relParts[0]];
     curTheta = (*GetParamVals(m->popSize, chain, state[chain])) * (*GetParamVals(m->clockRate, chain, state[chain]));
-    if (!strcmp(mp->ploidy, "Diploid"))
-        curTheta *= 4.0;
-    else if (!strcmp(mp->ploidy, "Zlinked"))
-        curTheta *= 3.0;
-    else
-        curTheta *= 2.0;
+    curTheta *= m->ploidyFactor;
     
     /* get minimum and maximum values for growth */
     minG = param->min;
@@ -8058,7 +8042,7 @@ int Move_NodeSliderClock (Param *param, int chain, RandLong *seed, MrBFlt *lnPri
 
     /* check whether or not we can change root */
     if ((t->root->left->isDated == YES && t->root->left->calibration->prior == fixed) ||
-        ((!strcmp(mp->clockPr, "Uniform") || !strcmp(mp->clockPr, "Birthdeath") || !strcmp(mp->clockPr, "Fossilization")) && mp->treeAgePr.prior == fixed))
+        ((m->clockPrId == CLOCKPR_UNIFORM || m->clockPrId == CLOCKPR_BIRTHDEATH || m->clockPrId == CLOCKPR_FOSSILIZATION) && mp->treeAgePr.prior == fixed))
         i = t->nNodes - 2;
     else
         i = t->nNodes - 1;
@@ -8134,9 +8118,7 @@ int Move_NodeSliderClock (Param *param, int chain, RandLong *seed, MrBFlt *lnPri
     
     if (p->isDated == YES)
         calibrationPtr = p->calibration;
-    else if (p->anc->anc == NULL && (!strcmp(mp->clockPr, "Uniform") ||
-                                     !strcmp(mp->clockPr, "Birthdeath")||
-                                     !strcmp(mp->clockPr, "Fossilization")))
+    else if (p->anc->anc == NULL && (m->clockPrId == CLOCKPR_UNIFORM || m->clockPrId == CLOCKPR_BIRTHDEATH || m->clockPrId == CLOCKPR_FOSSILIZATION))
         calibrationPtr = &mp->treeAgePr;
     else
         calibrationPtr = NULL;
@@ -9724,7 +9706,7 @@ int Move_ParsFossilSPRClock (Param *param, int chain, RandLong *seed, MrBFlt *ln
     
     /* find number of site patterns and modify randomly */
     globalNSitesOfPat = numSitesOfPat + ((chainId[chain] % chainParams.numChains) * numCompressedChars) + m->compCharStart;
-    nSitesOfPat = (CLFlt *) SafeCalloc (numCompressedChars, sizeof(CLFlt));
+    nSitesOfPat = (CLFlt *) ScratchCalloc (numCompressedChars, sizeof(CLFlt));
     if (!nSitesOfPat)
     {
         MrBayesPrint ("%s   Problem allocating nSitesOfPat in Move_ParsSPRClock\n", spacer);
@@ -9881,7 +9863,6 @@ int Move_ParsFossilSPRClock (Param *param, int chain, RandLong *seed, MrBFlt *ln
         if (newBrlen <= 0.0)
         {
             abortMove = YES;
-            free (nSitesOfPat);
             return (NO_ERROR);
         }
         
@@ -9957,14 +9938,12 @@ int Move_ParsFossilSPRClock (Param *param, int chain, RandLong *seed, MrBFlt *ln
             if (UpdateCppEvolLengths (subParm, a, chain) == ERROR)
             {
                 abortMove = YES;
-                free (nSitesOfPat);
                 return (NO_ERROR);
             }
             
             if (UpdateCppEvolLengths (subParm, u, chain) == ERROR)
             {
                 abortMove = YES;
-                free (nSitesOfPat);
                 return (NO_ERROR);
             }
         }   /* end cpp events parameter */
@@ -10038,7 +10017,6 @@ int Move_ParsFossilSPRClock (Param *param, int chain, RandLong *seed, MrBFlt *ln
     /* adjust prior ratio for clock tree */
     if (LogClockTreePriorRatio (param, chain, &x) == ERROR)
     {
-        free (nSitesOfPat);
         return (ERROR);
     }
     (*lnPriorRatio) += x;
@@ -10085,7 +10063,6 @@ int Move_ParsFossilSPRClock (Param *param, int chain, RandLong *seed, MrBFlt *ln
     getchar();
 #   endif
     
-    free (nSitesOfPat);
     return (NO_ERROR);
 }
 
@@ -10234,7 +10211,7 @@ int Move_ParsSPR (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio,
 
     /* find number of site patterns and modify randomly */
     globalNSitesOfPat = numSitesOfPat + (chainId[chain] % chainParams.numChains) * numCompressedChars + m->compCharStart;
-    nSitesOfPat = (CLFlt *) SafeCalloc (numCompressedChars, sizeof(CLFlt));
+    nSitesOfPat = (CLFlt *) ScratchCalloc (numCompressedChars, sizeof(CLFlt));
     if (!nSitesOfPat)
         {
         MrBayesPrint ("%s   Problem allocating nSitesOfPat in Move_ParsSPR\n", spacer);
@@ -10545,8 +10522,6 @@ int Move_ParsSPR (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio,
     getchar();
 #   endif
 
-    free (nSitesOfPat);
-
     return (NO_ERROR);
 }
 
@@ -10751,7 +10726,7 @@ int Move_ParsSPR1 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio
     
     /* find number of site patterns and modify randomly */
     globalNSitesOfPat = numSitesOfPat + (chainId[chain] % chainParams.numChains) * numCompressedChars + m->compCharStart;
-    nSitesOfPat = (CLFlt *) SafeCalloc (numCompressedChars, sizeof(CLFlt));
+    nSitesOfPat = (CLFlt *) ScratchCalloc (numCompressedChars, sizeof(CLFlt));
     if (!nSitesOfPat)  goto errorExit;
     for (i=0; i<numCompressedChars; i++)
         {
@@ -10768,9 +10743,9 @@ int Move_ParsSPR1 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio
 
     /* need to alloc a matrix for parsimony lengths, an array of pointers to crown part,
        and an array of pointers to root part. */
-    parLength = (MrBFlt *) SafeCalloc ((size_t)nRoot * (size_t)nCrown, sizeof(MrBFlt));
-    pRoot  = (TreeNode **) SafeCalloc(nRoot,  sizeof(TreeNode *));
-    pCrown = (TreeNode **) SafeCalloc(nCrown, sizeof(TreeNode *));
+    parLength = (MrBFlt *) ScratchCalloc ((size_t)nRoot * (size_t)nCrown, sizeof(MrBFlt));
+    pRoot  = (TreeNode **) ScratchCalloc (nRoot, sizeof(TreeNode *));
+    pCrown = (TreeNode **) ScratchCalloc (nCrown, sizeof(TreeNode *));
     if (!parLength || !pRoot || !pCrown)  goto errorExit;
     
     /* starting position */
@@ -11187,14 +11162,10 @@ outLoop:;
     if (isVPriorExp > 1)
         (*lnPriorRatio) += LogDirPrior(t, mp, isVPriorExp);
     
-    /* free up local memory */
-    free (parLength); free (pRoot); free (pCrown); free (nSitesOfPat);
-    
     return (NO_ERROR);
     
 errorExit:
     MrBayesPrint ("%s   Problem allocating memory in Move_ParsSPR\n", spacer);
-    free (parLength); free (pRoot); free (pCrown); free (nSitesOfPat);
     
     return (ERROR);
 }
@@ -11416,7 +11387,7 @@ int Move_ParsSPR2 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio
     
     /* find number of site patterns and modify randomly */
     globalNSitesOfPat = numSitesOfPat + (chainId[chain] % chainParams.numChains) * numCompressedChars + m->compCharStart;
-    nSitesOfPat = (CLFlt *) SafeCalloc (numCompressedChars, sizeof(CLFlt));
+    nSitesOfPat = (CLFlt *) ScratchCalloc (numCompressedChars, sizeof(CLFlt));
     if (!nSitesOfPat)  goto errorExit;
     for (i=0; i<numCompressedChars; i++)
         {
@@ -11433,9 +11404,9 @@ int Move_ParsSPR2 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio
 
     /* need to alloc a matrix for parsimony lengths, an array of pointers to crown part,
        and an array of pointers to root part. */
-    parLength = (MrBFlt *) SafeCalloc ((size_t)nRoot * (size_t)nCrown, sizeof(MrBFlt));
-    pRoot  = (TreeNode **) SafeCalloc(nRoot,  sizeof(TreeNode *));
-    pCrown = (TreeNode **) SafeCalloc(nCrown, sizeof(TreeNode *));
+    parLength = (MrBFlt *) ScratchCalloc ((size_t)nRoot * (size_t)nCrown, sizeof(MrBFlt));
+    pRoot  = (TreeNode **) ScratchCalloc (nRoot, sizeof(TreeNode *));
+    pCrown = (TreeNode **) ScratchCalloc (nCrown, sizeof(TreeNode *));
     if (!parLength || !pRoot || !pCrown)  goto errorExit;
     
     /* starting position */
@@ -11859,14 +11830,10 @@ outLoop:;
     if (isVPriorExp > 1)
         (*lnPriorRatio) += LogDirPrior(t, mp, isVPriorExp);
     
-    /* free up local memory */
-    free (parLength); free (pRoot); free (pCrown); free (nSitesOfPat);
-    
     return (NO_ERROR);
     
 errorExit:
     MrBayesPrint ("%s   Problem allocating memory in Move_ParsSPR\n", spacer);
-    free (parLength); free (pRoot); free (pCrown); free (nSitesOfPat);
     
     return (ERROR);
 }
@@ -12100,7 +12067,7 @@ int Move_ParsSPRClock (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorR
     
     /* find number of site patterns and modify randomly */
     globalNSitesOfPat = numSitesOfPat + (chainId[chain] % chainParams.numChains) * numCompressedChars + m->compCharStart;
-    nSitesOfPat = (CLFlt *) SafeCalloc (numCompressedChars, sizeof(CLFlt));
+    nSitesOfPat = (CLFlt *) ScratchCalloc (numCompressedChars, sizeof(CLFlt));
     if (!nSitesOfPat)
         {
         MrBayesPrint ("%s   Problem allocating nSitesOfPat in Move_ParsSPRClock\n", spacer);
@@ -12257,7 +12224,6 @@ int Move_ParsSPRClock (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorR
         if (newBrlen <= 0.0)
             {
             abortMove = YES;
-            free (nSitesOfPat);
             return (NO_ERROR);
             }
 
@@ -12333,14 +12299,12 @@ int Move_ParsSPRClock (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorR
             if (UpdateCppEvolLengths (subParm, a, chain) == ERROR)
                 {
                 abortMove = YES;
-                free (nSitesOfPat);
                 return (NO_ERROR);
                 }
 
             if (UpdateCppEvolLengths (subParm, u, chain) == ERROR)
                 {
                 abortMove = YES;
-                free (nSitesOfPat);
                 return (NO_ERROR);
                 }
             }   /* end cpp events parameter */
@@ -12427,7 +12391,6 @@ int Move_ParsSPRClock (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorR
     /* adjust prior ratio for clock tree */
     if (LogClockTreePriorRatio (param, chain, &x) == ERROR)
         {
-        free (nSitesOfPat);
         return (ERROR);
         }
     (*lnPriorRatio) += x;
@@ -12439,7 +12402,6 @@ int Move_ParsSPRClock (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorR
     getchar();
 #   endif
 
-    free (nSitesOfPat);
     return (NO_ERROR);
 }
 
@@ -12597,9 +12559,9 @@ int Move_ParsTBR1 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio
 
     /* need to alloc a matrix for parsimony lengths, an array of pointers to crown part,
        and an array of pointers to root part. */
-    parLength = (MrBFlt *) SafeCalloc ((size_t)nRoot * (size_t)nCrown, sizeof(MrBFlt));
-    pRoot  = (TreeNode **) SafeCalloc(nRoot,  sizeof(TreeNode *));
-    pCrown = (TreeNode **) SafeCalloc(nCrown, sizeof(TreeNode *));
+    parLength = (MrBFlt *) ScratchCalloc ((size_t)nRoot * (size_t)nCrown, sizeof(MrBFlt));
+    pRoot  = (TreeNode **) ScratchCalloc (nRoot, sizeof(TreeNode *));
+    pCrown = (TreeNode **) ScratchCalloc (nCrown, sizeof(TreeNode *));
     if (!parLength || !pRoot || !pCrown)  goto errorExit;
     /* starting position */
     pRoot[0] = a; pCrown[0] = c;
@@ -12624,7 +12586,7 @@ int Move_ParsTBR1 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio
 
     /* find number of site patterns and modify randomly */
     globalNSitesOfPat = numSitesOfPat + (chainId[chain] % chainParams.numChains) * numCompressedChars + m->compCharStart;
-    nSitesOfPat = (CLFlt *) SafeCalloc (numCompressedChars, sizeof(CLFlt));
+    nSitesOfPat = (CLFlt *) ScratchCalloc (numCompressedChars, sizeof(CLFlt));
     if (!nSitesOfPat)  goto errorExit;
     for (i=0; i<numCompressedChars; i++)
         {
@@ -12943,14 +12905,11 @@ outLoop:;
     if (isVPriorExp > 1)
         (*lnPriorRatio) += LogDirPrior(t, mp, isVPriorExp);
     
-    /* free up local memory */
-    free (parLength); free (pRoot); free (pCrown); free (nSitesOfPat);
 
     return (NO_ERROR);
 
 errorExit:
     MrBayesPrint ("%s   Problem allocating memory in Move_ParsTBR\n", spacer);
-    free (parLength); free (pRoot); free (pCrown); free (nSitesOfPat);
 
     return (ERROR);
 }
@@ -13108,9 +13067,9 @@ int Move_ParsTBR2 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio
 
     /* need to alloc a matrix for parsimony lengths, an array of pointers to crown part,
        and an array of pointers to root part. */
-    parLength = (MrBFlt *) SafeCalloc ((size_t)nRoot * (size_t)nCrown, sizeof(MrBFlt));
-    pRoot  = (TreeNode **) SafeCalloc(nRoot,  sizeof(TreeNode *));
-    pCrown = (TreeNode **) SafeCalloc(nCrown, sizeof(TreeNode *));
+    parLength = (MrBFlt *) ScratchCalloc ((size_t)nRoot * (size_t)nCrown, sizeof(MrBFlt));
+    pRoot  = (TreeNode **) ScratchCalloc (nRoot, sizeof(TreeNode *));
+    pCrown = (TreeNode **) ScratchCalloc (nCrown, sizeof(TreeNode *));
     if (!parLength || !pRoot || !pCrown)  goto errorExit;
     /* starting position */
     pRoot[0] = a; pCrown[0] = c;
@@ -13135,7 +13094,7 @@ int Move_ParsTBR2 (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRatio
 
     /* find number of site patterns and modify randomly */
     globalNSitesOfPat = numSitesOfPat + (chainId[chain] % chainParams.numChains) * numCompressedChars + m->compCharStart;
-    nSitesOfPat = (CLFlt *) SafeCalloc (numCompressedChars, sizeof(CLFlt));
+    nSitesOfPat = (CLFlt *) ScratchCalloc (numCompressedChars, sizeof(CLFlt));
     if (!nSitesOfPat)  goto errorExit;
     for (i=0; i<numCompressedChars; i++)
         {
@@ -13463,14 +13422,11 @@ outLoop:;
     if (isVPriorExp > 1)
         (*lnPriorRatio) += LogDirPrior(t, mp, isVPriorExp);
     
-    /* free up local memory */
-    free (parLength); free (pRoot); free (pCrown); free (nSitesOfPat);
 
     return (NO_ERROR);
 
 errorExit:
     MrBayesPrint ("%s   Problem allocating memory in Move_ParsTBR\n", spacer);
-    free (parLength); free (pRoot); free (pCrown); free (nSitesOfPat);
 
     return (ERROR);
 }
@@ -13640,15 +13596,10 @@ int Move_PopSize_M (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRati
         t = GetTree(modelSettings[param->relParts[0]].brlens,chain,state[chain]);
         m = &modelSettings[param->relParts[0]];
         clockRate = *GetParamVals(m->clockRate, chain, state[chain]);
-        if (!strcmp(mp->ploidy, "Diploid"))
-            clockRate *= 4.0;
-        else if (!strcmp(mp->ploidy, "Zlinked"))
-            clockRate *= 3.0;
-        else
-            clockRate *= 2.0;
+        clockRate *= m->ploidyFactor;
         newT = oldN * clockRate;
         oldT = newN * clockRate;
-        if (!strcmp(mp->growthPr, "Fixed"))
+        if (m->isGrowthFixed == YES)
             growth = mp->growthFix;
         else
             growth = *(GetParamVals (m->growthRate, chain, state[chain]));
@@ -13784,8 +13735,8 @@ int Move_RateMult_Dir (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorR
     MrBFlt      alphaPi, *value, *subValue, numSites, *alphaDir, x, y, sum,
                 rate_pot, *dirParm, *oldRate, *newRate;
 
-    /* allocate memory */
-    dirParm = (MrBFlt *) SafeCalloc (3*numCurrentDivisions, sizeof(MrBFlt));
+    /* get scratch space */
+    dirParm = (MrBFlt *) ScratchCalloc (3*numCurrentDivisions, sizeof(MrBFlt));
     oldRate = dirParm + numCurrentDivisions;
     newRate = dirParm + 2*numCurrentDivisions;
 
@@ -13885,8 +13836,6 @@ int Move_RateMult_Dir (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorR
         if (modelSettings[param->relParts[i]].nCijkParts > 1)
             modelSettings[param->relParts[i]].upDateCijk = YES;
 
-    free (dirParm);
-
     return (NO_ERROR);
 }
 
@@ -15053,7 +15002,7 @@ int Move_Speciation (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRat
     int         isLPriorExp, isValidL, valIndex;
     MrBFlt      *valPtr, oldL, newL, minL, maxL, lambdaExp=0.0, *sR, *eR, sF, *fR, oldLnPrior, newLnPrior,
                 window, clockRate;
-    char        *sS;
+    int         sS;
     ModelParams *mp;
     ModelInfo   *m;
     Tree        *t;
@@ -15111,10 +15060,10 @@ int Move_Speciation (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRat
     sR = GetParamVals (param, chain, state[chain]);
     eR = GetParamVals (m->extinctionRates, chain, state[chain]);
     sF = mp->sampleProb;
-    sS = mp->sampleStrat;
+    sS = m->sampleStratId;
     clockRate = *GetParamVals (m->clockRate, chain, state[chain]);
     
-    if (!strcmp(mp->clockPr,"Birthdeath"))
+    if (m->clockPrId == CLOCKPR_BIRTHDEATH)
         {
         if (LnBirthDeathPriorPr (t, clockRate, &oldLnPrior, *sR, *eR, sS, sF) == ERROR)
             {
@@ -15128,7 +15077,7 @@ int Move_Speciation (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRat
             return (ERROR);
             }
         }
-    else if (!strcmp(mp->clockPr,"Fossilization"))
+    else if (m->clockPrId == CLOCKPR_FOSSILIZATION)
         {
         fR = GetParamVals (m->fossilizationRates, chain, state[chain]);
         if (LnFossilizationPriorPr (t, clockRate, &oldLnPrior, sR, eR, fR, sF, sS) == ERROR)
@@ -15165,7 +15114,7 @@ int Move_Speciation_M (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorR
     int         isLPriorExp, isValidL, valIndex;
     MrBFlt      *valPtr, oldL, newL, minL, maxL, lambdaExp=0.0, *sR, *eR, sF, *fR, oldLnPrior, newLnPrior,
                 tuning, clockRate;
-    char        *sS;
+    int         sS;
     ModelParams *mp;
     ModelInfo   *m;
     Tree        *t;
@@ -15221,10 +15170,10 @@ int Move_Speciation_M (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorR
     sR = GetParamVals (param, chain, state[chain]);
     eR = GetParamVals (m->extinctionRates, chain, state[chain]);
     sF = mp->sampleProb;
-    sS = mp->sampleStrat;
+    sS = m->sampleStratId;
     clockRate = *GetParamVals(m->clockRate, chain, state[chain]);
     
-    if (!strcmp(mp->clockPr,"Birthdeath"))
+    if (m->clockPrId == CLOCKPR_BIRTHDEATH)
         {
         if (LnBirthDeathPriorPr (t, clockRate, &oldLnPrior, *sR, *eR, sS, sF) == ERROR)
             {
@@ -15238,7 +15187,7 @@ int Move_Speciation_M (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorR
             return (ERROR);
             }
         }
-    else if (!strcmp(mp->clockPr,"Fossilization"))
+    else if (m->clockPrId == CLOCKPR_FOSSILIZATION)
         {
         fR = GetParamVals (m->fossilizationRates, chain, state[chain]);
         if (LnFossilizationPriorPr (t, clockRate, &oldLnPrior, sR, eR, fR, sF, sS) == ERROR)
@@ -16033,9 +15982,7 @@ int Move_TreeStretch (Param *param, int chain, RandLong *seed, MrBFlt *lnPriorRa
             continue;
         if (p->isDated == YES)
             calibrationPtr = p->calibration;
-        else if (p->anc->anc == NULL && (!strcmp(mp->clockPr, "Uniform") ||
-                                         !strcmp(mp->clockPr, "Birthdeath") ||
-                                         !strcmp(mp->clockPr, "Fossilization")))
+        else if (p->anc->anc == NULL && (m->clockPrId == CLOCKPR_UNIFORM || m->clockPrId == CLOCKPR_BIRTHDEATH || m->clockPrId == CLOCKPR_FOSSILIZATION))
             calibrationPtr = &mp->treeAgePr;
         else
             calibrationPtr = NULL;
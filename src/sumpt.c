@@ -103,6 +103,7 @@ int      PrintModelStats (char *fileName, char **headerNames, int nHeaders, Para
 int      PrintOverlayPlot (MrBFlt **xVals, MrBFlt **yVals, int nRows, int startingFrom, int nSamples);
 int      PrintParamStats (char *fileName, char **headerNames, int nHeaders, ParameterSample *parameterSamples, int nRuns, int nSamples);
 void     PrintPlotHeader (void);
+int      SumSsBlocks (void);
 
 PartCtr *AddSumtPartition (PartCtr *r, PolyTree *t, PolyNode *p, int runId);
 TreeCtr *AddSumtTree (TreeCtr *r, int *order);
@@ -200,7 +201,7 @@ int DoSump (void)
     ParameterSample *parameterSamples=NULL;
     FILE            *fpLstat=NULL;
 
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     if (proc_id != 0)
         return NO_ERROR;
 #   endif
@@ -544,11 +545,14 @@ int DoSumSs (void)
     MrBFlt          sum;
     int             firstPass = YES;
 
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     if (proc_id != 0)
         return NO_ERROR;
 #   endif
 
+    if (sumssParams.numBlocks > 1)
+        return SumSsBlocks ();
+
     chainParams.isSS=YES;
 
     /* tell user we are ready to go */
@@ -1486,6 +1490,29 @@ int DoSumSsParm (char *parmName, char *tkn)
             else
                 return (ERROR);
             }
+        /* set Nblocks (sumssParams.numBlocks) *******************************************************/
+        else if (!strcmp(parmName, "Nblocks"))
+            {
+            if (expecting == Expecting(EQUALSIGN))
+                expecting = Expecting(NUMBER);
+            else if (expecting == Expecting(NUMBER))
+                {
+                sscanf (tkn, "%d", &tempI);
+                if (tempI < 1)
+                    {
+                    MrBayesPrint ("%s   Nblocks must be at least 1\n", spacer);
+                    return (ERROR);
+                    }
+                else
+                    {
+                    sumssParams.numBlocks = tempI;
+                    MrBayesPrint ("%s   Setting sumss nblocks to %d\n", spacer, sumssParams.numBlocks);
+                    expecting = Expecting(PARAMETER) | Expecting(SEMICOLON);
+                    }
+                }
+            else
+                return (ERROR);
+            }
         /* set Allruns (sumssParams.allRuns) ********************************************************/
         else if (!strcmp(parmName, "Allruns"))
             {
@@ -2874,6 +2901,142 @@ errorExit:
 }
 
 
+/* SumSsBlocks: Combine the step contributions in the .ss files written by stepping-stone
+      analyses that each sampled one block of the steps (ss nblocks=<n> block=<i>). The number
+      of steps is taken from the Nsteps setting of the analyses, and every step has to be found */
+int SumSsBlocks (void)
+{
+    int         i, run, step, numSteps, longestLine, *stepBlock=NULL;
+    char        fileName[220], *strBuf=NULL, *word;
+    MrBFlt      *power=NULL, *contrib=NULL, *marginalLnL=NULL, mean, var;
+    FILE        *fp=NULL;
+
+    MrBayesPrint ("%s   Combining step contributions in %d files (%s.block1.ss,\n", spacer, sumssParams.numBlocks, sumpParams.sumpFileName);
+    MrBayesPrint ("%s      %s.block2.ss, etc)\n", spacer, sumpParams.sumpFileName);
+
+    numSteps    = chainParams.numStepsSS;
+    if (numSteps < 1)
+        {
+        MrBayesPrint ("%s   Nsteps (%d) has to be at least 1\n", spacer, numSteps);
+        return (ERROR);
+        }
+    power       = (MrBFlt *) SafeMalloc ((size_t)numSteps * sizeof(MrBFlt));
+    contrib     = (MrBFlt *) SafeMalloc ((size_t)numSteps * sumssParams.numRuns * sizeof(MrBFlt));
+    stepBlock   = (int *) SafeCalloc ((size_t)numSteps, sizeof(int));
+    if (!power || !contrib || !stepBlock)
+        goto errorExit;
+
+    for (i=0; i<sumssParams.numBlocks; i++)
+        {
+        sprintf (fileName, "%s.block%d.ss", sumpParams.sumpFileName, i+1);
+        if ((fp = OpenBinaryFileR(fileName)) == NULL)
+            goto errorExit;
+        longestLine = LongestLine(fp)+10;
+        SafeFclose (&fp);
+        if ((fp = OpenTextFileR(fileName)) == NULL)
+            goto errorExit;
+        strBuf = (char *) SafeRealloc ((void *) strBuf, (size_t)longestLine * sizeof(char));
+        if (!strBuf)
+            goto errorExit;
+
+        while (fgets (strBuf, longestLine, fp) != NULL)
+            {
+            /* atoi returns 0 for the header lines */
+            word = strtok (strBuf, " \t\n");
+            if (word == NULL || (step = atoi(word)) <= 0)
+                continue;
+            if (step > numSteps)
+                {
+                MrBayesPrint ("%s   Step %d in file %s is larger than the number of steps (Nsteps = %d)\n", spacer, step, fileName, numSteps);
+                goto errorExit;
+                }
+            if (stepBlock[step-1] != 0)
+                {
+                MrBayesPrint ("%s   Step %d is found both in block %d and in block %d\n", spacer, step, stepBlock[step-1], i+1);
+                goto errorExit;
+                }
+            stepBlock[step-1] = i+1;
+            if ((word = strtok (NULL, "\t\n")) == NULL)
+                {
+                MrBayesPrint ("%s   Too few values for step %d in file %s\n", spacer, step, fileName);
+                goto errorExit;
+                }
+            power[step-1] = atof (word);
+            for (run=0; run<sumssParams.numRuns; run++)
+                {
+                if ((word = strtok (NULL, "\t\n")) == NULL)
+                    {
+                    MrBayesPrint ("%s   Too few values for step %d in file %s (expecting %d runs)\n", spacer, step, fileName, sumssParams.numRuns);
+                    goto errorExit;
+                    }
+                contrib[(step-1)*sumssParams.numRuns+run] = atof (word);
+                }
+            }
+        SafeFclose (&fp);
+        }
+
+    for (step=0; step<numSteps; step++)
+        {
+        if (stepBlock[step] == 0)
+            {
+            MrBayesPrint ("%s   Step %d of %d is missing; maybe the analysis of its block is not finished\n", spacer, step+1, numSteps);
+            goto errorExit;
+            }
+        }
+
+    marginalLnL = (MrBFlt *) SafeCalloc (sumssParams.numRuns, sizeof(MrBFlt));
+    if (!marginalLnL)
+        goto errorExit;
+
+    MrBayesPrint ("\n");
+    MrBayesPrint ("%s   Step contributions (in natural log units) of %d steps:\n\n", spacer, numSteps);
+    MrBayesPrint ("%s      Step  Block   Power", spacer);
+    for (run=0; run<sumssParams.numRuns; run++)
+        MrBayesPrint ("      Run %d", run+1);
+    MrBayesPrint ("\n");
+    for (step=0; step<numSteps; step++)
+        {
+        MrBayesPrint ("%s      %4d  %5d  %.4f", spacer, step+1, stepBlock[step], power[step]);
+        for (run=0; run<sumssParams.numRuns; run++)
+            {
+            MrBayesPrint ("  %9.2f", contrib[step*sumssParams.numRuns+run]);
+            marginalLnL[run] += contrib[step*sumssParams.numRuns+run];
+            }
+        MrBayesPrint ("\n");
+        }
+
+    MrBayesPrint ("\n");
+    MrBayesPrint ("%s   Marginal likelihood (in natural log units) estimated using stepping-stone sampling\n", spacer);
+    MrBayesPrint ("%s   based on %d steps sampled in %d blocks.\n\n", spacer, numSteps, sumssParams.numBlocks);
+    MrBayesPrint ("%s       Run   Marginal likelihood (ln)\n",spacer);
+    MrBayesPrint ("%s       ------------------------------\n",spacer);
+    for (run=0; run<sumssParams.numRuns; run++)
+        MrBayesPrint ("%s       %3d    %9.2f   \n", spacer, run+1, marginalLnL[run]);
+    MrBayesPrint ("%s       ------------------------------\n",spacer);
+    if (sumssParams.numRuns > 1)
+        {
+        MeanVarianceLog (marginalLnL, sumssParams.numRuns, &mean, &var, NULL);
+        MrBayesPrint ("%s       Mean:  %9.2f\n\n",spacer,mean);
+        }
+
+    free (strBuf);
+    free (power);
+    free (contrib);
+    free (stepBlock);
+    free (marginalLnL);
+    return (NO_ERROR);
+
+errorExit:
+    SafeFclose (&fp);
+    free (strBuf);
+    free (power);
+    free (contrib);
+    free (stepBlock);
+    free (marginalLnL);
+    return (ERROR);
+}
+
+
 /* the following are moved from sumt.c to combine with sump.c */
 PartCtr *AddSumtPartition (PartCtr *r, PolyTree *t, PolyNode *p, int runId)
 {
@@ -3663,7 +3826,7 @@ int DoCompareTree (void)
     Tree            *tree1=NULL, *tree2=NULL;
     SumtFileInfo    sumtFileInfo;
     
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     if (proc_id == 0)
         {
 #   endif
@@ -4345,7 +4508,7 @@ int DoCompareTree (void)
     /* reset taxon set */
     ResetTaxonSet();
 
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
         }
 #   endif
 
@@ -4571,7 +4734,7 @@ int DoCompRefTree (void)
     SumtFileInfo tFileInfo;
     Tree         *t;
 
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     if (proc_id != 0)
         return NO_ERROR;
 #   endif
@@ -4859,7 +5022,7 @@ int DoSumt (void)
 
 #define SCREEN_WIDTH 80
     
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     if (proc_id == 0)
         {
 #   endif
@@ -5781,7 +5944,7 @@ int DoSumt (void)
     /* reset numLocalTaxa and localOutGroup */
     ResetTaxonSet();
 
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
         }
 #   endif
 
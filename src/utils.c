@@ -54,10 +54,20 @@
 #define MIN(a,b)                            (((a) < (b)) ? (a) : (b))
 #endif
 #define SQUARE(a)                           ((a)*(a))
+#define SCRATCH_ALIGN                       16      /* alignment of scratch allocations in bytes */
 
 /* local global variable */
 char    noLabel[] = "";
 
+/* scratch space handed out by ScratchCalloc */
+char    *scratchBlock = NULL;               /* block that scratch space is taken from               */
+size_t  scratchBlockSize = 0;               /* size of the block in bytes                           */
+size_t  scratchUsed = 0;                    /* bytes handed out since the last reset                */
+void    **scratchExtra = NULL;              /* allocations made since the last reset when full      */
+int     numScratchExtra = 0;                /* number of such allocations                           */
+int     scratchExtraSize = 0;               /* size of the scratchExtra array                       */
+int     numHeapAllocs = 0;                  /* allocations by SafeMalloc, SafeCalloc and SafeRealloc */
+
 /* local prototypes */
 void    DatedNodeDepths (TreeNode *p, MrBFlt *nodeDepths, int *index);
 void    DatedNodes (TreeNode *p, TreeNode **datedTips, int *index);
@@ -772,6 +782,13 @@ int HarmonicArithmeticMeanOnLogs (MrBFlt *vals, int nVals, MrBFlt *mean, MrBFlt
 }
 
 
+/* HeapAllocs: Return the number of allocations made by SafeMalloc, SafeCalloc and SafeRealloc */
+int HeapAllocs (void)
+{
+    return numHeapAllocs;
+}
+
+
 /* IsBitSet: Is bit i set in BitsLong *bits ? */
 int IsBitSet (int i, BitsLong *bits)
 {
@@ -1138,7 +1155,7 @@ void MrBayesPrint (char *format, ...)
 {
     va_list ptr;
 
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     if (proc_id == 0)
         {
         if (echoMB == YES)
@@ -1195,7 +1212,7 @@ void MrBayesPrintf (FILE *f, char *format, ...)
 {
     va_list                 ptr;
 
-#   if defined (MPI_ENABLED)
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     if (proc_id == 0)
         {
         va_start (ptr, format);
@@ -1473,13 +1490,13 @@ void EstimatedSampleSize (MrBFlt **vals, int nRuns, int *count, MrBFlt *returnES
 
 int SafeFclose(FILE **fp) {
     int retval=-1;
-#   if defined MPI_ENABLED
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     if (proc_id == 0) {
 #   endif
     if (fp!=NULL && (*fp)!=NULL) 
         retval=fclose(*fp);
     *fp = NULL;
-#   if defined MPI_ENABLED
+#   if defined (MPI_ENABLED) || defined (BEST_MPI_ENABLED)
     }
 #   endif
     return retval;  
@@ -1519,6 +1536,7 @@ void *SafeMalloc (size_t s)
         }
 
     ptr = calloc (1, s);
+    numHeapAllocs++;
 
     if (ptr == NULL && s > 0)
         {
@@ -1544,6 +1562,7 @@ void *SafeCalloc (size_t n, size_t s)
         }
 
     ptr = calloc (n, s);
+    numHeapAllocs++;
 
     if (ptr == NULL && n * s > 0)
         {
@@ -1573,6 +1592,7 @@ void *SafeRealloc (void *ptr, size_t s)
         tmp = calloc (1, s);
     else
         tmp = realloc (ptr, s);
+    numHeapAllocs++;
 
     if (tmp == NULL)
         {
@@ -1621,6 +1641,95 @@ char *SafeStrcpy (char **target, const char *source)
 }
 
 
+/*-----------------------------------------------------------------
+|
+|   ScratchCalloc: Return cleared scratch space for n elements of size
+|       s, which is valid until the next call to ScratchReset and must
+|       not be freed by the caller. The space is taken from a single
+|       block; if the block is full, the space is allocated separately
+|       and the block is enlarged at the next reset, so that the
+|       allocator stops calling malloc once the block fits the largest
+|       amount of scratch space used between two resets.
+|
+------------------------------------------------------------------*/
+void *ScratchCalloc (size_t n, size_t s)
+{
+    size_t      size;
+    void        *ptr, **temp;
+
+    size = (n * s + SCRATCH_ALIGN - 1) / SCRATCH_ALIGN * SCRATCH_ALIGN;
+    if (size == 0)
+        size = SCRATCH_ALIGN;
+
+    if (scratchUsed + size <= scratchBlockSize)
+        {
+        ptr = scratchBlock + scratchUsed;
+        memset (ptr, 0, size);
+        }
+    else
+        {
+        if (numScratchExtra == scratchExtraSize)
+            {
+            temp = (void **) SafeRealloc ((void *) scratchExtra, (scratchExtraSize + 10) * sizeof (void *));
+            if (!temp)
+                return NULL;
+            scratchExtra = temp;
+            scratchExtraSize += 10;
+            }
+        ptr = SafeCalloc (1, size);
+        if (!ptr)
+            return NULL;
+        scratchExtra[numScratchExtra++] = ptr;
+        }
+    scratchUsed += size;
+
+    return ptr;
+}
+
+
+/* ScratchFree: Free all scratch space */
+void ScratchFree (void)
+{
+    ScratchReset ();
+    free (scratchBlock);
+    scratchBlock = NULL;
+    scratchBlockSize = 0;
+    free (scratchExtra);
+    scratchExtra = NULL;
+    scratchExtraSize = 0;
+}
+
+
+/* ScratchReset: Make all scratch space available again; enlarge the block if
+   scratch space had to be allocated outside of it since the last reset */
+void ScratchReset (void)
+{
+    int         i;
+
+    if (numScratchExtra > 0)
+        {
+        for (i=0; i<numScratchExtra; i++)
+            free (scratchExtra[i]);
+        numScratchExtra = 0;
+
+        /* leave some room for variation in the use of scratch space */
+        free (scratchBlock);
+        scratchBlockSize = scratchUsed + scratchUsed / 2;
+        scratchBlock = (char *) SafeMalloc (scratchBlockSize);
+        if (!scratchBlock)
+            scratchBlockSize = 0;
+        }
+    scratchUsed = 0;
+}
+
+
+/* ScratchSize: Return the size of the scratch block in bytes */
+size_t ScratchSize (void)
+{
+    return scratchBlockSize;
+}
+
+
 /* SetBit: Set a particular bit in a series of longs */
 void SetBit (int i, BitsLong *bits)
 {
@@ -1821,35 +1930,6 @@ int WantTo (const char *msg)
 
 
 /* the following are moved from tree.c */
-/* AddToTreeList: Add tree at end of tree list */
-int AddToTreeList (TreeList *treeList, Tree *tree)
-{
-    TreeListElement     *listElement = (TreeListElement *) SafeCalloc (1, sizeof(TreeListElement));
-    if (!listElement)
-        return (ERROR);
-
-    listElement->order = (int *) SafeCalloc (tree->nIntNodes-1, sizeof(int));
-    if (!listElement->order)
-        return (ERROR);
-    listElement->next = NULL;
-
-    if (treeList->last == NULL)
-        treeList->last = treeList->first = listElement;
-    else
-        {
-        treeList->last->next = listElement;
-        treeList->last = listElement;
-        }
-
-    if (tree->isRooted)
-        StoreRTopology (tree, listElement->order);
-    else
-        StoreUTopology (tree, listElement->order);
-
-    return (NO_ERROR);
-}
-
-
 /* AllocatePolyTree: Allocate memory space for a polytomous tree */
 PolyTree *AllocatePolyTree (int numTaxa)
 {
@@ -2013,6 +2093,7 @@ Tree *AllocateTree (int numTaxa)
     t->bitsets = NULL;
     t->flags = NULL;
     t->constraints = NULL;
+    t->traversal = NULL;
 
     /* allocate and initialize nodes and node arrays (enough for both rooted and unrooted trees) */
     t->nNodes = 0;
@@ -2079,6 +2160,7 @@ Tree *AllocateFixedTree (int numTaxa, int isRooted)
     t->bitsets = NULL;
     t->flags = NULL;
     t->constraints = NULL;
+    t->traversal = NULL;
 
     /* allocate and initialize nodes and node arrays (enough for both rooted and unrooted trees) */
     if (t->isRooted)
@@ -3606,27 +3688,6 @@ int Deroot (PolyTree *pt)
 }
 
 
-/* EraseTreeList: Erase all trees in treeList */
-void EraseTreeList (TreeList *treeList)
-{
-    TreeListElement *listElement;
-    TreeListElement *previous;
-
-    listElement = treeList->first;
-    if (listElement != NULL)
-        do 
-            {
-            free (listElement->order);
-            previous = listElement;
-            listElement = listElement->next;
-            free (previous);
-            } 
-        while (listElement != NULL);
-
-    treeList->first = treeList->last = NULL;
-}
-
-
 void UpdateTreeWithClockrate (Tree *t, MrBFlt clockRate)
 {
     int i;
@@ -3811,6 +3872,7 @@ void FreeTree (Tree *t)
         {
         free (t->bitsets);
         free (t->flags);
+        free (t->traversal);
         free (t->allDownPass);
         free (t->nodes);
         free (t);
@@ -3977,31 +4039,54 @@ void GetPolyNodeDownPass (PolyTree *t, PolyNode *p, int *i, int *j)
 }
 
 
-/* GetFromTreeList: Get first tree from a tree list and remove it from the list*/
-int GetFromTreeList (TreeList *treeList, Tree *tree)
+/*------------------------------------------------------------------
+|
+|   GetTraversal: Collect the interior nodes of t that need ti probs
+|       or cond likes to be updated, in down pass order, together with
+|       the indices and update flags of the nodes and their descendants.
+|       The record of each node is compact and contiguous, so that the
+|       divisions sharing the tree can run through it without following
+|       the node pointers again. In unrooted trees, the interior node
+|       next to the root is always included, because its ti probs are
+|       always recalculated.
+|
+------------------------------------------------------------------*/
+int GetTraversal (Tree *t)
 {
-    TreeListElement *listElement;
+    int             i;
+    TreeNode        *p;
+    TraversalNode   *q;
 
-    if (treeList->first == NULL)
+    if (t->traversal == NULL)
         {
-        MrBayesPrint ("%s   Tree list empty\n", spacer);
-        return (ERROR);
+        t->traversal = (TraversalNode *) SafeMalloc ((size_t)t->memNodes * sizeof (TraversalNode));
+        if (!t->traversal)
+            {
+            MrBayesPrint ("%s   Problem allocating traversal of tree '%s'\n", spacer, t->name);
+            return (ERROR);
+            }
         }
-    if (tree->isRooted == YES)
-        RetrieveRTopology (tree, treeList->first->order);
-    else
+
+    t->nTraversal = 0;
+    for (i=0; i<t->nIntNodes; i++)
         {
-        RetrieveUTopology (tree, treeList->first->order);
-        if (localOutGroup != 0)
-            MoveCalculationRoot (tree, localOutGroup);
+        p = t->intDownPass[i];
+        if (p->left->upDateTi == NO && p->right->upDateTi == NO && p->upDateCl == NO
+            && (t->isRooted == YES || p->anc->anc != NULL))
+            continue;
+        q = &t->traversal[t->nTraversal++];
+        q->node = p;
+        q->left = p->left;
+        q->right = p->right;
+        q->index = p->index;
+        q->leftIndex = p->left->index;
+        q->rightIndex = p->right->index;
+        q->upDateLeftTi = p->left->upDateTi;
+        q->upDateRightTi = p->right->upDateTi;
+        q->upDateCl = p->upDateCl;
+        q->isRoot = (p->anc->anc == NULL ? YES : NO);
         }
 
-    listElement = treeList->first;
-    treeList->first = listElement->next;
-
-    free (listElement->order);
-    free (listElement);
-
     return (NO_ERROR);
 }
 
@@ -61,6 +61,7 @@ void     GetIntSummary (int **vals, int nRows, int *rowCount, Stat *theStats, in
 int      GetKFromGrowthFxn (int *growthFxn);
 void     GetSummary (MrBFlt **vals, int nRows, int *rowCount, Stat *theStats, int HPD);
 int      HarmonicArithmeticMeanOnLogs (MrBFlt *vals, int nVals, MrBFlt *mean, MrBFlt *harm_mean);
+int      HeapAllocs (void);
 int      IsBitSet (int i, BitsLong *bits);
 int      IsConsistentWith (const char *token, const char *expected);
 int      IsPartNested (BitsLong *smaller, BitsLong *larger, int length);
@@ -94,6 +95,10 @@ void    *SafeMalloc (size_t s);
 void    *SafeRealloc (void *ptr, size_t s);
 char    *SafeStrcat (char **target, const char *source);
 char    *SafeStrcpy (char **target, const char *source);
+void    *ScratchCalloc (size_t n, size_t s);
+void     ScratchFree (void);
+void     ScratchReset (void);
+size_t   ScratchSize (void);
 void     SetBit (int i, BitsLong *bits);
 void     SortInts (int *item, int *assoc, int count, int descendingOrder);
 void     SortInts2 (int *item, int *assoc, int left, int right, int descendingOrder);
@@ -107,7 +112,6 @@ int      UpperTriangIndex (int i, int j, int size);
 int      WantTo (const char *msg);
 
 /* tree utility functions */
-int       AddToTreeList (TreeList *treeList, Tree *tree);
 Tree     *AllocateTree (int numTaxa);
 Tree     *AllocateFixedTree (int numTaxa, int isRooted);
 int       AllocateTreePartitions (Tree *t);
@@ -131,7 +135,6 @@ int       CopyToTreeFromTree (Tree *to, Tree *from);
 void      CopyTreeNodes (TreeNode *p, TreeNode *q, int nLongsNeeded);
 void      CopyTreeToSubtree (Tree *t, Tree *subtree);
 int       Deroot (PolyTree *pt);
-void      EraseTreeList (TreeList *treeList);
 void      findAllowedClockrate (Tree *t, MrBFlt *minClockRate, MrBFlt *maxClockRate);
 void      FreePolyTree (PolyTree *pt);
 void      FreePolyTreePartitions (PolyTree *pt);
@@ -147,8 +150,8 @@ void      GetPolyAges (PolyTree *t);
 void      GetPolyDepths (PolyTree *t);
 void      GetPolyDownPass (PolyTree *t);
 void      GetPolyNodeDownPass (PolyTree *t, PolyNode *p, int *i, int *j);
+int       GetTraversal (Tree *t);
 int       GetRandomEmbeddedSubtree (Tree *t, int nTerminals, RandLong *seed, int *nEmbeddedTrees);
-int       GetFromTreeList (TreeList *treeList, Tree *tree);
 int       InitBrlens (Tree *t, MrBFlt v);
 int       InitCalibratedBrlens (Tree *t, MrBFlt minLength, RandLong *seed);
 int       InitClockBrlens (Tree *t);